@@ -0,0 +1,9 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/count_allocations.dir/src/count_allocations.cpp.o"
+  "CMakeFiles/count_allocations.dir/src/count_allocations.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/count_allocations.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,347 @@
+#include <benchmark/benchmark.h>
+
+#include <complex>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "parser/compiled.h"
+#include "parser/derivative.h"
+#include "parser/instrument.h"
+#ifdef PARSER_JIT
+#include "parser/jit.h"
+#endif
+#include "parser/multi.h"
+#include "parser/parser.h"
+
+// Corpus of generated expressions, indexed by the argument of a benchmark
+enum corpus_size { SMALL, MEDIUM, HUGE };
+
+/**
+ * @brief Generates a random infix expression with the given number of leaves,
+ * using only operations that can be differentiated.
+ *
+ * @param rng Random number generator.
+ * @param leaves Number of variables and constants in the expression.
+ * @return Infix expression.
+*/
+auto generate(std::mt19937& rng, size_t leaves) -> std::string
+{
+    auto pick = [&](int n) { return std::uniform_int_distribution<int>(0, n - 1)(rng); };
+
+    if (leaves == 1)
+    {
+        switch (pick(4))
+        {
+            case 0:  return std::to_string(pick(9) + 1) + "." + std::to_string(pick(10));
+            case 1:  return "[" + std::to_string(pick(3)) + ",0.5]";
+            default: return "z";
+        }
+    }
+
+    auto left = std::uniform_int_distribution<size_t>(1, leaves - 1)(rng);
+    auto lhs = generate(rng, left);
+    auto rhs = generate(rng, leaves - left);
+
+    switch (pick(8))
+    {
+        case 0:  return "\\sin(" + lhs + " + " + rhs + ")";
+        case 1:  return "\\cos(" + lhs + " - " + rhs + ")";
+        case 2:  return "(" + lhs + ")^" + std::to_string(pick(3) + 2) + " + " + rhs;
+        case 3:  return "(" + lhs + ") / (" + rhs + ")";
+        case 4:
+        case 5:  return "(" + lhs + ") * (" + rhs + ")";
+        case 6:  return lhs + " - " + rhs;
+        default: return lhs + " + " + rhs;
+    }
+}
+
+/**
+ * @brief Infix expression of the given size, the same on every run.
+*/
+auto corpus(int64_t size) -> const std::string&
+{
+    static const std::vector<std::string> expressions = []
+    {
+        std::mt19937 rng(2023);
+        return std::vector<std::string>{generate(rng, 4), generate(rng, 64), generate(rng, 4096)};
+    }();
+
+    return expressions[size];
+}
+
+/**
+ * @brief Number of tokens in an expression.
+*/
+template<typename E>
+auto tokens(const E& e) -> size_t
+{
+    return std::distance(e.cbegin(), e.cend());
+}
+
+/**
+ * @brief Points spread over the region [-2, 2] x [-2, 2], the same on every
+ * run.
+*/
+template<std::floating_point T>
+auto points(size_t n) -> std::vector<std::complex<T>>
+{
+    std::mt19937 rng(2023);
+    std::uniform_real_distribution<T> dist(-2, 2);
+
+    std::vector<std::complex<T>> z(n);
+    for (auto& p: z)
+    {
+        p = {dist(rng), dist(rng)};
+    }
+
+    return z;
+}
+
+/**
+ * @brief Sets the allocs and bytes counters of a benchmark to the number and
+ * size of the allocations made by one call of a function, made once outside
+ * of the timed loop.
+*/
+template<typename function>
+void count_allocations(benchmark::State& state, function&& f)
+{
+    auto allocations = parser::count_allocations(f);
+    state.counters["allocs"] = (double) allocations.count;
+    state.counters["bytes"] = (double) allocations.bytes;
+}
+
+template<std::floating_point T>
+void parse(benchmark::State& state)
+{
+    auto& infix = corpus(state.range(0));
+    size_t n = 0;
+    count_allocations(state, [&] { parser::expr<T> e(infix); });
+
+    for (auto _: state)
+    {
+        auto e = parser::expr<T>(infix);
+        n = tokens(e);
+        benchmark::DoNotOptimize(e);
+    }
+
+    state.counters["tokens/s"] = benchmark::Counter((double) n * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+template<std::floating_point T>
+void postfix(benchmark::State& state)
+{
+    auto infix = parser::expr<T>(corpus(state.range(0)));
+    auto n = tokens(infix);
+    count_allocations(state, [&] { infix.postfix(); });
+
+    for (auto _: state)
+    {
+        auto e = infix.postfix();
+        benchmark::DoNotOptimize(e);
+    }
+
+    state.counters["tokens/s"] = benchmark::Counter((double) n * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+template<std::floating_point T>
+void parse_postfix(benchmark::State& state)
+{
+    auto& infix = corpus(state.range(0));
+    size_t n = 0;
+    count_allocations(state, [&] { parser::expr<T>::parse(infix); });
+
+    for (auto _: state)
+    {
+        auto e = parser::expr<T>::parse(infix);
+        n = tokens(e);
+        benchmark::DoNotOptimize(e);
+    }
+
+    state.counters["tokens/s"] = benchmark::Counter((double) n * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+template<std::floating_point T>
+void parse_compact(benchmark::State& state)
+{
+    auto& infix = corpus(state.range(0));
+    size_t n = 0;
+    count_allocations(state, [&] { parser::compact_expr<T>::parse(infix); });
+
+    for (auto _: state)
+    {
+        auto e = parser::compact_expr<T>::parse(infix);
+        n = e.size();
+        benchmark::DoNotOptimize(e);
+    }
+
+    // Memory held by the expression, against that of a vector of its tokens
+    auto e = parser::compact_expr<T>::parse(infix);
+    state.counters["tokens/s"] = benchmark::Counter((double) n * state.iterations(), benchmark::Counter::kIsRate);
+    state.counters["stored"] = (double) e.bytes();
+    state.counters["stored_tokens"] = (double) (e.size() * sizeof(parser::token<T>));
+}
+
+template<std::floating_point T>
+void differentiate(benchmark::State& state)
+{
+    auto postfix = parser::expr<T>(corpus(state.range(0))).postfix();
+    auto n = tokens(postfix);
+    count_allocations(state, [&] { parser::differentiate(postfix); });
+
+    for (auto _: state)
+    {
+        auto e = parser::differentiate(postfix);
+        benchmark::DoNotOptimize(e);
+    }
+
+    state.counters["tokens/s"] = benchmark::Counter((double) n * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+template<std::floating_point T>
+void evaluate(benchmark::State& state)
+{
+    auto postfix = parser::expr<T>(corpus(state.range(0))).postfix();
+    auto z = points<T>(256);
+
+    for (auto _: state)
+    {
+        for (auto p: z)
+        {
+            benchmark::DoNotOptimize(postfix.evaluate(p));
+        }
+    }
+
+    state.counters["points/s"] = benchmark::Counter((double) z.size() * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+template<std::floating_point T>
+void evaluate_compiled(benchmark::State& state)
+{
+    auto compiled = parser::compile(parser::expr<T>(corpus(state.range(0))));
+    auto z = points<T>(256);
+
+    for (auto _: state)
+    {
+        for (auto p: z)
+        {
+            benchmark::DoNotOptimize(compiled.evaluate(p));
+        }
+    }
+
+    state.counters["points/s"] = benchmark::Counter((double) z.size() * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+template<std::floating_point T>
+void evaluate_batch(benchmark::State& state)
+{
+    auto compiled = parser::compile(parser::expr<T>(corpus(state.range(0))));
+    auto z = points<T>(4096);
+    std::vector<std::complex<T>> out(z.size());
+    std::vector<T> scratch(compiled.scratch_size());
+
+    for (auto _: state)
+    {
+        compiled.evaluate(z, out, scratch);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.counters["points/s"] = benchmark::Counter((double) z.size() * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+/**
+ * @brief Population of small expressions, the same on every run.
+*/
+template<std::floating_point T>
+auto population(size_t n) -> std::vector<parser::vector_expr<T>>
+{
+    std::mt19937 rng(2023);
+    std::vector<parser::vector_expr<T>> exprs;
+    for (size_t k = 0; k < n; k++)
+    {
+        exprs.push_back(parser::vector_expr<T>::parse(generate(rng, 8)));
+    }
+
+    return exprs;
+}
+
+template<std::floating_point T>
+void evaluate_population(benchmark::State& state)
+{
+    std::vector<parser::compiled_expr<T>> compiled;
+    for (auto& e: population<T>(1024))
+    {
+        compiled.push_back(parser::compile(e));
+    }
+
+    auto z = points<T>(4096);
+    std::vector<std::complex<T>> out(compiled.size() * z.size());
+    std::vector<T> scratch;
+
+    for (auto _: state)
+    {
+        for (size_t k = 0; k < compiled.size(); k++)
+        {
+            scratch.resize(std::max(scratch.size(), compiled[k].scratch_size()));
+            compiled[k].evaluate(z, std::span(out).subspan(k * z.size(), z.size()), scratch);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.counters["values/s"] = benchmark::Counter((double) out.size() * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+template<std::floating_point T>
+void evaluate_multi(benchmark::State& state)
+{
+    parser::thread_pool pool(state.range(0));
+    parser::multi_expr<T> multi(population<T>(1024));
+    auto z = points<T>(4096);
+    std::vector<std::complex<T>> out(multi.size() * z.size());
+
+    for (auto _: state)
+    {
+        multi.evaluate(z, out, pool);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.counters["values/s"] = benchmark::Counter((double) out.size() * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+#ifdef PARSER_JIT
+template<std::floating_point T>
+void evaluate_jit(benchmark::State& state)
+{
+    auto jit = parser::jit_compile(parser::expr<T>(corpus(state.range(0))));
+    auto z = points<T>(4096);
+    std::vector<std::complex<T>> out(z.size());
+
+    for (auto _: state)
+    {
+        jit.evaluate(z, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.counters["points/s"] = benchmark::Counter((double) z.size() * state.iterations(), benchmark::Counter::kIsRate);
+}
+#endif
+
+#define BENCHMARK_CORPUS(f) \
+    BENCHMARK_TEMPLATE(f, float)->Arg(SMALL)->Arg(MEDIUM)->Arg(HUGE); \
+    BENCHMARK_TEMPLATE(f, double)->Arg(SMALL)->Arg(MEDIUM)->Arg(HUGE); \
+    BENCHMARK_TEMPLATE(f, long double)->Arg(SMALL)->Arg(MEDIUM)->Arg(HUGE)
+
+BENCHMARK_CORPUS(parse);
+BENCHMARK_CORPUS(postfix);
+BENCHMARK_CORPUS(parse_postfix);
+BENCHMARK_CORPUS(parse_compact);
+BENCHMARK_CORPUS(differentiate);
+BENCHMARK_CORPUS(evaluate);
+BENCHMARK_CORPUS(evaluate_compiled);
+BENCHMARK_CORPUS(evaluate_batch);
+BENCHMARK_TEMPLATE(evaluate_population, double)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(evaluate_multi, double)->Arg(1)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+#ifdef PARSER_JIT
+BENCHMARK_CORPUS(evaluate_jit);
+#endif
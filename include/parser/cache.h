@@ -0,0 +1,324 @@
+/**
+ * @file cache.h
+ * @brief Contains a thread-safe cache of parsed, differentiated and compiled
+ * math expressions, keyed by their source, so that a formula that is seen
+ * again is not parsed again.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "compiled.h"
+#include "dag.h"
+#include "derivative.h"
+#include "optimize.h"
+#include "parser/compact.h"
+#include "parser/expression.h"
+#include "parser/tokenizer.h"
+
+namespace parser
+{
+
+/**
+ * @brief Counters of an expr_cache.
+*/
+struct cache_stats
+{
+    size_t hits = 0;      // Lookups that found an entry
+    size_t misses = 0;    // Lookups that built a new entry
+    size_t evictions = 0; // Entries dropped to stay under the byte cap
+    size_t entries = 0;   // Entries currently in the cache
+    size_t bytes = 0;     // Approximate size of the entries in the cache
+};
+
+/**
+ * @brief Least recently used cache mapping the source of a math expression to
+ * its postfix form, its derivatives and their compiled programs. The postfix
+ * forms are kept as compact_expr, so an entry takes a few bytes per token of
+ * them rather than a whole token<T>.
+ *
+ * Entries are keyed by the tokens of their source rather than its
+ * characters, so sources that only differ in spaces between tokens, e.g.,
+ * "z + 1" and "z+1", are the same entry, while spaces that separate tokens
+ * still do, e.g., "1 2" is not "12". The source itself is parsed as is, so a
+ * lookup gives the same expression, or throws the same error, as parsing it
+ * directly. The floating point type is part of the type of the cache, so
+ * caches for different types never share entries.
+ *
+ * The cache is split into shards, each with its own lock, its own LRU list
+ * and an equal share of the byte size cap, and a source always goes to the
+ * same shard, so lookups of different sources rarely wait on each other.
+ * Entries are built outside of any lock, and are immutable and shared, so
+ * they stay valid after being evicted for as long as they are used.
+ *
+ * @tparam T The floating point type (float, double or long double) of the
+ * expressions. Defaults to double.
+*/
+template<std::floating_point T = double>
+class expr_cache
+{
+public:
+    /**
+     * @brief Cached expression.
+    */
+    struct entry
+    {
+        std::string source;                                // Source it was built from
+        std::string key;                                   // Tokens of the source
+        compact_expr<T> postfix;                           // Postfix form
+        compiled_expr<T> compiled;                         // Compiled postfix form
+        std::vector<compact_expr<T>> derivatives;          // 1st, 2nd, ... derivatives
+        std::vector<compiled_expr<T>> compiled_derivatives; // Compiled derivatives
+        size_t bytes = 0;                                  // Approximate size in memory
+    };
+
+private:
+    struct shard
+    {
+        std::mutex mutex;
+
+        // Most recently used entry first
+        std::list<std::shared_ptr<const entry>> lru;
+        std::unordered_map<std::string_view, typename std::list<std::shared_ptr<const entry>>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    std::vector<std::unique_ptr<shard>> m_shards;
+    size_t m_shard_bytes;
+    size_t m_derivatives;
+
+    std::atomic<size_t> m_hits = 0;
+    std::atomic<size_t> m_misses = 0;
+    std::atomic<size_t> m_evictions = 0;
+
+    /**
+     * @brief Builds the entry of a source.
+     *
+     * @param source Source to parse.
+     * @param key Key of the source, from key_of.
+     * @throw invalid_argument if the source is not a well-formed expression.
+    */
+    auto build(std::string_view source, std::string key) const -> std::shared_ptr<const entry>
+    {
+        auto e = std::make_shared<entry>();
+        e->source = source;
+        e->key = std::move(key);
+        auto postfix = expr<T, std::vector>::parse(e->source);
+        e->compiled = compiled_expr<T>(postfix);
+        e->postfix = compact_expr<T>(postfix);
+
+        // Derivatives are taken in one dag, so every order reuses the
+        // derivatives of the subexpressions found for the orders before it.
+        // They stop at the first one that can not be taken, e.g. for want of
+        // a rule for one of the functions.
+        dag<T> g;
+        std::vector<typename dag<T>::node_id> derivs;
+        auto root = g.push(postfix);
+
+        try
+        {
+            for (size_t i = 0; i < m_derivatives; i++)
+            {
+                root = differentiate(g, root, derivs);
+                e->derivatives.emplace_back(g.template to_expr<std::vector>(root));
+                e->compiled_derivatives.emplace_back(g, simplify(g, root));
+            }
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+
+        auto compiled_size = [](const compiled_expr<T>& c) { return c.code().size_bytes() + c.constants().size_bytes(); };
+
+        e->bytes = sizeof(entry) + e->source.size() + e->key.size() + e->postfix.bytes() + compiled_size(e->compiled);
+        for (size_t i = 0; i < e->derivatives.size(); i++)
+        {
+            e->bytes += e->derivatives[i].bytes() + compiled_size(e->compiled_derivatives[i]) + sizeof(compact_expr<T>) + sizeof(compiled_expr<T>);
+        }
+
+        return e;
+    }
+
+public:
+    /**
+     * @brief Creates an empty cache.
+     *
+     * @param max_bytes Cap on the approximate size in memory of the entries.
+     * Defaults to 64 MB.
+     * @param derivatives Number of derivatives to take of every expression.
+     * Defaults to 1.
+     * @param shards Number of shards. Defaults to 16.
+     *
+     * @return expr_cache instance.
+    */
+    explicit expr_cache(size_t max_bytes = 64 << 20, size_t derivatives = 1, size_t shards = 16) :
+        m_shard_bytes(max_bytes / std::max<size_t>(shards, 1)),
+        m_derivatives(derivatives)
+    {
+        for (size_t i = 0; i < std::max<size_t>(shards, 1); i++)
+        {
+            m_shards.push_back(std::make_unique<shard>());
+        }
+    }
+
+    expr_cache(const expr_cache&) = delete;
+    auto operator=(const expr_cache&) -> expr_cache& = delete;
+
+    /**
+     * @brief Key of a source: the type and operation of each of its tokens,
+     * followed by the value of a CONST token or the slot of a VAR token.
+     *
+     * @param infix String representing an infix math expression.
+     * @return Key, equal for two sources if and only if they have the same
+     * tokens.
+     * @throw parse_error if the string contains anything not recognized.
+    */
+    static auto key_of(std::string_view infix) -> std::string
+    {
+        std::string key;
+        key.reserve(infix.size());
+        tokenize<T>(infix, [&](const token<T>& t, size_t)
+        {
+            key.push_back((char) t.type);
+            key.push_back((char) t.op);
+            if (t.type == CONST)
+            {
+                // Written in hex rather than copied, as long double has
+                // padding bytes, and ended by a byte no number has
+                char digits[64];
+                for (T part: {t.val.real(), t.val.imag()})
+                {
+                    key.append(digits, std::to_chars(digits, digits + sizeof(digits), part, std::chars_format::hex).ptr);
+                    key.push_back(';');
+                }
+            }
+            else if (t.type == VAR)
+            {
+                key.append(reinterpret_cast<const char*>(&t.slot), sizeof(t.slot));
+            }
+        });
+        return key;
+    }
+
+    /**
+     * @brief Looks up an expression, building and inserting it if it is not
+     * in the cache. Safe to call from multiple threads at once.
+     *
+     * @param infix String representing an infix math expression.
+     * @return Cached expression.
+     * @throw invalid_argument if the expression is not well-formed. Nothing is
+     * inserted then.
+    */
+    auto get(std::string_view infix) -> std::shared_ptr<const entry>
+    {
+        std::string key;
+        try
+        {
+            key = key_of(infix);
+        }
+        catch (const parse_error&)
+        {
+            // Parsed anyway, for the error the parser reports first
+            m_misses++;
+            expr<T, std::vector>::parse(infix);
+            throw;
+        }
+
+        auto& s = *m_shards[std::hash<std::string>()(key) % m_shards.size()];
+
+        {
+            std::lock_guard lock(s.mutex);
+            auto it = s.index.find(key);
+            if (it != s.index.end())
+            {
+                s.lru.splice(s.lru.begin(), s.lru, it->second);
+                m_hits++;
+                return *it->second;
+            }
+        }
+
+        m_misses++;
+        auto e = build(infix, std::move(key));
+
+        std::lock_guard lock(s.mutex);
+
+        // Another thread may have inserted the same source meanwhile
+        auto it = s.index.find(e->key);
+        if (it != s.index.end())
+        {
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+            return *it->second;
+        }
+
+        // Entries that would take the whole share of the shard are not kept
+        if (e->bytes > m_shard_bytes)
+        {
+            return e;
+        }
+
+        s.lru.push_front(e);
+        s.index.emplace(e->key, s.lru.begin());
+        s.bytes += e->bytes;
+
+        while (s.bytes > m_shard_bytes)
+        {
+            auto& last = s.lru.back();
+            s.bytes -= last->bytes;
+            s.index.erase(last->key);
+            s.lru.pop_back();
+            m_evictions++;
+        }
+
+        return e;
+    }
+
+    /**
+     * @brief Current counters of the cache.
+    */
+    auto stats() const -> cache_stats
+    {
+        cache_stats result;
+        result.hits = m_hits;
+        result.misses = m_misses;
+        result.evictions = m_evictions;
+
+        for (auto& s: m_shards)
+        {
+            std::lock_guard lock(s->mutex);
+            result.entries += s->lru.size();
+            result.bytes += s->bytes;
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Removes all entries. Entries still in use stay valid.
+    */
+    void clear()
+    {
+        for (auto& s: m_shards)
+        {
+            std::lock_guard lock(s->mutex);
+            s->index.clear();
+            s->lru.clear();
+            s->bytes = 0;
+        }
+    }
+};
+
+};
@@ -0,0 +1,2691 @@
+/**
+ * @file compiled.h
+ * @brief Contains a compiled form of a postfix expression, where the tokens
+ * are lowered once into a flat array of instructions with all operations
+ * resolved ahead of time, so that evaluation needs no table lookups.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "dag.h"
+#include "dual.h"
+#include "interval.h"
+#include "kernels.h"
+#include "optimize.h"
+#include "parser/expression.h"
+#include "taylor.h"
+
+namespace parser
+{
+
+// Instruction set of a compiled expression. VAR pushes a variable, CONST
+// pushes a value from the constant pool, LOAD pushes a temporary, STORE copies
+// the top of the stack into a temporary, POWI raises the top of the stack to
+// an integer power, SQRT replaces it by its square root, and every other
+// opcode mirrors the operation of the same name, popping its arguments and
+// pushing its result. The fused opcodes SINCOS, SINHCOSH and POWLOG pop the
+// argument of two functions that share it and store both values in
+// temporaries arg and arg + 1 instead of pushing anything: sin and cos,
+// sinh and cosh, or f^g and log(f) for a base f and exponent g.
+enum class opcode : std::uint8_t { VAR, CONST, LOAD, STORE, ADD, SUB, MUL, DIV, POW, POWI, SQRT, NEG, RE, IM, ABS, ARG, CONJ, EXP, LOG, COS, SIN, TAN, SEC, CSC, COT, ACOS, ASIN, ATAN, COSH, SINH, TANH, ACOSH, ASINH, ATANH, DERIV, SINCOS, SINHCOSH, POWLOG };
+
+// Number of opcodes, to index arrays by opcode
+inline constexpr size_t opcode_count = (size_t) opcode::POWLOG + 1;
+
+// Largest |p| for which z^p with a constant integer p is compiled into POWI
+// instead of POW.
+inline constexpr int max_powi_exponent = 64;
+
+/**
+ * @brief A single instruction of a compiled expression.
+*/
+struct instruction
+{
+    opcode op;         // Must always be set
+    std::uint32_t arg; // Slot of variable if op = VAR, index into constant
+                       // pool if op = CONST, index of temporary if op = LOAD
+                       // or STORE, exponent as a two's complement int32 if
+                       // op = POWI, 0 otherwise
+};
+
+/**
+ * @brief Computes z^p for an integer p by exponentiation by squaring. See
+ * kernel_powi for its accuracy, and where it differs from std::pow.
+ *
+ * @param z Base.
+ * @param p Exponent.
+ * @return Value of z^p.
+*/
+template<std::floating_point T>
+inline auto powi(std::complex<T> z, int p) -> std::complex<T>
+{
+    T re = z.real();
+    T im = z.imag();
+    kernel_powi(&re, &im, p, 1);
+    return {re, im};
+}
+
+/**
+ * @brief Maps an operation to the opcode that evaluates it.
+ *
+ * @param op Enum specifying operation with type FUNC or BIN_OP.
+ * @return Opcode for the operation.
+ * @throw invalid_argument if op can not be evaluated.
+*/
+constexpr auto get_opcode(operation op) -> opcode
+{
+    switch (op)
+    {
+        case ADD:   return opcode::ADD;
+        case SUB:   return opcode::SUB;
+        case MUL:   return opcode::MUL;
+        case DIV:   return opcode::DIV;
+        case POW:   return opcode::POW;
+        case NEG:   return opcode::NEG;
+        case RE:    return opcode::RE;
+        case IM:    return opcode::IM;
+        case ABS:   return opcode::ABS;
+        case ARG:   return opcode::ARG;
+        case CONJ:  return opcode::CONJ;
+        case EXP:   return opcode::EXP;
+        case LOG:   return opcode::LOG;
+        case COS:   return opcode::COS;
+        case SIN:   return opcode::SIN;
+        case TAN:   return opcode::TAN;
+        case SEC:   return opcode::SEC;
+        case CSC:   return opcode::CSC;
+        case COT:   return opcode::COT;
+        case ACOS:  return opcode::ACOS;
+        case ASIN:  return opcode::ASIN;
+        case ATAN:  return opcode::ATAN;
+        case COSH:  return opcode::COSH;
+        case SINH:  return opcode::SINH;
+        case TANH:  return opcode::TANH;
+        case ACOSH: return opcode::ACOSH;
+        case ASINH: return opcode::ASINH;
+        case ATANH: return opcode::ATANH;
+        case DERIV: return opcode::DERIV;
+        default:    throw std::invalid_argument("Operation can not be compiled.");
+    }
+}
+
+/**
+ * @brief Maps an opcode back to the operation it evaluates, the inverse of
+ * get_opcode.
+ *
+ * @param op Opcode of a function or binary operation.
+ * @return Operation evaluated by the opcode.
+ * @throw invalid_argument if op does not evaluate an operation, e.g., POWI.
+*/
+constexpr auto to_operation(opcode op) -> operation
+{
+    switch (op)
+    {
+        case opcode::ADD:   return ADD;
+        case opcode::SUB:   return SUB;
+        case opcode::MUL:   return MUL;
+        case opcode::DIV:   return DIV;
+        case opcode::POW:   return POW;
+        case opcode::NEG:   return NEG;
+        case opcode::RE:    return RE;
+        case opcode::IM:    return IM;
+        case opcode::ABS:   return ABS;
+        case opcode::ARG:   return ARG;
+        case opcode::CONJ:  return CONJ;
+        case opcode::EXP:   return EXP;
+        case opcode::LOG:   return LOG;
+        case opcode::COS:   return COS;
+        case opcode::SIN:   return SIN;
+        case opcode::TAN:   return TAN;
+        case opcode::SEC:   return SEC;
+        case opcode::CSC:   return CSC;
+        case opcode::COT:   return COT;
+        case opcode::ACOS:  return ACOS;
+        case opcode::ASIN:  return ASIN;
+        case opcode::ATAN:  return ATAN;
+        case opcode::COSH:  return COSH;
+        case opcode::SINH:  return SINH;
+        case opcode::TANH:  return TANH;
+        case opcode::ACOSH: return ACOSH;
+        case opcode::ASINH: return ASINH;
+        case opcode::ATANH: return ATANH;
+        case opcode::DERIV: return DERIV;
+        default:            throw std::invalid_argument("Opcode has no operation.");
+    }
+}
+
+/**
+ * @brief Name of an opcode, e.g., for reporting an eval_profile.
+*/
+constexpr auto get_opcode_name(opcode op) -> std::string_view
+{
+    constexpr std::string_view names[opcode_count] = {"VAR", "CONST", "LOAD", "STORE", "ADD", "SUB", "MUL", "DIV", "POW", "POWI", "SQRT", "NEG", "RE", "IM", "ABS", "ARG", "CONJ", "EXP", "LOG", "COS", "SIN", "TAN", "SEC", "CSC", "COT", "ACOS", "ASIN", "ATAN", "COSH", "SINH", "TANH", "ACOSH", "ASINH", "ATANH", "DERIV", "SINCOS", "SINHCOSH", "POWLOG"};
+    return (size_t) op < opcode_count ? names[(size_t) op] : "UNKNOWN";
+}
+
+/**
+ * @brief Reads a counter that ticks at a constant rate: the time stamp
+ * counter on x86, which counts reference cycles, and nanoseconds of
+ * std::chrono::steady_clock elsewhere.
+*/
+inline auto read_cycles() noexcept -> std::uint64_t
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (std::uint64_t) std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/**
+ * @brief Counters recorded by the instrumented evaluators of compiled_expr,
+ * i.e., the overloads of evaluate taking an eval_profile. Every other
+ * evaluator is compiled without any instrumentation.
+ *
+ * Cycles are read around every instruction, which adds a few tens of cycles
+ * to each, so they are best compared with each other rather than with
+ * uninstrumented timings.
+*/
+struct eval_profile
+{
+    std::array<std::uint64_t, opcode_count> counts{}; // Times every opcode ran, per point
+    std::array<std::uint64_t, opcode_count> cycles{}; // Cycles spent in every opcode, see read_cycles
+    std::uint64_t evaluations = 0;                     // Number of points evaluated
+    size_t stack_high_water = 0;                       // Most values on the stack at once
+
+    /**
+     * @brief Adds the counters of another profile, e.g., of another thread.
+    */
+    auto operator+=(const eval_profile& other) -> eval_profile&
+    {
+        for (size_t i = 0; i < opcode_count; i++)
+        {
+            counts[i] += other.counts[i];
+            cycles[i] += other.cycles[i];
+        }
+        evaluations += other.evaluations;
+        stack_high_water = std::max(stack_high_water, other.stack_high_water);
+        return *this;
+    }
+};
+
+/**
+ * @brief Evaluates an opcode of a function of one variable. Gives the same
+ * results as the functions returned by get_func.
+ *
+ * @param op Opcode of a function of one variable.
+ * @param z Argument of the function.
+ * @return Value of the function at z.
+*/
+template<std::floating_point T>
+inline auto eval_func(opcode op, std::complex<T> z) -> std::complex<T>
+{
+    switch (op)
+    {
+        case opcode::SQRT:  return std::sqrt(z);
+        case opcode::NEG:   return - z;
+        case opcode::RE:    return z.real();
+        case opcode::IM:    return z.imag();
+        case opcode::ABS:   return std::abs(z);
+        case opcode::ARG:   return std::arg(z);
+        case opcode::CONJ:  return std::conj(z);
+        case opcode::EXP:   return std::exp(z);
+        case opcode::LOG:   return std::log(z);
+        case opcode::COS:   return std::cos(z);
+        case opcode::SIN:   return std::sin(z);
+        case opcode::TAN:   return std::tan(z);
+        case opcode::SEC:   return (T) 1.0 / std::cos(z);
+        case opcode::CSC:   return (T) 1.0 / std::sin(z);
+        case opcode::COT:   return (T) 1.0 / std::tan(z);
+        case opcode::ACOS:  return std::acos(z);
+        case opcode::ASIN:  return std::asin(z);
+        case opcode::ATAN:  return std::atan(z);
+        case opcode::COSH:  return std::cosh(z);
+        case opcode::SINH:  return std::sinh(z);
+        case opcode::TANH:  return std::tanh(z);
+        case opcode::ACOSH: return std::acosh(z);
+        case opcode::ASINH: return std::asinh(z);
+        case opcode::ATANH: return std::atanh(z);
+        case opcode::DERIV: return 0;
+        default:            throw std::invalid_argument("Opcode is not a function.");
+    }
+}
+
+/**
+ * @brief Evaluates an opcode of a binary operation. Gives the same results as
+ * the functions returned by get_bin_op.
+ *
+ * @param op Opcode of a binary operation.
+ * @param z_1 Left argument of the operation.
+ * @param z_2 Right argument of the operation.
+ * @return Value of z_1 · z_2, where · is the binary operation.
+*/
+template<std::floating_point T>
+inline auto eval_bin_op(opcode op, std::complex<T> z_1, std::complex<T> z_2) -> std::complex<T>
+{
+    switch (op)
+    {
+        case opcode::ADD: return z_1 + z_2;
+        case opcode::SUB: return z_1 - z_2;
+        case opcode::MUL: return z_1 * z_2;
+        case opcode::DIV: return z_1 / z_2;
+        case opcode::POW: return std::pow(z_1, z_2);
+        default:          throw std::invalid_argument("Opcode is not a binary operation.");
+    }
+}
+
+/**
+ * @brief Evaluates an opcode of a function of one variable at a real value,
+ * in real arithmetic. Gives the real part of eval_func wherever eval_func is
+ * real, and NaN wherever it is not, e.g., log(-1), so that a NaN tells a
+ * value that left the real line; im(x) is 0 x, so that it is NaN for NaN x.
+ * arg(x) and log(x) are NaN for x = -0 and x < 0 too, as on the negative real
+ * axis their values depend on the sign of the zero imaginary part, which real
+ * arithmetic does not keep.
+ *
+ * @param op Opcode of a function of one variable.
+ * @param x Argument of the function.
+ * @return Value of the function at x.
+*/
+template<std::floating_point T>
+inline auto eval_real_func(opcode op, T x) -> T
+{
+    switch (op)
+    {
+        case opcode::SQRT:  return std::sqrt(x);
+        case opcode::NEG:   return - x;
+        case opcode::RE:    return x;
+        case opcode::IM:    return 0 * x;
+        case opcode::ABS:   return std::abs(x);
+        case opcode::ARG:   return std::signbit(x) ? std::numeric_limits<T>::quiet_NaN() : std::atan2((T) 0, x);
+        case opcode::CONJ:  return x;
+        case opcode::EXP:   return std::exp(x);
+        case opcode::LOG:   return std::signbit(x) ? std::numeric_limits<T>::quiet_NaN() : std::log(x);
+        case opcode::COS:   return std::cos(x);
+        case opcode::SIN:   return std::sin(x);
+        case opcode::TAN:   return std::tan(x);
+        case opcode::SEC:   return (T) 1.0 / std::cos(x);
+        case opcode::CSC:   return (T) 1.0 / std::sin(x);
+        case opcode::COT:   return (T) 1.0 / std::tan(x);
+        case opcode::ACOS:  return std::acos(x);
+        case opcode::ASIN:  return std::asin(x);
+        case opcode::ATAN:  return std::atan(x);
+        case opcode::COSH:  return std::cosh(x);
+        case opcode::SINH:  return std::sinh(x);
+        case opcode::TANH:  return std::tanh(x);
+        case opcode::ACOSH: return std::acosh(x);
+        case opcode::ASINH: return std::asinh(x);
+        case opcode::ATANH: return std::atanh(x);
+        case opcode::DERIV: return 0;
+        default:            throw std::invalid_argument("Opcode is not a function.");
+    }
+}
+
+/**
+ * @brief Whether a value is on the branch cut of an opcode, where the value
+ * of the opcode depends on the sign of a zero real or imaginary part. The
+ * batch kernels do not give zeros the same signs as std::complex, so a value
+ * found by them is only used away from the cuts.
+ *
+ * @param op Opcode. For POW and POWLOG, z is the base.
+ * @param z Argument of the opcode.
+ * @return Whether z is on the branch cut of op. Always false for opcodes
+ * without a branch cut.
+*/
+template<std::floating_point T>
+inline auto on_branch_cut(opcode op, std::complex<T> z) -> bool
+{
+    switch (op)
+    {
+        case opcode::SQRT:
+        case opcode::ARG:
+        case opcode::LOG:
+        case opcode::POW:
+        case opcode::POWLOG: return z.imag() == 0 && std::signbit(z.real());
+        case opcode::ACOS:
+        case opcode::ASIN:
+        case opcode::ATANH:  return z.imag() == 0 && std::abs(z.real()) > 1;
+        case opcode::ACOSH:  return z.imag() == 0 && z.real() < 1;
+        case opcode::ATAN:
+        case opcode::ASINH:  return z.real() == 0 && std::abs(z.imag()) > 1;
+        default:             return false;
+    }
+}
+
+/**
+ * @brief Whether an opcode has a branch cut, see on_branch_cut.
+*/
+constexpr auto has_branch_cut(opcode op) -> bool
+{
+    switch (op)
+    {
+        case opcode::SQRT:
+        case opcode::ARG:
+        case opcode::LOG:
+        case opcode::POW:
+        case opcode::POWLOG:
+        case opcode::ACOS:
+        case opcode::ASIN:
+        case opcode::ATANH:
+        case opcode::ACOSH:
+        case opcode::ATAN:
+        case opcode::ASINH: return true;
+        default:            return false;
+    }
+}
+
+/**
+ * @brief Maps a fused opcode to the two operations it evaluates, whose values
+ * are stored in temporaries arg and arg + 1 in this order.
+ *
+ * @param op Fused opcode, SINCOS, SINHCOSH or POWLOG.
+ * @return Operations evaluated by the opcode.
+ * @throw invalid_argument if op is not a fused opcode.
+*/
+constexpr auto get_fused_operations(opcode op) -> std::pair<operation, operation>
+{
+    switch (op)
+    {
+        case opcode::SINCOS:   return {SIN, COS};
+        case opcode::SINHCOSH: return {SINH, COSH};
+        case opcode::POWLOG:   return {POW, LOG};
+        default:               throw std::invalid_argument("Opcode is not fused.");
+    }
+}
+
+/**
+ * @brief Evaluates a fused opcode. sin and cos, or sinh and cosh, are found
+ * from one sin, cos, sinh and cosh of the parts of z, as std:: finds each of
+ * them, and with std:: where they are not finite. z^w is found as
+ * exp(w log(z)) from the log, as std::pow finds it, but at z = 0.
+ *
+ * @param op Fused opcode, SINCOS, SINHCOSH or POWLOG.
+ * @param z Argument of the functions, or base of the power.
+ * @param w Exponent of the power, unused otherwise.
+ * @param first Where the value of the first operation of the opcode is
+ * written to, see get_fused_operations.
+ * @param second Where the value of the second operation is written to.
+*/
+template<std::floating_point T>
+inline void eval_fused(opcode op, std::complex<T> z, std::complex<T> w, std::complex<T>& first, std::complex<T>& second)
+{
+    if (op == opcode::POWLOG)
+    {
+        second = std::log(z);
+        first = z == (T) 0 ? std::pow(z, w) : std::exp(w * second);
+        return;
+    }
+
+    // sinh(a + bi) = -i sin(b + ai) and cosh(a + bi) = cos(b + ai)
+    bool hyperbolic = op == opcode::SINHCOSH;
+    T a = hyperbolic ? z.imag() : z.real();
+    T b = hyperbolic ? z.real() : z.imag();
+    T sin_a = std::sin(a), cos_a = std::cos(a), sinh_b = std::sinh(b), cosh_b = std::cosh(b);
+
+    first = hyperbolic ? std::complex<T>(sinh_b * cos_a, cosh_b * sin_a) : std::complex<T>(sin_a * cosh_b, cos_a * sinh_b);
+    second = hyperbolic ? std::complex<T>(cosh_b * cos_a, sinh_b * sin_a) : std::complex<T>(cos_a * cosh_b, - sin_a * sinh_b);
+
+    if (!std::isfinite(first.real()) || !std::isfinite(first.imag()) || !std::isfinite(second.real()) || !std::isfinite(second.imag()))
+    {
+        first = hyperbolic ? std::sinh(z) : std::sin(z);
+        second = hyperbolic ? std::cosh(z) : std::cos(z);
+    }
+}
+
+/**
+ * @brief A postfix expression lowered into a contiguous array of instructions
+ * and a pool of constants.
+ *
+ * The expression is walked once on construction, where every operation is
+ * resolved into an opcode, common subexpressions are moved into temporaries
+ * and the maximum depth of the evaluation stack is found. Powers with a
+ * constant exponent that is a small integer or 1/2 are compiled into POWI or
+ * SQRT, which are faster and more accurate than std::pow (see kernel_powi).
+ * They only differ from std::pow at z = 0 with an exponent p <= 0, where
+ * z^p is 1 for p = 0 and infinite or NaN for p < 0. The sin and cos, or
+ * sinh and cosh, of the same value, and a power and the log of its base, as
+ * in derivatives, are compiled into one fused instruction that shares the
+ * work of both (see eval_fused). Evaluation is then
+ * a single pass over the instructions, dispatched with a switch, on a stack
+ * that is allocated up front.
+ *
+ * When every constant of the program is real, real inputs are evaluated in
+ * real arithmetic, on a stack of T, with the real kernels of kernels.h. The
+ * real functions are NaN wherever the complex ones leave the real line, e.g.,
+ * sqrt(-1), so every value that comes out NaN is evaluated again in complex
+ * arithmetic, and the results agree with the complex evaluator to within
+ * rounding, except where a value is infinite.
+ *
+ * @tparam T The floating point type (float, double or long double) to use in
+ * the evaluation of the expression. Defaults to double.
+*/
+template<std::floating_point T = double>
+class compiled_expr
+{
+private:
+    // Expressions whose evaluation stack fits in this many values are
+    // evaluated without allocating any memory.
+    static constexpr size_t local_stack_size = 32;
+
+    // Instructions and constant pool, owned by this and every copy of it
+    struct program
+    {
+        std::vector<instruction> code;
+        std::vector<std::complex<T>> consts;
+    };
+
+    // Keeps the memory viewed by m_code and m_consts alive. Either a
+    // program, or whatever owns the memory of a program that was loaded in
+    // place, e.g., a memory mapped file. The memory is never modified, so
+    // copies share it.
+    std::shared_ptr<const void> m_owner;
+
+    std::span<const instruction> m_code;
+    std::span<const std::complex<T>> m_consts;
+
+    // Maximum number of values on the evaluation stack at any point
+    size_t m_depth = 0;
+
+    // Number of temporaries holding common subexpressions
+    size_t m_temps = 0;
+
+    // Number of values left on the stack by the instructions, one per root
+    size_t m_outputs = 1;
+
+    // Number of variable slots, one more than the largest slot of a VAR
+    // instruction, and at least 1
+    size_t m_variables = 1;
+
+    // Parameters of a program compiled with parameters, which are bound to
+    // values held in the constant pool rather than read from the slots given
+    // to evaluate. Every maximal subexpression that only depends on
+    // parameters and constants, e.g., c sin(c) in z^2 + c sin(c), is folded
+    // into one entry of the pool, recomputed by its own program whenever a
+    // parameter it depends on is bound.
+    struct parameter_table
+    {
+        size_t first = 0;                                   // Slot of the first parameter
+        std::vector<std::complex<T>> slots;                 // Values of the parameters, at their slots
+        std::vector<compiled_expr> entries;                 // Program of the k-th entry of the pool
+        std::vector<std::vector<std::uint32_t>> dependents; // Entries using every parameter
+        std::vector<std::complex<T>> consts;                // Constant pool, viewed by m_consts
+    };
+
+    // Shared by copies until one of them binds a parameter
+    std::shared_ptr<parameter_table> m_parameters;
+
+    // Whether every constant is real, so that real inputs are evaluated in
+    // real arithmetic
+    bool m_real = false;
+
+    /**
+     * @brief Sets m_real from the constant pool.
+    */
+    void find_real() noexcept
+    {
+        m_real = std::all_of(m_consts.begin(), m_consts.end(), [](const std::complex<T>& c) { return c.imag() == 0; });
+    }
+
+    /**
+     * @brief Lowers subexpressions of a dag into instructions, eliminating
+     * common subexpressions: a node used more than once in the subexpressions
+     * is evaluated the first time it is needed and stored in a temporary,
+     * which is loaded in every other place the node is used. The roots are
+     * evaluated one after the other, and their values are left on the stack
+     * in the same order.
+     *
+     * @param g Graph containing subexpressions.
+     * @param roots Ids of root nodes of subexpressions.
+     * @param fixed Values of the first entries of the constant pool, if any.
+     * @param fixed_ids Nodes replaced by one of those entries, where entry
+     * fixed_ids[n] replaces node n, or none. Their arguments are not lowered.
+    */
+    void lower(const dag<T>& g, std::span<const typename dag<T>::node_id> roots, std::span<const std::complex<T>> fixed = {}, std::span<const std::uint32_t> fixed_ids = {})
+    {
+        using node_id = typename dag<T>::node_id;
+        constexpr auto none = std::numeric_limits<std::uint32_t>::max();
+
+        if (roots.empty())
+        {
+            throw std::invalid_argument("Compiled expression needs at least one root.");
+        }
+
+        m_outputs = roots.size();
+        auto root = *std::max_element(roots.begin(), roots.end());
+
+        auto owned = std::make_shared<program>();
+        auto& code = owned->code;
+        auto& consts = owned->consts;
+        consts.assign(fixed.begin(), fixed.end());
+
+        // Temporary holding every node used more than once, and index in the
+        // constant pool of every constant, once they are emitted
+        std::vector<std::uint32_t> temp(root + 1, none);
+        std::vector<std::uint32_t> pool(root + 1, none);
+        for (size_t id = 0; id < fixed_ids.size() && id <= root; id++)
+        {
+            pool[id] = fixed_ids[id];
+        }
+
+        // Number of uses of every node within the subexpressions. Users
+        // always come after the nodes they use, so a single pass backwards
+        // from the last root reaches everything.
+        std::vector<size_t> uses(root + 1, 0);
+        for (auto r: roots)
+        {
+            uses[r]++;
+        }
+        for (node_id n = root + 1; n-- > 0;)
+        {
+            if (uses[n] > 0 && pool[n] == none && g[n].lhs != dag<T>::no_node)
+            {
+                uses[g[n].lhs]++;
+            }
+            if (uses[n] > 0 && pool[n] == none && g[n].rhs != dag<T>::no_node)
+            {
+                uses[g[n].rhs]++;
+            }
+        }
+
+        // Instruction replacing a POW node by a constant exponent that has a
+        // faster opcode, i.e., a small integer or 1/2, if there is one. The
+        // exponent is then not pushed at all.
+        auto fast_pow = [&](const typename dag<T>::node& current) -> std::optional<instruction>
+        {
+            if (current.t.type != BIN_OP || current.t.op != POW || g[current.rhs].t.type != CONST || g[current.rhs].t.val.imag() != 0)
+            {
+                return std::nullopt;
+            }
+
+            auto p = g[current.rhs].t.val.real();
+            if (p == (T) 0.5)
+            {
+                return instruction{opcode::SQRT, 0};
+            }
+            else if (p == std::round(p) && std::abs(p) <= max_powi_exponent)
+            {
+                return instruction{opcode::POWI, (std::uint32_t) (std::int32_t) p};
+            }
+
+            return std::nullopt;
+        };
+
+        // Node evaluated by the same fused instruction as every node, if
+        // any: the sin and cos, or sinh and cosh, of the same argument, and
+        // a power and the log of its base, as in the derivatives of
+        // sin(f), sinh(f) and f^g. The first of the two to be emitted emits
+        // the fused instruction, storing both values, and the other one is
+        // loaded.
+        std::vector<node_id> partner(root + 1, dag<T>::no_node);
+        {
+            auto is_fusable = [&](node_id id)
+            {
+                auto& current = g[id];
+                if (uses[id] == 0 || pool[id] != none || (current.t.type != FUNC && current.t.type != BIN_OP))
+                {
+                    return false;
+                }
+
+                return current.t.op == SIN || current.t.op == COS || current.t.op == SINH || current.t.op == COSH || current.t.op == LOG || (current.t.op == POW && !fast_pow(current));
+            };
+
+            // Whether the subexpression of a uses b, e.g., the exponent of
+            // f^log(f) uses log(f), which can then not be fused with the
+            // power. Users come after the nodes they use, so only nodes past
+            // b can use it.
+            auto depends = [&](node_id a, node_id b)
+            {
+                std::vector<node_id> todo = {a};
+                std::vector<bool> seen(root + 1, false);
+                while (!todo.empty())
+                {
+                    auto n = todo.back();
+                    todo.pop_back();
+                    if (n == b)
+                    {
+                        return true;
+                    }
+                    if (n == dag<T>::no_node || n < b || seen[n])
+                    {
+                        continue;
+                    }
+
+                    seen[n] = true;
+                    todo.push_back(g[n].lhs);
+                    todo.push_back(g[n].rhs);
+                }
+                return false;
+            };
+
+            // First node of every operation applied to every argument
+            std::unordered_map<std::uint64_t, node_id> by_arg;
+            auto key = [](operation op, node_id arg) { return ((std::uint64_t) op << 32) | arg; };
+            for (node_id id = 0; id <= root; id++)
+            {
+                if (is_fusable(id))
+                {
+                    by_arg.try_emplace(key(g[id].t.op, g[id].lhs), id);
+                }
+            }
+
+            constexpr std::pair<operation, operation> pairs[] = {{SIN, COS}, {SINH, COSH}, {POW, LOG}};
+            for (auto [first, second]: pairs)
+            {
+                for (auto [k, id]: by_arg)
+                {
+                    if ((operation) (k >> 32) != first)
+                    {
+                        continue;
+                    }
+
+                    auto other = by_arg.find(key(second, g[id].lhs));
+                    if (other != by_arg.end() && !(first == POW && depends(g[id].rhs, other->second)))
+                    {
+                        partner[id] = other->second;
+                        partner[other->second] = id;
+                    }
+                }
+            }
+        }
+
+        // Fused instruction evaluating a node and its partner, whose values
+        // are stored in temporaries t and t + 1 for the nodes in the order
+        // of pairs, i.e., sin, sinh or the power first
+        auto fused = [&](node_id id) -> std::pair<opcode, node_id>
+        {
+            auto op = g[id].t.op;
+            auto first = op == SIN || op == SINH || op == POW ? id : partner[id];
+            auto fop = g[first].t.op;
+            return {fop == SIN ? opcode::SINCOS : fop == SINH ? opcode::SINHCOSH : opcode::POWLOG, first};
+        };
+
+        // Exponent of the power fused with a LOG node that is emitted before
+        // it, which is evaluated right after the base to emit the POWLOG
+        auto fused_exponent = [&](node_id id) -> node_id
+        {
+            auto p = partner[id];
+            return g[id].t.op == LOG && p != dag<T>::no_node ? g[p].rhs : dag<T>::no_node;
+        };
+
+        // Number of values on the stack after the current instruction
+        size_t n = 0;
+
+        // Walk the tree of every subexpression depth first, as in
+        // dag::to_expr, but emit a LOAD in place of every node that is
+        // already held in a temporary.
+        std::vector<std::pair<node_id, int>> stack;
+
+        for (auto r: roots)
+        {
+            stack.push_back({r, 0});
+            while (!stack.empty())
+            {
+                auto& [id, visited] = stack.back();
+                auto& current = g[id];
+
+                if (visited == 0 && temp[id] != none)
+                {
+                    code.push_back({opcode::LOAD, temp[id]});
+                    n++;
+                    stack.pop_back();
+                }
+                else if (visited == 0 && pool[id] != none)
+                {
+                    code.push_back({opcode::CONST, pool[id]});
+                    n++;
+                    stack.pop_back();
+                }
+                else if (visited == 0 && current.lhs != dag<T>::no_node)
+                {
+                    visited = 1;
+                    stack.push_back({current.lhs, 0});
+                    continue;
+                }
+                else if (visited <= 1 && current.rhs != dag<T>::no_node && !fast_pow(current))
+                {
+                    visited = 2;
+                    stack.push_back({current.rhs, 0});
+                    continue;
+                }
+                else if (visited <= 1 && fused_exponent(id) != dag<T>::no_node)
+                {
+                    visited = 2;
+                    stack.push_back({fused_exponent(id), 0});
+                    continue;
+                }
+                else
+                {
+                    if (current.t.type == VAR)
+                    {
+                        code.push_back({opcode::VAR, current.t.slot});
+                        m_variables = std::max<size_t>(m_variables, (size_t) current.t.slot + 1);
+                        n++;
+                    }
+                    else if (current.t.type == CONST)
+                    {
+                        if (pool[id] == none)
+                        {
+                            pool[id] = (std::uint32_t) consts.size();
+                            consts.push_back(current.t.val);
+                        }
+
+                        code.push_back({opcode::CONST, pool[id]});
+                        n++;
+                    }
+                    else if (partner[id] != dag<T>::no_node)
+                    {
+                        // The arguments of both nodes are on the stack, and
+                        // are replaced by the value of this one
+                        auto [op, first] = fused(id);
+                        temp[first] = (std::uint32_t) m_temps;
+                        temp[partner[first]] = (std::uint32_t) m_temps + 1;
+                        m_temps += 2;
+
+                        code.push_back({op, temp[first]});
+                        code.push_back({opcode::LOAD, temp[id]});
+                        n -= op == opcode::POWLOG;
+                    }
+                    else
+                    {
+                        if (auto ins = fast_pow(current))
+                        {
+                            code.push_back(*ins);
+                        }
+                        else
+                        {
+                            code.push_back({get_opcode(current.t.op), 0});
+                            n -= current.t.type == BIN_OP;
+                        }
+
+                        if (uses[id] > 1)
+                        {
+                            temp[id] = (std::uint32_t) m_temps++;
+                            code.push_back({opcode::STORE, temp[id]});
+                        }
+                    }
+
+                    stack.pop_back();
+                }
+
+                m_depth = std::max(m_depth, n);
+            }
+        }
+
+        m_code = code;
+        m_consts = consts;
+        m_owner = std::move(owned);
+        find_real();
+    }
+
+    /**
+     * @brief Runs the instructions on the given stack.
+     *
+     * @tparam profiled Whether to record every instruction in profile.
+     * @param slots Pointer to the values of the m_variables variables.
+     * @param stack Pointer to at least m_depth + m_temps values to use as the
+     * stack, followed by the temporaries.
+     * @param profile Profile to record in if profiled is true.
+     * @return Value of expression at slots.
+    */
+    template<bool profiled = false>
+    auto run(const std::complex<T>* slots, std::complex<T>* stack, eval_profile* profile = nullptr) const -> std::complex<T>
+    {
+        auto temps = stack + m_depth;
+
+        // Index one after the top of the stack
+        size_t n = 0;
+
+        for (const auto& ins: m_code)
+        {
+            [[maybe_unused]] std::uint64_t start;
+            if constexpr (profiled)
+            {
+                start = read_cycles();
+            }
+
+            switch (ins.op)
+            {
+                case opcode::VAR:
+                    stack[n++] = slots[ins.arg];
+                    break;
+                case opcode::CONST:
+                    stack[n++] = m_consts[ins.arg];
+                    break;
+                case opcode::LOAD:
+                    stack[n++] = temps[ins.arg];
+                    break;
+                case opcode::STORE:
+                    temps[ins.arg] = stack[n - 1];
+                    break;
+                case opcode::ADD:
+                    n--;
+                    stack[n - 1] += stack[n];
+                    break;
+                case opcode::SUB:
+                    n--;
+                    stack[n - 1] -= stack[n];
+                    break;
+                case opcode::MUL:
+                    n--;
+                    stack[n - 1] *= stack[n];
+                    break;
+                case opcode::DIV:
+                    n--;
+                    stack[n - 1] /= stack[n];
+                    break;
+                case opcode::POW:
+                    n--;
+                    stack[n - 1] = std::pow(stack[n - 1], stack[n]);
+                    break;
+                case opcode::POWI:
+                    stack[n - 1] = powi(stack[n - 1], (std::int32_t) ins.arg);
+                    break;
+                case opcode::NEG:
+                    stack[n - 1] = - stack[n - 1];
+                    break;
+                case opcode::SINCOS:
+                case opcode::SINHCOSH:
+                    n--;
+                    eval_fused(ins.op, stack[n], {}, temps[ins.arg], temps[ins.arg + 1]);
+                    break;
+                case opcode::POWLOG:
+                    n -= 2;
+                    eval_fused(ins.op, stack[n], stack[n + 1], temps[ins.arg], temps[ins.arg + 1]);
+                    break;
+                default:
+                    stack[n - 1] = eval_func(ins.op, stack[n - 1]);
+                    break;
+            }
+
+            if constexpr (profiled)
+            {
+                profile->counts[(size_t) ins.op]++;
+                profile->cycles[(size_t) ins.op] += read_cycles() - start;
+                profile->stack_high_water = std::max(profile->stack_high_water, n);
+            }
+        }
+
+        return stack[0];
+    }
+
+    /**
+     * @brief Runs the instructions on dual numbers, so that the derivative is
+     * carried along with the value (see dual.h). The derivative is taken
+     * with respect to the variable of slot 0.
+     *
+     * @param slots Pointer to the values of the m_variables variables.
+     * @param stack Pointer to at least m_depth + m_temps values to use as the
+     * stack, followed by the temporaries.
+     * @return Value and derivative of expression at slots.
+    */
+    auto run_dual(const std::complex<T>* slots, dual<std::complex<T>>* stack) const -> dual<std::complex<T>>
+    {
+        using value = dual<std::complex<T>>;
+
+        auto temps = stack + m_depth;
+        size_t n = 0;
+
+        for (const auto& ins: m_code)
+        {
+            switch (ins.op)
+            {
+                case opcode::VAR:
+                    stack[n++] = value(slots[ins.arg], ins.arg == 0 ? 1 : 0);
+                    break;
+                case opcode::CONST:
+                    stack[n++] = value(m_consts[ins.arg]);
+                    break;
+                case opcode::LOAD:
+                    stack[n++] = temps[ins.arg];
+                    break;
+                case opcode::STORE:
+                    temps[ins.arg] = stack[n - 1];
+                    break;
+                case opcode::ADD:
+                    n--;
+                    stack[n - 1] = stack[n - 1] + stack[n];
+                    break;
+                case opcode::SUB:
+                    n--;
+                    stack[n - 1] = stack[n - 1] - stack[n];
+                    break;
+                case opcode::MUL:
+                    n--;
+                    stack[n - 1] = stack[n - 1] * stack[n];
+                    break;
+                case opcode::DIV:
+                    n--;
+                    stack[n - 1] = stack[n - 1] / stack[n];
+                    break;
+                case opcode::POW:
+                    n--;
+                    stack[n - 1] = pow(stack[n - 1], stack[n]);
+                    break;
+                case opcode::POWI:
+                {
+                    // d(f^p) = p f^(p - 1) f', with f^p found from f^(p - 1)
+                    auto p = (std::int32_t) ins.arg;
+                    auto& x = stack[n - 1];
+                    if (p == 0)
+                    {
+                        x = value(1);
+                    }
+                    else
+                    {
+                        auto v = powi(x.val, p - 1);
+                        x = value(v * x.val, (T) p * v * x.der);
+                    }
+                    break;
+                }
+                case opcode::SQRT:
+                    stack[n - 1] = sqrt(stack[n - 1]);
+                    break;
+                case opcode::SINCOS:
+                case opcode::SINHCOSH:
+                {
+                    auto [first, second] = get_fused_operations(ins.op);
+                    n--;
+                    temps[ins.arg] = apply_func(first, stack[n]);
+                    temps[ins.arg + 1] = apply_func(second, stack[n]);
+                    break;
+                }
+                case opcode::POWLOG:
+                    n -= 2;
+                    temps[ins.arg] = pow(stack[n], stack[n + 1]);
+                    temps[ins.arg + 1] = apply_func(LOG, stack[n]);
+                    break;
+                default:
+                    stack[n - 1] = apply_func(to_operation(ins.op), stack[n - 1]);
+                    break;
+            }
+        }
+
+        return stack[0];
+    }
+
+    /**
+     * @brief Runs the instructions on truncated Taylor series (see taylor.h),
+     * in the variable of slot 0.
+     *
+     * @param slots Pointer to the values of the m_variables variables.
+     * @param order Number of coefficients of every series.
+     * @param stack Pointer to at least (m_depth + m_temps + 1) * order values
+     * to use as the stack, followed by the temporaries and one more series
+     * of scratch storage.
+     * @return Pointer to the series of the expression at slots.
+    */
+    auto run_taylor(const std::complex<T>* slots, size_t order, std::complex<T>* stack) const -> const std::complex<T>*
+    {
+        auto at = [&](size_t k) { return stack + k * order; };
+        auto temps = m_depth;
+        auto scratch = at(m_depth + m_temps);
+        size_t n = 0;
+
+        // Result of an operation goes to scratch first, as outputs must not
+        // overlap inputs, and is then moved to the top of the stack.
+        auto replace = [&](size_t k) { std::copy(scratch, scratch + order, at(k)); };
+
+        for (const auto& ins: m_code)
+        {
+            switch (ins.op)
+            {
+                case opcode::VAR:
+                    std::fill(at(n), at(n + 1), 0);
+                    at(n)[0] = slots[ins.arg];
+                    if (order > 1 && ins.arg == 0)
+                    {
+                        at(n)[1] = 1;
+                    }
+                    n++;
+                    break;
+                case opcode::CONST:
+                    std::fill(at(n), at(n + 1), 0);
+                    at(n)[0] = m_consts[ins.arg];
+                    n++;
+                    break;
+                case opcode::LOAD:
+                    std::copy(at(temps + ins.arg), at(temps + ins.arg + 1), at(n));
+                    n++;
+                    break;
+                case opcode::STORE:
+                    std::copy(at(n - 1), at(n), at(temps + ins.arg));
+                    break;
+                case opcode::ADD:
+                case opcode::SUB:
+                case opcode::MUL:
+                case opcode::DIV:
+                case opcode::POW:
+                    n--;
+                    taylor_bin_op(to_operation(ins.op), at(n - 1), at(n), scratch, order);
+                    replace(n - 1);
+                    break;
+                case opcode::POWI:
+                    taylor_powi(at(n - 1), (std::int32_t) ins.arg, scratch, order);
+                    replace(n - 1);
+                    break;
+                case opcode::SQRT:
+                    taylor_sqrt(at(n - 1), scratch, order);
+                    replace(n - 1);
+                    break;
+                case opcode::SINCOS:
+                case opcode::SINHCOSH:
+                {
+                    auto [first, second] = get_fused_operations(ins.op);
+                    n--;
+                    taylor_func(first, at(n), at(temps + ins.arg), order);
+                    taylor_func(second, at(n), at(temps + ins.arg + 1), order);
+                    break;
+                }
+                case opcode::POWLOG:
+                    n -= 2;
+                    taylor_bin_op(POW, at(n), at(n + 1), at(temps + ins.arg), order);
+                    taylor_func(LOG, at(n), at(temps + ins.arg + 1), order);
+                    break;
+                default:
+                    taylor_func(to_operation(ins.op), at(n - 1), scratch, order);
+                    replace(n - 1);
+                    break;
+            }
+        }
+
+        return at(0);
+    }
+
+    /**
+     * @brief Runs the instructions on complex intervals (see interval.h), so
+     * that the value of every instruction bounds its values over the
+     * rectangles of the variables.
+     *
+     * @param slots Pointer to the rectangles of the m_variables variables.
+     * @param stack Pointer to at least m_depth + m_temps values to use as the
+     * stack, followed by the temporaries.
+     * @return Rectangle containing the values of expression over slots.
+    */
+    auto run_interval(const complex_interval<T>* slots, complex_interval<T>* stack) const -> complex_interval<T>
+    {
+        auto temps = stack + m_depth;
+        size_t n = 0;
+
+        for (const auto& ins: m_code)
+        {
+            switch (ins.op)
+            {
+                case opcode::VAR:
+                    stack[n++] = slots[ins.arg];
+                    break;
+                case opcode::CONST:
+                    stack[n++] = m_consts[ins.arg];
+                    break;
+                case opcode::LOAD:
+                    stack[n++] = temps[ins.arg];
+                    break;
+                case opcode::STORE:
+                    temps[ins.arg] = stack[n - 1];
+                    break;
+                case opcode::ADD:
+                    n--;
+                    stack[n - 1] = stack[n - 1] + stack[n];
+                    break;
+                case opcode::SUB:
+                    n--;
+                    stack[n - 1] = stack[n - 1] - stack[n];
+                    break;
+                case opcode::MUL:
+                    n--;
+                    stack[n - 1] = stack[n - 1] * stack[n];
+                    break;
+                case opcode::DIV:
+                    n--;
+                    stack[n - 1] = stack[n - 1] / stack[n];
+                    break;
+                case opcode::POW:
+                    n--;
+                    stack[n - 1] = pow(stack[n - 1], stack[n]);
+                    break;
+                case opcode::POWI:
+                    stack[n - 1] = powi(stack[n - 1], (std::int32_t) ins.arg);
+                    break;
+                case opcode::SQRT:
+                    stack[n - 1] = sqrt(stack[n - 1]);
+                    break;
+                case opcode::SINCOS:
+                case opcode::SINHCOSH:
+                {
+                    auto [first, second] = get_fused_operations(ins.op);
+                    n--;
+                    temps[ins.arg] = apply_func(first, stack[n]);
+                    temps[ins.arg + 1] = apply_func(second, stack[n]);
+                    break;
+                }
+                case opcode::POWLOG:
+                    n -= 2;
+                    temps[ins.arg] = pow(stack[n], stack[n + 1]);
+                    temps[ins.arg + 1] = apply_func(LOG, stack[n]);
+                    break;
+                default:
+                    stack[n - 1] = apply_func(to_operation(ins.op), stack[n - 1]);
+                    break;
+            }
+        }
+
+        return stack[0];
+    }
+
+    /**
+     * @brief Runs the instructions on a block of points at once. The stack
+     * holds one block of real lanes and one block of imaginary lanes per
+     * value, and every instruction is applied to the whole block before
+     * moving on to the next instruction. The values of the roots are left in
+     * the first lanes of the stack. Exponentials, logarithms and the
+     * trigonometric and hyperbolic functions use the kernels of fastmath.h,
+     * so differ from the scalar evaluator by a few ulp, unless
+     * PARSER_EXACT_FUNCTIONS is defined. The signs of zeros may differ from
+     * those of the scalar evaluator too, so the lanes that reach a branch cut
+     * (see on_branch_cut) are reported, for the caller to evaluate them with
+     * the scalar evaluator instead.
+     *
+     * @tparam profiled Whether to record every instruction in profile.
+     * @param n Number of points, at most block_size.
+     * @param stack Pointer to at least scratch_size() values to use as the
+     * stack, followed by the variables, already split into lanes, and the
+     * temporaries.
+     * @param profile Profile to record in if profiled is true.
+     * @return Lanes whose value was on the branch cut of an instruction.
+    */
+    template<bool profiled = false>
+    auto run_lanes(size_t n, T* stack, eval_profile* profile = nullptr) const
+    {
+        // Real and imaginary lanes of the k-th value on the stack
+        auto re = [&](size_t k) { return stack + 2 * k * block_size; };
+        auto im = [&](size_t k) { return stack + (2 * k + 1) * block_size; };
+
+        // The variables are past the top of the stack, one value per slot,
+        // and copied from there by every VAR instruction.
+        auto var = m_depth;
+
+        // Temporaries come after the variables
+        auto temp = m_depth + m_variables;
+
+        // Index one after the top of the stack
+        size_t k = 0;
+
+        std::bitset<block_size> cut;
+
+        for (const auto& ins: m_code)
+        {
+            [[maybe_unused]] std::uint64_t start;
+            if constexpr (profiled)
+            {
+                start = read_cycles();
+            }
+
+            if (has_branch_cut(ins.op))
+            {
+                // The base of a power is below the exponent
+                auto arg = ins.op == opcode::POW || ins.op == opcode::POWLOG ? k - 2 : k - 1;
+                for (size_t i = 0; i < n; i++)
+                {
+                    if (on_branch_cut(ins.op, std::complex<T>(re(arg)[i], im(arg)[i])))
+                    {
+                        cut.set(i);
+                    }
+                }
+            }
+
+            switch (ins.op)
+            {
+                case opcode::VAR:
+                    std::copy(re(var + ins.arg), re(var + ins.arg) + n, re(k));
+                    std::copy(im(var + ins.arg), im(var + ins.arg) + n, im(k));
+                    k++;
+                    break;
+                case opcode::CONST:
+                    kernel_fill(re(k), im(k), m_consts[ins.arg], n);
+                    k++;
+                    break;
+                case opcode::LOAD:
+                    std::copy(re(temp + ins.arg), re(temp + ins.arg) + n, re(k));
+                    std::copy(im(temp + ins.arg), im(temp + ins.arg) + n, im(k));
+                    k++;
+                    break;
+                case opcode::STORE:
+                    std::copy(re(k - 1), re(k - 1) + n, re(temp + ins.arg));
+                    std::copy(im(k - 1), im(k - 1) + n, im(temp + ins.arg));
+                    break;
+                case opcode::ADD:
+                    k--;
+                    kernel_add(re(k - 1), im(k - 1), re(k), im(k), n);
+                    break;
+                case opcode::SUB:
+                    k--;
+                    kernel_sub(re(k - 1), im(k - 1), re(k), im(k), n);
+                    break;
+                case opcode::MUL:
+                    k--;
+                    kernel_mul(re(k - 1), im(k - 1), re(k), im(k), n);
+                    break;
+                case opcode::DIV:
+                    k--;
+                    kernel_div(re(k - 1), im(k - 1), re(k), im(k), n);
+                    break;
+                case opcode::NEG:
+                    kernel_neg(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::CONJ:
+                    kernel_conj(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::RE:
+                    kernel_re(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::IM:
+                    kernel_im(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::ABS:
+                    kernel_abs(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::POWI:
+                    kernel_powi(re(k - 1), im(k - 1), (std::int32_t) ins.arg, n);
+                    break;
+                case opcode::SQRT:
+                    kernel_sqrt(re(k - 1), im(k - 1), n);
+                    break;
+                // Remaining binary operations are evaluated one lane at a time
+                case opcode::POW:
+                    k--;
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        auto v = eval_bin_op(ins.op, std::complex<T>(re(k - 1)[i], im(k - 1)[i]), std::complex<T>(re(k)[i], im(k)[i]));
+                        re(k - 1)[i] = v.real();
+                        im(k - 1)[i] = v.imag();
+                    }
+                    break;
+                case opcode::SINCOS:
+                case opcode::SINHCOSH:
+                {
+                    k--;
+                    auto t = temp + ins.arg;
+#ifndef PARSER_EXACT_FUNCTIONS
+                    if (ins.op == opcode::SINCOS)
+                    {
+                        kernel_sincos(re(k), im(k), re(t), im(t), re(t + 1), im(t + 1), n);
+                    }
+                    else
+                    {
+                        kernel_sinhcosh(re(k), im(k), re(t), im(t), re(t + 1), im(t + 1), n);
+                    }
+#else
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        std::complex<T> first, second;
+                        eval_fused(ins.op, std::complex<T>(re(k)[i], im(k)[i]), {}, first, second);
+                        re(t)[i] = first.real();
+                        im(t)[i] = first.imag();
+                        re(t + 1)[i] = second.real();
+                        im(t + 1)[i] = second.imag();
+                    }
+#endif
+                    break;
+                }
+                case opcode::POWLOG:
+                {
+                    k -= 2;
+                    auto t = temp + ins.arg;
+#ifndef PARSER_EXACT_FUNCTIONS
+                    kernel_pow_log(re(k), im(k), re(k + 1), im(k + 1), re(t), im(t), re(t + 1), im(t + 1), n);
+#else
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        std::complex<T> first, second;
+                        eval_fused(ins.op, std::complex<T>(re(k)[i], im(k)[i]), std::complex<T>(re(k + 1)[i], im(k + 1)[i]), first, second);
+                        re(t)[i] = first.real();
+                        im(t)[i] = first.imag();
+                        re(t + 1)[i] = second.real();
+                        im(t + 1)[i] = second.imag();
+                    }
+#endif
+                    break;
+                }
+#ifndef PARSER_EXACT_FUNCTIONS
+                // Transcendental functions have polynomial kernels, see fastmath.h
+                case opcode::EXP:
+                    kernel_exp(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::LOG:
+                    kernel_log(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::SIN:
+                    kernel_sin(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::COS:
+                    kernel_cos(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::TAN:
+                    kernel_tan(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::SEC:
+                    kernel_sec(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::CSC:
+                    kernel_csc(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::COT:
+                    kernel_cot(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::SINH:
+                    kernel_sinh(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::COSH:
+                    kernel_cosh(re(k - 1), im(k - 1), n);
+                    break;
+                case opcode::TANH:
+                    kernel_tanh(re(k - 1), im(k - 1), n);
+                    break;
+#endif
+                // Remaining functions are evaluated one lane at a time
+                default:
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        auto v = eval_func(ins.op, std::complex<T>(re(k - 1)[i], im(k - 1)[i]));
+                        re(k - 1)[i] = v.real();
+                        im(k - 1)[i] = v.imag();
+                    }
+                    break;
+            }
+
+            if constexpr (profiled)
+            {
+                profile->counts[(size_t) ins.op] += n;
+                profile->cycles[(size_t) ins.op] += read_cycles() - start;
+                profile->stack_high_water = std::max(profile->stack_high_water, k);
+            }
+        }
+
+        return cut;
+    }
+
+    /**
+     * @brief Runs the instructions of an expression of one variable on a
+     * block of points at once, see run_lanes.
+     *
+     * @param in Pointer to the points to evaluate expression at.
+     * @param out Pointer to where the values of the expression are written.
+     * @param n Number of points, at most block_size.
+     * @param stack Pointer to at least scratch_size() values to use as the
+     * stack.
+     * @param profile Profile to record in if profiled is true.
+    */
+    template<bool profiled = false>
+    void run_block(const std::complex<T>* in, std::complex<T>* out, size_t n, T* stack, eval_profile* profile = nullptr) const
+    {
+        if (m_real && std::all_of(in, in + n, [](const std::complex<T>& z) { return z.imag() == 0; }))
+        {
+            // Real points of a real program are evaluated in real arithmetic,
+            // and only the points whose values left the real line again in
+            // complex arithmetic, which includes those on a branch cut, see
+            // eval_real_func. Imaginary parts that are rounding errors in
+            // complex arithmetic are dropped, see evaluate.
+            auto values = stack;
+            auto points = stack + m_depth * block_size;
+            for (size_t i = 0; i < n; i++)
+            {
+                points[i] = in[i].real();
+            }
+
+            run_real_lanes<profiled>(n, stack, profile);
+
+            for (size_t i = 0; i < n; i++)
+            {
+                out[i] = values[i];
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                if (std::isnan(values[i]))
+                {
+                    out[i] = evaluate_complex(in + i);
+                }
+            }
+            return;
+        }
+
+        kernel_load(in, stack + 2 * m_depth * block_size, stack + (2 * m_depth + 1) * block_size, n);
+        auto cut = run_lanes<profiled>(n, stack, profile);
+        kernel_store(stack, stack + block_size, out, n);
+
+        for (size_t i = 0; cut.any() && i < n; i++)
+        {
+            if (cut[i])
+            {
+                out[i] = evaluate_complex(in + i);
+            }
+        }
+    }
+
+    /**
+     * @brief Evaluates the compiled expression at one set of values of its
+     * variables in complex arithmetic.
+     *
+     * @param slots Pointer to the values of the m_variables variables.
+    */
+    auto evaluate_complex(const std::complex<T>* slots) const -> std::complex<T>
+    {
+        if (m_depth + m_temps <= local_stack_size)
+        {
+            std::array<std::complex<T>, local_stack_size> stack;
+            return run(slots, stack.data());
+        }
+        else
+        {
+            std::vector<std::complex<T>> stack(m_depth + m_temps);
+            return run(slots, stack.data());
+        }
+    }
+
+    /**
+     * @brief Runs the instructions in real arithmetic on the given stack. Only
+     * used when m_real is true.
+     *
+     * @param slots Pointer to the real values of the m_variables variables.
+     * @param stack Pointer to at least m_depth + m_temps values to use as the
+     * stack, followed by the temporaries.
+     * @return Value of expression at slots, NaN if a value left the real line.
+    */
+    auto run_real(const T* slots, T* stack) const -> T
+    {
+        auto temps = stack + m_depth;
+        size_t n = 0;
+
+        for (const auto& ins: m_code)
+        {
+            switch (ins.op)
+            {
+                case opcode::VAR:
+                    stack[n++] = slots[ins.arg];
+                    break;
+                case opcode::CONST:
+                    stack[n++] = m_consts[ins.arg].real();
+                    break;
+                case opcode::LOAD:
+                    stack[n++] = temps[ins.arg];
+                    break;
+                case opcode::STORE:
+                    temps[ins.arg] = stack[n - 1];
+                    break;
+                case opcode::ADD:
+                    n--;
+                    stack[n - 1] += stack[n];
+                    break;
+                case opcode::SUB:
+                    n--;
+                    stack[n - 1] -= stack[n];
+                    break;
+                case opcode::MUL:
+                    n--;
+                    stack[n - 1] *= stack[n];
+                    break;
+                case opcode::DIV:
+                    n--;
+                    stack[n - 1] /= stack[n];
+                    break;
+                case opcode::POW:
+                    n--;
+                    stack[n - 1] = std::pow(stack[n - 1], stack[n]);
+                    break;
+                case opcode::POWI:
+                    kernel_real_powi(stack + n - 1, (std::int32_t) ins.arg, 1);
+                    break;
+                case opcode::SINCOS:
+                    n--;
+                    temps[ins.arg] = std::sin(stack[n]);
+                    temps[ins.arg + 1] = std::cos(stack[n]);
+                    break;
+                case opcode::SINHCOSH:
+                    n--;
+                    temps[ins.arg] = std::sinh(stack[n]);
+                    temps[ins.arg + 1] = std::cosh(stack[n]);
+                    break;
+                case opcode::POWLOG:
+                    // The real power is found with std::pow, which is more
+                    // accurate than exp(g log(f)) and defined for f < 0
+                    n -= 2;
+                    temps[ins.arg] = std::pow(stack[n], stack[n + 1]);
+                    temps[ins.arg + 1] = eval_real_func(opcode::LOG, stack[n]);
+                    break;
+                default:
+                    stack[n - 1] = eval_real_func(ins.op, stack[n - 1]);
+                    break;
+            }
+        }
+
+        return stack[0];
+    }
+
+    /**
+     * @brief Runs the instructions in real arithmetic on a block of points at
+     * once, as run_lanes, with one lane per value instead of two. Only used
+     * when m_real is true. The value of the first root is left in the first
+     * lane of the stack.
+     *
+     * @tparam profiled Whether to record every instruction in profile.
+     * @param n Number of points, at most block_size.
+     * @param stack Pointer to at least scratch_size() / 2 values to use as
+     * the stack, followed by the variables and the temporaries.
+     * @param profile Profile to record in if profiled is true.
+    */
+    template<bool profiled = false>
+    void run_real_lanes(size_t n, T* stack, eval_profile* profile = nullptr) const
+    {
+        auto at = [&](size_t k) { return stack + k * block_size; };
+        auto var = m_depth;
+        auto temp = m_depth + m_variables;
+        size_t k = 0;
+
+        for (const auto& ins: m_code)
+        {
+            [[maybe_unused]] std::uint64_t start;
+            if constexpr (profiled)
+            {
+                start = read_cycles();
+            }
+
+            switch (ins.op)
+            {
+                case opcode::VAR:
+                    std::copy(at(var + ins.arg), at(var + ins.arg) + n, at(k));
+                    k++;
+                    break;
+                case opcode::CONST:
+                    kernel_real_fill(at(k), m_consts[ins.arg].real(), n);
+                    k++;
+                    break;
+                case opcode::LOAD:
+                    std::copy(at(temp + ins.arg), at(temp + ins.arg) + n, at(k));
+                    k++;
+                    break;
+                case opcode::STORE:
+                    std::copy(at(k - 1), at(k - 1) + n, at(temp + ins.arg));
+                    break;
+                case opcode::ADD:
+                    k--;
+                    kernel_real_add(at(k - 1), at(k), n);
+                    break;
+                case opcode::SUB:
+                    k--;
+                    kernel_real_sub(at(k - 1), at(k), n);
+                    break;
+                case opcode::MUL:
+                    k--;
+                    kernel_real_mul(at(k - 1), at(k), n);
+                    break;
+                case opcode::DIV:
+                    k--;
+                    kernel_real_div(at(k - 1), at(k), n);
+                    break;
+                case opcode::NEG:
+                    kernel_real_neg(at(k - 1), n);
+                    break;
+                case opcode::RE:
+                case opcode::CONJ:
+                    break;
+                case opcode::ABS:
+                    kernel_real_abs(at(k - 1), n);
+                    break;
+                case opcode::POWI:
+                    kernel_real_powi(at(k - 1), (std::int32_t) ins.arg, n);
+                    break;
+                case opcode::SQRT:
+                    kernel_real_sqrt(at(k - 1), n);
+                    break;
+                case opcode::POW:
+                    k--;
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        at(k - 1)[i] = std::pow(at(k - 1)[i], at(k)[i]);
+                    }
+                    break;
+                case opcode::SINCOS:
+                case opcode::SINHCOSH:
+                {
+                    k--;
+                    auto t = temp + ins.arg;
+#ifndef PARSER_EXACT_FUNCTIONS
+                    if (ins.op == opcode::SINCOS)
+                    {
+                        kernel_real_sincos(at(k), at(t), at(t + 1), n);
+                    }
+                    else
+                    {
+                        kernel_real_sinhcosh(at(k), at(t), at(t + 1), n);
+                    }
+#else
+                    auto [first, second] = get_fused_operations(ins.op);
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        at(t)[i] = eval_real_func(get_opcode(first), at(k)[i]);
+                        at(t + 1)[i] = eval_real_func(get_opcode(second), at(k)[i]);
+                    }
+#endif
+                    break;
+                }
+                case opcode::POWLOG:
+                {
+                    k -= 2;
+                    auto t = temp + ins.arg;
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        at(t)[i] = std::pow(at(k)[i], at(k + 1)[i]);
+                    }
+                    std::copy(at(k), at(k) + n, at(t + 1));
+#ifndef PARSER_EXACT_FUNCTIONS
+                    kernel_real_log(at(t + 1), n);
+#else
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        at(t + 1)[i] = eval_real_func(opcode::LOG, at(t + 1)[i]);
+                    }
+#endif
+                    break;
+                }
+#ifndef PARSER_EXACT_FUNCTIONS
+                case opcode::EXP:
+                    kernel_real_exp(at(k - 1), n);
+                    break;
+                case opcode::LOG:
+                    kernel_real_log(at(k - 1), n);
+                    break;
+                case opcode::SIN:
+                    kernel_real_sin(at(k - 1), n);
+                    break;
+                case opcode::COS:
+                    kernel_real_cos(at(k - 1), n);
+                    break;
+                case opcode::TAN:
+                    kernel_real_tan(at(k - 1), n);
+                    break;
+                case opcode::SEC:
+                    kernel_real_sec(at(k - 1), n);
+                    break;
+                case opcode::CSC:
+                    kernel_real_csc(at(k - 1), n);
+                    break;
+                case opcode::COT:
+                    kernel_real_cot(at(k - 1), n);
+                    break;
+                case opcode::SINH:
+                    kernel_real_sinh(at(k - 1), n);
+                    break;
+                case opcode::COSH:
+                    kernel_real_cosh(at(k - 1), n);
+                    break;
+                case opcode::TANH:
+                    kernel_real_tanh(at(k - 1), n);
+                    break;
+#endif
+                default:
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        at(k - 1)[i] = eval_real_func(ins.op, at(k - 1)[i]);
+                    }
+                    break;
+            }
+
+            if constexpr (profiled)
+            {
+                profile->counts[(size_t) ins.op] += n;
+                profile->cycles[(size_t) ins.op] += read_cycles() - start;
+                profile->stack_high_water = std::max(profile->stack_high_water, k);
+            }
+        }
+    }
+
+    /**
+     * @brief Checks that values are given for every variable of the program.
+     *
+     * @param given Number of variables given values.
+     * @throw invalid_argument if given is less than the number of variables.
+    */
+    void check_variables(size_t given) const
+    {
+        if (given < m_variables)
+        {
+            throw std::invalid_argument("Values of the variables of compiled expression not given.");
+        }
+    }
+
+public:
+    // Number of points evaluated together by the batch evaluator.
+    static constexpr size_t block_size = 128;
+
+    /**
+     * @brief Default constructor.
+    */
+    compiled_expr() {};
+
+    /**
+     * @brief Compiles a math expression. The expression is interned into a
+     * dag first, so that every distinct subexpression is evaluated once, and
+     * simplified (see optimize.h) unless asked not to.
+     *
+     * @param e Expression to compile. Converted to postfix first if it is in
+     * infix.
+     * @param optimize Whether to fold constants and apply algebraic
+     * identities before compiling. Defaults to true.
+     *
+     * @return compiled_expr instance evaluating the math expression.
+     * @throw invalid_argument if the expression is not a well-formed
+     * expression.
+    */
+    template<template<typename...> class container>
+    explicit compiled_expr(const expr<T, container>& e, bool optimize = true)
+    {
+        dag<T> g;
+        auto root = g.push(e.postfix());
+        root = optimize ? simplify(g, root) : root;
+        lower(g, std::span(&root, 1));
+    }
+
+    /**
+     * @brief Parses and compiles a string representing an infix math
+     * expression, going straight from the string to a postfix expression
+     * (see expr::parse).
+     *
+     * @param infix String representing an infix math expression.
+     * @param variables Names of the variables, in order of their slots.
+     * Defaults to the single variable z.
+     * @param optimize Whether to fold constants and apply algebraic
+     * identities before compiling. Defaults to true.
+     *
+     * @return compiled_expr instance evaluating the math expression.
+     * @throw parse_error if the string is not a well-formed expression.
+    */
+    explicit compiled_expr(std::string_view infix, std::span<const std::string_view> variables = default_variables, bool optimize = true) :
+        compiled_expr(expr<T, std::vector>::parse(infix, variables), optimize)
+    {
+    }
+
+    /**
+     * @brief Compiles a subexpression of a dag as is, without simplifying it.
+     *
+     * @param g Graph containing subexpression.
+     * @param root Id of root node of subexpression.
+     *
+     * @return compiled_expr instance evaluating the subexpression.
+    */
+    compiled_expr(const dag<T>& g, typename dag<T>::node_id root)
+    {
+        lower(g, std::span(&root, 1));
+    }
+
+    /**
+     * @brief Compiles many subexpressions of a dag as is into one program,
+     * in which subexpressions they have in common are only evaluated once.
+     * evaluate gives the value of the first one, and evaluate_lanes the
+     * values of all of them.
+     *
+     * @param g Graph containing subexpressions.
+     * @param roots Ids of root nodes of subexpressions.
+     *
+     * @return compiled_expr instance evaluating the subexpressions.
+     * @throw invalid_argument if roots is empty.
+    */
+    compiled_expr(const dag<T>& g, std::span<const typename dag<T>::node_id> roots)
+    {
+        lower(g, roots);
+    }
+
+    /**
+     * @brief Compiles a math expression in which the variables of the last
+     * slots are parameters, bound to values held by the compiled expression
+     * instead of given to evaluate, for expressions whose constants are
+     * changed far more often than they are parsed, e.g., while dragging a
+     * slider. Constants are folded through the parameters as through any
+     * other constant, and bind only recomputes the folded values that depend
+     * on the parameter it changes.
+     *
+     * @param e Expression to compile. Converted to postfix first if it is in
+     * infix.
+     * @param variables Number of slots given to evaluate. Slot variables + k
+     * is the k-th parameter.
+     * @param parameters Values of the parameters.
+     * @param optimize Whether to fold constants and apply algebraic
+     * identities before compiling. Defaults to true.
+     *
+     * @return compiled_expr instance evaluating the math expression.
+     * @throw invalid_argument if the expression is not a well-formed
+     * expression, or has a variable past the last parameter.
+    */
+    template<template<typename...> class container>
+    compiled_expr(const expr<T, container>& e, size_t variables, std::span<const std::complex<T>> parameters, bool optimize = true)
+    {
+        using node_id = typename dag<T>::node_id;
+        constexpr auto none = std::numeric_limits<std::uint32_t>::max();
+
+        dag<T> g;
+        auto root = g.push(e.postfix());
+        root = optimize ? simplify(g, root) : root;
+
+        auto table = std::make_shared<parameter_table>();
+        table->first = variables;
+        table->slots.resize(variables + parameters.size());
+        std::copy(parameters.begin(), parameters.end(), table->slots.begin() + variables);
+        table->dependents.resize(parameters.size());
+
+        // Whether every node depends on a variable that is not a parameter
+        std::vector<bool> varies(root + 1, false);
+        for (node_id n = 0; n <= root; n++)
+        {
+            auto& current = g[n];
+            if (current.t.type == VAR && current.t.slot >= table->slots.size())
+            {
+                throw std::invalid_argument("Expression has a variable past the last parameter.");
+            }
+
+            varies[n] = (current.t.type == VAR && current.t.slot < variables) || (current.lhs != dag<T>::no_node && varies[current.lhs]) || (current.rhs != dag<T>::no_node && varies[current.rhs]);
+        }
+
+        // Nodes that do not vary but are used by one that does, or are the
+        // root, are the maximal subexpressions of parameters and constants.
+        // Constants are left to lower.
+        std::vector<std::uint32_t> fixed_ids(root + 1, none);
+        auto fold = [&](node_id n)
+        {
+            if (n == dag<T>::no_node || varies[n] || g[n].t.type == CONST || fixed_ids[n] != none)
+            {
+                return;
+            }
+
+            auto entry = (std::uint32_t) table->entries.size();
+            fixed_ids[n] = entry;
+            table->entries.push_back(compiled_expr(g, n));
+
+            for (const auto& ins: table->entries.back().code())
+            {
+                if (ins.op != opcode::VAR)
+                {
+                    continue;
+                }
+
+                auto& users = table->dependents[ins.arg - variables];
+                if (users.empty() || users.back() != entry)
+                {
+                    users.push_back(entry);
+                }
+            }
+        };
+
+        fold(root);
+        for (node_id n = 0; n <= root; n++)
+        {
+            if (varies[n])
+            {
+                fold(g[n].lhs);
+                fold(g[n].rhs);
+            }
+        }
+
+        std::vector<std::complex<T>> fixed;
+        for (const auto& entry: table->entries)
+        {
+            fixed.push_back(entry.evaluate(table->slots));
+        }
+
+        lower(g, std::span(&root, 1), fixed, fixed_ids);
+
+        table->consts.assign(m_consts.begin(), m_consts.end());
+        m_consts = table->consts;
+        m_parameters = std::move(table);
+    }
+
+    /**
+     * @brief Uses a program that was compiled before, e.g., one loaded from a
+     * file (see serialize.h), in place, without copying it. The program is
+     * checked in one pass over its instructions, so a corrupt program is
+     * rejected instead of reading out of bounds.
+     *
+     * @param code Instructions of the program.
+     * @param consts Constant pool of the program.
+     * @param temps Number of temporaries used by the program.
+     * @param outputs Number of values the program leaves on the stack.
+     * @param owner Keeps the memory of code and consts alive for as long as
+     * the compiled_expr or any copy of it is used. May be null if the memory
+     * outlives them anyway.
+     *
+     * @return compiled_expr instance running the program.
+     * @throw invalid_argument if the program is not well-formed, i.e., it has
+     * an unknown opcode, pops an empty stack, loads a constant or temporary
+     * that does not exist, or does not leave outputs values on the stack.
+    */
+    compiled_expr(std::span<const instruction> code, std::span<const std::complex<T>> consts, size_t temps, size_t outputs, std::shared_ptr<const void> owner = nullptr) :
+        m_owner(std::move(owner)),
+        m_code(code),
+        m_consts(consts),
+        m_temps(temps),
+        m_outputs(outputs)
+    {
+        std::vector<bool> stored(temps, false);
+        size_t n = 0;
+
+        for (const auto& ins: code)
+        {
+            // Number of values the instruction needs on the stack, and the
+            // number it leaves there in their place
+            size_t pops = 1, pushes = 1;
+            switch (ins.op)
+            {
+                case opcode::VAR:
+                    pops = 0;
+                    m_variables = std::max<size_t>(m_variables, (size_t) ins.arg + 1);
+                    break;
+                case opcode::CONST:
+                    pops = 0;
+                    if (ins.arg >= consts.size())
+                    {
+                        throw std::invalid_argument("Compiled program loads a constant that does not exist.");
+                    }
+                    break;
+                case opcode::LOAD:
+                    pops = 0;
+                    if (ins.arg >= temps || !stored[ins.arg])
+                    {
+                        throw std::invalid_argument("Compiled program loads a temporary that was not stored.");
+                    }
+                    break;
+                case opcode::STORE:
+                    if (ins.arg >= temps)
+                    {
+                        throw std::invalid_argument("Compiled program stores a temporary that does not exist.");
+                    }
+                    stored[ins.arg] = true;
+                    break;
+                case opcode::ADD:
+                case opcode::SUB:
+                case opcode::MUL:
+                case opcode::DIV:
+                case opcode::POW:
+                    pops = 2;
+                    break;
+                case opcode::SINCOS:
+                case opcode::SINHCOSH:
+                case opcode::POWLOG:
+                    pops = ins.op == opcode::POWLOG ? 2 : 1;
+                    pushes = 0;
+                    if (ins.arg + (size_t) 1 >= temps)
+                    {
+                        throw std::invalid_argument("Compiled program stores a temporary that does not exist.");
+                    }
+                    stored[ins.arg] = stored[ins.arg + 1] = true;
+                    break;
+                default:
+                    if ((size_t) ins.op >= opcode_count)
+                    {
+                        throw std::invalid_argument("Compiled program has an unknown opcode.");
+                    }
+                    break;
+            }
+
+            if (n < pops)
+            {
+                throw std::invalid_argument("Compiled program pops an empty stack.");
+            }
+
+            n = n - pops + pushes;
+            m_depth = std::max(m_depth, n);
+        }
+
+        if (n != outputs || outputs == 0)
+        {
+            throw std::invalid_argument("Compiled program does not leave one value per output on the stack.");
+        }
+
+        find_real();
+    }
+
+    /**
+     * @brief Binds a parameter of an expression compiled with parameters to a
+     * new value, recomputing only the entries of the constant pool that
+     * depend on it. Copies of the compiled expression keep the old value. Not
+     * safe to call while the compiled expression is being evaluated.
+     *
+     * @param k Index of the parameter.
+     * @param value New value of the parameter.
+     * @throw invalid_argument if there is no parameter k.
+    */
+    void bind(size_t k, std::complex<T> value)
+    {
+        if (!m_parameters || k >= m_parameters->dependents.size())
+        {
+            throw std::invalid_argument("Compiled expression has no such parameter.");
+        }
+
+        // Copies share the parameters until they are bound
+        if (m_parameters.use_count() > 1)
+        {
+            m_parameters = std::make_shared<parameter_table>(*m_parameters);
+            m_consts = m_parameters->consts;
+        }
+
+        auto& table = *m_parameters;
+        table.slots[table.first + k] = value;
+        for (auto entry: table.dependents[k])
+        {
+            table.consts[entry] = table.entries[entry].evaluate(table.slots);
+        }
+
+        find_real();
+    }
+
+    /**
+     * @brief Value of a parameter of an expression compiled with parameters.
+     *
+     * @param k Index of the parameter.
+     * @throw invalid_argument if there is no parameter k.
+    */
+    auto parameter(size_t k) const -> std::complex<T>
+    {
+        if (!m_parameters || k >= m_parameters->dependents.size())
+        {
+            throw std::invalid_argument("Compiled expression has no such parameter.");
+        }
+
+        return m_parameters->slots[m_parameters->first + k];
+    }
+
+    /**
+     * @brief Number of parameters, 0 unless compiled with parameters.
+    */
+    auto parameters() const noexcept -> size_t
+    {
+        return m_parameters ? m_parameters->dependents.size() : 0;
+    }
+
+    /**
+     * @brief Evaluates the compiled expression of one variable. Safe to call
+     * from multiple threads at once.
+     *
+     * @param z Value to evaluate expression at.
+     * @return Value of expression at z.
+     * @throw invalid_argument if the expression has more than one variable.
+    */
+    auto evaluate(std::complex<T> z) const -> std::complex<T>
+    {
+        return evaluate(std::span<const std::complex<T>>(&z, 1));
+    }
+
+    /**
+     * @brief Evaluates the compiled expression at one set of values of its
+     * variables. Variables were resolved to slots when parsing, so no names
+     * are looked up. Safe to call from multiple threads at once.
+     *
+     * @param slots Values of the variables, indexed by slot. Values past
+     * variables() are ignored.
+     * @return Value of expression at slots.
+     * @throw invalid_argument if slots has fewer than variables() values.
+    */
+    auto evaluate(std::span<const std::complex<T>> slots) const -> std::complex<T>
+    {
+        check_variables(slots.size());
+
+        // At real values of a real program, in real arithmetic unless a value
+        // leaves the real line
+        if (m_real && m_depth + m_temps <= local_stack_size && m_variables <= local_stack_size && std::all_of(slots.begin(), slots.begin() + m_variables, [](const std::complex<T>& z) { return z.imag() == 0; }))
+        {
+            std::array<T, local_stack_size> real_slots, stack;
+            for (size_t k = 0; k < m_variables; k++)
+            {
+                real_slots[k] = slots[k].real();
+            }
+
+            auto value = run_real(real_slots.data(), stack.data());
+            if (!std::isnan(value))
+            {
+                return value;
+            }
+        }
+
+        return evaluate_complex(slots.data());
+    }
+
+    /**
+     * @brief Evaluates the compiled expression, recording the count and
+     * cycles of every instruction that runs. Safe to call from multiple
+     * threads at once, each with its own profile.
+     *
+     * @param z Value to evaluate expression at.
+     * @param profile Profile to add the counters of this evaluation to.
+     * @return Value of expression at z.
+     * @throw invalid_argument if the expression has more than one variable.
+    */
+    auto evaluate(std::complex<T> z, eval_profile& profile) const -> std::complex<T>
+    {
+        check_variables(1);
+        profile.evaluations++;
+        std::vector<std::complex<T>> stack(m_depth + m_temps);
+        return run<true>(&z, stack.data(), &profile);
+    }
+
+    /**
+     * @brief Evaluates the compiled expression at many points with the batch
+     * evaluator, recording the count, per point, and cycles of every
+     * instruction that runs. Safe to call from multiple threads at once, each
+     * with its own profile.
+     *
+     * @param in Points to evaluate expression at.
+     * @param out Where the value of the expression at in[i] is written to
+     * out[i]. Must be the same size as in.
+     * @param profile Profile to add the counters of this evaluation to.
+     * @throw invalid_argument if in and out have different sizes, or the
+     * expression has more than one variable.
+    */
+    void evaluate(std::span<const std::complex<T>> in, std::span<std::complex<T>> out, eval_profile& profile) const
+    {
+        check_variables(1);
+
+        if (in.size() != out.size())
+        {
+            throw std::invalid_argument("Input and output of batch evaluation have different sizes.");
+        }
+
+        std::vector<T> scratch(scratch_size());
+        for (size_t i = 0; i < in.size(); i += block_size)
+        {
+            auto n = std::min(block_size, in.size() - i);
+            run_block<true>(in.data() + i, out.data() + i, n, scratch.data(), &profile);
+        }
+        profile.evaluations += in.size();
+    }
+
+    /**
+     * @brief Evaluates the compiled expression and its derivative together,
+     * in forward mode: the instructions are run once on dual numbers, so no
+     * expression of the derivative is ever built or compiled. Costs a small
+     * multiple of evaluate, as every function also evaluates its derivative,
+     * e.g. about 1.5 times for a mix of transcendental functions and
+     * arithmetic. Safe to call from multiple threads at once.
+     *
+     * @param z Value to evaluate expression at.
+     * @return Value and derivative of expression at z.
+     * @throw invalid_argument if the expression has more than one variable.
+    */
+    auto evaluate_with_derivative(std::complex<T> z) const -> std::pair<std::complex<T>, std::complex<T>>
+    {
+        check_variables(1);
+
+        dual<std::complex<T>> result;
+        if (m_depth + m_temps <= local_stack_size)
+        {
+            std::array<dual<std::complex<T>>, local_stack_size> stack;
+            result = run_dual(&z, stack.data());
+        }
+        else
+        {
+            std::vector<dual<std::complex<T>>> stack(m_depth + m_temps);
+            result = run_dual(&z, stack.data());
+        }
+
+        return {result.val, result.der};
+    }
+
+    /**
+     * @brief Evaluates the compiled expression and all of its derivatives up
+     * to the given order together, in forward mode: the instructions are run
+     * once on truncated Taylor series, which takes O(order^2) operations per
+     * instruction. Safe to call from multiple threads at once.
+     *
+     * @param z Value to evaluate expression at.
+     * @param order Highest derivative to evaluate.
+     * @return Values of the expression and its first order derivatives at z,
+     * in order of the derivatives.
+     * @throw invalid_argument if the expression has more than one variable.
+    */
+    auto evaluate_derivatives(std::complex<T> z, size_t order) const -> std::vector<std::complex<T>>
+    {
+        check_variables(1);
+
+        auto size = order + 1;
+        std::vector<std::complex<T>> stack((m_depth + m_temps + 1) * size);
+        auto series = run_taylor(&z, size, stack.data());
+
+        // The k-th coefficient of the series is the k-th derivative over k!
+        std::vector<std::complex<T>> result(series, series + size);
+        T factorial = 1;
+        for (size_t k = 1; k < size; k++)
+        {
+            factorial *= (T) k;
+            result[k] *= factorial;
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Bounds the values of the compiled expression over a rectangle
+     * of the complex plane, in one pass of interval arithmetic (see
+     * interval.h). Costs a small multiple of evaluate, however large the
+     * rectangle. Safe to call from multiple threads at once.
+     *
+     * @param z Rectangle of values of the variable.
+     * @return Rectangle containing the value of expression at every point of
+     * z.
+     * @throw invalid_argument if the expression has more than one variable.
+    */
+    auto evaluate_interval(const complex_interval<T>& z) const -> complex_interval<T>
+    {
+        return evaluate_interval(std::span<const complex_interval<T>>(&z, 1));
+    }
+
+    /**
+     * @brief Bounds the values of the compiled expression over rectangles of
+     * values of its variables.
+     *
+     * @param slots Rectangle of values of every variable, in slot order.
+     * @return Rectangle containing the value of expression at every point of
+     * slots.
+     * @throw invalid_argument if fewer rectangles than variables() are given.
+    */
+    auto evaluate_interval(std::span<const complex_interval<T>> slots) const -> complex_interval<T>
+    {
+        check_variables(slots.size());
+
+        if (m_depth + m_temps <= local_stack_size)
+        {
+            std::array<complex_interval<T>, local_stack_size> stack;
+            return run_interval(slots.data(), stack.data());
+        }
+
+        std::vector<complex_interval<T>> stack(m_depth + m_temps);
+        return run_interval(slots.data(), stack.data());
+    }
+
+    /**
+     * @brief Evaluates the compiled expression at many points. The points
+     * are evaluated block_size at a time, with the vectorized kernels of
+     * kernels.h for ADD, SUB, MUL, DIV, POWI, SQRT, NEG, CONJ, RE, IM and
+     * ABS, and one point at a time for every other operation. Safe to call
+     * from multiple threads at once.
+     *
+     * Blocks of real points of a real expression (see is_real) are evaluated
+     * in real arithmetic, so the values match those of evaluate(z) only to
+     * within rounding: an imaginary part that complex arithmetic leaves from
+     * rounding alone is exactly 0 here, e.g., that of (-2)^z at integer z.
+     * Neither real arithmetic nor the kernels keep the signs of zeros as
+     * std::complex does, so every point at which an operation is on its
+     * branch cut, e.g., arg(x) at x < 0, where the sign of a zero imaginary
+     * part picks the branch, is evaluated as by evaluate(z) instead, and takes
+     * the same branch.
+     *
+     * @param in Points to evaluate expression at.
+     * @param out Where the value of the expression at in[i] is written to
+     * out[i]. Must be the same size as in.
+     * @throw invalid_argument if in and out have different sizes.
+    */
+    void evaluate(std::span<const std::complex<T>> in, std::span<std::complex<T>> out) const
+    {
+        std::vector<T> scratch(scratch_size());
+        evaluate(in, out, scratch);
+    }
+
+    /**
+     * @brief Evaluates the compiled expression at many points, using the
+     * given scratch storage for the evaluation stack instead of allocating
+     * it. Each thread evaluating at the same time needs its own scratch.
+     *
+     * @param in Points to evaluate expression at.
+     * @param out Where the value of the expression at in[i] is written to
+     * out[i]. Must be the same size as in.
+     * @param scratch Storage for at least scratch_size() values.
+     * @throw invalid_argument if in and out have different sizes, scratch is
+     * too small, or the expression has more than one variable.
+    */
+    void evaluate(std::span<const std::complex<T>> in, std::span<std::complex<T>> out, std::span<T> scratch) const
+    {
+        check_variables(1);
+
+        if (in.size() != out.size())
+        {
+            throw std::invalid_argument("Input and output of batch evaluation have different sizes.");
+        }
+
+        if (scratch.size() < scratch_size())
+        {
+            throw std::invalid_argument("Scratch storage for batch evaluation is too small.");
+        }
+
+        for (size_t i = 0; i < in.size(); i += block_size)
+        {
+            auto n = std::min(block_size, in.size() - i);
+            run_block(in.data() + i, out.data() + i, n, scratch.data());
+        }
+    }
+
+    /**
+     * @brief Evaluates a real compiled expression (see is_real) at many real
+     * points, in real arithmetic only. The points are evaluated block_size at
+     * a time, with the real kernels of kernels.h. Safe to call from multiple
+     * threads at once.
+     *
+     * @param in Points to evaluate expression at.
+     * @param out Where the value of the expression at in[i] is written to
+     * out[i], or NaN if a value left the real line, e.g., log(-1). Must be
+     * the same size as in.
+     * @throw invalid_argument if in and out have different sizes, or the
+     * expression is not real or has more than one variable.
+    */
+    void evaluate(std::span<const T> in, std::span<T> out) const
+    {
+        std::vector<T> scratch(scratch_size());
+        evaluate(in, out, scratch);
+    }
+
+    /**
+     * @brief Evaluates a real compiled expression at many real points, using
+     * the given scratch storage for the evaluation stack instead of
+     * allocating it. Each thread evaluating at the same time needs its own
+     * scratch.
+     *
+     * @param in Points to evaluate expression at.
+     * @param out Where the value of the expression at in[i] is written to
+     * out[i], or NaN if a value left the real line.
+     * @param scratch Storage for at least scratch_size() values.
+     * @throw invalid_argument if in and out have different sizes, scratch is
+     * too small, or the expression is not real or has more than one
+     * variable.
+    */
+    void evaluate(std::span<const T> in, std::span<T> out, std::span<T> scratch) const
+    {
+        check_variables(1);
+
+        if (!m_real)
+        {
+            throw std::invalid_argument("Compiled expression has complex constants.");
+        }
+
+        if (in.size() != out.size())
+        {
+            throw std::invalid_argument("Input and output of batch evaluation have different sizes.");
+        }
+
+        if (scratch.size() < scratch_size())
+        {
+            throw std::invalid_argument("Scratch storage for batch evaluation is too small.");
+        }
+
+        auto stack = scratch.data();
+        for (size_t i = 0; i < in.size(); i += block_size)
+        {
+            auto n = std::min(block_size, in.size() - i);
+            std::copy(in.data() + i, in.data() + i + n, stack + m_depth * block_size);
+            run_real_lanes(n, stack);
+            std::copy(stack, stack + n, out.data() + i);
+        }
+    }
+
+    /**
+     * @brief Evaluates the compiled expression at many sets of values of its
+     * variables, e.g., a sweep over the parameters of a family of functions.
+     * The values of every variable are given as a separate column, and a
+     * column of a single value is used for every set, so that a parameter
+     * held fixed over the sweep need not be repeated. Evaluated block_size
+     * sets at a time, as the batch evaluator of one variable. Safe to call
+     * from multiple threads at once.
+     *
+     * @param columns Values of the variables, where columns[k][i] is the
+     * value of the variable of slot k in set i. Every column has either one
+     * value or out.size() values. Columns past variables() are ignored.
+     * @param out Where the value of the expression at set i is written to
+     * out[i].
+     * @throw invalid_argument if there are fewer than variables() columns, or
+     * a column has the wrong size.
+    */
+    void evaluate(std::span<const std::span<const std::complex<T>>> columns, std::span<std::complex<T>> out) const
+    {
+        std::vector<T> scratch(scratch_size());
+        evaluate(columns, out, scratch);
+    }
+
+    /**
+     * @brief Evaluates the compiled expression at many sets of values of its
+     * variables, using the given scratch storage for the evaluation stack
+     * instead of allocating it. Each thread evaluating at the same time needs
+     * its own scratch.
+     *
+     * @param columns Values of the variables, see the overload without
+     * scratch.
+     * @param out Where the value of the expression at set i is written to
+     * out[i].
+     * @param scratch Storage for at least scratch_size() values.
+     * @throw invalid_argument if there are fewer than variables() columns, a
+     * column has the wrong size, or scratch is too small.
+    */
+    void evaluate(std::span<const std::span<const std::complex<T>>> columns, std::span<std::complex<T>> out, std::span<T> scratch) const
+    {
+        check_variables(columns.size());
+
+        for (size_t k = 0; k < m_variables; k++)
+        {
+            if (columns[k].size() != 1 && columns[k].size() != out.size())
+            {
+                throw std::invalid_argument("Column of batch evaluation has the wrong size.");
+            }
+        }
+
+        if (scratch.size() < scratch_size())
+        {
+            throw std::invalid_argument("Scratch storage for batch evaluation is too small.");
+        }
+
+        // Lanes of the variables are only read by the instructions, so the
+        // lanes of a single value are filled once for every block.
+        auto stack = scratch.data();
+        auto re = [&](size_t k) { return stack + 2 * (m_depth + k) * block_size; };
+        auto im = [&](size_t k) { return stack + (2 * (m_depth + k) + 1) * block_size; };
+
+        for (size_t k = 0; k < m_variables; k++)
+        {
+            if (columns[k].size() == 1)
+            {
+                kernel_fill(re(k), im(k), columns[k][0], block_size);
+            }
+        }
+
+        for (size_t i = 0; i < out.size(); i += block_size)
+        {
+            auto n = std::min(block_size, out.size() - i);
+            for (size_t k = 0; k < m_variables; k++)
+            {
+                if (columns[k].size() != 1)
+                {
+                    kernel_load(columns[k].data() + i, re(k), im(k), n);
+                }
+            }
+
+            auto cut = run_lanes(n, stack);
+            kernel_store(stack, stack + block_size, out.data() + i, n);
+
+            for (size_t j = 0; cut.any() && j < n; j++)
+            {
+                if (cut[j])
+                {
+                    std::vector<std::complex<T>> slots(m_variables);
+                    for (size_t k = 0; k < m_variables; k++)
+                    {
+                        slots[k] = columns[k][columns[k].size() == 1 ? 0 : i + j];
+                    }
+                    out[i + j] = evaluate_complex(slots.data());
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Evaluates every root of the compiled expression at a block of
+     * points given as separate real and imaginary lanes, as the kernels of
+     * kernels.h take them. For callers that keep their own data in lanes, to
+     * avoid splitting and joining it on every call. Each thread evaluating at
+     * the same time needs its own scratch.
+     *
+     * @param in_re Real parts of the points to evaluate expression at.
+     * @param in_im Imaginary parts of the points to evaluate expression at.
+     * @param out_re Where the real part of root k at point i is written to
+     * out_re[k * block_size + i]. Must have outputs() * block_size values.
+     * @param out_im Same as out_re, for the imaginary parts.
+     * @param n Number of points, at most block_size.
+     * @param scratch Storage for at least scratch_size() values.
+     * @throw invalid_argument if n is more than block_size, scratch is too
+     * small, or the expression has more than one variable.
+    */
+    void evaluate_lanes(const T* in_re, const T* in_im, T* out_re, T* out_im, size_t n, std::span<T> scratch) const
+    {
+        check_variables(1);
+
+        if (n > block_size)
+        {
+            throw std::invalid_argument("Lanes of batch evaluation are longer than a block.");
+        }
+
+        if (scratch.size() < scratch_size())
+        {
+            throw std::invalid_argument("Scratch storage for batch evaluation is too small.");
+        }
+
+        auto stack = scratch.data();
+        std::copy(in_re, in_re + n, stack + 2 * m_depth * block_size);
+        std::copy(in_im, in_im + n, stack + (2 * m_depth + 1) * block_size);
+        auto cut = run_lanes(n, stack);
+
+        for (size_t k = 0; k < m_outputs; k++)
+        {
+            std::copy(stack + 2 * k * block_size, stack + 2 * k * block_size + n, out_re + k * block_size);
+            std::copy(stack + (2 * k + 1) * block_size, stack + (2 * k + 1) * block_size + n, out_im + k * block_size);
+        }
+
+        // Every root of a lane on a branch cut is found again by the scalar
+        // evaluator, which leaves them at the bottom of its stack
+        for (size_t i = 0; cut.any() && i < n; i++)
+        {
+            if (cut[i])
+            {
+                std::vector<std::complex<T>> values(m_depth + m_temps);
+                run(std::array<std::complex<T>, 1>{std::complex<T>(in_re[i], in_im[i])}.data(), values.data());
+                for (size_t k = 0; k < m_outputs; k++)
+                {
+                    out_re[k * block_size + i] = values[k].real();
+                    out_im[k * block_size + i] = values[k].imag();
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Number of values of type T needed as scratch storage by the
+     * batch evaluator. One extra value per variable past the top of the stack
+     * holds the input lanes, and the temporaries follow them.
+    */
+    auto scratch_size() const noexcept -> size_t
+    {
+        return 2 * (m_depth + m_variables + m_temps) * block_size;
+    }
+
+    /**
+     * @brief Instructions of the compiled expression.
+    */
+    auto code() const noexcept -> std::span<const instruction>
+    {
+        return m_code;
+    }
+
+    /**
+     * @brief Constant pool of the compiled expression, indexed by the
+     * argument of CONST instructions.
+    */
+    auto constants() const noexcept -> std::span<const std::complex<T>>
+    {
+        return m_consts;
+    }
+
+    /**
+     * @brief Maximum number of values on the evaluation stack.
+    */
+    auto stack_depth() const noexcept -> size_t
+    {
+        return m_depth;
+    }
+
+    /**
+     * @brief Number of temporaries holding common subexpressions.
+    */
+    auto temporaries() const noexcept -> size_t
+    {
+        return m_temps;
+    }
+
+    /**
+     * @brief Whether every constant of the compiled expression is real, so
+     * that it is evaluated in real arithmetic at real points.
+    */
+    auto is_real() const noexcept -> bool
+    {
+        return m_real;
+    }
+
+    /**
+     * @brief Number of variable slots read by the compiled expression, at
+     * least 1.
+    */
+    auto variables() const noexcept -> size_t
+    {
+        return m_variables;
+    }
+
+    /**
+     * @brief Number of roots evaluated by the compiled expression.
+    */
+    auto outputs() const noexcept -> size_t
+    {
+        return m_outputs;
+    }
+
+    /**
+     * @brief Number of instructions.
+    */
+    auto size() const noexcept -> size_t
+    {
+        return m_code.size();
+    }
+};
+
+/**
+ * @brief Compiles given expression.
+ *
+ * @param e Expression to compile.
+ * @tparam T floating point type used by expression.
+ *
+ * @return Compiled expression.
+*/
+template<std::floating_point T, template<typename...> class container>
+auto compile(const expr<T, container>& e) -> compiled_expr<T>
+{
+    return compiled_expr<T>(e);
+}
+
+};
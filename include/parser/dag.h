@@ -0,0 +1,361 @@
+/**
+ * @file dag.h
+ * @brief Contains a class to represent math expressions as a directed acyclic
+ * graph (DAG) of nodes, where a subexpression used in several places is
+ * stored once and referenced by every user. Nodes are hash-consed, so
+ * structurally identical subexpressions are always the same node.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "parser/expression.h"
+
+namespace parser
+{
+
+/**
+ * @brief Arena of nodes representing one or more math expressions. Every node
+ * is a token together with the nodes of its arguments, so a node is the root
+ * of the subexpression made up of it and everything reachable from it.
+ *
+ * Nodes are only ever appended, and the arguments of a node always come
+ * before it in the arena, so iterating over the nodes in order visits every
+ * subexpression after its arguments.
+ *
+ * Nodes are interned: adding a node equal to one already in the graph (same
+ * token and same arguments) returns the existing node. Since the arguments
+ * are themselves interned, two subexpressions are the same node exactly when
+ * they are structurally identical, however they were built.
+ *
+ * @tparam T The floating point type (float, double or long double) to use in
+ * the storing of values in the nodes. Defaults to double.
+*/
+template<std::floating_point T = double>
+class dag
+{
+public:
+    using node_id = std::uint32_t;
+
+    // Argument of a node that does not have that argument
+    static constexpr node_id no_node = std::numeric_limits<node_id>::max();
+
+    /**
+     * @brief A single node of the graph.
+    */
+    struct node
+    {
+        token<T> t;      // Token of the node
+        node_id lhs;     // Argument of a FUNC or left argument of a BIN_OP
+        node_id rhs;     // Right argument of a BIN_OP
+
+        auto operator==(const node& other) const -> bool
+        {
+            // Constants 0 and -0 are kept apart, so folding keeps the sign of a zero
+            auto same_sign = std::signbit(t.val.real()) == std::signbit(other.t.val.real()) && std::signbit(t.val.imag()) == std::signbit(other.t.val.imag());
+            return t.type == other.t.type && t.op == other.t.op && t.val == other.t.val && same_sign && t.slot == other.t.slot && lhs == other.lhs && rhs == other.rhs;
+        }
+    };
+
+private:
+    struct node_hash
+    {
+        auto operator()(const node& n) const -> size_t
+        {
+            auto h = std::hash<T>()(n.t.val.real());
+            auto combine = [&](size_t v) { h ^= v + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2); };
+
+            combine(std::hash<T>()(n.t.val.imag()));
+            combine(((size_t) n.t.slot << 16) | ((size_t) n.t.type << 8) | (size_t) n.t.op);
+            combine(((size_t) n.lhs << 32) | n.rhs);
+
+            return h;
+        }
+    };
+
+    std::vector<node> m_nodes;
+
+    // Id of every node, to look up nodes equal to a new one
+    std::unordered_map<node, node_id, node_hash> m_index;
+
+public:
+    /**
+     * @brief Default constructor.
+    */
+    dag() {};
+
+    /**
+     * @brief Appends a node to the graph, unless an equal node is already in
+     * the graph.
+     *
+     * @param t Token of the node. Must have type VAR, CONST, FUNC or BIN_OP.
+     * @param lhs Argument of a FUNC or left argument of a BIN_OP.
+     * @param rhs Right argument of a BIN_OP.
+     *
+     * @return Id of the new node, or of the equal node already in the graph.
+    */
+    auto add(token<T> t, node_id lhs = no_node, node_id rhs = no_node) -> node_id
+    {
+        // VAR and CONST tokens may carry an op, which is ignored
+        if (t.type == VAR || t.type == CONST)
+        {
+            t.op = NO_OP;
+        }
+        // Only CONST tokens have values, and only VAR tokens have slots
+        if (t.type != CONST)
+        {
+            t.val = 0;
+        }
+        if (t.type != VAR)
+        {
+            t.slot = 0;
+        }
+
+        node n{t, lhs, rhs};
+
+        auto [it, added] = m_index.try_emplace(n, (node_id) m_nodes.size());
+        if (added)
+        {
+            m_nodes.push_back(n);
+        }
+
+        return it->second;
+    }
+
+    /**
+     * @brief Appends a variable node.
+     *
+     * @param slot Slot of the variable. Defaults to 0, the only variable of
+     * an expression of z.
+    */
+    auto var(std::uint32_t slot = 0) -> node_id
+    {
+        return add({VAR, NO_OP, 0, slot});
+    }
+
+    /**
+     * @brief Appends a constant node.
+     *
+     * @param val Value of the constant.
+    */
+    auto constant(std::complex<T> val) -> node_id
+    {
+        return add({CONST, NO_OP, val});
+    }
+
+    /**
+     * @brief Appends a node for a function of one variable.
+     *
+     * @param op Operation with type FUNC.
+     * @param arg Argument of the function.
+    */
+    auto func(operation op, node_id arg) -> node_id
+    {
+        return add({FUNC, op}, arg);
+    }
+
+    /**
+     * @brief Appends a node for a binary operation.
+     *
+     * @param op Operation with type BIN_OP.
+     * @param lhs Left argument of the operation.
+     * @param rhs Right argument of the operation.
+    */
+    auto bin_op(operation op, node_id lhs, node_id rhs) -> node_id
+    {
+        return add({BIN_OP, op}, lhs, rhs);
+    }
+
+    /**
+     * @brief Appends the nodes of a postfix expression to the graph, in a
+     * single pass over its tokens.
+     *
+     * @param begin Iterator to first token of postfix expression.
+     * @param end Iterator to one after last token of postfix expression.
+     * @param var If given, every VAR token is replaced by this node instead of
+     * getting a node of its own, i.e., the expression is composed with the
+     * subexpression of var.
+     *
+     * @return Id of the node of the whole expression.
+     * @throw invalid_argument if the expression is not a legal postfix
+     * expression.
+    */
+    template<std::input_iterator iter>
+    auto push(iter begin, iter end, node_id var = no_node) -> node_id
+    {
+        // Nodes of the subexpressions evaluated so far; the stack of an
+        // evaluation, with nodes in place of values.
+        std::vector<node_id> stack;
+
+        for (auto it = begin; it != end; it++)
+        {
+            if (it->type == VAR && var != no_node)
+            {
+                stack.push_back(var);
+            }
+            else if (it->type == VAR || it->type == CONST)
+            {
+                stack.push_back(add(*it));
+            }
+            else if (it->type == FUNC && stack.size() >= 1)
+            {
+                stack.back() = add(*it, stack.back());
+            }
+            else if (it->type == BIN_OP && stack.size() >= 2)
+            {
+                auto rhs = stack.back();
+                stack.pop_back();
+                stack.back() = add(*it, stack.back(), rhs);
+            }
+            else
+            {
+                throw std::invalid_argument("Expression is not a legal postfix expression.");
+            }
+        }
+
+        if (stack.size() != 1)
+        {
+            throw std::invalid_argument("Expression is not a legal postfix expression.");
+        }
+
+        return stack.back();
+    }
+
+    /**
+     * @brief Appends the nodes of a postfix expression to the graph.
+     *
+     * @param postfix Postfix expression.
+     *
+     * @return Id of the node of the whole expression.
+    */
+    template<template<typename...> class container>
+    auto push(const expr<T, container>& postfix) -> node_id
+    {
+        return push(postfix.cbegin(), postfix.cend());
+    }
+
+    /**
+     * @brief Expands the subexpression with the given root back into a
+     * postfix expression. Subexpressions shared in the graph are written out
+     * once for every place they are used.
+     *
+     * @tparam container Container to store the tokens of the expression in.
+     * Defaults to std::list.
+     *
+     * @param root Id of the node of the subexpression.
+     *
+     * @return Postfix expression of the subexpression.
+    */
+    template<template<typename...> class container = std::list>
+    auto to_expr(node_id root) const -> expr<T, container>
+    {
+        typename expr<T, container>::storage_type tokens;
+
+        if constexpr (requires { tokens.reserve(1); })
+        {
+            tokens.reserve(expanded_size(root));
+        }
+
+        // Walk the tree of the subexpression depth first without recursion.
+        // A node is written once both of its arguments have been, so each
+        // entry remembers how many of its arguments were already visited.
+        std::vector<std::pair<node_id, int>> stack = {{root, 0}};
+
+        while (!stack.empty())
+        {
+            auto& [n, visited] = stack.back();
+            auto& current = m_nodes[n];
+
+            if (visited == 0 && current.lhs != no_node)
+            {
+                visited = 1;
+                stack.push_back({current.lhs, 0});
+            }
+            else if (visited <= 1 && current.rhs != no_node)
+            {
+                visited = 2;
+                stack.push_back({current.rhs, 0});
+            }
+            else
+            {
+                tokens.push_back(current.t);
+                stack.pop_back();
+            }
+        }
+
+        return expr<T, container>(std::move(tokens));
+    }
+
+    /**
+     * @brief Number of tokens in the postfix expression of the subexpression
+     * with the given root, where shared subexpressions count once for every
+     * place they are used.
+     *
+     * @param root Id of the node of the subexpression.
+    */
+    auto expanded_size(node_id root) const -> size_t
+    {
+        // Arguments come before the node using them, so one pass in order
+        // finds the size of every subexpression up to root.
+        std::vector<size_t> sizes(root + 1);
+        for (node_id n = 0; n <= root; n++)
+        {
+            auto& current = m_nodes[n];
+            sizes[n] = 1 + (current.lhs != no_node ? sizes[current.lhs] : 0) + (current.rhs != no_node ? sizes[current.rhs] : 0);
+        }
+
+        return sizes[root];
+    }
+
+    /**
+     * @brief Node with the given id.
+    */
+    auto operator[](node_id n) const -> const node&
+    {
+        return m_nodes[n];
+    }
+
+    /**
+     * @brief Number of nodes in the graph.
+    */
+    auto size() const noexcept -> size_t
+    {
+        return m_nodes.size();
+    }
+
+    /**
+     * @brief Removes all nodes.
+    */
+    void clear() noexcept
+    {
+        m_nodes.clear();
+        m_index.clear();
+    }
+};
+
+/**
+ * @brief Checks whether a node of a dag is a given constant.
+ *
+ * @param g Graph containing node.
+ * @param n Id of node.
+ * @param val Value of constant.
+ *
+ * @return True if node n is a CONST equal to val.
+*/
+template<std::floating_point T>
+auto is_constant(const dag<T>& g, typename dag<T>::node_id n, std::complex<T> val) -> bool
+{
+    return g[n].t.type == CONST && g[n].t.val == val;
+}
+
+};
@@ -2,23 +2,38 @@
 /**
  * @file derivative.h
  * @brief Contains functions to find derivatives in and of postfix expressions.
- * 
- * @author: Dhairya Patel 
+ *
+ * Derivatives are built in a dag, which the whole differentiation shares: the
+ * nodes of a derivative refer to the nodes of the operands of the expression
+ * being differentiated instead of copying them, and every subexpression is
+ * differentiated at most once. So differentiating an expression takes time
+ * and memory linear in its size, and only expanding the derivative back into
+ * a postfix expression writes out the shared operands in full.
+ *
+ * Expressions of many variables are differentiated with respect to the
+ * variable of slot 0, the first one named when parsing; every other variable
+ * is held constant.
+ *
+ * @author: Dhairya Patel
 */
 
 #pragma once
 
+#include <unordered_map>
+#include <vector>
+
+#include "dag.h"
 #include "parser/expression.h"
 
-namespace parser 
+namespace parser
 {
 
 /**
  * @brief Computes all derivatives in given postfix expression.
- * 
+ *
  * @param postfix Postfix expression.
  * @tparam T floating point type used by expression.
- * 
+ *
  * @return Postfix expression with all derivatives computed.
 */
 template<std::floating_point T>
@@ -26,676 +41,570 @@ auto all_derivatives(const expr<T>& e) -> expr<T>;
 
 /**
  * @brief Differentiates given postfix expression.
- * 
+ *
  * @param postfix Postfix expression.
  * @tparam T floating point type used by expression.
- * 
+ *
  * @return Derivative of postfix expression.
 */
-template<std::floating_point T>
-auto differentiate(const expr<T>& postfix) -> expr<T>
+template<std::floating_point T, template<typename...> class container>
+auto differentiate(const expr<T, container>& postfix) -> expr<T, container>
 {
-    return differentiate<T>(postfix.cbegin(), postfix.cend());
+    return differentiate<T, container>(postfix.cbegin(), postfix.cend());
 }
 
 /**
  * @brief Differentiates given postfix expression within specified bounds.
- * 
+ *
  * @tparam T Floating point type used by expression.
- * @tparam iter Bidirectional iterator.
- * 
+ * @tparam container Container to store the tokens of the derivative in.
+ * Defaults to std::list.
+ * @tparam iter Input iterator.
+ *
  * @param begin Iterator to first element of expression to differentiate.
- * @param end Iterator to one after the last element of expression to 
+ * @param end Iterator to one after the last element of expression to
  * differentiate.
- * 
- * @warning Bidirectional iterator should point to type token<T>. 
- * 
+ *
+ * @warning Input iterator should point to type token<T>.
+ *
  * @return Derivative of postfix subexpression.
 */
-template<std::floating_point T, std::bidirectional_iterator iter>
-auto differentiate(iter begin, iter end) -> expr<T>
+template<std::floating_point T, template<typename...> class container = std::list, std::input_iterator iter>
+auto differentiate(iter begin, iter end) -> expr<T, container>
+{
+    dag<T> g;
+    std::vector<typename dag<T>::node_id> derivs;
+
+    auto root = g.push(begin, end);
+    return g.template to_expr<container>(differentiate(g, root, derivs));
+}
+
+/**
+ * @brief Appends [[a] [b] *] to a dag, or a simpler equal node when either of
+ * [a] or [b] is 0 or 1. Without the special cases, derivatives are full of
+ * multiplications by 0 and 1, which are unnecessary computations.
+ *
+ * @param g Graph containing a and b.
+ * @param a Id of left argument.
+ * @param b Id of right argument.
+ *
+ * @return Id of node equal to [[a] [b] *].
+*/
+template<std::floating_point T>
+auto multiply(dag<T>& g, typename dag<T>::node_id a, typename dag<T>::node_id b) -> typename dag<T>::node_id
 {
-    // If expression to differentiate is a single variable, the derivative is 1
-    if (std::prev(end)->type == VAR)
+    if (is_constant<T>(g, a, 0) || is_constant<T>(g, b, 1))
     {
-        return {{CONST, NO_OP, 1.0}};
+        return a;
     }
-    // If expression to differentiate is a constant, the derivative is 1
-    else if (std::prev(end)->type == CONST)
+    else if (is_constant<T>(g, b, 0) || is_constant<T>(g, a, 1))
     {
-        return {{CONST, NO_OP, 0.0}};
+        return b;
     }
-    // If expression to differentiate is a function of one variable, we call a
-    // separate function to deal with that case
-    else if (std::prev(end)->type == FUNC)
+    else
     {
-        return differentiate_func<T>(begin, end);
+        return g.bin_op(MUL, a, b);
     }
-    // If expression to differentiate is a binary operation, we call a separate
-    // function to deal with that case
-    else if (std::prev(end)->type == BIN_OP)
+}
+
+/**
+ * @brief Appends [[a] [b] +] to a dag, or just [a] or [b] if the other is 0.
+ *
+ * @param g Graph containing a and b.
+ * @param a Id of left argument.
+ * @param b Id of right argument.
+ *
+ * @return Id of node equal to [[a] [b] +].
+*/
+template<std::floating_point T>
+auto add(dag<T>& g, typename dag<T>::node_id a, typename dag<T>::node_id b) -> typename dag<T>::node_id
+{
+    if (is_constant<T>(g, a, 0))
+    {
+        return b;
+    }
+    else if (is_constant<T>(g, b, 0))
     {
-        return differentiate_bin_op<T>(begin, end);
+        return a;
     }
     else
     {
-        throw std::invalid_argument("Unrecognized token to differentiate.");
+        return g.bin_op(ADD, a, b);
     }
 }
 
 /**
- * @brief Differentiates given postfix expression within specified bounds that
- * can be represented as f(g(z)) where f corresponds to an operation with type
- * FUNC and g(z) is any function of z represented in postfix. 
- * 
+ * @brief Appends [[a] [b] -] to a dag, or a simpler equal node if either of
+ * [a] or [b] is 0.
+ *
+ * @param g Graph containing a and b.
+ * @param a Id of left argument.
+ * @param b Id of right argument.
+ *
+ * @return Id of node equal to [[a] [b] -].
+*/
+template<std::floating_point T>
+auto subtract(dag<T>& g, typename dag<T>::node_id a, typename dag<T>::node_id b) -> typename dag<T>::node_id
+{
+    if (is_constant<T>(g, b, 0))
+    {
+        return a;
+    }
+    // [0 [b] -] is [[b] ~], or just the constant [-b] if [b] is a constant
+    else if (is_constant<T>(g, a, 0))
+    {
+        return g[b].t.type == CONST ? g.constant(- g[b].t.val) : g.func(NEG, b);
+    }
+    else
+    {
+        return g.bin_op(SUB, a, b);
+    }
+}
+
+/**
+ * @brief Differentiates a subexpression of a dag. The nodes of the derivative
+ * are appended to the same dag.
+ *
+ * Nodes are differentiated without recursion, so that expressions nested
+ * arbitrarily deep, e.g., machine generated ones, take stack space that does
+ * not depend on their depth. Arguments always have smaller ids than the nodes
+ * using them, so one pass backwards from n finds every node that still has to
+ * be differentiated, and differentiating those in order of id differentiates
+ * the arguments of every node before the node itself.
+ *
  * @tparam T Floating point type used by expression.
- * @tparam iter Bidirectional iterator.
- * 
- * @param begin Iterator to first element of expression to differentiate.
- * @param end Iterator to one after the last element of expression to 
- * differentiate.
- * 
- * @return Derivative of postfix subexpression.
- * 
- * @warning Bidirectional iterator should point to type token<T>. 
- * 
- * @throw invalid_argument if prev(end) is not of type FUNC.
+ *
+ * @param g Graph containing subexpression.
+ * @param n Id of root node of subexpression to differentiate.
+ * @param derivs Derivatives found so far, where derivs[m] is the id of the
+ * derivative of node m, or dag<T>::no_node if node m was not differentiated
+ * yet. Shared by all calls differentiating nodes of g, so that no node is
+ * differentiated twice; grown as needed.
+ *
+ * @return Id of root node of derivative.
 */
-template<std::floating_point T, std::bidirectional_iterator iter>
-auto differentiate_func(iter begin, iter end) -> expr<T>
+template<std::floating_point T>
+auto differentiate(dag<T>& g, typename dag<T>::node_id n, std::vector<typename dag<T>::node_id>& derivs) -> typename dag<T>::node_id
 {
-    auto f = std::prev(end);
-    if (f->type != FUNC)
+    using node_id = typename dag<T>::node_id;
+
+    if (derivs.size() <= n)
     {
-        throw std::invalid_argument("Expression to differentiate is not a function of one variable.");
+        derivs.resize(g.size(), dag<T>::no_node);
     }
 
-    // Input postfix [begin : end] looks like [[g] f], where [g] is itself
-    // a subexpression, postfix[begin : end - 1] = postfix[begin : f]. The 
-    // derivative of postfix[begin : end] is equivalent to [[g'] [g] [f'] *] by
-    // the chain rule, where [f'] and [g'] are the postfix expressions 
-    // representing the symbolic derivatives of f and [g], respectively.
+    if (derivs[n] != dag<T>::no_node)
+    {
+        return derivs[n];
+    }
 
-    // Deal with special case where g(z) = c (so f'(g(z)) * g'(z) = 0) and when
-    // g(z) = z so f'(g(z)) * g'(z) = f'(z). We do not necessarily need a separate
-    // case, but without this special case, the final derivative will have 
-    // expressions multiplied by 1 and 0, which adds unnecessary computations.
-    auto g_end = std::prev(f);
-    if (begin == g_end)
+    // Nodes of the subexpression that are not differentiated yet. The
+    // arguments of nodes that are differentiated already are not needed.
+    std::vector<bool> needed(n + 1, false);
+    needed[n] = true;
+    for (node_id m = n + 1; m-- > 0;)
     {
-        // If the argument of the function is constant, the derivative is 0.
-        if (begin->type == CONST)
-        {
-            return expr<T>{{CONST, NO_OP, 0.0}};
-        }
-        // If the argument of the function is z, the derivative is [z [f']].
-        else if (begin->type == VAR)
+        if (needed[m] && derivs[m] == dag<T>::no_node)
         {
-            auto derivative = get_deriv(*f);
-            derivative.emplace_front(VAR, NO_OP);
-
-            return derivative;
+            if (g[m].lhs != dag<T>::no_node)
+            {
+                needed[g[m].lhs] = true;
+            }
+            if (g[m].rhs != dag<T>::no_node)
+            {
+                needed[g[m].rhs] = true;
+            }
         }
         else
         {
-            throw std::logic_error("Unexpected token encountered.");
+            needed[m] = false;
         }
     }
-    // In general, the derivative is [[g'] [g] [f'] *]
-    else
-    {
-        auto derivative = differentiate<T>(begin, f);
-        derivative.insert(derivative.end(), begin, f);
-        auto f_deriv = get_deriv(*f);
-        derivative.insert(derivative.end(), std::make_move_iterator(f_deriv.begin()), std::make_move_iterator(f_deriv.end()));
-        derivative.emplace_back(BIN_OP, MUL);
 
-        return derivative;
+    for (node_id m = 0; m <= n; m++)
+    {
+        if (needed[m])
+        {
+            // The derivative is computed before it is stored, as derivs is
+            // only indexed by nodes that existed before differentiating
+            auto derivative = differentiate_node(g, m, derivs);
+            derivs[m] = derivative;
+        }
     }
+
+    return derivs[n];
 }
 
 /**
- * @brief Differentiates given postfix expression within specified bounds that
- * can be represented as f(z) · g(z) where · is one of +, -, *, / or ^, and 
- * g(z) and h(z) are any expressions. 
- * 
+ * @brief Differentiates a single node of a dag, whose arguments are already
+ * differentiated. See differentiate.
+ *
  * @tparam T Floating point type used by expression.
- * @tparam iter Bidirectional iterator.
- * 
- * @param begin Iterator to first element of expression to differentiate.
- * @param end Iterator to one after the last element of expression to 
- * differentiate.
- * 
- * @return Derivative of postfix subexpression.
- * 
- * @warning Bidirectional iterator should point to type token<T>. 
- * 
- * @throw invalid_argument if prev(end) is not of type BIN_OP.
+ *
+ * @param g Graph containing node.
+ * @param n Id of node to differentiate.
+ * @param derivs Derivatives found so far. See differentiate.
+ *
+ * @return Id of root node of derivative.
+ * @throw invalid_argument if the node can not be differentiated.
 */
-template<std::floating_point T, std::bidirectional_iterator iter>
-auto differentiate_bin_op(iter begin, iter end) -> expr<T>
+template<std::floating_point T>
+auto differentiate_node(dag<T>& g, typename dag<T>::node_id n, std::vector<typename dag<T>::node_id>& derivs) -> typename dag<T>::node_id
 {
-    auto bin_op = std::prev(end);
-
-    if (bin_op->type != BIN_OP)
+    // If expression to differentiate is the variable of slot 0, the
+    // derivative is 1
+    if (g[n].t.type == VAR && g[n].t.slot == 0)
     {
-        throw std::invalid_argument("Expression to differentiate is not a binary operation.");
-    }
-
-    if (bin_op->op == ADD || bin_op->op == SUB)
-    {
-        return differentiate_bin_op_add_sub<T>(begin, end);
+        return g.constant(1);
     }
-    else if (bin_op->op == MUL)
+    // If expression to differentiate is a constant, or any other variable,
+    // the derivative is 0
+    else if (g[n].t.type == CONST || g[n].t.type == VAR)
     {
-        return differentiate_bin_op_mul<T>(begin, end);
+        return g.constant(0);
     }
-    else if (bin_op->op == DIV)
+    // If expression to differentiate is a function of one variable, we call a
+    // separate function to deal with that case
+    else if (g[n].t.type == FUNC)
     {
-        return differentiate_bin_op_div<T>(begin, end);
+        return differentiate_func(g, n, derivs);
     }
-    else if (bin_op->op == POW)
+    // If expression to differentiate is a binary operation, we call a separate
+    // function to deal with that case
+    else if (g[n].t.type == BIN_OP)
     {
-        return differentiate_bin_op_pow<T>(begin, end);
+        return differentiate_bin_op(g, n, derivs);
     }
     else
     {
-        throw std::invalid_argument("Unrecognized/unimplemented binary operator.");
+        throw std::invalid_argument("Unrecognized token to differentiate.");
     }
 }
 
 /**
- * @brief Differentiates given postfix expression within specified bounds when
- * the expression ends with an ADD or SUB. Between begin and end 
- * (not inclusive), the postfix should look like [[f] [g] ·], where [f] and [g]
- * are themselves postfix expressions and · is either + or -.
- * 
+ * @brief Differentiates a subexpression of a dag that can be represented as
+ * f(g(z)) where f corresponds to an operation with type FUNC and g(z) is any
+ * function of z.
+ *
  * @tparam T Floating point type used by expression.
- * @tparam iter Bidirectional iterator.
- * 
- * @param begin Iterator to first element of expression to differentiate.
- * @param end Iterator to one after the last element of expression to 
- * differentiate.
- * 
- * @return Derivative of postfix subexpression.
- * 
- * @warning Bidirectional iterator should point to type token<T>. 
- * 
- * @throw invalid_argument if prev(end) is not ADD or SUB.
+ *
+ * @param g Graph containing subexpression.
+ * @param n Id of root node of subexpression to differentiate.
+ * @param derivs Derivatives found so far. See differentiate.
+ *
+ * @return Id of root node of derivative.
+ *
+ * @throw invalid_argument if node n is not of type FUNC.
 */
-template<std::floating_point T, std::bidirectional_iterator iter>
-auto differentiate_bin_op_add_sub(iter begin, iter end) -> expr<T>
+template<std::floating_point T>
+auto differentiate_func(dag<T>& g, typename dag<T>::node_id n, std::vector<typename dag<T>::node_id>& derivs) -> typename dag<T>::node_id
 {
-    // Decrement iterator to point to the binary operator.
-    end--;
-    if (end->op != ADD && end->op != SUB)
+    if (g[n].t.type != FUNC)
     {
-        throw std::invalid_argument("Expression to differentiate is not an addition or subtraction.");
+        throw std::invalid_argument("Expression to differentiate is not a function of one variable.");
     }
 
-    // With end decremented, postfix[begin:end] looks like [[f] [g]], where [f]
-    // and [g] are subexpressions. We want the middle index that points to the
-    // first element of [g]/ one after last element of [f] to isolate the two
-    // subexpressions [f] and [g].
-    auto mid = expr<T>::subexpr_begin(end);
-    // [g] = postfix[mid:end]
-    // [f] = postfix[begin:mid]
-
-    // First we deal with special cases where [f'] or [g'] are constants. This
-    // is not strictly necessary, but without the special cases, we get zero
-    // additions in final expression, which are unnecessary.
+    // The subexpression looks like [[g] f], where [g] is itself a
+    // subexpression. Its derivative is [[g'] [g] [f'] *] by the chain rule,
+    // where [f'] and [g'] are the symbolic derivatives of f and [g],
+    // respectively. [g] is the node already in the graph, not a copy of it.
+    auto arg = g[n].lhs;
+    auto arg_deriv = differentiate(g, arg, derivs);
+    auto op = g[n].t.op;
 
-    // In case [f] is a constant, we can simply return [g'] instead if · is +
-    // and [- [g']] if · is -.
-    if (begin == std::prev(mid) && begin->type == CONST)
+    // If [g'] is 0 (e.g., g(z) = c), the derivative is 0 and [f'] is not
+    // needed. deriv always evaluates to 0, so its derivative is 0 too.
+    if (is_constant<T>(g, arg_deriv, 0) || op == DERIV)
     {
-        auto derivative = differentiate<T>(mid, end);
-        // Insert negation if the binary operation was subtraction
-        if (end->op == SUB)
-        {
-            // If [g'] is also a constant, can just compute [-g']
-            if (derivative.size() == 1 && derivative.front().type == CONST)
-            {
-                derivative.front().val = - derivative.front().val;
-            }
-            // Otherwise, a negative operation is appended [[g'] -]
-            else
-            {
-                derivative.emplace_back(FUNC, NEG);
-            }
-        }
+        return g.constant(0);
+    }
 
-        return derivative;
+    // re, im, conj, abs and arg are not holomorphic, so their derivatives are
+    // not a product of [g'] and a derivative of f. They are differentiated
+    // along the real axis instead, as in dual.h: [[g'] re], [[g'] im],
+    // [[g'] conj], [[g] conj [g'] * re [g] abs /] and [[g'] [g] / im].
+    if (op == RE || op == IM || op == CONJ)
+    {
+        return g.func(op, arg_deriv);
     }
-    // In case [g] is a constant, we can simply return [f'] instead.
-    else if (mid == std::prev(end) && mid->type == CONST)
+    else if (op == ABS)
     {
-        return differentiate<T>(begin, mid);   // [[f']]
+        return g.bin_op(DIV, g.func(RE, multiply(g, g.func(CONJ, arg), arg_deriv)), n);
     }
-    // In general, d(f · g)/dz = df/dz · dg/dz when · is + or -. So, the 
-    // derivative of [[f] [g] ·] is [[f'] [g'] ·].
-    else
+    else if (op == ARG)
     {
-        auto derivative = differentiate<T>(begin, mid);
-        auto g_deriv = differentiate<T>(mid, end);
-        derivative.insert(derivative.end(), std::make_move_iterator(g_deriv.begin()), std::make_move_iterator(g_deriv.end()));
-        derivative.push_back(*end);
-
-        return derivative;
+        return g.func(IM, g.bin_op(DIV, arg_deriv, arg));
     }
+
+    auto& f_deriv = get_deriv(g[n].t);
+    auto outer = g.push(f_deriv.cbegin(), f_deriv.cend(), arg);
+
+    return multiply(g, arg_deriv, outer);
 }
 
 /**
- * @brief Differentiates given postfix expression within specified bounds when
- * the expression ends with a MUL. Between begin and end (not inclusive), the
- * postfix should look like [[f] [g] *].
- * 
+ * @brief Differentiates a subexpression of a dag that can be represented as
+ * f(z) · g(z) where · is one of +, -, *, / or ^, and f(z) and g(z) are any
+ * expressions.
+ *
  * @tparam T Floating point type used by expression.
- * @tparam iter Bidirectional iterator.
- * 
- * @param begin Iterator to first element of expression to differentiate.
- * @param end Iterator to one after the last element of expression to 
- * differentiate.
- * 
- * @return Derivative of postfix subexpression.
- * 
- * @warning Bidirectional iterator should point to type token<T>. 
- * 
- * @throw invalid_argument if prev(end) is not MUL.
+ *
+ * @param g Graph containing subexpression.
+ * @param n Id of root node of subexpression to differentiate.
+ * @param derivs Derivatives found so far. See differentiate.
+ *
+ * @return Id of root node of derivative.
+ *
+ * @throw invalid_argument if node n is not of type BIN_OP.
 */
-template<std::floating_point T, std::bidirectional_iterator iter>
-auto differentiate_bin_op_mul(iter begin, iter end) -> expr<T>
+template<std::floating_point T>
+auto differentiate_bin_op(dag<T>& g, typename dag<T>::node_id n, std::vector<typename dag<T>::node_id>& derivs) -> typename dag<T>::node_id
 {
-    // Decrement iterator to point to the binary operator.
-    end--;
-    if (end->op != MUL)
+    if (g[n].t.type != BIN_OP)
     {
-        throw std::invalid_argument("Expression to differentiate is not an addition or subtraction.");
+        throw std::invalid_argument("Expression to differentiate is not a binary operation.");
     }
 
-    // With end decremented, postfix[begin:end] looks like [[f] [g]], where [f]
-    // and [g] are subexpressions. We want the middle index that points to the
-    // first element of [g]/ one after last element of [f] to isolate the two
-    // subexpressions [f] and [g].
-    auto mid = expr<T>::subexpr_begin(end);
-    // [g] = postfix[mid:end]
-    // [f] = postfix[begin:mid]
-
-    // In the general case, the derivative is [[f'] [g] * [g'] [f] * +].
-    // Let [p_1] be the expression [[f'] [g] *] 
-    // Let [p_2] be the expression [[g'] [f] *]
-    // The derivative is then [[p_1] [p_2] +]
+    auto op = g[n].t.op;
 
-    expr<T> p_1;
-    // If [f] is a constant or a variable, [p_1] is simpler
-    if (begin == std::prev(mid))
+    if (op == ADD || op == SUB)
     {
-        // [f] is a constant, so [p_1] is [0]
-        if (begin->type == CONST)
-        {
-            p_1 = {{CONST, NO_OP, 0}};
-        }
-        // [f] is a variable, so [p_1] is [[g]]
-        else if (begin->type == VAR)
-        {
-            p_1 = expr<T>(mid, end);
-        }
-        else
-        {
-            std::invalid_argument("Unexpected token encountered.");
-        }
+        return differentiate_bin_op_add_sub(g, n, derivs);
     }
-    // In general, the[p_1] is [[f'] [g] *]
-    else
+    else if (op == MUL)
     {
-        p_1 = differentiate<T>(begin, mid);
-        p_1.insert(p_1.end(), mid, end);
-        p_1.emplace_back(BIN_OP, MUL);
+        return differentiate_bin_op_mul(g, n, derivs);
     }
-
-    expr<T> p_2;
-    // If [g] is a constant or a variable, [p_2] is simpler
-    if (mid == std::prev(mid))
+    else if (op == DIV)
     {
-        // [g] is a constant, so [p_2] is [0]
-        if (mid->type == CONST)
-        {
-            p_2 = {{CONST, NO_OP, 0}};
-        }
-        // [g] is a variable, so [p_2] is [[f]]
-        else if (mid->type == VAR)
-        {
-            p_2 = expr<T>(begin, mid);
-        }
-        else
-        {
-            std::invalid_argument("Unexpected token encountered.");
-        }
+        return differentiate_bin_op_div(g, n, derivs);
     }
-    // In general, [p_2] is [[g'] [f] *]
-    else
+    else if (op == POW)
     {
-        p_2 = differentiate<T>(mid, end);
-        p_2.insert(p_1.end(), begin, mid);
-        p_2.emplace_back(BIN_OP, MUL);
+        return differentiate_bin_op_pow(g, n, derivs);
     }
-
-    // [0 [p_2] +] is equal to [[p_2]]
-    if (p_1.size() == 1 && p_1.front().type == CONST && p_1.front().val == std::complex<T>(0, 0))
+    else
     {
-        return p_2;
+        throw std::invalid_argument("Unrecognized/unimplemented binary operator.");
     }
-    // [[p_1] 0 +] is equal to [[p_1]]
-    else if (p_2.size() == 1 && p_2.front().type == CONST && p_2.front().val == std::complex<T>(0, 0))
+}
+
+/**
+ * @brief Differentiates a subexpression of a dag that looks like
+ * [[f] [g] ·], where [f] and [g] are themselves subexpressions and · is
+ * either + or -.
+ *
+ * @tparam T Floating point type used by expression.
+ *
+ * @param g Graph containing subexpression.
+ * @param n Id of root node of subexpression to differentiate.
+ * @param derivs Derivatives found so far. See differentiate.
+ *
+ * @return Id of root node of derivative.
+ *
+ * @throw invalid_argument if node n is not ADD or SUB.
+*/
+template<std::floating_point T>
+auto differentiate_bin_op_add_sub(dag<T>& g, typename dag<T>::node_id n, std::vector<typename dag<T>::node_id>& derivs) -> typename dag<T>::node_id
+{
+    auto op = g[n].t.op;
+    if (op != ADD && op != SUB)
     {
-        return p_1;
+        throw std::invalid_argument("Expression to differentiate is not an addition or subtraction.");
     }
-    // In general, return [[p_1] [p_2] +]
-    else
-    {
-        p_1.insert(p_1.end(), std::make_move_iterator(p_2.begin()), std::make_move_iterator(p_2.end()));
-        p_1.emplace_back(BIN_OP, ADD);
 
-        return p_1;
-    }
+    // d(f · g)/dz = df/dz · dg/dz when · is + or -. So, the derivative of
+    // [[f] [g] ·] is [[f'] [g'] ·]. add and subtract leave out the operation
+    // when [f'] or [g'] is 0.
+    auto f = g[n].lhs;
+    auto h = g[n].rhs;
+    auto f_deriv = differentiate(g, f, derivs);
+    auto g_deriv = differentiate(g, h, derivs);
+
+    return op == ADD ? add(g, f_deriv, g_deriv) : subtract(g, f_deriv, g_deriv);
 }
 
 /**
- * @brief Differentiates given postfix expression within specified bounds when
- * the expression ends with a MUL. Between begin and end (not inclusive), the
- * postfix should look like [[f] [g] /].
- * 
+ * @brief Differentiates a subexpression of a dag that looks like
+ * [[f] [g] *].
+ *
  * @tparam T Floating point type used by expression.
- * @tparam iter Bidirectional iterator.
- * 
- * @param begin Iterator to first element of expression to differentiate.
- * @param end Iterator to one after the last element of expression to 
- * differentiate.
- * 
- * @return Derivative of postfix subexpression.
- * 
- * @warning Bidirectional iterator should point to type token<T>. 
- * 
- * @throw invalid_argument if prev(end) is not DIV.
+ *
+ * @param g Graph containing subexpression.
+ * @param n Id of root node of subexpression to differentiate.
+ * @param derivs Derivatives found so far. See differentiate.
+ *
+ * @return Id of root node of derivative.
+ *
+ * @throw invalid_argument if node n is not MUL.
 */
-template<std::floating_point T, std::bidirectional_iterator iter>
-auto differentiate_bin_op_div(iter begin, iter end) -> expr<T>
+template<std::floating_point T>
+auto differentiate_bin_op_mul(dag<T>& g, typename dag<T>::node_id n, std::vector<typename dag<T>::node_id>& derivs) -> typename dag<T>::node_id
 {
-    // Decrement iterator to point to the binary operator.
-    end--;
-    if (end->op != DIV)
+    if (g[n].t.op != MUL)
     {
-        throw std::invalid_argument("Expression to differentiate is not an addition or subtraction.");
+        throw std::invalid_argument("Expression to differentiate is not a multiplication.");
     }
 
-    // With end decremented, postfix[begin:end] looks like [[f] [g]], where [f]
-    // and [g] are subexpressions. We want the middle index that points to the
-    // first element of [g]/ one after last element of [f] to isolate the two
-    // subexpressions [f] and [g].
-    auto mid = expr<T>::subexpr_begin(end);
-    // [g] = postfix[mid:end]
-    // [f] = postfix[begin:mid]
+    auto f = g[n].lhs;
+    auto h = g[n].rhs;
 
-    // In the general case, the derivative is [[f'] [g] * [g'] [f] * - [g] [g] * /].
-    // Let [p_1] be the expression [[f'] [g] *] 
+    // The derivative is [[f'] [g] * [g'] [f] * +].
+    // Let [p_1] be the expression [[f'] [g] *]
     // Let [p_2] be the expression [[g'] [f] *]
-    // Let [p_3] be the expression [[g] [g] *]
-    // The derivative is then [[p_1] [p_2] - [p_3] /]
+    // The derivative is then [[p_1] [p_2] +]
+    // multiply and add simplify away the terms where [f'] or [g'] is 0 or 1.
+    auto p_1 = multiply(g, differentiate(g, f, derivs), h);
+    auto p_2 = multiply(g, differentiate(g, h, derivs), f);
 
-    expr<T> p_2, p_3;
-    // If [g] is a constant or a variable, [p_2] are [p_3] can be simpler
-    if (mid == std::prev(end))
-    {
-        // If [g] is a constant, the derivative is [[f'] [1 / g] *]
-        if (mid->type == CONST)
-        {
-            auto derivative = differentiate<T>(begin, mid);
-            derivative.emplace_back(CONST, NO_OP, (T) 1.0 / mid->val);
-            derivative.emplace_back(BIN_OP, MUL);
+    return add(g, p_1, p_2);
+}
 
-            return derivative;
-        }
-        // If [g] is a variable, so [p_2] is [[f]] and [p_3] is [z z *]
-        else if (mid->type == VAR)
-        {
-            p_2 = expr<T>(begin, mid);
-            p_3 = {{VAR, NO_OP}, {VAR, NO_OP}, {BIN_OP, MUL}};
-        }
-        else
-        {
-            std::invalid_argument("Unexpected token encountered.");
-        }
-    }
-    // In general, [p_1] is [[g'] [f] *]
-    // In general, [p_3] is [[g] [g] *]
-    else
-    {
-        p_2 = differentiate<T>(mid, end);
-        p_2.insert(p_2.begin(), begin, mid);
-        p_2.emplace_back(BIN_OP, MUL);
-        
-        p_3 = expr<T>(mid, end);
-        p_3.insert(p_3.end(), mid, end);
-        p_3.emplace_back(BIN_OP, MUL);
-    }
-    
-    expr<T> p_1;
-    // If [f] is a constant or a variable, [p_1] is simpler
-    if (begin == std::prev(mid))
-    {
-        // [f] is a constant, so [p_1] is [0]
-        if (begin->type == CONST)
-        {
-            p_1 = {{CONST, NO_OP, 0}};
-        }
-        // [f] is a variable, so [p_1] is [[g]]
-        else if (begin->type == VAR)
-        {
-            p_1 = expr<T>(mid, end);
-        }
-        else
-        {
-            std::invalid_argument("Unexpected token encountered.");
-        }
-    }
-    // In general, [p_1] is [[f'] [g] *]
-    else
+/**
+ * @brief Differentiates a subexpression of a dag that looks like
+ * [[f] [g] /].
+ *
+ * @tparam T Floating point type used by expression.
+ *
+ * @param g Graph containing subexpression.
+ * @param n Id of root node of subexpression to differentiate.
+ * @param derivs Derivatives found so far. See differentiate.
+ *
+ * @return Id of root node of derivative.
+ *
+ * @throw invalid_argument if node n is not DIV.
+*/
+template<std::floating_point T>
+auto differentiate_bin_op_div(dag<T>& g, typename dag<T>::node_id n, std::vector<typename dag<T>::node_id>& derivs) -> typename dag<T>::node_id
+{
+    if (g[n].t.op != DIV)
     {
-        p_1 = differentiate<T>(begin, mid);
-        p_1.insert(p_1.end(), mid, end);
-        p_1.emplace_back(BIN_OP, MUL);
+        throw std::invalid_argument("Expression to differentiate is not a division.");
     }
-    
-    expr<T> derivative;
-    // [0 [p_2] -] is equal to [[p_2] -]
-    if (p_1.size() == 1 && p_1.front().type == CONST && p_1.front().val == std::complex<T>(0, 0))
+
+    auto f = g[n].lhs;
+    auto h = g[n].rhs;
+    auto f_deriv = differentiate(g, f, derivs);
+
+    // If [g] is a constant, the derivative is [[f'] [1 / g] *]
+    if (g[h].t.type == CONST)
     {
-        derivative = std::move(p_2);
-        derivative.emplace_back(FUNC, NEG);
+        return multiply(g, f_deriv, g.constant((T) 1.0 / g[h].t.val));
     }
-    // In general, the numerator of the derivative is [[p_1] [p_2] -]
-    else
-    {
-        p_1.insert(p_1.end(), std::make_move_iterator(p_2.begin()), std::make_move_iterator(p_2.end()));
-        p_1.emplace_back(BIN_OP, SUB);
 
-        derivative = std::move(p_1);
-    }
+    // In general, the derivative is [[f'] [g] * [g'] [f] * - [g] [g] * /].
+    // Let [p_1] be the expression [[f'] [g] *]
+    // Let [p_2] be the expression [[g'] [f] *]
+    // Let [p_3] be the expression [[g] [g] *]
+    // The derivative is then [[p_1] [p_2] - [p_3] /]
+    auto p_1 = multiply(g, f_deriv, h);
+    auto p_2 = multiply(g, differentiate(g, h, derivs), f);
+    auto p_3 = g.bin_op(MUL, h, h);
 
-    derivative.insert(derivative.end(), std::make_move_iterator(p_3.begin()), std::make_move_iterator(p_3.end()));
-    derivative.emplace_back(BIN_OP, DIV);
-    return derivative;
+    return g.bin_op(DIV, subtract(g, p_1, p_2), p_3);
 }
 
 /**
- * @brief Differentiates given postfix expression within specified bounds when
- * the expression ends with a MUL. Between begin and end (not inclusive), the
- * postfix should look like [[f] [g] ^].
- * 
+ * @brief Differentiates a subexpression of a dag that looks like
+ * [[f] [g] ^].
+ *
  * @tparam T Floating point type used by expression.
- * @tparam iter Bidirectional iterator.
- * 
- * @param begin Iterator to first element of expression to differentiate.
- * @param end Iterator to one after the last element of expression to 
- * differentiate.
- * 
- * @return Derivative of postfix subexpression.
- * 
- * @warning Bidirectional iterator should point to type token<T>. 
- * 
- * @throw invalid_argument if prev(end) is not POW.
+ *
+ * @param g Graph containing subexpression.
+ * @param n Id of root node of subexpression to differentiate.
+ * @param derivs Derivatives found so far. See differentiate.
+ *
+ * @return Id of root node of derivative.
+ *
+ * @throw invalid_argument if node n is not POW.
 */
-template<std::floating_point T, std::bidirectional_iterator iter>
-auto differentiate_bin_op_pow(iter begin, iter end) -> expr<T>
+template<std::floating_point T>
+auto differentiate_bin_op_pow(dag<T>& g, typename dag<T>::node_id n, std::vector<typename dag<T>::node_id>& derivs) -> typename dag<T>::node_id
 {
-    // Decrement iterator to point to the binary operator.
-    end--;
-    if (end->op != POW)
+    if (g[n].t.op != POW)
     {
-        throw std::invalid_argument("Expression to differentiate is not an addition or subtraction.");
+        throw std::invalid_argument("Expression to differentiate is not an exponentiation.");
+    }
+
+    auto f = g[n].lhs;
+    auto h = g[n].rhs;
+
+    // If [f] is exactly 0, we will simply return the derivative as [0]
+    if (is_constant<T>(g, f, 0))
+    {
+        return g.constant(0);
     }
 
-    // With end decremented, postfix[begin:end] looks like [[f] [g]], where [f]
-    // and [g] are subexpressions. We want the middle index that points to the
-    // first element of [g]/ one after last element of [f] to isolate the two
-    // subexpressions [f] and [g].
-    auto mid = expr<T>::subexpr_begin(end);
-    // [g] = postfix[mid:end]
-    // [f] = postfix[begin:mid]
-  
     // d(f ^ g)/dz = g * f^{g - 1} * f' + f^g * g' * ln(f)
     // In the general case, the derivative is (absolute cringe incoming)
-    // [[f'] [g] [f] [g] 1 - ^ * * [f] ln [g'] [f] [g] ^ * * +]
+    // [[f'] [g] [f] [g] 1 - ^ * * [g'] [f] ln [f] [g] ^ * * +]
     // Let [p_1] be the expression [[f'] [g] [f] [g] 1 - ^ * *]
     // Let [p_2] be the expression [[g'] [f] ln [f] [g] ^ * *]
     // The derivative is then [[p_1] [p_2] +]
+    // The [[f] [g] ^] inside [p_2] is node n itself.
 
-    expr<T> p_1;
-    // If [f] is a constant or a variable
-    if (begin == std::prev(mid))
-    {
-        // If [f] is a constant, [p_1] is [0]
-        if (begin->type == CONST)
-        {
-            p_1 = {{CONST, NO_OP, 0}};
-
-            // If [f] is exactly 0, we will simply return the derivative as [0]
-            if (begin->val == std::complex<T>(0, 0))
-            {
-                return p_1;
-            }
-        }
-        // If [f] is a variable, [p_1] is [[g] [f] [g] 1 - ^ *] 
-        else if (begin->type == VAR)
-        {
-            p_1 = expr<T>(mid, end);
-            p_1.insert(p_1.end(), begin, mid);
-            // If [g] is a constant, the [[g] 1 -] portion can be simplified to
-            // the constant [[g - 1]]
-            if (mid == std::prev(end) && mid->type == CONST)
-            {
-                p_1.emplace_back(CONST, NO_OP, mid->val - (T) 1.0);
-            }
-            // If [g] is not a constant, push back [[g] 1 -]
-            else
-            {
-                p_1.insert(p_1.end(), mid, end);
-                p_1.emplace_back(CONST, NO_OP, 1.0);
-                p_1.emplace_back(BIN_OP, SUB);
-            }
-            p_1.emplace_back(BIN_OP, POW);
-            p_1.emplace_back(BIN_OP, MUL);
-        }
-        else
-        {
-            std::invalid_argument("Unexpected token encountered.");
-        }
-    }
-    // In the general case, [p_1] is  [[f'] [g] [f] [g] 1 - ^ * *]
-    else
+    auto p_1 = differentiate(g, f, derivs);
+    if (!is_constant<T>(g, p_1, 0))
     {
-        p_1 = differentiate<T>(begin, mid);
-        p_1.insert(p_1.end(), mid, end);
-        p_1.insert(p_1.end(), begin, mid);
-        p_1.insert(p_1.end(), mid, end);
-        p_1.emplace_back(CONST, NO_OP, 1.0);
-        p_1.emplace_back(BIN_OP, SUB);
-        p_1.emplace_back(BIN_OP, POW);
-        p_1.emplace_back(BIN_OP, MUL);
-        p_1.emplace_back(BIN_OP, MUL);
+        // If [g] is a constant, the [[g] 1 -] portion can be simplified to
+        // the constant [[g - 1]]
+        auto exponent = g[h].t.type == CONST ? g.constant(g[h].t.val - (T) 1.0) : g.bin_op(SUB, h, g.constant(1));
+        p_1 = multiply(g, p_1, g.bin_op(MUL, h, g.bin_op(POW, f, exponent)));
     }
 
-    expr<T> p_2;
-    // If [g] is a constant or a variable
-    if (mid == std::prev(end))
+    auto p_2 = differentiate(g, h, derivs);
+    if (!is_constant<T>(g, p_2, 0))
     {
-        // If [g] is a constant, [p_2] is [0]
-        if (mid->type == CONST)
-        {
-            p_2 = {{CONST, NO_OP, 0.0}};
-        }
-        // If [g] is a variable, [p_2] is [[f] ln [f] [g] ^ *]
-        else if (mid->type == VAR)
-        {
-            p_2 = expr<T>(begin, mid);
-            p_2.emplace_back(FUNC, LOG);
-            p_2.insert(p_2.end(), begin, mid);
-            p_2.insert(p_2.end(), mid, end);
-            p_2.emplace_back(BIN_OP, POW);
-            p_2.emplace_back(BIN_OP, MUL);
-        }
-        else
-        {
-            std::invalid_argument("Unexpected token encountered.");
-        }
-    }
-    // In the general case, [p_1] is  [[g'] [f] ln [f] [g] ^ * *]
-    else
-    {
-        p_2 = differentiate<T>(mid, end);
-        p_2.insert(p_2.end(), begin, mid);
-        p_2.emplace_back(FUNC, LOG);
-        p_2.insert(p_2.end(), begin, mid);
-        p_2.insert(p_2.end(), mid, end);
-        p_2.emplace_back(BIN_OP, POW);
-        p_2.emplace_back(BIN_OP, MUL);
-        p_2.emplace_back(BIN_OP, MUL);
-    }
-    
-    // [0 [p_2] +] is equal to [[p_2]]
-    if (p_1.size() == 1 && p_1.front().type == CONST && p_1.front().val == std::complex<T>(0, 0))
-    {
-        return p_2;
+        p_2 = multiply(g, p_2, g.bin_op(MUL, g.func(LOG, f), n));
     }
-    // [[p_1] 0 +] is equal to [[p_1]]
-    else if (p_2.size() == 1 && p_2.front().type == CONST && p_2.front().val == std::complex<T>(0, 0))
-    {
-        return p_1;
-    }
-    // In general, return [[p_1] [p_2] +]
-    else
-    {
-        p_1.insert(p_1.end(), std::make_move_iterator(p_2.begin()), std::make_move_iterator(p_2.end()));
-        p_1.emplace_back(BIN_OP, ADD);
 
-        return p_1;
-    }
+    return add(g, p_1, p_2);
 }
 
 /**
- * @brief Map a token representing a single argument function to a vector of 
- * tokens in a postfix expression representing its derivative.
- * 
+ * @brief Map a token representing a single argument function to a postfix
+ * expression representing its derivative, where VAR stands for the argument
+ * of the function. For example, the derivative of [[g] cos] is
+ * [[g] sin ~], so the entry for cos is [z sin ~].
+ *
+ * Every holomorphic function has an entry. The square roots in the
+ * derivatives of the inverse functions are powers of 1/2, which compile into
+ * SQRT, with the same branches as in dual.h.
+ *
  * @param t Token with type function.
- * @return Vector of tokens representing the derivative of input token.
- * @throw invalid_argument if derivative of input token not found.
+ * @return Postfix expression representing the derivative of input token.
+ * @throw invalid_argument if derivative of input token not found, i.e., for
+ * re, im, abs, arg, conj and deriv, which differentiate_func handles itself.
 */
 template<std::floating_point T>
-auto get_deriv(token<T> t) -> expr<T>
+auto get_deriv(token<T> t) -> const expr<T>&
 {
+    constexpr token<T> z = {VAR, NO_OP};
+    constexpr token<T> one = {CONST, NO_OP, 1.0};
+    constexpr token<T> two = {CONST, NO_OP, 2.0};
+    constexpr token<T> half = {CONST, NO_OP, 0.5};
+    constexpr token<T> add = {BIN_OP, ADD}, sub = {BIN_OP, SUB}, mul = {BIN_OP, MUL}, div = {BIN_OP, DIV}, pow = {BIN_OP, POW};
+    constexpr token<T> neg = {FUNC, NEG};
+
     static std::unordered_map<operation, expr<T>> const table = {
-        {operation::SIN, { {FUNC, COS} }},
-        {operation::COS, { {FUNC, SIN} , {FUNC, NEG} }}
+        {operation::NEG,   { {CONST, NO_OP, -1.0} }},
+        {operation::EXP,   { z, {FUNC, EXP} }},
+        {operation::LOG,   { one, z, div }},
+        {operation::SIN,   { z, {FUNC, COS} }},
+        {operation::COS,   { z, {FUNC, SIN}, neg }},
+        {operation::TAN,   { one, z, {FUNC, TAN}, two, pow, add }},
+        {operation::SEC,   { z, {FUNC, SEC}, z, {FUNC, TAN}, mul }},
+        {operation::CSC,   { z, {FUNC, CSC}, z, {FUNC, COT}, mul, neg }},
+        {operation::COT,   { one, z, {FUNC, COT}, two, pow, add, neg }},
+        {operation::ACOS,  { one, one, z, two, pow, sub, half, pow, div, neg }},
+        {operation::ASIN,  { one, one, z, two, pow, sub, half, pow, div }},
+        {operation::ATAN,  { one, one, z, two, pow, add, div }},
+        {operation::COSH,  { z, {FUNC, SINH} }},
+        {operation::SINH,  { z, {FUNC, COSH} }},
+        {operation::TANH,  { one, z, {FUNC, TANH}, two, pow, sub }},
+        {operation::ACOSH, { one, z, one, sub, half, pow, z, one, add, half, pow, mul, div }},
+        {operation::ASINH, { one, z, two, pow, one, add, half, pow, div }},
+        {operation::ATANH, { one, one, z, two, pow, sub, div }}
     };
 
     auto it = table.find(t.op);
@@ -709,4 +618,4 @@ auto get_deriv(token<T> t) -> expr<T>
     }
 }
 
-};
\ No newline at end of file
+};
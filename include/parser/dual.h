@@ -0,0 +1,275 @@
+/**
+ * @file dual.h
+ * @brief Contains dual numbers, which carry a value together with its
+ * derivative through every operation, for forward mode differentiation of
+ * math expressions. Dual numbers of dual numbers carry higher derivatives.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <concepts>
+#include <stdexcept>
+
+#include "parser/token.h"
+
+namespace parser
+{
+
+/**
+ * @brief Dual number val + der ε, where ε² = 0. Evaluating f at z + ε gives
+ * f(z) + f'(z) ε, so the derivative of a function is found by evaluating it
+ * on dual numbers.
+ *
+ * @tparam V Type of the value and derivative; std::complex<T>, or a dual
+ * number itself for higher derivatives.
+*/
+template<typename V>
+struct dual
+{
+    V val; // Value
+    V der; // Derivative
+
+    constexpr dual() : val(), der() {}
+
+    constexpr dual(V val, V der) : val(val), der(der) {}
+
+    /**
+     * @brief Constant, i.e., a value with zero derivative.
+    */
+    template<typename U>
+    requires std::constructible_from<V, U>
+    constexpr dual(const U& val) : val(val), der() {}
+};
+
+template<typename V>
+constexpr auto operator-(const dual<V>& x) -> dual<V>
+{
+    return {- x.val, - x.der};
+}
+
+template<typename V>
+constexpr auto operator+(const dual<V>& x, const dual<V>& y) -> dual<V>
+{
+    return {x.val + y.val, x.der + y.der};
+}
+
+template<typename V>
+constexpr auto operator-(const dual<V>& x, const dual<V>& y) -> dual<V>
+{
+    return {x.val - y.val, x.der - y.der};
+}
+
+template<typename V>
+constexpr auto operator*(const dual<V>& x, const dual<V>& y) -> dual<V>
+{
+    return {x.val * y.val, x.der * y.val + x.val * y.der};
+}
+
+template<typename V>
+constexpr auto operator/(const dual<V>& x, const dual<V>& y) -> dual<V>
+{
+    auto q = x.val / y.val;
+    return {q, (x.der - q * y.der) / y.val};
+}
+
+/**
+ * @brief Square root, needed by the derivatives of the inverse functions.
+*/
+template<typename V>
+inline auto sqrt(const dual<V>& x) -> dual<V>
+{
+    using std::sqrt;
+    auto r = sqrt(x.val);
+    return {r, x.der / (V(2) * r)};
+}
+
+/**
+ * @brief Evaluates a function of one variable, with the operation known at
+ * compile time. Gives the same results as the functions returned by get_func.
+ *
+ * @tparam op Operation with type FUNC.
+ * @param z Argument of the function.
+ * @return Value of the function at z.
+*/
+template<operation op, std::floating_point T>
+inline auto apply_func(std::complex<T> z) -> std::complex<T>
+{
+    if constexpr (op == NEG)        return - z;
+    else if constexpr (op == RE)    return z.real();
+    else if constexpr (op == IM)    return z.imag();
+    else if constexpr (op == ABS)   return std::abs(z);
+    else if constexpr (op == ARG)   return std::arg(z);
+    else if constexpr (op == CONJ)  return std::conj(z);
+    else if constexpr (op == EXP)   return std::exp(z);
+    else if constexpr (op == LOG)   return std::log(z);
+    else if constexpr (op == COS)   return std::cos(z);
+    else if constexpr (op == SIN)   return std::sin(z);
+    else if constexpr (op == TAN)   return std::tan(z);
+    else if constexpr (op == SEC)   return (T) 1.0 / std::cos(z);
+    else if constexpr (op == CSC)   return (T) 1.0 / std::sin(z);
+    else if constexpr (op == COT)   return (T) 1.0 / std::tan(z);
+    else if constexpr (op == ACOS)  return std::acos(z);
+    else if constexpr (op == ASIN)  return std::asin(z);
+    else if constexpr (op == ATAN)  return std::atan(z);
+    else if constexpr (op == COSH)  return std::cosh(z);
+    else if constexpr (op == SINH)  return std::sinh(z);
+    else if constexpr (op == TANH)  return std::tanh(z);
+    else if constexpr (op == ACOSH) return std::acosh(z);
+    else if constexpr (op == ASINH) return std::asinh(z);
+    else if constexpr (op == ATANH) return std::atanh(z);
+    else if constexpr (op == DERIV) return 0;
+    else static_assert(op == NEG, "Operation is not a function.");
+}
+
+/**
+ * @brief Evaluates a function of one variable on a dual number, with the
+ * operation known at compile time, so that the derivative comes out with the
+ * value by the chain rule.
+ *
+ * RE, IM, ABS, ARG and CONJ are not holomorphic, so they have no complex
+ * derivative. They are differentiated along the real axis instead, i.e., as
+ * functions of a real variable, which for a holomorphic argument is what the
+ * symbolic rules d re(f) = re(f') and so on give.
+ *
+ * @tparam op Operation with type FUNC.
+ * @param x Argument of the function.
+ * @return Value and derivative of the function at x.
+*/
+template<operation op, typename V>
+inline auto apply_func(const dual<V>& x) -> dual<V>
+{
+    using std::sqrt;
+
+    auto f = apply_func<op>(x.val);
+    auto one = V(1);
+
+    if constexpr (op == NEG)        return {f, - x.der};
+    else if constexpr (op == RE)    return {f, apply_func<RE>(x.der)};
+    else if constexpr (op == IM)    return {f, apply_func<IM>(x.der)};
+    else if constexpr (op == CONJ)  return {f, apply_func<CONJ>(x.der)};
+    else if constexpr (op == ABS)   return {f, apply_func<RE>(apply_func<CONJ>(x.val) * x.der) / f};
+    else if constexpr (op == ARG)   return {f, apply_func<IM>(x.der / x.val)};
+    else if constexpr (op == EXP)   return {f, f * x.der};
+    else if constexpr (op == LOG)   return {f, x.der / x.val};
+    else if constexpr (op == COS)   return {f, - apply_func<SIN>(x.val) * x.der};
+    else if constexpr (op == SIN)   return {f, apply_func<COS>(x.val) * x.der};
+    else if constexpr (op == TAN)   return {f, (one + f * f) * x.der};
+    else if constexpr (op == SEC)   return {f, f * apply_func<TAN>(x.val) * x.der};
+    else if constexpr (op == CSC)   return {f, - f * apply_func<COT>(x.val) * x.der};
+    else if constexpr (op == COT)   return {f, - (one + f * f) * x.der};
+    else if constexpr (op == ACOS)  return {f, - x.der / sqrt((one - x.val) * (one + x.val))};
+    else if constexpr (op == ASIN)  return {f, x.der / sqrt((one - x.val) * (one + x.val))};
+    else if constexpr (op == ATAN)  return {f, x.der / (one + x.val * x.val)};
+    else if constexpr (op == COSH)  return {f, apply_func<SINH>(x.val) * x.der};
+    else if constexpr (op == SINH)  return {f, apply_func<COSH>(x.val) * x.der};
+    else if constexpr (op == TANH)  return {f, (one - f * f) * x.der};
+    else if constexpr (op == ACOSH) return {f, x.der / (sqrt(x.val - one) * sqrt(x.val + one))};
+    else if constexpr (op == ASINH) return {f, x.der / sqrt(x.val * x.val + one)};
+    else if constexpr (op == ATANH) return {f, x.der / ((one - x.val) * (one + x.val))};
+    else if constexpr (op == DERIV) return {f, V(0)};
+    else static_assert(op == NEG, "Operation is not a function.");
+}
+
+/**
+ * @brief Evaluates a function of one variable on a dual number, with the
+ * operation only known at runtime.
+ *
+ * @param op Operation with type FUNC.
+ * @param x Argument of the function.
+ * @return Value and derivative of the function at x.
+ * @throw invalid_argument if op is not a function.
+*/
+template<typename V>
+inline auto apply_func(operation op, const dual<V>& x) -> dual<V>
+{
+    switch (op)
+    {
+        case NEG:   return apply_func<NEG>(x);
+        case RE:    return apply_func<RE>(x);
+        case IM:    return apply_func<IM>(x);
+        case ABS:   return apply_func<ABS>(x);
+        case ARG:   return apply_func<ARG>(x);
+        case CONJ:  return apply_func<CONJ>(x);
+        case EXP:   return apply_func<EXP>(x);
+        case LOG:   return apply_func<LOG>(x);
+        case COS:   return apply_func<COS>(x);
+        case SIN:   return apply_func<SIN>(x);
+        case TAN:   return apply_func<TAN>(x);
+        case SEC:   return apply_func<SEC>(x);
+        case CSC:   return apply_func<CSC>(x);
+        case COT:   return apply_func<COT>(x);
+        case ACOS:  return apply_func<ACOS>(x);
+        case ASIN:  return apply_func<ASIN>(x);
+        case ATAN:  return apply_func<ATAN>(x);
+        case COSH:  return apply_func<COSH>(x);
+        case SINH:  return apply_func<SINH>(x);
+        case TANH:  return apply_func<TANH>(x);
+        case ACOSH: return apply_func<ACOSH>(x);
+        case ASINH: return apply_func<ASINH>(x);
+        case ATANH: return apply_func<ATANH>(x);
+        case DERIV: return apply_func<DERIV>(x);
+        default:    throw std::invalid_argument("Function not found.");
+    }
+}
+
+/**
+ * @brief Whether a value, and for a dual number every derivative it carries,
+ * is zero.
+*/
+template<std::floating_point T>
+constexpr auto is_zero(const std::complex<T>& z) -> bool
+{
+    return z == (T) 0;
+}
+
+template<typename V>
+constexpr auto is_zero(const dual<V>& x) -> bool
+{
+    return is_zero(x.val) && is_zero(x.der);
+}
+
+/**
+ * @brief Evaluates f^g on dual numbers, using d(f^g) = f^g (g' log(f) + g f' / f),
+ * or d(f^g) = g f^(g - 1) f' for a constant exponent, which is also defined
+ * at f = 0.
+*/
+template<typename V>
+inline auto pow(const dual<V>& x, const dual<V>& y) -> dual<V>
+{
+    using std::pow;
+
+    auto p = pow(x.val, y.val);
+    if (is_zero(y.der))
+    {
+        return {p, y.val * pow(x.val, y.val - V(1)) * x.der};
+    }
+    return {p, p * (y.der * apply_func<LOG>(x.val) + y.val * x.der / x.val)};
+}
+
+/**
+ * @brief Evaluates a binary operation, with the operation known at compile
+ * time. Works on std::complex<T> and on dual numbers alike.
+ *
+ * @tparam op Operation with type BIN_OP.
+ * @param x Left argument of the operation.
+ * @param y Right argument of the operation.
+ * @return Value of x · y, where · is the binary operation.
+*/
+template<operation op, typename V>
+inline auto apply_bin_op(const V& x, const V& y) -> V
+{
+    using std::pow;
+
+    if constexpr (op == ADD)      return x + y;
+    else if constexpr (op == SUB) return x - y;
+    else if constexpr (op == MUL) return x * y;
+    else if constexpr (op == DIV) return x / y;
+    else if constexpr (op == POW) return pow(x, y);
+    else static_assert(op == ADD, "Operation is not a binary operation.");
+}
+
+};
@@ -0,0 +1,695 @@
+/**
+ * @file gpu.h
+ * @brief Contains a GPU backend for evaluating compiled expressions over
+ * large grids of points with CUDA, and evaluate_grid, which picks the GPU or
+ * the threads of the CPU at runtime.
+ *
+ * The GPU backend is only built with the PARSER_CUDA option in
+ * CMakeLists.txt, which needs the CUDA driver and NVRTC. Without it,
+ * gpu_available is false and evaluate_grid always runs on the CPU, so
+ * CPU-only builds need nothing else.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef PARSER_CUDA
+#include <cuda.h>
+#include <nvrtc.h>
+#endif
+
+#include "compiled.h"
+#include "parallel.h"
+#include "thread_pool.h"
+
+#ifndef PARSER_CUDA_INCLUDE
+#define PARSER_CUDA_INCLUDE "/usr/local/cuda/include"
+#endif
+
+namespace parser
+{
+
+/**
+ * @brief Where evaluate_grid evaluates.
+*/
+enum class backend : std::uint8_t
+{
+    CPU, // Threads of a thread pool, see parallel_evaluate
+    GPU, // The first CUDA device, see gpu_expr
+    AUTO // The GPU if there is one that can evaluate the expression, else the CPU
+};
+
+// Largest number of values on the stack and in the temporaries of an
+// expression evaluated on the GPU, which are kept in registers and local
+// memory of every thread.
+inline constexpr size_t gpu_stack_size = 32;
+
+// Number of points evaluated by one launch of the grid kernel. The values of
+// one band are copied back while the next band is evaluated.
+inline constexpr size_t gpu_band_size = 1 << 20;
+
+// Source of the kernels run on the GPU, compiled by NVRTC once per process.
+// Every thread interprets the instructions of a compiled expression at one
+// point, so one module evaluates every expression, and its code and constant
+// pool are only uploaded once per gpu_expr. The opcodes and the layout of an
+// instruction must match those of compiled.h.
+inline constexpr const char* gpu_kernel_source = R"(
+#include <cuda/std/complex>
+
+using cuda::std::complex;
+
+enum op : unsigned char { VAR, CONST, LOAD, STORE, ADD, SUB, MUL, DIV, POW, POWI, SQRT, NEG, RE, IM, ABS, ARG, CONJ, EXP, LOG, COS, SIN, TAN, SEC, CSC, COT, ACOS, ASIN, ATAN, COSH, SINH, TANH, ACOSH, ASINH, ATANH, DERIV, SINCOS, SINHCOSH, POWLOG };
+
+struct instruction
+{
+    unsigned char op;
+    unsigned int arg;
+};
+
+template<typename T>
+__device__ complex<T> powi(complex<T> z, int p)
+{
+    complex<T> result = 1;
+    for (unsigned e = p < 0 ? - (unsigned) p : (unsigned) p; e != 0; e >>= 1)
+    {
+        if (e & 1) result *= z;
+        if (e > 1) z *= z;
+    }
+    return p < 0 ? (T) 1 / result : result;
+}
+
+template<typename T>
+__device__ complex<T> run(const instruction* code, unsigned size, const complex<T>* consts, unsigned depth, complex<T> z)
+{
+    complex<T> stack[PARSER_GPU_STACK];
+    complex<T>* temps = stack + depth;
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < size; i++)
+    {
+        const instruction ins = code[i];
+        complex<T>& x = stack[n > 0 ? n - 1 : 0];
+
+        switch (ins.op)
+        {
+            case VAR:   stack[n++] = z; break;
+            case CONST: stack[n++] = consts[ins.arg]; break;
+            case LOAD:  stack[n++] = temps[ins.arg]; break;
+            case STORE: temps[ins.arg] = x; break;
+            case ADD:   n--; stack[n - 1] += stack[n]; break;
+            case SUB:   n--; stack[n - 1] -= stack[n]; break;
+            case MUL:   n--; stack[n - 1] *= stack[n]; break;
+            case DIV:   n--; stack[n - 1] /= stack[n]; break;
+            case POW:   n--; stack[n - 1] = cuda::std::pow(stack[n - 1], stack[n]); break;
+            case POWI:  x = powi(x, (int) ins.arg); break;
+            case SQRT:  x = cuda::std::sqrt(x); break;
+            case NEG:   x = - x; break;
+            case RE:    x = x.real(); break;
+            case IM:    x = x.imag(); break;
+            case ABS:   x = cuda::std::abs(x); break;
+            case ARG:   x = cuda::std::arg(x); break;
+            case CONJ:  x = cuda::std::conj(x); break;
+            case EXP:   x = cuda::std::exp(x); break;
+            case LOG:   x = cuda::std::log(x); break;
+            case COS:   x = cuda::std::cos(x); break;
+            case SIN:   x = cuda::std::sin(x); break;
+            case TAN:   x = cuda::std::tan(x); break;
+            case SEC:   x = (T) 1 / cuda::std::cos(x); break;
+            case CSC:   x = (T) 1 / cuda::std::sin(x); break;
+            case COT:   x = (T) 1 / cuda::std::tan(x); break;
+            case ACOS:  x = cuda::std::acos(x); break;
+            case ASIN:  x = cuda::std::asin(x); break;
+            case ATAN:  x = cuda::std::atan(x); break;
+            case COSH:  x = cuda::std::cosh(x); break;
+            case SINH:  x = cuda::std::sinh(x); break;
+            case TANH:  x = cuda::std::tanh(x); break;
+            case ACOSH: x = cuda::std::acosh(x); break;
+            case ASINH: x = cuda::std::asinh(x); break;
+            case ATANH: x = cuda::std::atanh(x); break;
+            case DERIV: x = 0; break;
+            case SINCOS:
+            case SINHCOSH:
+            {
+                // As in eval_fused
+                bool hyperbolic = ins.op == SINHCOSH;
+                complex<T> w = stack[--n];
+                T a = hyperbolic ? w.imag() : w.real(), b = hyperbolic ? w.real() : w.imag();
+                T s = sin(a), c = cos(a), sh = sinh(b), ch = cosh(b);
+                complex<T> first = hyperbolic ? complex<T>(sh * c, ch * s) : complex<T>(s * ch, c * sh);
+                complex<T> second = hyperbolic ? complex<T>(ch * c, sh * s) : complex<T>(c * ch, - s * sh);
+                if (!isfinite(first.real()) || !isfinite(first.imag()) || !isfinite(second.real()) || !isfinite(second.imag()))
+                {
+                    first = hyperbolic ? cuda::std::sinh(w) : cuda::std::sin(w);
+                    second = hyperbolic ? cuda::std::cosh(w) : cuda::std::cos(w);
+                }
+                temps[ins.arg] = first;
+                temps[ins.arg + 1] = second;
+                break;
+            }
+            case POWLOG:
+            {
+                n -= 2;
+                complex<T> l = cuda::std::log(stack[n]);
+                temps[ins.arg] = stack[n] == (T) 0 ? cuda::std::pow(stack[n], stack[n + 1]) : cuda::std::exp(stack[n + 1] * l);
+                temps[ins.arg + 1] = l;
+                break;
+            }
+        }
+    }
+
+    return stack[0];
+}
+
+template<typename T>
+__device__ void grid(const instruction* code, unsigned size, const complex<T>* consts, unsigned depth, complex<T>* out, T re, T im, T dx, T dy, unsigned width, unsigned row, unsigned rows)
+{
+    unsigned x = blockIdx.x * blockDim.x + threadIdx.x;
+    unsigned y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x < width && y < rows)
+    {
+        complex<T> z(re + (x + (T) 0.5) * dx, im - (row + y + (T) 0.5) * dy);
+        out[(size_t) y * width + x] = run(code, size, consts, depth, z);
+    }
+}
+
+template<typename T>
+__device__ void points(const instruction* code, unsigned size, const complex<T>* consts, unsigned depth, const complex<T>* in, complex<T>* out, unsigned n)
+{
+    unsigned i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i < n)
+    {
+        out[i] = run(code, size, consts, depth, in[i]);
+    }
+}
+
+extern "C" __global__ void parser_gpu_grid_float(const instruction* code, unsigned size, const complex<float>* consts, unsigned depth, complex<float>* out, float re, float im, float dx, float dy, unsigned width, unsigned row, unsigned rows)
+{
+    grid(code, size, consts, depth, out, re, im, dx, dy, width, row, rows);
+}
+
+extern "C" __global__ void parser_gpu_grid_double(const instruction* code, unsigned size, const complex<double>* consts, unsigned depth, complex<double>* out, double re, double im, double dx, double dy, unsigned width, unsigned row, unsigned rows)
+{
+    grid(code, size, consts, depth, out, re, im, dx, dy, width, row, rows);
+}
+
+extern "C" __global__ void parser_gpu_points_float(const instruction* code, unsigned size, const complex<float>* consts, unsigned depth, const complex<float>* in, complex<float>* out, unsigned n)
+{
+    points(code, size, consts, depth, in, out, n);
+}
+
+extern "C" __global__ void parser_gpu_points_double(const instruction* code, unsigned size, const complex<double>* consts, unsigned depth, const complex<double>* in, complex<double>* out, unsigned n)
+{
+    points(code, size, consts, depth, in, out, n);
+}
+)";
+
+static_assert(opcode_count == 38 && sizeof(instruction) == 8, "Opcodes of gpu_kernel_source do not match compiled.h.");
+
+#ifdef PARSER_CUDA
+
+/**
+ * @brief Throws if a call to the CUDA driver failed.
+ *
+ * @param result Result of the call.
+ * @param what Description of the call.
+ * @throw runtime_error if result is not CUDA_SUCCESS.
+*/
+inline void gpu_check(CUresult result, const char* what)
+{
+    if (result != CUDA_SUCCESS)
+    {
+        const char* error = nullptr;
+        cuGetErrorString(result, &error);
+        throw std::runtime_error(std::string("CUDA could not ") + what + ": " + (error ? error : "unknown error"));
+    }
+}
+
+/**
+ * @brief The first CUDA device, with the kernels of gpu_kernel_source loaded
+ * into its primary context.
+*/
+class gpu_device
+{
+private:
+    CUdevice m_device = 0;
+    CUcontext m_context = nullptr;
+    CUmodule m_module = nullptr;
+    CUfunction m_grid[2] = {};
+    CUfunction m_points[2] = {};
+
+public:
+    /**
+     * @brief Initializes the driver and compiles the kernels for the
+     * architecture of the device.
+     *
+     * @throw runtime_error if there is no device, or the kernels do not
+     * compile.
+    */
+    gpu_device()
+    {
+        gpu_check(cuInit(0), "be initialized");
+        gpu_check(cuDeviceGet(&m_device, 0), "find a device");
+        gpu_check(cuDevicePrimaryCtxRetain(&m_context, m_device), "create a context");
+        gpu_check(cuCtxSetCurrent(m_context), "set the context");
+
+        int major = 0, minor = 0;
+        gpu_check(cuDeviceGetAttribute(&major, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR, m_device), "read the compute capability");
+        gpu_check(cuDeviceGetAttribute(&minor, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR, m_device), "read the compute capability");
+
+        auto arch = "--gpu-architecture=compute_" + std::to_string(major) + std::to_string(minor);
+        auto stack = "-DPARSER_GPU_STACK=" + std::to_string(gpu_stack_size);
+        auto include = std::string("--include-path=") + PARSER_CUDA_INCLUDE;
+        const char* options[] = {arch.c_str(), stack.c_str(), include.c_str(), "--std=c++17"};
+
+        nvrtcProgram program;
+        if (nvrtcCreateProgram(&program, gpu_kernel_source, "parser_gpu.cu", 0, nullptr, nullptr) != NVRTC_SUCCESS)
+        {
+            throw std::runtime_error("NVRTC could not create the GPU kernels.");
+        }
+
+        auto compiled = nvrtcCompileProgram(program, 4, options);
+        if (compiled != NVRTC_SUCCESS)
+        {
+            size_t size = 0;
+            nvrtcGetProgramLogSize(program, &size);
+            std::string log(size, '\0');
+            nvrtcGetProgramLog(program, log.data());
+            nvrtcDestroyProgram(&program);
+            throw std::runtime_error("NVRTC compilation of the GPU kernels failed: " + log);
+        }
+
+        size_t size = 0;
+        nvrtcGetPTXSize(program, &size);
+        std::string ptx(size, '\0');
+        nvrtcGetPTX(program, ptx.data());
+        nvrtcDestroyProgram(&program);
+
+        gpu_check(cuModuleLoadData(&m_module, ptx.data()), "load the GPU kernels");
+        gpu_check(cuModuleGetFunction(&m_grid[0], m_module, "parser_gpu_grid_float"), "find a GPU kernel");
+        gpu_check(cuModuleGetFunction(&m_grid[1], m_module, "parser_gpu_grid_double"), "find a GPU kernel");
+        gpu_check(cuModuleGetFunction(&m_points[0], m_module, "parser_gpu_points_float"), "find a GPU kernel");
+        gpu_check(cuModuleGetFunction(&m_points[1], m_module, "parser_gpu_points_double"), "find a GPU kernel");
+    }
+
+    gpu_device(const gpu_device&) = delete;
+    auto operator=(const gpu_device&) -> gpu_device& = delete;
+
+    ~gpu_device()
+    {
+        cuModuleUnload(m_module);
+        cuDevicePrimaryCtxRelease(m_device);
+    }
+
+    /**
+     * @brief Makes the context of the device current on the calling thread,
+     * as every thread calling the driver needs.
+    */
+    void bind() const
+    {
+        gpu_check(cuCtxSetCurrent(m_context), "set the context");
+    }
+
+    /**
+     * @brief Kernel evaluating a grid of points of type T.
+    */
+    template<std::floating_point T>
+    auto grid_kernel() const noexcept -> CUfunction
+    {
+        return m_grid[std::is_same_v<T, double>];
+    }
+
+    /**
+     * @brief Kernel evaluating an array of points of type T.
+    */
+    template<std::floating_point T>
+    auto points_kernel() const noexcept -> CUfunction
+    {
+        return m_points[std::is_same_v<T, double>];
+    }
+
+    /**
+     * @brief Device shared by the whole process, set up on first use.
+     *
+     * @throw runtime_error if there is no device or the kernels do not
+     * compile, in which case the next call tries again.
+    */
+    static auto global() -> gpu_device&
+    {
+        static gpu_device device;
+        return device;
+    }
+};
+
+/**
+ * @brief Memory on the device, freed on destruction.
+*/
+class gpu_buffer
+{
+private:
+    CUdeviceptr m_data = 0;
+
+public:
+    /**
+     * @brief Allocates memory on the device, and copies to it if data is
+     * given.
+     *
+     * @param bytes Size of memory.
+     * @param data Bytes to copy to the memory, or nullptr.
+     * @throw runtime_error if the allocation or copy fails.
+    */
+    explicit gpu_buffer(size_t bytes, const void* data = nullptr)
+    {
+        gpu_check(cuMemAlloc(&m_data, std::max<size_t>(bytes, 1)), "allocate device memory");
+        if (data && bytes > 0)
+        {
+            auto copied = cuMemcpyHtoD(m_data, data, bytes);
+            if (copied != CUDA_SUCCESS)
+            {
+                cuMemFree(m_data);
+                gpu_check(copied, "copy to device memory");
+            }
+        }
+    }
+
+    gpu_buffer(const gpu_buffer&) = delete;
+    auto operator=(const gpu_buffer&) -> gpu_buffer& = delete;
+
+    ~gpu_buffer()
+    {
+        cuMemFree(m_data);
+    }
+
+    /**
+     * @brief Address of the memory on the device.
+    */
+    auto data() const noexcept -> CUdeviceptr
+    {
+        return m_data;
+    }
+};
+
+/**
+ * @brief A compiled expression uploaded to the GPU. Its instructions and
+ * constant pool are copied to the device once on construction, and every
+ * evaluation only moves points and values. Cheap to copy, since copies share
+ * the memory on the device.
+ *
+ * Values are found with the complex functions of the CUDA standard library,
+ * so they may differ from those of compiled_expr in the last few bits.
+ *
+ * @tparam T The floating point type (float or double) to use in the
+ * evaluation of the expression. Defaults to double.
+*/
+template<std::floating_point T = double>
+class gpu_expr
+{
+private:
+    static_assert(!std::is_same_v<T, long double>, "GPU expressions can only be evaluated in float or double.");
+
+    // Threads per block of a launch, and their shape for grids
+    static constexpr unsigned threads = 256;
+    static constexpr unsigned threads_x = 32;
+
+    std::shared_ptr<gpu_buffer> m_code;
+    std::shared_ptr<gpu_buffer> m_consts;
+    unsigned m_size = 0;
+    unsigned m_depth = 0;
+
+    void launch(CUfunction kernel, unsigned blocks_x, unsigned blocks_y, unsigned block_x, unsigned block_y, void** args, CUstream stream = nullptr) const
+    {
+        gpu_check(cuLaunchKernel(kernel, blocks_x, blocks_y, 1, block_x, block_y, 1, 0, stream, args, nullptr), "launch a GPU kernel");
+    }
+
+public:
+    /**
+     * @brief Default constructor.
+    */
+    gpu_expr() {};
+
+    /**
+     * @brief Uploads a compiled expression to the device.
+     *
+     * @param e Compiled expression.
+     *
+     * @return gpu_expr instance evaluating the expression.
+     * @throw invalid_argument if the expression has more than one variable,
+     * or needs more than gpu_stack_size values of stack and temporaries.
+     * @throw runtime_error if there is no device.
+    */
+    explicit gpu_expr(const compiled_expr<T>& e)
+    {
+        if (e.variables() > 1)
+        {
+            throw std::invalid_argument("Only expressions of one variable can be evaluated on the GPU.");
+        }
+
+        if (e.stack_depth() + e.temporaries() > gpu_stack_size)
+        {
+            throw std::invalid_argument("Expression needs too large a stack to be evaluated on the GPU.");
+        }
+
+        gpu_device::global().bind();
+
+        m_code = std::make_shared<gpu_buffer>(e.code().size_bytes(), e.code().data());
+        m_consts = std::make_shared<gpu_buffer>(e.constants().size_bytes(), e.constants().data());
+        m_size = (unsigned) e.code().size();
+        m_depth = (unsigned) e.stack_depth();
+    }
+
+    /**
+     * @brief Evaluates the expression at many points on the device. Safe to
+     * call from multiple threads at once.
+     *
+     * @param in Points to evaluate expression at.
+     * @param out Where the value of the expression at in[i] is written to
+     * out[i]. Must be the same size as in.
+     * @throw invalid_argument if in and out have different sizes.
+     * @throw runtime_error if the device fails.
+    */
+    void evaluate(std::span<const std::complex<T>> in, std::span<std::complex<T>> out) const
+    {
+        if (in.size() != out.size())
+        {
+            throw std::invalid_argument("Input and output of batch evaluation have different sizes.");
+        }
+
+        if (in.empty())
+        {
+            return;
+        }
+
+        auto& device = gpu_device::global();
+        device.bind();
+
+        gpu_buffer points(in.size_bytes(), in.data());
+        gpu_buffer values(out.size_bytes());
+
+        auto code = m_code->data(), consts = m_consts->data(), src = points.data(), dst = values.data();
+        auto size = m_size, depth = m_depth, n = (unsigned) in.size();
+        void* args[] = {&code, &size, &consts, &depth, &src, &dst, &n};
+
+        launch(device.template points_kernel<T>(), (n + threads - 1) / threads, 1, threads, 1, args);
+        gpu_check(cuMemcpyDtoH(out.data(), values.data(), out.size_bytes()), "copy from device memory");
+    }
+
+    /**
+     * @brief Evaluates the expression over a grid of width × height points
+     * covering a region of the complex plane, with the points placed as in
+     * for_each_tile. The points are found on the device, so only values are
+     * copied, one band of rows at a time: the values of a band are copied
+     * back while the next is evaluated.
+     *
+     * @param r Region of the complex plane to evaluate over.
+     * @param width Number of points along the real axis.
+     * @param height Number of points along the imaginary axis.
+     * @param out Where the value at pixel (x, y) is written to
+     * out[y * width + x]. Must have width * height values.
+     * @throw invalid_argument if out has the wrong size.
+     * @throw runtime_error if the device fails.
+    */
+    void evaluate(region<T> r, size_t width, size_t height, std::span<std::complex<T>> out) const
+    {
+        if (out.size() != width * height)
+        {
+            throw std::invalid_argument("Output of grid evaluation has the wrong size.");
+        }
+
+        if (out.empty())
+        {
+            return;
+        }
+
+        auto& device = gpu_device::global();
+        device.bind();
+
+        T re = r.min.real(), im = r.max.imag();
+        T dx = (r.max.real() - re) / width;
+        T dy = (im - r.min.imag()) / height;
+
+        auto rows = (unsigned) std::max<size_t>(gpu_band_size / width, 1);
+        auto band = rows * width;
+
+        // Two bands in flight, each with its own stream, device memory and
+        // page-locked staging memory to copy back to
+        struct lane
+        {
+            CUstream stream = nullptr;
+            void* staging = nullptr;
+            size_t first = 0, size = 0;
+        };
+
+        gpu_buffer values[2] = {gpu_buffer(band * sizeof(std::complex<T>)), gpu_buffer(band * sizeof(std::complex<T>))};
+        lane lanes[2];
+
+        auto release = [&]
+        {
+            for (auto& l: lanes)
+            {
+                if (l.stream) cuStreamDestroy(l.stream);
+                if (l.staging) cuMemFreeHost(l.staging);
+            }
+        };
+
+        // Waits for the band of a lane and moves its values to out
+        auto drain = [&](lane& l)
+        {
+            if (l.size > 0)
+            {
+                gpu_check(cuStreamSynchronize(l.stream), "evaluate a grid");
+                auto staged = static_cast<const std::complex<T>*>(l.staging);
+                std::copy(staged, staged + l.size, out.begin() + l.first);
+                l.size = 0;
+            }
+        };
+
+        try
+        {
+            for (auto& l: lanes)
+            {
+                gpu_check(cuStreamCreate(&l.stream, CU_STREAM_NON_BLOCKING), "create a stream");
+                gpu_check(cuMemAllocHost(&l.staging, band * sizeof(std::complex<T>)), "allocate page-locked memory");
+            }
+
+            auto code = m_code->data(), consts = m_consts->data();
+            auto size = m_size, depth = m_depth, w = (unsigned) width;
+
+            for (size_t row = 0, k = 0; row < height; row += rows, k ^= 1)
+            {
+                auto& l = lanes[k];
+                drain(l);
+
+                auto dst = values[k].data();
+                auto first = (unsigned) row, count = (unsigned) std::min<size_t>(rows, height - row);
+                void* args[] = {&code, &size, &consts, &depth, &dst, &re, &im, &dx, &dy, &w, &first, &count};
+
+                launch(device.template grid_kernel<T>(), (w + threads_x - 1) / threads_x, (count + threads / threads_x - 1) / (threads / threads_x), threads_x, threads / threads_x, args, l.stream);
+
+                l.first = row * width;
+                l.size = count * width;
+                gpu_check(cuMemcpyDtoHAsync(l.staging, dst, l.size * sizeof(std::complex<T>), l.stream), "copy from device memory");
+            }
+
+            drain(lanes[0]);
+            drain(lanes[1]);
+        }
+        catch (...)
+        {
+            for (auto& l: lanes)
+            {
+                if (l.stream) cuStreamSynchronize(l.stream);
+            }
+            release();
+            throw;
+        }
+
+        release();
+    }
+};
+
+#endif
+
+/**
+ * @brief Whether a CUDA device is there to evaluate on. Always false unless
+ * built with the PARSER_CUDA option.
+*/
+inline auto gpu_available() -> bool
+{
+#ifdef PARSER_CUDA
+    try
+    {
+        gpu_device::global();
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Evaluates a compiled expression over a grid of width × height
+ * points covering a region of the complex plane, on the backend picked at
+ * runtime, with the points placed as in for_each_tile. Uploads the
+ * expression on every call; construct a gpu_expr to evaluate the same
+ * expression on the GPU many times.
+ *
+ * AUTO evaluates on the GPU if gpu_available, T is float or double, and the
+ * expression fits the GPU (see gpu_expr), and on the CPU otherwise.
+ *
+ * @param e Compiled expression to evaluate.
+ * @param r Region of the complex plane to evaluate over.
+ * @param width Number of points along the real axis.
+ * @param height Number of points along the imaginary axis.
+ * @param out Where the value at pixel (x, y) is written to
+ * out[y * width + x]. Must have width * height values.
+ * @param where Backend to evaluate on. Defaults to AUTO.
+ * @param pool Thread pool to evaluate on if on the CPU. Defaults to
+ * thread_pool::global().
+ *
+ * @return Backend the grid was evaluated on, CPU or GPU.
+ * @throw invalid_argument if out has the wrong size, or the expression can
+ * not be evaluated on the GPU asked for.
+ * @throw runtime_error if GPU is asked for and no device is available.
+*/
+template<std::floating_point T>
+auto evaluate_grid(const compiled_expr<T>& e, region<T> r, size_t width, size_t height, std::span<std::complex<T>> out, backend where = backend::AUTO, thread_pool& pool = thread_pool::global()) -> backend
+{
+    if (where == backend::AUTO)
+    {
+        auto fits = !std::is_same_v<T, long double> && e.variables() <= 1 && e.stack_depth() + e.temporaries() <= gpu_stack_size;
+        where = fits && gpu_available() ? backend::GPU : backend::CPU;
+    }
+
+    if (where == backend::GPU)
+    {
+#ifdef PARSER_CUDA
+        if constexpr (!std::is_same_v<T, long double>)
+        {
+            gpu_expr<T>(e).evaluate(r, width, height, out);
+            return backend::GPU;
+        }
+        throw std::invalid_argument("GPU expressions can only be evaluated in float or double.");
+#else
+        throw std::runtime_error("Built without the GPU backend, see the PARSER_CUDA option.");
+#endif
+    }
+
+    parallel_evaluate(e, r, width, height, out, pool);
+    return backend::CPU;
+}
+
+};
@@ -0,0 +1,202 @@
+/**
+ * @file instrument.h
+ * @brief Contains counters of the time spent and the memory allocated while
+ * parsing, converting to postfix, differentiating and compiling math
+ * expressions. Counters of the evaluators are in compiled.h (eval_profile).
+ *
+ * Allocations are counted by replacing the global operator new and operator
+ * delete, which may only be done once in a program. They are replaced in
+ * src/count_allocations.cpp, which only the binaries that profile allocations
+ * link; without it, the allocation counters stay at zero, and nothing else
+ * changes. counting_resource counts the allocations of the containers that
+ * take a memory resource, e.g., arena_expr, without replacing anything.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <string_view>
+
+#include "compiled.h"
+#include "derivative.h"
+#include "parser/compact.h"
+#include "parser/expression.h"
+
+namespace parser
+{
+
+/**
+ * @brief Number and total size of memory allocations.
+*/
+struct allocation_stats
+{
+    std::uint64_t count = 0; // Calls to operator new
+    std::uint64_t bytes = 0; // Bytes asked for by those calls
+};
+
+// Allocations made by this thread so far. Only counted when linked with
+// src/count_allocations.cpp, see the top of this file.
+inline thread_local allocation_stats thread_allocations;
+
+/**
+ * @brief Counts the allocations made by this thread while calling a function.
+ *
+ * @param f Function to call.
+ * @return Allocations made by f.
+*/
+template<typename function>
+auto count_allocations(function&& f) -> allocation_stats
+{
+    auto before = thread_allocations;
+    f();
+    return {thread_allocations.count - before.count, thread_allocations.bytes - before.bytes};
+}
+
+/**
+ * @brief Memory resource that counts the allocations made through it, and
+ * passes them on to another resource. Is its own hook for counting, so it
+ * can be used where the global operator new can not be replaced, e.g., in a
+ * program that already replaces it. Not safe to use from multiple threads at
+ * once, as other memory resources.
+ *
+ * For example, with std::pmr::set_default_resource(&counter), every
+ * arena_expr parsed, converted to postfix or differentiated afterwards
+ * allocates through counter.
+*/
+class counting_resource : public std::pmr::memory_resource
+{
+    std::pmr::memory_resource* m_upstream;
+    allocation_stats m_stats;
+    std::uint64_t m_live = 0;
+    std::uint64_t m_peak = 0;
+
+    auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override
+    {
+        auto p = m_upstream->allocate(bytes, alignment);
+        m_stats.count++;
+        m_stats.bytes += bytes;
+        m_live += bytes;
+        m_peak = std::max(m_peak, m_live);
+        return p;
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        m_upstream->deallocate(p, bytes, alignment);
+        m_live -= bytes;
+    }
+
+    auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override
+    {
+        return this == &other;
+    }
+
+public:
+    /**
+     * @brief Constructs a resource that has counted nothing yet.
+     *
+     * @param upstream Resource to allocate from. Defaults to
+     * std::pmr::new_delete_resource().
+     *
+     * @return counting_resource instance.
+    */
+    explicit counting_resource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource()) :
+        m_upstream(upstream)
+    {
+    }
+
+    /**
+     * @brief Allocations made through the resource so far.
+    */
+    auto stats() const noexcept -> allocation_stats
+    {
+        return m_stats;
+    }
+
+    /**
+     * @brief Bytes allocated through the resource and not deallocated yet.
+    */
+    auto live_bytes() const noexcept -> std::uint64_t
+    {
+        return m_live;
+    }
+
+    /**
+     * @brief Largest value of live_bytes so far.
+    */
+    auto peak_bytes() const noexcept -> std::uint64_t
+    {
+        return m_peak;
+    }
+};
+
+/**
+ * @brief Cost of one stage of turning a string into a compiled expression.
+*/
+struct stage_profile
+{
+    allocation_stats allocations; // Allocations made by the stage
+    std::uint64_t cycles = 0;     // Cycles spent in the stage, see read_cycles
+};
+
+/**
+ * @brief Costs of every stage of turning a string into a compiled expression,
+ * as measured by profile_pipeline.
+*/
+struct pipeline_profile
+{
+    stage_profile parse;          // Infix constructor of expr
+    stage_profile postfix;        // expr::postfix
+    stage_profile differentiate;  // differentiate of the postfix expression
+    stage_profile compile;        // compiled_expr constructor, simplifying first
+    size_t tokens = 0;            // Tokens of the infix expression
+    size_t derivative_tokens = 0; // Tokens of the derivative
+    size_t postfix_bytes = 0;     // Bytes of the tokens of the postfix expression
+    size_t compact_bytes = 0;     // Bytes of the postfix expression as a compact_expr
+};
+
+/**
+ * @brief Parses, converts to postfix, differentiates and compiles a math
+ * expression, measuring every stage.
+ *
+ * @tparam T Floating point type used by expression. Defaults to double.
+ * @param infix String representing an infix math expression.
+ *
+ * @return Costs of every stage.
+ * @throw invalid_argument if the expression is not well-formed or can not be
+ * differentiated.
+*/
+template<std::floating_point T = double>
+auto profile_pipeline(std::string_view infix) -> pipeline_profile
+{
+    pipeline_profile profile;
+
+    auto measure = [](stage_profile& stage, auto&& f)
+    {
+        auto start = read_cycles();
+        stage.allocations = count_allocations(f);
+        stage.cycles = read_cycles() - start;
+    };
+
+    expr<T> e, postfix, derivative;
+    compiled_expr<T> compiled;
+
+    measure(profile.parse, [&] { e = expr<T>(infix); });
+    measure(profile.postfix, [&] { postfix = e.postfix(); });
+    measure(profile.differentiate, [&] { derivative = differentiate(postfix); });
+    measure(profile.compile, [&] { compiled = compiled_expr<T>(postfix); });
+
+    profile.tokens = (size_t) std::distance(e.cbegin(), e.cend());
+    profile.derivative_tokens = (size_t) std::distance(derivative.cbegin(), derivative.cend());
+    profile.postfix_bytes = (size_t) std::distance(postfix.cbegin(), postfix.cend()) * sizeof(token<T>);
+    profile.compact_bytes = compact_expr<T>(postfix).bytes();
+    return profile;
+}
+
+};
@@ -0,0 +1,526 @@
+/**
+ * @file interval.h
+ * @brief Contains interval arithmetic on rectangles of the complex plane, for
+ * bounding the values of a math expression over a whole region at once.
+ *
+ * A complex_interval is the rectangle of the points whose real and imaginary
+ * parts lie in two intervals. Every operation on complex intervals gives a
+ * rectangle containing the values of the operation at every pair of points
+ * of its arguments, so evaluating an expression on the rectangle covering a
+ * region gives a rectangle containing every value of the expression over the
+ * region. The bound is often wider than the true range, as every occurrence
+ * of a variable is bounded on its own (e.g., z - z is not 0), but it shrinks
+ * with the region.
+ *
+ * Results are widened outward by a few units in the last place, to cover the
+ * rounding of the floating point operations used to find them. A NaN endpoint,
+ * e.g. from inf - inf, widens the interval to the whole real line, and so does
+ * division by an interval containing 0. Functions with branch cuts take the
+ * same branches as std::complex, giving the whole range of the function along
+ * the cut when a rectangle crosses it.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <concepts>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+
+#include "parser/token.h"
+
+namespace parser
+{
+
+/**
+ * @brief Closed interval [lo, hi] of the real line, possibly with infinite
+ * endpoints.
+ *
+ * @tparam T The floating point type (float, double or long double) of the
+ * endpoints.
+*/
+template<std::floating_point T>
+struct interval
+{
+    T lo; // Smallest value
+    T hi; // Largest value
+
+    constexpr interval() : lo(0), hi(0) {}
+
+    constexpr interval(T x) : lo(x), hi(x) {}
+
+    constexpr interval(T lo, T hi) : lo(lo), hi(hi) {}
+
+    /**
+     * @brief The whole real line.
+    */
+    static constexpr auto entire() -> interval
+    {
+        return {- std::numeric_limits<T>::infinity(), std::numeric_limits<T>::infinity()};
+    }
+
+    /**
+     * @brief Whether x is in the interval.
+    */
+    constexpr auto contains(T x) const -> bool
+    {
+        return lo <= x && x <= hi;
+    }
+
+    /**
+     * @brief Length of the interval.
+    */
+    constexpr auto width() const -> T
+    {
+        return hi - lo;
+    }
+};
+
+/**
+ * @brief Interval from exact endpoints, widened outward to cover rounding.
+ * Finite endpoints are moved by a few units in the last place, overflowed
+ * endpoints are pulled back to the largest finite value, and a NaN endpoint
+ * gives the whole real line.
+ *
+ * @param lo Smallest value, as rounded.
+ * @param hi Largest value, as rounded.
+ * @return Interval containing [lo, hi] before rounding.
+*/
+template<std::floating_point T>
+inline auto outward(T lo, T hi) -> interval<T>
+{
+    constexpr T slack = 4 * std::numeric_limits<T>::epsilon();
+    constexpr T tiny = std::numeric_limits<T>::denorm_min();
+
+    if (std::isnan(lo) || std::isnan(hi))
+    {
+        return interval<T>::entire();
+    }
+
+    lo = std::isfinite(lo) ? lo - std::abs(lo) * slack - tiny : std::min(lo, std::numeric_limits<T>::max());
+    hi = std::isfinite(hi) ? hi + std::abs(hi) * slack + tiny : std::max(hi, std::numeric_limits<T>::lowest());
+    return {lo, hi};
+}
+
+template<std::floating_point T>
+inline auto operator-(const interval<T>& x) -> interval<T>
+{
+    return {- x.hi, - x.lo};
+}
+
+template<std::floating_point T>
+inline auto operator+(const interval<T>& x, const interval<T>& y) -> interval<T>
+{
+    return outward(x.lo + y.lo, x.hi + y.hi);
+}
+
+template<std::floating_point T>
+inline auto operator-(const interval<T>& x, const interval<T>& y) -> interval<T>
+{
+    return outward(x.lo - y.hi, x.hi - y.lo);
+}
+
+template<std::floating_point T>
+inline auto operator*(const interval<T>& x, const interval<T>& y) -> interval<T>
+{
+    // 0 inf is taken as 0, as an infinite endpoint only stands for values
+    // that are too large to represent
+    auto mul = [](T a, T b) { return a == 0 || b == 0 ? (T) 0 : a * b; };
+
+    T p[] = {mul(x.lo, y.lo), mul(x.lo, y.hi), mul(x.hi, y.lo), mul(x.hi, y.hi)};
+    return outward(*std::min_element(p, p + 4), *std::max_element(p, p + 4));
+}
+
+template<std::floating_point T>
+inline auto operator/(const interval<T>& x, const interval<T>& y) -> interval<T>
+{
+    if (y.contains(0))
+    {
+        return interval<T>::entire();
+    }
+
+    T p[] = {x.lo / y.lo, x.lo / y.hi, x.hi / y.lo, x.hi / y.hi};
+    return outward(*std::min_element(p, p + 4), *std::max_element(p, p + 4));
+}
+
+/**
+ * @brief x^2, which unlike x x is never negative.
+*/
+template<std::floating_point T>
+inline auto sqr(const interval<T>& x) -> interval<T>
+{
+    auto a = x.lo * x.lo;
+    auto b = x.hi * x.hi;
+    return x.contains(0) ? outward((T) 0, std::max(a, b)) : outward(std::min(a, b), std::max(a, b));
+}
+
+template<std::floating_point T>
+inline auto exp(const interval<T>& x) -> interval<T>
+{
+    auto result = outward(std::exp(x.lo), std::exp(x.hi));
+    result.lo = std::max(result.lo, (T) 0);
+    return result;
+}
+
+/**
+ * @brief log(x) of an interval of x >= 0, where log(0) = -inf.
+*/
+template<std::floating_point T>
+inline auto log(const interval<T>& x) -> interval<T>
+{
+    return outward(std::log(std::max(x.lo, (T) 0)), std::log(std::max(x.hi, (T) 0)));
+}
+
+/**
+ * @brief sqrt(x) of an interval of x >= 0.
+*/
+template<std::floating_point T>
+inline auto sqrt(const interval<T>& x) -> interval<T>
+{
+    auto result = outward(std::sqrt(std::max(x.lo, (T) 0)), std::sqrt(std::max(x.hi, (T) 0)));
+    result.lo = std::max(result.lo, (T) 0);
+    return result;
+}
+
+/**
+ * @brief sin(x) or cos(x). The extremes are at the endpoints, unless a peak
+ * of the function is inside the interval.
+ *
+ * The peaks are found with the rounded π, so their positions are off by
+ * about |x| units in the last place. Near a peak the function is flat, so an
+ * endpoint that is that close to a peak missed is within the outward
+ * widening of it as long as |x| is below 1 / (8 sqrt(ε)), about 8e6 for
+ * double. Beyond that the bound is [-1, 1].
+ *
+ * @param phase Position of the first maximum, π/2 for sin and 0 for cos.
+*/
+template<std::floating_point T>
+inline auto periodic(const interval<T>& x, T phase, T (*f)(T)) -> interval<T>
+{
+    constexpr T pi = std::numbers::pi_v<T>;
+    const T large = 1 / (8 * std::sqrt(std::numeric_limits<T>::epsilon()));
+
+    if (!std::isfinite(x.lo) || !std::isfinite(x.hi) || x.width() >= 2 * pi || std::max(std::abs(x.lo), std::abs(x.hi)) > large)
+    {
+        return {-1, 1};
+    }
+
+    auto a = f(x.lo);
+    auto b = f(x.hi);
+    T lo = std::min(a, b);
+    T hi = std::max(a, b);
+
+    // First maximum and minimum at or after x.lo
+    if (phase + 2 * pi * std::ceil((x.lo - phase) / (2 * pi)) <= x.hi)
+    {
+        hi = 1;
+    }
+    if (phase + pi + 2 * pi * std::ceil((x.lo - phase - pi) / (2 * pi)) <= x.hi)
+    {
+        lo = -1;
+    }
+
+    auto result = outward(lo, hi);
+    return {std::max(result.lo, (T) -1), std::min(result.hi, (T) 1)};
+}
+
+template<std::floating_point T>
+inline auto sin(const interval<T>& x) -> interval<T>
+{
+    return periodic<T>(x, std::numbers::pi_v<T> / 2, [](T t) { return std::sin(t); });
+}
+
+template<std::floating_point T>
+inline auto cos(const interval<T>& x) -> interval<T>
+{
+    return periodic<T>(x, 0, [](T t) { return std::cos(t); });
+}
+
+template<std::floating_point T>
+inline auto sinh(const interval<T>& x) -> interval<T>
+{
+    return outward(std::sinh(x.lo), std::sinh(x.hi));
+}
+
+template<std::floating_point T>
+inline auto cosh(const interval<T>& x) -> interval<T>
+{
+    auto a = std::cosh(x.lo);
+    auto b = std::cosh(x.hi);
+    auto result = x.contains(0) ? outward((T) 1, std::max(a, b)) : outward(std::min(a, b), std::max(a, b));
+    result.lo = std::max(result.lo, (T) 1);
+    return result;
+}
+
+/**
+ * @brief Rectangle re + i im of the complex plane, the set of complex numbers
+ * whose real part is in re and whose imaginary part is in im.
+ *
+ * @tparam T The floating point type (float, double or long double) of the
+ * endpoints.
+*/
+template<std::floating_point T>
+struct complex_interval
+{
+    interval<T> re; // Real parts
+    interval<T> im; // Imaginary parts
+
+    constexpr complex_interval() = default;
+
+    constexpr complex_interval(interval<T> re, interval<T> im = 0) : re(re), im(im) {}
+
+    /**
+     * @brief Rectangle of a single point.
+    */
+    constexpr complex_interval(std::complex<T> z) : re(z.real()), im(z.imag()) {}
+
+    /**
+     * @brief Rectangle with two opposite corners.
+     *
+     * @param min Corner with smallest real and imaginary parts.
+     * @param max Corner with largest real and imaginary parts.
+    */
+    constexpr complex_interval(std::complex<T> min, std::complex<T> max) :
+        re(min.real(), max.real()),
+        im(min.imag(), max.imag())
+    {
+    }
+
+    /**
+     * @brief The whole complex plane.
+    */
+    static constexpr auto entire() -> complex_interval
+    {
+        return {interval<T>::entire(), interval<T>::entire()};
+    }
+
+    /**
+     * @brief Whether z is in the rectangle.
+    */
+    constexpr auto contains(std::complex<T> z) const -> bool
+    {
+        return re.contains(z.real()) && im.contains(z.imag());
+    }
+};
+
+template<std::floating_point T>
+inline auto operator-(const complex_interval<T>& x) -> complex_interval<T>
+{
+    return {- x.re, - x.im};
+}
+
+template<std::floating_point T>
+inline auto operator+(const complex_interval<T>& x, const complex_interval<T>& y) -> complex_interval<T>
+{
+    return {x.re + y.re, x.im + y.im};
+}
+
+template<std::floating_point T>
+inline auto operator-(const complex_interval<T>& x, const complex_interval<T>& y) -> complex_interval<T>
+{
+    return {x.re - y.re, x.im - y.im};
+}
+
+template<std::floating_point T>
+inline auto operator*(const complex_interval<T>& x, const complex_interval<T>& y) -> complex_interval<T>
+{
+    return {x.re * y.re - x.im * y.im, x.re * y.im + x.im * y.re};
+}
+
+/**
+ * @brief x / y = x conj(y) / |y|^2, which covers the whole plane if y
+ * contains 0.
+*/
+template<std::floating_point T>
+inline auto operator/(const complex_interval<T>& x, const complex_interval<T>& y) -> complex_interval<T>
+{
+    auto d = sqr(y.re) + sqr(y.im);
+    if (d.lo <= 0)
+    {
+        return complex_interval<T>::entire();
+    }
+
+    return {(x.re * y.re + x.im * y.im) / d, (x.im * y.re - x.re * y.im) / d};
+}
+
+/**
+ * @brief Multiplies by i.
+*/
+template<std::floating_point T>
+inline auto times_i(const complex_interval<T>& x) -> complex_interval<T>
+{
+    return {- x.im, x.re};
+}
+
+/**
+ * @brief |z| over the rectangle, from the point nearest to 0 to the corner
+ * furthest from it.
+*/
+template<std::floating_point T>
+inline auto abs(const complex_interval<T>& x) -> interval<T>
+{
+    auto nearest = [](const interval<T>& a) { return a.contains(0) ? (T) 0 : std::min(std::abs(a.lo), std::abs(a.hi)); };
+    auto furthest = [](const interval<T>& a) { return std::max(std::abs(a.lo), std::abs(a.hi)); };
+
+    auto result = outward(std::hypot(nearest(x.re), nearest(x.im)), std::hypot(furthest(x.re), furthest(x.im)));
+    result.lo = std::max(result.lo, (T) 0);
+    return result;
+}
+
+/**
+ * @brief arg(z) over the rectangle. A rectangle that does not contain 0 or
+ * cross the branch cut along the negative real axis has its extremes at
+ * corners; any other gives [-π, π].
+*/
+template<std::floating_point T>
+inline auto arg(const complex_interval<T>& x) -> interval<T>
+{
+    constexpr T pi = std::numbers::pi_v<T>;
+
+    if (x.re.lo < 0 && x.im.lo <= 0 && x.im.hi >= 0)
+    {
+        return outward(- pi, pi);
+    }
+
+    T a[] = {std::atan2(x.im.lo, x.re.lo), std::atan2(x.im.lo, x.re.hi), std::atan2(x.im.hi, x.re.lo), std::atan2(x.im.hi, x.re.hi)};
+    return outward(*std::min_element(a, a + 4), *std::max_element(a, a + 4));
+}
+
+/**
+ * @brief r e^(i t) over the intervals of r >= 0 and t.
+*/
+template<std::floating_point T>
+inline auto polar(const interval<T>& r, const interval<T>& t) -> complex_interval<T>
+{
+    return {r * cos(t), r * sin(t)};
+}
+
+template<std::floating_point T>
+inline auto exp(const complex_interval<T>& x) -> complex_interval<T>
+{
+    return polar(exp(x.re), x.im);
+}
+
+template<std::floating_point T>
+inline auto log(const complex_interval<T>& x) -> complex_interval<T>
+{
+    return {log(abs(x)), arg(x)};
+}
+
+template<std::floating_point T>
+inline auto sqrt(const complex_interval<T>& x) -> complex_interval<T>
+{
+    return polar(sqrt(abs(x)), arg(x) * interval<T>((T) 0.5));
+}
+
+/**
+ * @brief x^y = exp(y log(x)), as std::pow.
+*/
+template<std::floating_point T>
+inline auto pow(const complex_interval<T>& x, const complex_interval<T>& y) -> complex_interval<T>
+{
+    return exp(y * log(x));
+}
+
+/**
+ * @brief x^p for an integer p, by exponentiation by squaring.
+*/
+template<std::floating_point T>
+inline auto powi(const complex_interval<T>& x, int p) -> complex_interval<T>
+{
+    complex_interval<T> result = std::complex<T>(1), base = x;
+    for (unsigned e = p < 0 ? - (unsigned) p : (unsigned) p; e != 0; e >>= 1)
+    {
+        if (e & 1)
+        {
+            result = result * base;
+        }
+        if (e > 1)
+        {
+            base = base * base;
+        }
+    }
+
+    return p < 0 ? complex_interval<T>(std::complex<T>(1)) / result : result;
+}
+
+template<std::floating_point T>
+inline auto sin(const complex_interval<T>& x) -> complex_interval<T>
+{
+    return {sin(x.re) * cosh(x.im), cos(x.re) * sinh(x.im)};
+}
+
+template<std::floating_point T>
+inline auto cos(const complex_interval<T>& x) -> complex_interval<T>
+{
+    return {cos(x.re) * cosh(x.im), - (sin(x.re) * sinh(x.im))};
+}
+
+template<std::floating_point T>
+inline auto sinh(const complex_interval<T>& x) -> complex_interval<T>
+{
+    return {sinh(x.re) * cos(x.im), cosh(x.re) * sin(x.im)};
+}
+
+template<std::floating_point T>
+inline auto cosh(const complex_interval<T>& x) -> complex_interval<T>
+{
+    return {cosh(x.re) * cos(x.im), sinh(x.re) * sin(x.im)};
+}
+
+/**
+ * @brief Evaluates a function of one variable on a complex interval. The
+ * inverse functions are bounded through their expressions by logs and square
+ * roots, e.g. asin(z) = -i log(iz + sqrt(1 - z^2)), which take the same
+ * branches as std::complex.
+ *
+ * @param op Operation with type FUNC.
+ * @param x Argument of the function.
+ * @return Rectangle containing the values of the function over x.
+ * @throw invalid_argument if op is not a function.
+*/
+template<std::floating_point T>
+inline auto apply_func(operation op, const complex_interval<T>& x) -> complex_interval<T>
+{
+    using box = complex_interval<T>;
+
+    constexpr T pi = std::numbers::pi_v<T>;
+    const box one = std::complex<T>(1);
+    const box half = std::complex<T>((T) 0.5);
+
+    switch (op)
+    {
+        case NEG:   return - x;
+        case RE:    return {x.re, 0};
+        case IM:    return {x.im, 0};
+        case ABS:   return {abs(x), 0};
+        case ARG:   return {arg(x), 0};
+        case CONJ:  return {x.re, - x.im};
+        case EXP:   return exp(x);
+        case LOG:   return log(x);
+        case COS:   return cos(x);
+        case SIN:   return sin(x);
+        case TAN:   return sin(x) / cos(x);
+        case SEC:   return one / cos(x);
+        case CSC:   return one / sin(x);
+        case COT:   return cos(x) / sin(x);
+        case ASIN:  return - times_i(log(times_i(x) + sqrt(one - x * x)));
+        case ACOS:  return box(std::complex<T>(pi / 2)) + times_i(log(times_i(x) + sqrt(one - x * x)));
+        case ATAN:  return times_i(half * (log(one - times_i(x)) - log(one + times_i(x))));
+        case COSH:  return cosh(x);
+        case SINH:  return sinh(x);
+        case TANH:  return sinh(x) / cosh(x);
+        case ACOSH: return log(x + sqrt(x + one) * sqrt(x - one));
+        case ASINH: return log(x + sqrt(x * x + one));
+        case ATANH: return half * (log(one + x) - log(one - x));
+        case DERIV: return std::complex<T>(0);
+        default:    throw std::invalid_argument("Function not found.");
+    }
+}
+
+};
@@ -0,0 +1,766 @@
+/**
+ * @file jit.h
+ * @brief Contains a just-in-time compiler for math expressions. A compiled
+ * expression is translated into a C++ function with one straight-line loop
+ * body, which is compiled into a shared library by the system C++ compiler
+ * and loaded with dlopen. Only available on POSIX systems; see the PARSER_JIT
+ * option in CMakeLists.txt.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "compiled.h"
+
+#ifndef PARSER_JIT_COMPILER
+#define PARSER_JIT_COMPILER "c++"
+#endif
+
+extern char** environ;
+
+namespace parser
+{
+
+/**
+ * @brief Default directory of the shared libraries of the JIT, one per user,
+ * so no other user can put a library there for this one to load.
+*/
+inline auto jit_default_cache_dir() -> std::filesystem::path
+{
+    return std::filesystem::temp_directory_path() / ("math-parser-jit-" + std::to_string(getuid()));
+}
+
+/**
+ * @brief Options for the system compiler used by the JIT.
+*/
+struct jit_options
+{
+    // C++ compiler to run, looked up in PATH if it has no slash
+    std::string compiler = PARSER_JIT_COMPILER;
+
+    // Flags to compile with, separated by whitespace. They are passed to the
+    // compiler as they are, without a shell. -fno-math-errno lets the loop be
+    // vectorized around std::sqrt, as for the batch kernels.
+    std::string flags = "-O3 -march=native -fno-math-errno";
+
+    // Directory shared libraries are written to and looked up in, so an
+    // expression is only ever compiled once on a machine. Created with mode
+    // 0700 if it does not exist; it, and every library in it, must be owned
+    // by this user and writable by no one else.
+    std::filesystem::path cache_dir = jit_default_cache_dir();
+};
+
+/**
+ * @brief Translates a compiled expression into the source of a C++ function
+ *
+ *     extern "C" void parser_jit_evaluate(const T* in, T* out, size_t n)
+ *
+ * that evaluates the expression at the n complex values in[2i] + in[2i + 1] i
+ * and writes the results in the same layout to out.
+ *
+ * Every instruction becomes a few statements on named real and imaginary
+ * parts in a single loop body, so there is no stack and no dispatch, and the
+ * compiler can vectorize the loop over the points when every instruction is
+ * arithmetic. ADD, SUB, MUL, DIV, NEG, CONJ, RE, IM, ABS, SQRT and POWI use
+ * the same formulas as the kernels in kernels.h (POWI is unrolled), the
+ * fused opcodes the same formulas as eval_fused, and every other operation
+ * calls the std::complex function, as eval_func does.
+ *
+ * @param e Compiled expression to translate.
+ * @return Source of the function.
+ * @throw invalid_argument if the expression has more than one variable.
+*/
+template<std::floating_point T>
+auto jit_source(const compiled_expr<T>& e) -> std::string
+{
+    if (e.variables() > 1)
+    {
+        throw std::invalid_argument("Only expressions of one variable can be JIT compiled.");
+    }
+
+    std::ostringstream src;
+
+    const char* type = std::is_same_v<T, float> ? "float" : std::is_same_v<T, double> ? "double" : "long double";
+
+    src << "#include <algorithm>\n#include <cmath>\n#include <complex>\n#include <cstddef>\n#include <limits>\n\n";
+    src << "using T = " << type << ";\nusing C = std::complex<T>;\n\n";
+    src << "extern \"C\" void parser_jit_evaluate(const T* __restrict in, T* __restrict out, std::size_t n)\n{\n";
+    src << "    for (std::size_t i = 0; i < n; i++)\n    {\n";
+    src << "        const T x_re = in[2 * i];\n        const T x_im = in[2 * i + 1];\n";
+
+    // Names of the values on the stack and in the temporaries. A value is
+    // named v<k> with parts v<k>_re and v<k>_im.
+    std::vector<std::string> stack;
+    std::vector<std::string> temps(e.temporaries());
+    size_t next = 0;
+
+    auto line = [&](const std::string& s) { src << "        " << s << "\n"; };
+    auto define = [&](const std::string& re, const std::string& im)
+    {
+        auto v = "v" + std::to_string(next++);
+        line("const T " + v + "_re = " + re + ";");
+        line("const T " + v + "_im = " + im + ";");
+        return v;
+    };
+    auto literal = [&](T val) -> std::string
+    {
+        if (std::isnan(val))
+        {
+            return "std::numeric_limits<T>::quiet_NaN()";
+        }
+        else if (std::isinf(val))
+        {
+            return val > 0 ? "std::numeric_limits<T>::infinity()" : "- std::numeric_limits<T>::infinity()";
+        }
+
+        // Hexadecimal, so the value is written exactly
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%La", (long double) val);
+        return std::string("(T) ") + buffer + "L";
+    };
+    auto multiply = [&](const std::string& a, const std::string& b)
+    {
+        return define(a + "_re * " + b + "_re - " + a + "_im * " + b + "_im", a + "_re * " + b + "_im + " + a + "_im * " + b + "_re");
+    };
+    auto divide = [&](const std::string& a, const std::string& b)
+    {
+        // Denominator scaled by max(|c|, |d|) first, as in kernel_div
+        auto s = "s" + std::to_string(next);
+        line("const T " + s + " = std::max(std::abs(" + b + "_re), std::abs(" + b + "_im));");
+        line("const T " + s + "_c = " + b + "_re / " + s + ";");
+        line("const T " + s + "_d = " + b + "_im / " + s + ";");
+        line("const T " + s + "_denom = (" + s + "_c * " + s + "_c + " + s + "_d * " + s + "_d) * " + s + ";");
+        return define("(" + a + "_re * " + s + "_c + " + a + "_im * " + s + "_d) / " + s + "_denom", "(" + a + "_im * " + s + "_c - " + a + "_re * " + s + "_d) / " + s + "_denom");
+    };
+    auto call = [&](const std::string& f)
+    {
+        auto w = "w" + std::to_string(next);
+        line("const C " + w + " = " + f + ";");
+        return define(w + ".real()", w + ".imag()");
+    };
+
+    auto pop = [&]
+    {
+        auto v = stack.back();
+        stack.pop_back();
+        return v;
+    };
+
+    for (const auto& ins: e.code())
+    {
+        switch (ins.op)
+        {
+            case opcode::VAR:
+                stack.push_back("x");
+                break;
+            case opcode::CONST:
+            {
+                auto c = e.constants()[ins.arg];
+                stack.push_back(define(literal(c.real()), literal(c.imag())));
+                break;
+            }
+            case opcode::LOAD:
+                stack.push_back(temps[ins.arg]);
+                break;
+            case opcode::STORE:
+                temps[ins.arg] = stack.back();
+                break;
+            case opcode::ADD:
+            {
+                auto b = pop(), a = pop();
+                stack.push_back(define(a + "_re + " + b + "_re", a + "_im + " + b + "_im"));
+                break;
+            }
+            case opcode::SUB:
+            {
+                auto b = pop(), a = pop();
+                stack.push_back(define(a + "_re - " + b + "_re", a + "_im - " + b + "_im"));
+                break;
+            }
+            case opcode::MUL:
+            {
+                auto b = pop(), a = pop();
+                stack.push_back(multiply(a, b));
+                break;
+            }
+            case opcode::DIV:
+            {
+                auto b = pop(), a = pop();
+                stack.push_back(divide(a, b));
+                break;
+            }
+            case opcode::POW:
+            {
+                auto b = pop(), a = pop();
+                stack.push_back(call("std::pow(C(" + a + "_re, " + a + "_im), C(" + b + "_re, " + b + "_im))"));
+                break;
+            }
+            case opcode::POWI:
+            {
+                // Exponentiation by squaring, unrolled
+                auto p = (std::int32_t) ins.arg;
+                auto base = pop();
+                auto result = define("1", "0");
+
+                for (auto bits = p < 0 ? - (std::uint32_t) p : (std::uint32_t) p; bits != 0; bits >>= 1)
+                {
+                    if (bits & 1)
+                    {
+                        result = multiply(result, base);
+                    }
+                    if (bits > 1)
+                    {
+                        base = multiply(base, base);
+                    }
+                }
+
+                stack.push_back(p < 0 ? divide(define("1", "0"), result) : result);
+                break;
+            }
+            case opcode::SQRT:
+            {
+                // As in kernel_sqrt
+                auto a = pop();
+                auto s = "s" + std::to_string(next);
+                line("const T " + s + "_a = std::abs(" + a + "_re);");
+                line("const T " + s + "_b = std::abs(" + a + "_im);");
+                line("const T " + s + " = std::max(" + s + "_a, " + s + "_b);");
+                line("const T " + s + "_u = " + s + " + (T) (" + s + " == 0);");
+                line("const T " + s + "_abs = " + s + " * std::sqrt((" + s + "_a / " + s + "_u) * (" + s + "_a / " + s + "_u) + (" + s + "_b / " + s + "_u) * (" + s + "_b / " + s + "_u));");
+                line("const T " + s + "_t = std::sqrt((" + s + "_abs + " + s + "_a) / 2);");
+                line("const T " + s + "_v = " + a + "_im / (2 * (" + s + "_t + (T) (" + s + "_t == 0)));");
+                stack.push_back(define(a + "_re >= 0 ? " + s + "_t : std::abs(" + s + "_v)", a + "_re >= 0 ? " + s + "_v : std::copysign(" + s + "_t, " + a + "_im)"));
+                break;
+            }
+            case opcode::NEG:
+            {
+                auto a = pop();
+                stack.push_back(define("- " + a + "_re", "- " + a + "_im"));
+                break;
+            }
+            case opcode::CONJ:
+            {
+                auto a = pop();
+                stack.push_back(define(a + "_re", "- " + a + "_im"));
+                break;
+            }
+            case opcode::RE:
+            {
+                auto a = pop();
+                stack.push_back(define(a + "_re", "0"));
+                break;
+            }
+            case opcode::IM:
+            {
+                auto a = pop();
+                stack.push_back(define(a + "_im", "0"));
+                break;
+            }
+            case opcode::ABS:
+            {
+                // As in kernel_abs
+                auto a = pop();
+                auto s = "s" + std::to_string(next);
+                line("const T " + s + "_a = std::abs(" + a + "_re);");
+                line("const T " + s + "_b = std::abs(" + a + "_im);");
+                line("const T " + s + " = std::max(" + s + "_a, " + s + "_b);");
+                line("const T " + s + "_u = " + s + " + (T) (" + s + " == 0);");
+                stack.push_back(define(s + " * std::sqrt((" + s + "_a / " + s + "_u) * (" + s + "_a / " + s + "_u) + (" + s + "_b / " + s + "_u) * (" + s + "_b / " + s + "_u))", "0"));
+                break;
+            }
+            case opcode::SINCOS:
+            case opcode::SINHCOSH:
+            {
+                // As in eval_fused, sinh(a + bi) and cosh(a + bi) are found
+                // from sin(b + ai) and cos(b + ai)
+                bool hyperbolic = ins.op == opcode::SINHCOSH;
+                auto x = pop();
+                auto f = "f" + std::to_string(next);
+                auto a = x + (hyperbolic ? "_im" : "_re");
+                auto b = x + (hyperbolic ? "_re" : "_im");
+                auto z = "C(" + x + "_re, " + x + "_im)";
+                line("const T " + f + "_s = std::sin(" + a + "), " + f + "_c = std::cos(" + a + "), " + f + "_sh = std::sinh(" + b + "), " + f + "_ch = std::cosh(" + b + ");");
+                if (hyperbolic)
+                {
+                    line("C " + f + "_first(" + f + "_sh * " + f + "_c, " + f + "_ch * " + f + "_s), " + f + "_second(" + f + "_ch * " + f + "_c, " + f + "_sh * " + f + "_s);");
+                }
+                else
+                {
+                    line("C " + f + "_first(" + f + "_s * " + f + "_ch, " + f + "_c * " + f + "_sh), " + f + "_second(" + f + "_c * " + f + "_ch, - " + f + "_s * " + f + "_sh);");
+                }
+                line("if (!std::isfinite(" + f + "_first.real()) || !std::isfinite(" + f + "_first.imag()) || !std::isfinite(" + f + "_second.real()) || !std::isfinite(" + f + "_second.imag()))");
+                line("{");
+                line("    " + f + "_first = " + (hyperbolic ? "std::sinh(" : "std::sin(") + z + ");");
+                line("    " + f + "_second = " + (hyperbolic ? "std::cosh(" : "std::cos(") + z + ");");
+                line("}");
+                temps[ins.arg] = define(f + "_first.real()", f + "_first.imag()");
+                temps[ins.arg + 1] = define(f + "_second.real()", f + "_second.imag()");
+                break;
+            }
+            case opcode::POWLOG:
+            {
+                auto b = pop(), a = pop();
+                auto f = "f" + std::to_string(next);
+                auto base = "C(" + a + "_re, " + a + "_im)";
+                auto exponent = "C(" + b + "_re, " + b + "_im)";
+                line("const C " + f + "_log = std::log(" + base + ");");
+                line("const C " + f + "_pow = " + a + "_re == 0 && " + a + "_im == 0 ? std::pow(" + base + ", " + exponent + ") : std::exp(" + exponent + " * " + f + "_log);");
+                temps[ins.arg] = define(f + "_pow.real()", f + "_pow.imag()");
+                temps[ins.arg + 1] = define(f + "_log.real()", f + "_log.imag()");
+                break;
+            }
+            case opcode::DERIV:
+                pop();
+                stack.push_back(define("0", "0"));
+                break;
+            default:
+            {
+                auto a = pop();
+                auto z = "C(" + a + "_re, " + a + "_im)";
+                std::string f;
+
+                switch (ins.op)
+                {
+                    case opcode::ARG:   f = "C(std::arg(" + z + "))"; break;
+                    case opcode::EXP:   f = "std::exp(" + z + ")"; break;
+                    case opcode::LOG:   f = "std::log(" + z + ")"; break;
+                    case opcode::COS:   f = "std::cos(" + z + ")"; break;
+                    case opcode::SIN:   f = "std::sin(" + z + ")"; break;
+                    case opcode::TAN:   f = "std::tan(" + z + ")"; break;
+                    case opcode::SEC:   f = "(T) 1.0 / std::cos(" + z + ")"; break;
+                    case opcode::CSC:   f = "(T) 1.0 / std::sin(" + z + ")"; break;
+                    case opcode::COT:   f = "(T) 1.0 / std::tan(" + z + ")"; break;
+                    case opcode::ACOS:  f = "std::acos(" + z + ")"; break;
+                    case opcode::ASIN:  f = "std::asin(" + z + ")"; break;
+                    case opcode::ATAN:  f = "std::atan(" + z + ")"; break;
+                    case opcode::COSH:  f = "std::cosh(" + z + ")"; break;
+                    case opcode::SINH:  f = "std::sinh(" + z + ")"; break;
+                    case opcode::TANH:  f = "std::tanh(" + z + ")"; break;
+                    case opcode::ACOSH: f = "std::acosh(" + z + ")"; break;
+                    case opcode::ASINH: f = "std::asinh(" + z + ")"; break;
+                    case opcode::ATANH: f = "std::atanh(" + z + ")"; break;
+                    default:            throw std::invalid_argument("Opcode can not be compiled to native code.");
+                }
+
+                stack.push_back(call(f));
+                break;
+            }
+        }
+    }
+
+    src << "        out[2 * i] = " << stack.back() << "_re;\n";
+    src << "        out[2 * i + 1] = " << stack.back() << "_im;\n";
+    src << "    }\n}\n";
+
+    return src.str();
+}
+
+/**
+ * @brief Shared library loaded by the JIT, unloaded once the last expression
+ * using it is destroyed.
+*/
+class jit_module
+{
+private:
+    void* m_handle = nullptr;
+    void* m_function = nullptr;
+
+public:
+    /**
+     * @brief Loads a shared library and looks up parser_jit_evaluate in it.
+     *
+     * @param path Path of shared library.
+     * @throw runtime_error if the library can not be loaded.
+    */
+    explicit jit_module(const std::filesystem::path& path)
+    {
+        m_handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!m_handle)
+        {
+            throw std::runtime_error(std::string("Could not load JIT compiled expression: ") + dlerror());
+        }
+
+        m_function = dlsym(m_handle, "parser_jit_evaluate");
+        if (!m_function)
+        {
+            dlclose(m_handle);
+            throw std::runtime_error("JIT compiled expression has no parser_jit_evaluate.");
+        }
+    }
+
+    jit_module(const jit_module&) = delete;
+    auto operator=(const jit_module&) -> jit_module& = delete;
+
+    ~jit_module()
+    {
+        dlclose(m_handle);
+    }
+
+    /**
+     * @brief Address of parser_jit_evaluate.
+    */
+    auto function() const noexcept -> void*
+    {
+        return m_function;
+    }
+};
+
+/**
+ * @brief Cache of the shared libraries loaded by the JIT, keyed by a hash of
+ * their source. Expressions compiled to the same source share a library, so
+ * compiling an expression again is just a lookup. Safe to use from multiple
+ * threads at once. Libraries are compiled without holding the lock of the
+ * cache, so threads compiling different sources do not wait for each other,
+ * while a thread that wants a library another thread is compiling waits for
+ * it instead of compiling it again.
+*/
+class jit_cache
+{
+private:
+    std::mutex m_mutex;
+    std::unordered_map<std::uint64_t, std::weak_ptr<jit_module>> m_modules;
+
+    // Keys of the libraries being compiled, and signalled when one is done
+    std::unordered_set<std::uint64_t> m_building;
+    std::condition_variable m_built;
+
+    /**
+     * @brief 64-bit FNV-1a hash of a string.
+    */
+    static auto hash(const std::string& s) -> std::uint64_t
+    {
+        std::uint64_t h = 0xcbf29ce484222325;
+        for (unsigned char c: s)
+        {
+            h = (h ^ c) * 0x100000001b3;
+        }
+
+        return h;
+    }
+
+    /**
+     * @brief Checks that a file is owned by this user and can not be written
+     * by anyone else, so a library loaded from it is one this user built.
+     *
+     * @param path Path of the file, which is not followed if it is a link.
+     * @param directory Whether the file must be a directory, rather than a
+     * regular file.
+     * @throw runtime_error if the file is not safe to use.
+    */
+    static void check_owner(const std::filesystem::path& path, bool directory)
+    {
+        struct stat info;
+        if (lstat(path.c_str(), &info) != 0)
+        {
+            throw std::runtime_error("Could not stat " + path.string() + ".");
+        }
+
+        bool type = directory ? S_ISDIR(info.st_mode) : S_ISREG(info.st_mode);
+        if (!type || info.st_uid != getuid() || (info.st_mode & (S_IWGRP | S_IWOTH)))
+        {
+            throw std::runtime_error(path.string() + " is not owned by this user, or is writable by others, so the JIT does not use it.");
+        }
+    }
+
+    /**
+     * @brief Runs the compiler on a source file, without a shell, with its
+     * output written to a log file.
+     *
+     * @return Whether the compiler succeeded.
+    */
+    static auto compile(const jit_options& options, const std::filesystem::path& src_path, const std::filesystem::path& out_path, const std::filesystem::path& log_path) -> bool
+    {
+        std::vector<std::string> args = {options.compiler};
+        std::istringstream flags(options.flags);
+        for (std::string flag; flags >> flag;)
+        {
+            args.push_back(flag);
+        }
+        for (auto arg: {"-std=c++17", "-fPIC", "-shared", "-o"})
+        {
+            args.push_back(arg);
+        }
+        args.push_back(out_path.string());
+        args.push_back(src_path.string());
+
+        std::vector<char*> argv;
+        for (auto& arg: args)
+        {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+        pid_t pid;
+        int error = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        if (error != 0)
+        {
+            return false;
+        }
+
+        int status;
+        while (waitpid(pid, &status, 0) < 0)
+        {
+            if (errno != EINTR)
+            {
+                return false;
+            }
+        }
+
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    /**
+     * @brief Loads the shared library built from the given source from the
+     * cache directory, compiling it first if it is not there.
+     *
+     * @param key Hash of the source and the options.
+     * @param source Source of the library, from jit_source.
+     * @param options Options for the system compiler.
+     * @return Loaded library.
+     * @throw runtime_error if compiling or loading the library fails.
+    */
+    static auto load(std::uint64_t key, const std::string& source, const jit_options& options) -> std::shared_ptr<jit_module>
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long) key);
+        auto library = options.cache_dir / (std::string(name) + ".so");
+
+        if (!std::filesystem::exists(options.cache_dir))
+        {
+            std::filesystem::create_directories(options.cache_dir.parent_path());
+            if (mkdir(options.cache_dir.c_str(), 0700) != 0 && errno != EEXIST)
+            {
+                throw std::runtime_error("Could not create " + options.cache_dir.string() + ".");
+            }
+        }
+        check_owner(options.cache_dir, true);
+
+        if (!std::filesystem::exists(library))
+        {
+            // Built under a name unique to this process and renamed when done,
+            // so other processes never load a partly written library
+            auto stem = std::string(name) + "." + std::to_string(getpid());
+            auto src_path = options.cache_dir / (stem + ".cpp");
+            auto tmp_path = options.cache_dir / (stem + ".so");
+            auto log_path = options.cache_dir / (stem + ".log");
+
+            std::ofstream(src_path) << source;
+
+            auto compiled = compile(options, src_path, tmp_path, log_path);
+
+            std::stringstream log;
+            log << std::ifstream(log_path).rdbuf();
+            std::filesystem::remove(src_path);
+            std::filesystem::remove(log_path);
+
+            if (!compiled)
+            {
+                std::filesystem::remove(tmp_path);
+                throw std::runtime_error("JIT compilation of expression failed: " + log.str());
+            }
+
+            std::filesystem::rename(tmp_path, library);
+        }
+
+        check_owner(library, false);
+        return std::make_shared<jit_module>(library);
+    }
+
+public:
+    /**
+     * @brief Gets the shared library built from the given source, compiling
+     * it first if it is neither loaded nor in the cache directory.
+     *
+     * @param source Source of the library, from jit_source.
+     * @param options Options for the system compiler.
+     * @return Loaded library.
+     * @throw runtime_error if compiling or loading the library fails.
+    */
+    auto get(const std::string& source, const jit_options& options) -> std::shared_ptr<jit_module>
+    {
+        auto key = hash(options.compiler + " " + options.flags + "\n" + source);
+
+        std::unique_lock lock(m_mutex);
+        m_built.wait(lock, [&] { return !m_building.contains(key); });
+
+        if (auto it = m_modules.find(key); it != m_modules.end())
+        {
+            if (auto module = it->second.lock())
+            {
+                return module;
+            }
+        }
+
+        // Compiled with the lock released, so other sources are not held up
+        m_building.insert(key);
+        lock.unlock();
+
+        std::shared_ptr<jit_module> module;
+        try
+        {
+            module = load(key, source, options);
+        }
+        catch (...)
+        {
+            lock.lock();
+            m_building.erase(key);
+            m_built.notify_all();
+            throw;
+        }
+
+        lock.lock();
+        m_modules.insert_or_assign(key, module);
+        m_building.erase(key);
+        m_built.notify_all();
+        return module;
+    }
+
+    /**
+     * @brief Number of libraries that are loaded.
+    */
+    auto size() -> size_t
+    {
+        std::lock_guard lock(m_mutex);
+
+        size_t n = 0;
+        for (auto& [key, module]: m_modules)
+        {
+            n += !module.expired();
+        }
+
+        return n;
+    }
+
+    /**
+     * @brief Cache shared by the whole process.
+    */
+    static auto global() -> jit_cache&
+    {
+        static jit_cache cache;
+        return cache;
+    }
+};
+
+/**
+ * @brief A math expression compiled to native code by the JIT. Cheap to copy,
+ * since copies share the loaded library.
+ *
+ * @tparam T The floating point type (float, double or long double) to use in
+ * the evaluation of the expression. Defaults to double.
+*/
+template<std::floating_point T = double>
+class jit_expr
+{
+private:
+    using function = void (*)(const T*, T*, size_t);
+
+    std::shared_ptr<jit_module> m_module;
+    function m_function = nullptr;
+
+public:
+    /**
+     * @brief Default constructor.
+    */
+    jit_expr() {};
+
+    /**
+     * @brief Compiles a compiled expression to native code, or takes it from
+     * the cache if the same code was compiled before.
+     *
+     * @param e Compiled expression.
+     * @param options Options for the system compiler.
+     * @param cache Cache to look up and store the library in. Defaults to
+     * jit_cache::global().
+     *
+     * @return jit_expr instance evaluating the expression.
+     * @throw invalid_argument if the expression has more than one variable.
+     * @throw runtime_error if compiling or loading the library fails.
+    */
+    explicit jit_expr(const compiled_expr<T>& e, const jit_options& options = {}, jit_cache& cache = jit_cache::global()) :
+        m_module(cache.get(jit_source(e), options)),
+        m_function(reinterpret_cast<function>(m_module->function()))
+    {}
+
+    /**
+     * @brief Evaluates the expression. Safe to call from multiple threads at
+     * once.
+     *
+     * @param z Value to evaluate expression at.
+     * @return Value of expression at z.
+    */
+    auto evaluate(std::complex<T> z) const -> std::complex<T>
+    {
+        std::complex<T> result;
+        m_function(reinterpret_cast<const T*>(&z), reinterpret_cast<T*>(&result), 1);
+        return result;
+    }
+
+    /**
+     * @brief Evaluates the expression at many points with the vectorized loop.
+     * Safe to call from multiple threads at once.
+     *
+     * @param in Points to evaluate expression at.
+     * @param out Where the value of the expression at in[i] is written to
+     * out[i]. Must be the same size as in, and must not overlap in.
+     * @throw invalid_argument if in and out have different sizes.
+    */
+    void evaluate(std::span<const std::complex<T>> in, std::span<std::complex<T>> out) const
+    {
+        if (in.size() != out.size())
+        {
+            throw std::invalid_argument("Input and output of batch evaluation have different sizes.");
+        }
+
+        m_function(reinterpret_cast<const T*>(in.data()), reinterpret_cast<T*>(out.data()), in.size());
+    }
+};
+
+/**
+ * @brief Compiles given expression to native code.
+ *
+ * @param e Expression to compile.
+ * @param options Options for the system compiler.
+ * @tparam T floating point type used by expression.
+ *
+ * @return Expression compiled to native code.
+ * @throw runtime_error if compiling or loading the library fails.
+*/
+template<std::floating_point T, template<typename...> class container>
+auto jit_compile(const expr<T, container>& e, const jit_options& options = {}) -> jit_expr<T>
+{
+    return jit_expr<T>(compile(e), options);
+}
+
+};
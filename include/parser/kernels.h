@@ -0,0 +1,1233 @@
+/**
+ * @file kernels.h
+ * @brief Contains the kernels used in batch evaluation. Every kernel works on
+ * a block of complex values stored as structure of arrays, i.e., with the
+ * real parts and imaginary parts in separate arrays (lanes), and is written
+ * as a plain loop without branches or aliasing, so that the compiler can
+ * vectorize it for the target instruction set (SSE, AVX2, AVX-512, NEON).
+ *
+ * The arithmetic kernels use textbook formulas and so do not handle infinities
+ * and NaNs the way the operators of std::complex do (C99 Annex G). They agree
+ * with std::complex to within a few ulp for all finite values that do not
+ * overflow.
+ *
+ * The kernel_real_ kernels work on a block of real values, one lane per value,
+ * for expressions evaluated in real arithmetic (see compiled_expr). Real
+ * square roots are NaN for negative values, which is what tells the evaluator
+ * that a value left the real line.
+ *
+ * The function kernels (kernel_exp, kernel_log, kernel_sin, ...) evaluate
+ * transcendental functions with the branch-free polynomials of fastmath.h,
+ * where their errors are listed, and recompute with std:: only the lanes that
+ * are out of their range or not finite.
+ *
+ * Build with optimizations and the target architecture enabled (e.g. -O3
+ * -march=native) for the loops to be vectorized. kernel_abs and kernel_sqrt
+ * also need -fno-math-errno, since std::sqrt may otherwise set errno.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <concepts>
+#include <type_traits>
+
+#include "fastmath.h"
+
+namespace parser
+{
+
+/**
+ * @brief Computes x = x + y, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param y_re Real parts of y.
+ * @param y_im Imaginary parts of y.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_add(T* __restrict x_re, T* __restrict x_im, const T* __restrict y_re, const T* __restrict y_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x_re[i] += y_re[i];
+        x_im[i] += y_im[i];
+    }
+}
+
+/**
+ * @brief Computes x = x - y, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param y_re Real parts of y.
+ * @param y_im Imaginary parts of y.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_sub(T* __restrict x_re, T* __restrict x_im, const T* __restrict y_re, const T* __restrict y_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x_re[i] -= y_re[i];
+        x_im[i] -= y_im[i];
+    }
+}
+
+/**
+ * @brief Computes x = x * y, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param y_re Real parts of y.
+ * @param y_im Imaginary parts of y.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_mul(T* __restrict x_re, T* __restrict x_im, const T* __restrict y_re, const T* __restrict y_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        // (a + bi)(c + di) = (ac - bd) + (ad + bc)i
+        T re = x_re[i] * y_re[i] - x_im[i] * y_im[i];
+        T im = x_re[i] * y_im[i] + x_im[i] * y_re[i];
+        x_re[i] = re;
+        x_im[i] = im;
+    }
+}
+
+/**
+ * @brief Computes x = x / y, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param y_re Real parts of y.
+ * @param y_im Imaginary parts of y.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_div(T* __restrict x_re, T* __restrict x_im, const T* __restrict y_re, const T* __restrict y_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        // (a + bi)/(c + di) = ((ac + bd) + (bc - ad)i)/(c^2 + d^2). The
+        // denominator is scaled by s = max(|c|, |d|) first so that c^2 + d^2
+        // can not overflow.
+        T s = std::max(std::abs(y_re[i]), std::abs(y_im[i]));
+        T c = y_re[i] / s;
+        T d = y_im[i] / s;
+        T denom = (c * c + d * d) * s;
+        T re = (x_re[i] * c + x_im[i] * d) / denom;
+        T im = (x_im[i] * c - x_re[i] * d) / denom;
+        x_re[i] = re;
+        x_im[i] = im;
+    }
+}
+
+/**
+ * @brief Computes x = -x, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_neg(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x_re[i] = - x_re[i];
+        x_im[i] = - x_im[i];
+    }
+}
+
+/**
+ * @brief Computes x = conj(x), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_conj([[maybe_unused]] T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x_im[i] = - x_im[i];
+    }
+}
+
+/**
+ * @brief Computes x = re(x), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_re([[maybe_unused]] T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x_im[i] = 0;
+    }
+}
+
+/**
+ * @brief Computes x = im(x), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_im(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x_re[i] = x_im[i];
+        x_im[i] = 0;
+    }
+}
+
+/**
+ * @brief Computes x = abs(x), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_abs(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        // |a + bi| = s sqrt((a/s)^2 + (b/s)^2) where s = max(|a|, |b|), which
+        // can not overflow. s = 0 is replaced by 1 to avoid dividing 0 by 0.
+        T a = std::abs(x_re[i]);
+        T b = std::abs(x_im[i]);
+        T s = std::max(a, b);
+        T t = s + (T) (s == 0);
+        a /= t;
+        b /= t;
+        x_re[i] = s * std::sqrt(a * a + b * b);
+        x_im[i] = 0;
+    }
+}
+
+/**
+ * @brief Computes x = x^p for an integer p, lane by lane, by exponentiation
+ * by squaring. Takes at most 2 log2(|p|) multiplications, so the relative
+ * error is within about 2 log2(|p|) times that of a single multiplication,
+ * independent of the size of x. std::pow goes through exp(p log(x)), where
+ * the error of log(x) is multiplied by p, so this is both faster and more
+ * accurate for small |p|.
+ *
+ * Unlike std::pow, x^0 = 1 for every x, including 0, and 0^p is infinite or
+ * NaN for p < 0.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param p Exponent.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_powi(T* __restrict x_re, T* __restrict x_im, int p, size_t n)
+{
+    // Lanes are done in chunks, so the result and the running square of
+    // every lane fit in registers or at least the L1 cache.
+    constexpr size_t chunk = 64;
+
+    for (size_t begin = 0; begin < n; begin += chunk)
+    {
+        auto m = std::min(chunk, n - begin);
+        T* __restrict b_re = x_re + begin;
+        T* __restrict b_im = x_im + begin;
+        T r_re[chunk], r_im[chunk];
+
+        for (size_t i = 0; i < m; i++)
+        {
+            r_re[i] = 1;
+            r_im[i] = 0;
+        }
+
+        // The bits of |p| are the same for every lane, so the branches are
+        // outside of the loops over the lanes.
+        for (unsigned e = p < 0 ? - (unsigned) p : (unsigned) p; e != 0; e >>= 1)
+        {
+            if (e & 1)
+            {
+                for (size_t i = 0; i < m; i++)
+                {
+                    T re = r_re[i] * b_re[i] - r_im[i] * b_im[i];
+                    r_im[i] = r_re[i] * b_im[i] + r_im[i] * b_re[i];
+                    r_re[i] = re;
+                }
+            }
+
+            if (e > 1)
+            {
+                for (size_t i = 0; i < m; i++)
+                {
+                    T re = b_re[i] * b_re[i] - b_im[i] * b_im[i];
+                    b_im[i] = 2 * b_re[i] * b_im[i];
+                    b_re[i] = re;
+                }
+            }
+        }
+
+        if (p < 0)
+        {
+            // 1/(a + bi) with a and b scaled by s = max(|a|, |b|) first, as in
+            // kernel_div
+            for (size_t i = 0; i < m; i++)
+            {
+                T s = std::max(std::abs(r_re[i]), std::abs(r_im[i]));
+                T a = r_re[i] / s;
+                T b = r_im[i] / s;
+                T d = s * (a * a + b * b);
+                b_re[i] = a / d;
+                b_im[i] = - b / d;
+            }
+        }
+        else
+        {
+            std::copy(r_re, r_re + m, b_re);
+            std::copy(r_im, r_im + m, b_im);
+        }
+    }
+}
+
+/**
+ * @brief Computes x = sqrt(x), the principal square root, lane by lane. The
+ * branch cut is along the negative real axis, where the sign of the
+ * imaginary part of the result follows that of x as in std::sqrt. Agrees with
+ * std::sqrt to within a few ulp.
+ *
+ * Needs -fno-math-errno to be vectorized, as kernel_abs.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_sqrt(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        // With t = sqrt((|x| + |a|) / 2), sqrt(a + bi) = t + bi / 2t if a >= 0
+        // and |b| / 2t + sign(b) t i otherwise. |x| is found as in kernel_abs,
+        // and t = 0 (only when x = 0) is replaced by 1 when dividing.
+        T a = std::abs(x_re[i]);
+        T b = std::abs(x_im[i]);
+        T s = std::max(a, b);
+        T u = s + (T) (s == 0);
+        T abs = s * std::sqrt((a / u) * (a / u) + (b / u) * (b / u));
+        T t = std::sqrt((abs + a) / 2);
+        T v = x_im[i] / (2 * (t + (T) (t == 0)));
+
+        T re = x_re[i] >= 0 ? t : std::abs(v);
+        x_im[i] = x_re[i] >= 0 ? v : std::copysign(t, x_im[i]);
+        x_re[i] = re;
+    }
+}
+
+/**
+ * @brief Fills x with a constant, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param c Constant to fill with.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_fill(T* __restrict x_re, T* __restrict x_im, std::complex<T> c, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x_re[i] = c.real();
+        x_im[i] = c.imag();
+    }
+}
+
+/**
+ * @brief Splits interleaved complex values into separate real and imaginary
+ * lanes.
+ *
+ * @param in Complex values to split.
+ * @param x_re Real parts to write to.
+ * @param x_im Imaginary parts to write to.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_load(const std::complex<T>* __restrict in, T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    // std::complex<T> is guaranteed to have the layout of T[2]
+    auto values = reinterpret_cast<const T*>(in);
+    for (size_t i = 0; i < n; i++)
+    {
+        x_re[i] = values[2 * i];
+        x_im[i] = values[2 * i + 1];
+    }
+}
+
+/**
+ * @brief Joins separate real and imaginary lanes into interleaved complex
+ * values.
+ *
+ * @param x_re Real parts to read from.
+ * @param x_im Imaginary parts to read from.
+ * @param out Complex values to write to.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_store(const T* __restrict x_re, const T* __restrict x_im, std::complex<T>* __restrict out, size_t n)
+{
+    auto values = reinterpret_cast<T*>(out);
+    for (size_t i = 0; i < n; i++)
+    {
+        values[2 * i] = x_re[i];
+        values[2 * i + 1] = x_im[i];
+    }
+}
+
+/**
+ * @brief Computes x = x + y for real x and y, lane by lane.
+ *
+ * @param x Values of x.
+ * @param y Values of y.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_real_add(T* __restrict x, const T* __restrict y, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] += y[i];
+    }
+}
+
+/**
+ * @brief Computes x = x - y for real x and y, lane by lane.
+ *
+ * @param x Values of x.
+ * @param y Values of y.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_real_sub(T* __restrict x, const T* __restrict y, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] -= y[i];
+    }
+}
+
+/**
+ * @brief Computes x = x * y for real x and y, lane by lane.
+ *
+ * @param x Values of x.
+ * @param y Values of y.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_real_mul(T* __restrict x, const T* __restrict y, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] *= y[i];
+    }
+}
+
+/**
+ * @brief Computes x = x / y for real x and y, lane by lane.
+ *
+ * @param x Values of x.
+ * @param y Values of y.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_real_div(T* __restrict x, const T* __restrict y, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] /= y[i];
+    }
+}
+
+/**
+ * @brief Computes x = -x for real x, lane by lane.
+ *
+ * @param x Values of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_real_neg(T* __restrict x, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = - x[i];
+    }
+}
+
+/**
+ * @brief Computes x = abs(x) for real x, lane by lane.
+ *
+ * @param x Values of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_real_abs(T* __restrict x, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = std::abs(x[i]);
+    }
+}
+
+/**
+ * @brief Computes x = sqrt(x) for real x, lane by lane, which is NaN for
+ * x < 0. Needs -fno-math-errno to be vectorized, as kernel_sqrt.
+ *
+ * @param x Values of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_real_sqrt(T* __restrict x, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = std::sqrt(x[i]);
+    }
+}
+
+/**
+ * @brief Computes x = x^p for real x and an integer p, lane by lane, by
+ * exponentiation by squaring, with the same accuracy and special cases as
+ * kernel_powi.
+ *
+ * @param x Values of x.
+ * @param p Exponent.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_real_powi(T* __restrict x, int p, size_t n)
+{
+    constexpr size_t chunk = 64;
+
+    for (size_t begin = 0; begin < n; begin += chunk)
+    {
+        auto m = std::min(chunk, n - begin);
+        T* __restrict b = x + begin;
+        T r[chunk];
+
+        for (size_t i = 0; i < m; i++)
+        {
+            r[i] = 1;
+        }
+
+        for (unsigned e = p < 0 ? - (unsigned) p : (unsigned) p; e != 0; e >>= 1)
+        {
+            if (e & 1)
+            {
+                for (size_t i = 0; i < m; i++)
+                {
+                    r[i] *= b[i];
+                }
+            }
+
+            if (e > 1)
+            {
+                for (size_t i = 0; i < m; i++)
+                {
+                    b[i] *= b[i];
+                }
+            }
+        }
+
+        for (size_t i = 0; i < m; i++)
+        {
+            b[i] = p < 0 ? 1 / r[i] : r[i];
+        }
+    }
+}
+
+/**
+ * @brief Fills x with a real constant, lane by lane.
+ *
+ * @param x Values of x.
+ * @param c Constant to fill with.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_real_fill(T* __restrict x, T c, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = c;
+    }
+}
+
+/**
+ * @brief Computes x = f(x) lane by lane, with a branch-free formula fast
+ * evaluated in double, and then std:: exact on the lanes where fast does not
+ * hold: those with a part larger than fast_trig_limit, or a value that is not
+ * finite. Long doubles are evaluated with exact only.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+ * @param fast Called with the parts of x and references to the parts of f(x).
+ * @param exact Called with x, returns f(x).
+*/
+template<std::floating_point T, typename F, typename G>
+inline void kernel_func(T* __restrict x_re, T* __restrict x_im, size_t n, const F& fast, const G& exact)
+{
+    if constexpr (std::is_same_v<T, long double>)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            auto z = exact(std::complex<T>(x_re[i], x_im[i]));
+            x_re[i] = z.real();
+            x_im[i] = z.imag();
+        }
+    }
+    else
+    {
+        // Arguments are kept a chunk at a time for the lanes that need them
+        constexpr size_t chunk = 64;
+        T a[chunk], b[chunk];
+
+        for (size_t j = 0; j < n; j += chunk)
+        {
+            auto m = std::min(chunk, n - j);
+            std::copy(x_re + j, x_re + j + m, a);
+            std::copy(x_im + j, x_im + j + m, b);
+
+            for (size_t i = 0; i < m; i++)
+            {
+                double re, im;
+                fast((double) a[i], (double) b[i], re, im);
+                x_re[j + i] = (T) re;
+                x_im[j + i] = (T) im;
+            }
+
+            for (size_t i = 0; i < m; i++)
+            {
+                if (!std::isfinite(x_re[j + i]) || !std::isfinite(x_im[j + i]) || std::abs(a[i]) > (T) fast_trig_limit || std::abs(b[i]) > (T) fast_trig_limit)
+                {
+                    auto z = exact(std::complex<T>(a[i], b[i]));
+                    x_re[j + i] = z.real();
+                    x_im[j + i] = z.imag();
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Computes x = f(x) for real x lane by lane, as kernel_func.
+ *
+ * @param x Values of x.
+ * @param n Number of lanes.
+ * @param fast Called with x in double, returns f(x).
+ * @param exact Called with x, returns f(x).
+*/
+template<std::floating_point T, typename F, typename G>
+inline void kernel_real_func(T* __restrict x, size_t n, const F& fast, const G& exact)
+{
+    if constexpr (std::is_same_v<T, long double>)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            x[i] = exact(x[i]);
+        }
+    }
+    else
+    {
+        constexpr size_t chunk = 64;
+        T a[chunk];
+
+        for (size_t j = 0; j < n; j += chunk)
+        {
+            auto m = std::min(chunk, n - j);
+            std::copy(x + j, x + j + m, a);
+
+            for (size_t i = 0; i < m; i++)
+            {
+                x[j + i] = (T) fast((double) a[i]);
+            }
+
+            for (size_t i = 0; i < m; i++)
+            {
+                if (!std::isfinite(x[j + i]) || std::abs(a[i]) > (T) fast_trig_limit)
+                {
+                    x[j + i] = exact(a[i]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Computes x = exp(x) = e^a (cos b + i sin b), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_exp(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double e = fast_exp(a), s, c;
+        fast_sincos(b, s, c);
+        re = e * c;
+        im = e * s;
+    }, [](std::complex<T> z) { return std::exp(z); });
+}
+
+/**
+ * @brief Computes x = log(x) = log|x| + i arg(x), lane by lane, with
+ * log|x| = log(s) + log(1 + (t / s)^2) / 2 for s = max(|a|, |b|) and
+ * t = min(|a|, |b|), which does not overflow.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_log(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double u = a < 0 ? - a : a;
+        double v = b < 0 ? - b : b;
+        double s = u > v ? u : v;
+        double q = (u > v ? v : u) / s;
+        re = fast_log(s) + 0.5 * fast_log1p(q * q);
+        im = fast_atan2(b, a);
+    }, [](std::complex<T> z) { return std::log(z); });
+}
+
+/**
+ * @brief Computes x = sin(x) = sin a cosh b + i cos a sinh b, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_sin(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double s, c, sh, ch;
+        fast_sincos(a, s, c);
+        fast_sinhcosh(b, sh, ch);
+        re = s * ch;
+        im = c * sh;
+    }, [](std::complex<T> z) { return std::sin(z); });
+}
+
+/**
+ * @brief Computes x = cos(x) = cos a cosh b - i sin a sinh b, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_cos(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double s, c, sh, ch;
+        fast_sincos(a, s, c);
+        fast_sinhcosh(b, sh, ch);
+        re = c * ch;
+        im = - s * sh;
+    }, [](std::complex<T> z) { return std::cos(z); });
+}
+
+/**
+ * @brief Computes x = sinh(x) = sinh a cos b + i cosh a sin b, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_sinh(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double s, c, sh, ch;
+        fast_sincos(b, s, c);
+        fast_sinhcosh(a, sh, ch);
+        re = sh * c;
+        im = ch * s;
+    }, [](std::complex<T> z) { return std::sinh(z); });
+}
+
+/**
+ * @brief Computes x = cosh(x) = cosh a cos b + i sinh a sin b, lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_cosh(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double s, c, sh, ch;
+        fast_sincos(b, s, c);
+        fast_sinhcosh(a, sh, ch);
+        re = ch * c;
+        im = sh * s;
+    }, [](std::complex<T> z) { return std::cosh(z); });
+}
+
+/**
+ * @brief Computes x = tan(x) = sin(x) / cos(x), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_tan(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double s, c, sh, ch;
+        fast_sincos(a, s, c);
+        fast_sinhcosh(b, sh, ch);
+        fast_div(s * ch, c * sh, c * ch, - s * sh, re, im);
+    }, [](std::complex<T> z) { return std::tan(z); });
+}
+
+/**
+ * @brief Computes x = cot(x) = cos(x) / sin(x), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_cot(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double s, c, sh, ch;
+        fast_sincos(a, s, c);
+        fast_sinhcosh(b, sh, ch);
+        fast_div(c * ch, - s * sh, s * ch, c * sh, re, im);
+    }, [](std::complex<T> z) { return (T) 1.0 / std::tan(z); });
+}
+
+/**
+ * @brief Computes x = sec(x) = 1 / cos(x), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_sec(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double s, c, sh, ch;
+        fast_sincos(a, s, c);
+        fast_sinhcosh(b, sh, ch);
+        fast_div(1, 0, c * ch, - s * sh, re, im);
+    }, [](std::complex<T> z) { return (T) 1.0 / std::cos(z); });
+}
+
+/**
+ * @brief Computes x = csc(x) = 1 / sin(x), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_csc(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double s, c, sh, ch;
+        fast_sincos(a, s, c);
+        fast_sinhcosh(b, sh, ch);
+        fast_div(1, 0, s * ch, c * sh, re, im);
+    }, [](std::complex<T> z) { return (T) 1.0 / std::sin(z); });
+}
+
+/**
+ * @brief Computes x = tanh(x) = sinh(x) / cosh(x), lane by lane.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_tanh(T* __restrict x_re, T* __restrict x_im, size_t n)
+{
+    kernel_func(x_re, x_im, n, [](double a, double b, double& re, double& im)
+    {
+        double s, c, sh, ch;
+        fast_sincos(b, s, c);
+        fast_sinhcosh(a, sh, ch);
+        fast_div(sh * c, ch * s, ch * c, sh * s, re, im);
+    }, [](std::complex<T> z) { return std::tanh(z); });
+}
+
+/**
+ * @brief Computes f(x) and g(x) lane by lane, for two functions f and g
+ * sharing most of their work, as kernel_func: with fast in double, and then
+ * with f_exact and g_exact on the lanes where fast does not hold.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param f_re Where the real parts of f(x) are written to.
+ * @param f_im Where the imaginary parts of f(x) are written to.
+ * @param g_re Where the real parts of g(x) are written to.
+ * @param g_im Where the imaginary parts of g(x) are written to.
+ * @param n Number of lanes.
+ * @param fast Called with the parts of x and references to the parts of
+ * f(x) and g(x).
+ * @param f_exact Called with x, returns f(x).
+ * @param g_exact Called with x, returns g(x).
+*/
+template<std::floating_point T, typename F, typename G, typename H>
+inline void kernel_func_pair(const T* __restrict x_re, const T* __restrict x_im, T* __restrict f_re, T* __restrict f_im, T* __restrict g_re, T* __restrict g_im, size_t n, const F& fast, const G& f_exact, const H& g_exact)
+{
+    if constexpr (!std::is_same_v<T, long double>)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            double a_re, a_im, b_re, b_im;
+            fast((double) x_re[i], (double) x_im[i], a_re, a_im, b_re, b_im);
+            f_re[i] = (T) a_re;
+            f_im[i] = (T) a_im;
+            g_re[i] = (T) b_re;
+            g_im[i] = (T) b_im;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (std::is_same_v<T, long double> || !std::isfinite(f_re[i]) || !std::isfinite(f_im[i]) || !std::isfinite(g_re[i]) || !std::isfinite(g_im[i]) || std::abs(x_re[i]) > (T) fast_trig_limit || std::abs(x_im[i]) > (T) fast_trig_limit)
+        {
+            std::complex<T> z(x_re[i], x_im[i]);
+            auto f = f_exact(z), g = g_exact(z);
+            f_re[i] = f.real();
+            f_im[i] = f.imag();
+            g_re[i] = g.real();
+            g_im[i] = g.imag();
+        }
+    }
+}
+
+/**
+ * @brief Computes s = sin(x) and c = cos(x) lane by lane, from one sin, cos,
+ * sinh and cosh of the parts of x.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param s_re Where the real parts of sin(x) are written to.
+ * @param s_im Where the imaginary parts of sin(x) are written to.
+ * @param c_re Where the real parts of cos(x) are written to.
+ * @param c_im Where the imaginary parts of cos(x) are written to.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_sincos(const T* __restrict x_re, const T* __restrict x_im, T* __restrict s_re, T* __restrict s_im, T* __restrict c_re, T* __restrict c_im, size_t n)
+{
+    kernel_func_pair(x_re, x_im, s_re, s_im, c_re, c_im, n, [](double a, double b, double& sr, double& si, double& cr, double& ci)
+    {
+        double s, c, sh, ch;
+        fast_sincos(a, s, c);
+        fast_sinhcosh(b, sh, ch);
+        sr = s * ch;
+        si = c * sh;
+        cr = c * ch;
+        ci = - s * sh;
+    }, [](std::complex<T> z) { return std::sin(z); }, [](std::complex<T> z) { return std::cos(z); });
+}
+
+/**
+ * @brief Computes s = sinh(x) and c = cosh(x) lane by lane, from one sin,
+ * cos, sinh and cosh of the parts of x.
+ *
+ * @param x_re Real parts of x.
+ * @param x_im Imaginary parts of x.
+ * @param s_re Where the real parts of sinh(x) are written to.
+ * @param s_im Where the imaginary parts of sinh(x) are written to.
+ * @param c_re Where the real parts of cosh(x) are written to.
+ * @param c_im Where the imaginary parts of cosh(x) are written to.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_sinhcosh(const T* __restrict x_re, const T* __restrict x_im, T* __restrict s_re, T* __restrict s_im, T* __restrict c_re, T* __restrict c_im, size_t n)
+{
+    kernel_func_pair(x_re, x_im, s_re, s_im, c_re, c_im, n, [](double a, double b, double& sr, double& si, double& cr, double& ci)
+    {
+        double s, c, sh, ch;
+        fast_sincos(b, s, c);
+        fast_sinhcosh(a, sh, ch);
+        sr = sh * c;
+        si = ch * s;
+        cr = ch * c;
+        ci = sh * s;
+    }, [](std::complex<T> z) { return std::sinh(z); }, [](std::complex<T> z) { return std::cosh(z); });
+}
+
+/**
+ * @brief Computes l = log(f) and p = f^g = exp(g log(f)) lane by lane, with
+ * kernel_log, kernel_mul and kernel_exp, so that the log is found once for
+ * both. This is how std::pow finds f^g, but at f = 0, where p is found with
+ * std::pow.
+ *
+ * @param f_re Real parts of f.
+ * @param f_im Imaginary parts of f.
+ * @param g_re Real parts of g.
+ * @param g_im Imaginary parts of g.
+ * @param p_re Where the real parts of f^g are written to.
+ * @param p_im Where the imaginary parts of f^g are written to.
+ * @param l_re Where the real parts of log(f) are written to.
+ * @param l_im Where the imaginary parts of log(f) are written to.
+ * @param n Number of lanes.
+*/
+template<std::floating_point T>
+inline void kernel_pow_log(const T* __restrict f_re, const T* __restrict f_im, const T* __restrict g_re, const T* __restrict g_im, T* __restrict p_re, T* __restrict p_im, T* __restrict l_re, T* __restrict l_im, size_t n)
+{
+    std::copy(f_re, f_re + n, l_re);
+    std::copy(f_im, f_im + n, l_im);
+    kernel_log(l_re, l_im, n);
+
+    std::copy(l_re, l_re + n, p_re);
+    std::copy(l_im, l_im + n, p_im);
+    kernel_mul(p_re, p_im, g_re, g_im, n);
+    kernel_exp(p_re, p_im, n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (f_re[i] == 0 && f_im[i] == 0)
+        {
+            auto p = std::pow(std::complex<T>(f_re[i], f_im[i]), std::complex<T>(g_re[i], g_im[i]));
+            p_re[i] = p.real();
+            p_im[i] = p.imag();
+        }
+    }
+}
+
+/**
+ * @brief Computes x = exp(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_exp(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a) { return fast_exp(a); }, [](T a) { return std::exp(a); });
+}
+
+/**
+ * @brief Computes x = log(x) for real x, lane by lane; NaN for x < 0 and
+ * x = -0, as eval_real_func.
+*/
+template<std::floating_point T>
+inline void kernel_real_log(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a) { return fast_log(a); }, [](T a) { return std::signbit(a) ? std::numeric_limits<T>::quiet_NaN() : std::log(a); });
+}
+
+/**
+ * @brief Computes x = sin(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_sin(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a)
+    {
+        double s, c;
+        fast_sincos(a, s, c);
+        return s;
+    }, [](T a) { return std::sin(a); });
+}
+
+/**
+ * @brief Computes x = cos(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_cos(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a)
+    {
+        double s, c;
+        fast_sincos(a, s, c);
+        return c;
+    }, [](T a) { return std::cos(a); });
+}
+
+/**
+ * @brief Computes x = tan(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_tan(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a)
+    {
+        double s, c;
+        fast_sincos(a, s, c);
+        return s / c;
+    }, [](T a) { return std::tan(a); });
+}
+
+/**
+ * @brief Computes x = sec(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_sec(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a)
+    {
+        double s, c;
+        fast_sincos(a, s, c);
+        return 1 / c;
+    }, [](T a) { return (T) 1.0 / std::cos(a); });
+}
+
+/**
+ * @brief Computes x = csc(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_csc(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a)
+    {
+        double s, c;
+        fast_sincos(a, s, c);
+        return 1 / s;
+    }, [](T a) { return (T) 1.0 / std::sin(a); });
+}
+
+/**
+ * @brief Computes x = cot(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_cot(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a)
+    {
+        double s, c;
+        fast_sincos(a, s, c);
+        return c / s;
+    }, [](T a) { return (T) 1.0 / std::tan(a); });
+}
+
+/**
+ * @brief Computes x = sinh(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_sinh(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a)
+    {
+        double s, c;
+        fast_sinhcosh(a, s, c);
+        return s;
+    }, [](T a) { return std::sinh(a); });
+}
+
+/**
+ * @brief Computes x = cosh(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_cosh(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a)
+    {
+        double s, c;
+        fast_sinhcosh(a, s, c);
+        return c;
+    }, [](T a) { return std::cosh(a); });
+}
+
+/**
+ * @brief Computes x = tanh(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_tanh(T* __restrict x, size_t n)
+{
+    kernel_real_func(x, n, [](double a)
+    {
+        double s, c;
+        fast_sinhcosh(a, s, c);
+        return s / c;
+    }, [](T a) { return std::tanh(a); });
+}
+
+/**
+ * @brief Computes s = f(x) and c = g(x) for real x lane by lane, as
+ * kernel_func_pair.
+ *
+ * @param x Values of x.
+ * @param s Where the values of f(x) are written to.
+ * @param c Where the values of g(x) are written to.
+ * @param n Number of lanes.
+ * @param fast Called with x in double and references to f(x) and g(x).
+ * @param f_exact Called with x, returns f(x).
+ * @param g_exact Called with x, returns g(x).
+*/
+template<std::floating_point T, typename F, typename G, typename H>
+inline void kernel_real_func_pair(const T* __restrict x, T* __restrict s, T* __restrict c, size_t n, const F& fast, const G& f_exact, const H& g_exact)
+{
+    if constexpr (!std::is_same_v<T, long double>)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            double a, b;
+            fast((double) x[i], a, b);
+            s[i] = (T) a;
+            c[i] = (T) b;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (std::is_same_v<T, long double> || !std::isfinite(s[i]) || !std::isfinite(c[i]) || std::abs(x[i]) > (T) fast_trig_limit)
+        {
+            s[i] = f_exact(x[i]);
+            c[i] = g_exact(x[i]);
+        }
+    }
+}
+
+/**
+ * @brief Computes s = sin(x) and c = cos(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_sincos(const T* __restrict x, T* __restrict s, T* __restrict c, size_t n)
+{
+    kernel_real_func_pair(x, s, c, n, [](double a, double& sa, double& ca) { fast_sincos(a, sa, ca); }, [](T a) { return std::sin(a); }, [](T a) { return std::cos(a); });
+}
+
+/**
+ * @brief Computes s = sinh(x) and c = cosh(x) for real x, lane by lane.
+*/
+template<std::floating_point T>
+inline void kernel_real_sinhcosh(const T* __restrict x, T* __restrict s, T* __restrict c, size_t n)
+{
+    kernel_real_func_pair(x, s, c, n, [](double a, double& sa, double& ca) { fast_sinhcosh(a, sa, ca); }, [](T a) { return std::sinh(a); }, [](T a) { return std::cosh(a); });
+}
+
+};
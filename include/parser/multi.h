@@ -0,0 +1,240 @@
+/**
+ * @file multi.h
+ * @brief Contains an engine that compiles many distinct expressions into one
+ * packed table of programs and evaluates all of them at the same points,
+ * e.g., a population of candidate formulas in a symbolic regression search.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <complex>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "compiled.h"
+#include "parallel.h"
+#include "thread_pool.h"
+
+namespace parser
+{
+
+/**
+ * @brief Many compiled expressions of one variable, evaluated together at
+ * the same points.
+ *
+ * The instructions and constants of every expression are packed end to end
+ * into one table, which the compiled expressions view in place, so a
+ * population of thousands of small expressions is a few contiguous arrays
+ * rather than two allocations each. evaluate splits the work into tiles of
+ * multi_formulas expressions by multi_points points, run on a thread pool,
+ * so it is parallel across expressions and across points alike. Within a
+ * tile the loops are interchanged: every block of block_size points is
+ * evaluated by all the expressions of the tile before the next block is
+ * read, so the points and the values on the evaluation stack stay in the L1
+ * cache, and the programs of the tile in the L2 cache, instead of every
+ * expression streaming all the points through the cache in turn.
+ *
+ * @tparam T The floating point type (float, double or long double) to use in
+ * the evaluation of the expressions. Defaults to double.
+*/
+template<std::floating_point T = double>
+class multi_expr
+{
+public:
+    // Number of expressions, and of points, in a tile of evaluate. A tile of
+    // 1024 complex<double> points is 16 KB.
+    static constexpr size_t multi_formulas = 32;
+    static constexpr size_t multi_points = 8 * compiled_expr<T>::block_size;
+
+private:
+    // Instructions and constants of every expression, end to end
+    struct table
+    {
+        std::vector<instruction> code;
+        std::vector<std::complex<T>> consts;
+    };
+
+    std::vector<compiled_expr<T>> m_exprs;
+
+    // Largest scratch_size of the expressions
+    size_t m_scratch = 0;
+
+    /**
+     * @brief Packs compiled expressions into one table, and views each of
+     * them in it.
+     *
+     * @param exprs Compiled expressions of one variable.
+     * @throw invalid_argument if an expression has more than one variable or
+     * more than one output.
+    */
+    void pack(const std::vector<compiled_expr<T>>& exprs)
+    {
+        auto packed = std::make_shared<table>();
+        size_t code_size = 0, consts_size = 0;
+        for (const auto& e: exprs)
+        {
+            if (e.variables() > 1 || e.outputs() != 1)
+            {
+                throw std::invalid_argument("Only expressions of one variable with one output can be evaluated together.");
+            }
+
+            code_size += e.code().size();
+            consts_size += e.constants().size();
+        }
+
+        packed->code.reserve(code_size);
+        packed->consts.reserve(consts_size);
+        for (const auto& e: exprs)
+        {
+            packed->code.insert(packed->code.end(), e.code().begin(), e.code().end());
+            packed->consts.insert(packed->consts.end(), e.constants().begin(), e.constants().end());
+        }
+
+        // Spans into the table are only taken once it no longer grows
+        m_exprs.reserve(exprs.size());
+        size_t code_offset = 0, consts_offset = 0;
+        for (const auto& e: exprs)
+        {
+            auto code = std::span<const instruction>(packed->code).subspan(code_offset, e.code().size());
+            auto consts = std::span<const std::complex<T>>(packed->consts).subspan(consts_offset, e.constants().size());
+            m_exprs.emplace_back(code, consts, e.temporaries(), 1, packed);
+
+            code_offset += code.size();
+            consts_offset += consts.size();
+            m_scratch = std::max(m_scratch, m_exprs.back().scratch_size());
+        }
+    }
+
+public:
+    /**
+     * @brief Default constructor, with no expressions.
+    */
+    multi_expr() {};
+
+    /**
+     * @brief Compiles many math expressions of one variable together.
+     *
+     * @param exprs Range of expressions (expr instances) to compile, each
+     * converted to postfix first if it is in infix.
+     * @param optimize Whether to fold constants and apply algebraic
+     * identities before compiling. Defaults to true.
+     *
+     * @return multi_expr instance evaluating the expressions.
+     * @throw invalid_argument if an expression is not well-formed or has
+     * more than one variable.
+    */
+    template<std::ranges::input_range R>
+        requires requires (std::ranges::range_reference_t<R> e) { compiled_expr<T>(e, true); }
+    explicit multi_expr(const R& exprs, bool optimize = true)
+    {
+        std::vector<compiled_expr<T>> compiled;
+        for (const auto& e: exprs)
+        {
+            compiled.emplace_back(e, optimize);
+        }
+
+        pack(compiled);
+    }
+
+    /**
+     * @brief Parses and compiles many strings representing infix math
+     * expressions of one variable together (see expr::parse).
+     *
+     * @param infix Strings representing infix math expressions.
+     * @param variables Name of the variable, as the only element. Defaults
+     * to z.
+     * @param optimize Whether to fold constants and apply algebraic
+     * identities before compiling. Defaults to true.
+     *
+     * @return multi_expr instance evaluating the expressions.
+     * @throw invalid_argument if a string is not a well-formed expression of
+     * one variable.
+    */
+    explicit multi_expr(std::span<const std::string_view> infix, std::span<const std::string_view> variables = default_variables, bool optimize = true)
+    {
+        std::vector<compiled_expr<T>> compiled;
+        compiled.reserve(infix.size());
+        for (auto e: infix)
+        {
+            compiled.emplace_back(e, variables, optimize);
+        }
+
+        pack(compiled);
+    }
+
+    /**
+     * @brief Evaluates every expression at every point.
+     *
+     * @param in Points to evaluate the expressions at.
+     * @param out Where the value of expression k at in[i] is written to
+     * out[k * in.size() + i]. Must have size() * in.size() values.
+     * @param pool Thread pool to evaluate on. Defaults to
+     * thread_pool::global().
+     * @throw invalid_argument if out has the wrong size.
+    */
+    void evaluate(std::span<const std::complex<T>> in, std::span<std::complex<T>> out, thread_pool& pool = thread_pool::global()) const
+    {
+        constexpr auto block_size = compiled_expr<T>::block_size;
+
+        if (out.size() != m_exprs.size() * in.size())
+        {
+            throw std::invalid_argument("Output of evaluation of many expressions has the wrong size.");
+        }
+
+        auto tiles_k = (m_exprs.size() + multi_formulas - 1) / multi_formulas;
+        auto tiles_i = (in.size() + multi_points - 1) / multi_points;
+
+        run_tiles(tiles_k, tiles_i, pool, [&](size_t tk, size_t ti)
+        {
+            // Scratch is kept per thread, as in parallel_evaluate
+            static thread_local std::vector<T> scratch;
+            scratch.resize(std::max(scratch.size(), m_scratch));
+
+            auto k_end = std::min((tk + 1) * multi_formulas, m_exprs.size());
+            auto i_end = std::min((ti + 1) * multi_points, in.size());
+
+            for (auto i = ti * multi_points; i < i_end; i += block_size)
+            {
+                auto n = std::min(block_size, i_end - i);
+                for (auto k = tk * multi_formulas; k < k_end; k++)
+                {
+                    m_exprs[k].evaluate(in.subspan(i, n), out.subspan(k * in.size() + i, n), scratch);
+                }
+            }
+        });
+    }
+
+    /**
+     * @brief Compiled expression k, which views the packed table.
+    */
+    auto operator[](size_t k) const -> const compiled_expr<T>&
+    {
+        return m_exprs[k];
+    }
+
+    /**
+     * @brief Number of expressions.
+    */
+    auto size() const noexcept -> size_t
+    {
+        return m_exprs.size();
+    }
+
+    /**
+     * @brief Number of values of type T needed as scratch storage to
+     * evaluate any one of the expressions.
+    */
+    auto scratch_size() const noexcept -> size_t
+    {
+        return m_scratch;
+    }
+};
+
+};
@@ -0,0 +1,332 @@
+/**
+ * @file newton.h
+ * @brief Contains root finding by Newton's and Halley's methods, iterated in
+ * the batch evaluator over many starting points at once, e.g., every pixel of
+ * a Newton fractal.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "compiled.h"
+#include "dag.h"
+#include "derivative.h"
+#include "kernels.h"
+#include "optimize.h"
+#include "parallel.h"
+#include "parser/expression.h"
+
+namespace parser
+{
+
+/**
+ * @brief Update applied to the iterate z of a root of f on every iteration.
+*/
+enum class root_method : std::uint8_t
+{
+    NEWTON, // z - f / f', converges quadratically
+    HALLEY  // z - 2 f f' / (2 f'^2 - f f''), converges cubically
+};
+
+/**
+ * @brief Options of root_finder::solve.
+ *
+ * @tparam T The floating point type (float, double or long double) of the
+ * iterates. Defaults to double.
+*/
+template<std::floating_point T = double>
+struct root_options
+{
+    // Largest number of updates made from any starting point
+    size_t max_iterations = 64;
+
+    // A point has converged once an update moves it by at most this much
+    T tolerance = std::sqrt(std::numeric_limits<T>::epsilon());
+
+    // Factor a of the update, i.e., z - a f / f' for NEWTON. Values other
+    // than 1 give the relaxed Newton fractals.
+    std::complex<T> relaxation = 1;
+};
+
+/**
+ * @brief Result of iterating from one starting point.
+ *
+ * @tparam T The floating point type (float, double or long double) of the
+ * iterates. Defaults to double.
+*/
+template<std::floating_point T = double>
+struct root_result
+{
+    std::complex<T> root;   // Last iterate
+    size_t iterations = 0;  // Number of updates made
+    bool converged = false; // Whether the last update was within the tolerance
+};
+
+/**
+ * @brief Finds roots of a math expression f by iterating Newton's or
+ * Halley's method.
+ *
+ * f, f' and, for Halley's method, f'' are differentiated in one dag and
+ * compiled into a single program, so the subexpressions they have in common,
+ * e.g., the sin(z) in both sin(z) z and its derivative cos(z) z + sin(z), are
+ * only evaluated once per iteration.
+ *
+ * Points are iterated compiled_expr::block_size at a time in the batch
+ * evaluator, as separate real and imaginary lanes. A point leaves its block
+ * as soon as it converges, or its iterate is no longer finite, or it runs out
+ * of iterations, and the next starting point takes its lane, so blocks stay
+ * full while there are points left rather than iterating lanes that are
+ * already done.
+ *
+ * @tparam T The floating point type (float, double or long double) of the
+ * iterates. Defaults to double.
+*/
+template<std::floating_point T = double>
+class root_finder
+{
+private:
+    static constexpr size_t block_size = compiled_expr<T>::block_size;
+
+    compiled_expr<T> m_program;
+    root_method m_method;
+
+public:
+    /**
+     * @brief Compiles the updates of a method for a math expression.
+     *
+     * @param f Expression to find the roots of. Converted to postfix first if
+     * it is in infix.
+     * @param method Update to iterate. Defaults to NEWTON.
+     *
+     * @return root_finder instance for the expression.
+     * @throw invalid_argument if the expression is not well-formed, can not
+     * be differentiated, or has more than one variable.
+    */
+    template<template<typename...> class container>
+    explicit root_finder(const expr<T, container>& f, root_method method = root_method::NEWTON) :
+        m_method(method)
+    {
+        dag<T> g;
+        std::vector<typename dag<T>::node_id> derivs;
+
+        std::vector<typename dag<T>::node_id> roots = {g.push(f.postfix())};
+        roots.push_back(differentiate(g, roots[0], derivs));
+        if (method == root_method::HALLEY)
+        {
+            roots.push_back(differentiate(g, roots[1], derivs));
+        }
+
+        for (auto& root: roots)
+        {
+            root = simplify(g, root);
+        }
+
+        m_program = compiled_expr<T>(g, roots);
+
+        if (m_program.variables() > 1)
+        {
+            throw std::invalid_argument("Roots can only be found of expressions of one variable.");
+        }
+    }
+
+    /**
+     * @brief Iterates from many starting points. Safe to call from multiple
+     * threads at once.
+     *
+     * @param in Starting points.
+     * @param out Where the result of iterating from in[i] is written to
+     * out[i]. Must be the same size as in.
+     * @param options Options of the iteration.
+     * @throw invalid_argument if in and out have different sizes.
+    */
+    void solve(std::span<const std::complex<T>> in, std::span<root_result<T>> out, const root_options<T>& options = {}) const
+    {
+        if (in.size() != out.size())
+        {
+            throw std::invalid_argument("Input and output of root finding have different sizes.");
+        }
+
+        // Lanes of the iterates, the values of f, f' (and f'') at them, the
+        // update and one more value for Halley's method
+        auto outputs = m_program.outputs();
+        std::vector<T> lanes(2 * (outputs + 3) * block_size);
+        std::vector<T> scratch(m_program.scratch_size());
+
+        T* z_re = lanes.data();
+        T* z_im = z_re + block_size;
+        T* f_re = z_im + block_size;
+        T* f_im = f_re + outputs * block_size;
+        T* step_re = f_im + outputs * block_size;
+        T* step_im = step_re + block_size;
+        T* t_re = step_im + block_size;
+        T* t_im = t_re + block_size;
+
+        // Values of f, f' and f'' in the order of the roots of the program
+        T* d_re = f_re + block_size;
+        T* d_im = f_im + block_size;
+        T* h_re = f_re + 2 * block_size;
+        T* h_im = f_im + 2 * block_size;
+
+        // Starting point and number of updates of every lane
+        std::array<size_t, block_size> point;
+        std::array<size_t, block_size> iterations;
+
+        T tolerance = options.tolerance * options.tolerance;
+        size_t next = 0;
+        size_t n = 0;
+
+        while (true)
+        {
+            // Fill the free lanes with the next starting points
+            for (; n < block_size && next < in.size(); n++, next++)
+            {
+                z_re[n] = in[next].real();
+                z_im[n] = in[next].imag();
+                point[n] = next;
+                iterations[n] = 0;
+            }
+
+            if (n == 0)
+            {
+                break;
+            }
+
+            m_program.evaluate_lanes(z_re, z_im, f_re, f_im, n, scratch);
+
+            std::copy(f_re, f_re + n, step_re);
+            std::copy(f_im, f_im + n, step_im);
+
+            if (m_method == root_method::NEWTON)
+            {
+                kernel_div(step_re, step_im, d_re, d_im, n);
+            }
+            else
+            {
+                // 2 f f' / (2 f'^2 - f f'')
+                kernel_mul(step_re, step_im, h_re, h_im, n);
+                std::copy(d_re, d_re + n, t_re);
+                std::copy(d_im, d_im + n, t_im);
+                kernel_mul(t_re, t_im, d_re, d_im, n);
+                for (size_t i = 0; i < n; i++)
+                {
+                    t_re[i] = 2 * t_re[i] - step_re[i];
+                    t_im[i] = 2 * t_im[i] - step_im[i];
+                }
+
+                std::copy(f_re, f_re + n, step_re);
+                std::copy(f_im, f_im + n, step_im);
+                kernel_mul(step_re, step_im, d_re, d_im, n);
+                for (size_t i = 0; i < n; i++)
+                {
+                    step_re[i] *= 2;
+                    step_im[i] *= 2;
+                }
+                kernel_div(step_re, step_im, t_re, t_im, n);
+            }
+
+            if (options.relaxation != (T) 1)
+            {
+                kernel_fill(t_re, t_im, options.relaxation, n);
+                kernel_mul(step_re, step_im, t_re, t_im, n);
+            }
+
+            kernel_sub(z_re, z_im, step_re, step_im, n);
+
+            // Move the lanes that are done out of the block, and the others
+            // to the front of it
+            size_t active = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                iterations[i]++;
+
+                auto size = step_re[i] * step_re[i] + step_im[i] * step_im[i];
+                auto converged = size <= tolerance;
+
+                if (converged || !std::isfinite(size) || !std::isfinite(z_re[i]) || !std::isfinite(z_im[i]) || iterations[i] >= options.max_iterations)
+                {
+                    out[point[i]] = {{z_re[i], z_im[i]}, iterations[i], converged};
+                }
+                else
+                {
+                    z_re[active] = z_re[i];
+                    z_im[active] = z_im[i];
+                    point[active] = point[i];
+                    iterations[active] = iterations[i];
+                    active++;
+                }
+            }
+
+            n = active;
+        }
+    }
+
+    /**
+     * @brief Iterates from one starting point.
+     *
+     * @param z Starting point.
+     * @param options Options of the iteration.
+     * @return Result of the iteration.
+    */
+    auto solve(std::complex<T> z, const root_options<T>& options = {}) const -> root_result<T>
+    {
+        root_result<T> result;
+        solve(std::span(&z, 1), std::span(&result, 1), options);
+        return result;
+    }
+
+    /**
+     * @brief Iterates from every point of a grid of width × height points
+     * covering a region of the complex plane, placed as in for_each_tile,
+     * using the workers of a thread pool.
+     *
+     * @param r Region of the complex plane to iterate over.
+     * @param width Number of points along the real axis.
+     * @param height Number of points along the imaginary axis.
+     * @param out Where the result of iterating from pixel (x, y) is written
+     * to out[y * width + x]. Must have width * height values.
+     * @param options Options of the iteration.
+     * @param pool Thread pool to iterate on. Defaults to thread_pool::global().
+     * @throw invalid_argument if out has the wrong size.
+    */
+    void solve(region<T> r, size_t width, size_t height, std::span<root_result<T>> out, const root_options<T>& options = {}, thread_pool& pool = thread_pool::global()) const
+    {
+        if (out.size() != width * height)
+        {
+            throw std::invalid_argument("Output of grid root finding has the wrong size.");
+        }
+
+        for_each_tile(r, width, height, pool, [&](std::span<const std::complex<T>> points, size_t offset)
+        {
+            solve(points, out.subspan(offset, points.size()), options);
+        });
+    }
+
+    /**
+     * @brief Program evaluating f, f' and, for HALLEY, f'', in that order.
+    */
+    auto program() const noexcept -> const compiled_expr<T>&
+    {
+        return m_program;
+    }
+
+    /**
+     * @brief Update iterated by the root finder.
+    */
+    auto method() const noexcept -> root_method
+    {
+        return m_method;
+    }
+};
+
+};
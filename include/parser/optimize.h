@@ -0,0 +1,259 @@
+/**
+ * @file optimize.h
+ * @brief Contains an optimization pass over math expressions, which folds
+ * constant subexpressions and applies algebraic identities.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "dag.h"
+#include "parser/expression.h"
+
+namespace parser
+{
+
+/**
+ * @brief Report of what an optimization pass did.
+*/
+struct optimize_stats
+{
+    size_t tokens_before = 0; // Tokens in postfix of expression before pass
+    size_t tokens_after = 0;  // Tokens in postfix of expression after pass
+    size_t folded = 0;        // Operations on constants replaced by their value
+    size_t rewritten = 0;     // Operations replaced using algebraic identities
+
+    /**
+     * @brief Number of tokens removed from the expression by the pass.
+     * Negative if the pass added tokens, e.g., rewriting x^2 as x * x writes
+     * out x twice in postfix, which is larger when x is.
+    */
+    auto tokens_removed() const noexcept -> std::ptrdiff_t
+    {
+        return (std::ptrdiff_t) tokens_before - (std::ptrdiff_t) tokens_after;
+    }
+};
+
+/**
+ * @brief Whether a node is the constant 0 + 0i with both zeros of the given
+ * sign.
+*/
+template<std::floating_point T>
+auto is_signed_zero(const dag<T>& g, typename dag<T>::node_id n, bool negative) -> bool
+{
+    auto val = g[n].t.val;
+    return is_constant<T>(g, n, 0) && std::signbit(val.real()) == negative && std::signbit(val.imag()) == negative;
+}
+
+/**
+ * @brief Appends a simplified version of a single node to a dag, given its
+ * already simplified arguments.
+ *
+ * Functions and binary operations of constants are folded into a constant
+ * using get_func and get_bin_op. Then only the identities that give the same
+ * bits for every complex x, including signed zeros, infinities and NaNs, are
+ * applied: --x = x, x - 0 = x, x + (-0) = (-0) + x = x and (-0) - x = -x.
+ *
+ * With fast_math, so are x + 0 = 0 + x = x, 0 - x = -x, x * 1 = 1 * x = x,
+ * x / 1 = x, x^1 = x and x^0 = 1, which may change the sign of a zero, and
+ * the value at 0, infinity or NaN, e.g., 0^0 is NaN with std::pow. Small
+ * integer powers x^2, x^3, x^4 and x^-1 are then also replaced by
+ * multiplications and divisions, which are faster and more accurate than
+ * std::pow, but differ from it in the last bits.
+ *
+ * @param g Graph to append node to.
+ * @param t Token of node.
+ * @param lhs Id of simplified argument of a FUNC, or left argument of a BIN_OP.
+ * @param rhs Id of simplified right argument of a BIN_OP.
+ * @param stats Counts of folds and rewrites to add to.
+ * @param fast_math Whether to apply the identities that may change values.
+ *
+ * @return Id of simplified node.
+*/
+template<std::floating_point T>
+auto simplify_node(dag<T>& g, token<T> t, typename dag<T>::node_id lhs, typename dag<T>::node_id rhs, optimize_stats& stats, bool fast_math = false) -> typename dag<T>::node_id
+{
+    auto rewrite = [&](typename dag<T>::node_id n)
+    {
+        stats.rewritten++;
+        return n;
+    };
+
+    // -x, with --y = y
+    auto negate = [&](typename dag<T>::node_id n)
+    {
+        return g[n].t.type == FUNC && g[n].t.op == NEG ? g[n].lhs : g.func(NEG, n);
+    };
+
+    if (t.type == FUNC)
+    {
+        if (g[lhs].t.type == CONST)
+        {
+            stats.folded++;
+            return g.constant(get_func<T>(t.op)(g[lhs].t.val));
+        }
+
+        // --x = x
+        if (t.op == NEG && g[lhs].t.type == FUNC && g[lhs].t.op == NEG)
+        {
+            return rewrite(g[lhs].lhs);
+        }
+
+        return g.func(t.op, lhs);
+    }
+    else if (t.type == BIN_OP)
+    {
+        if (g[lhs].t.type == CONST && g[rhs].t.type == CONST)
+        {
+            stats.folded++;
+            return g.constant(get_bin_op<T>(t.op)(g[lhs].t.val, g[rhs].t.val));
+        }
+
+        if ((t.op == SUB && is_signed_zero<T>(g, rhs, false)) || (t.op == ADD && is_signed_zero<T>(g, rhs, true)))
+        {
+            return rewrite(lhs);
+        }
+        else if (t.op == ADD && is_signed_zero<T>(g, lhs, true))
+        {
+            return rewrite(rhs);
+        }
+        else if (t.op == SUB && is_signed_zero<T>(g, lhs, true))
+        {
+            return rewrite(negate(rhs));
+        }
+        else if (!fast_math)
+        {
+            return g.bin_op(t.op, lhs, rhs);
+        }
+
+        if ((t.op == ADD || t.op == SUB) && is_constant<T>(g, rhs, 0))
+        {
+            return rewrite(lhs);
+        }
+        else if ((t.op == MUL || t.op == DIV || t.op == POW) && is_constant<T>(g, rhs, 1))
+        {
+            return rewrite(lhs);
+        }
+        else if ((t.op == ADD && is_constant<T>(g, lhs, 0)) || (t.op == MUL && is_constant<T>(g, lhs, 1)))
+        {
+            return rewrite(rhs);
+        }
+        else if (t.op == SUB && is_constant<T>(g, lhs, 0))
+        {
+            return rewrite(negate(rhs));
+        }
+        else if (t.op == POW && is_constant<T>(g, rhs, 0))
+        {
+            return rewrite(g.constant(1));
+        }
+        else if (t.op == POW && is_constant<T>(g, rhs, 2))
+        {
+            return rewrite(g.bin_op(MUL, lhs, lhs));
+        }
+        else if (t.op == POW && is_constant<T>(g, rhs, 3))
+        {
+            return rewrite(g.bin_op(MUL, g.bin_op(MUL, lhs, lhs), lhs));
+        }
+        else if (t.op == POW && is_constant<T>(g, rhs, 4))
+        {
+            auto square = g.bin_op(MUL, lhs, lhs);
+            return rewrite(g.bin_op(MUL, square, square));
+        }
+        else if (t.op == POW && is_constant<T>(g, rhs, -1))
+        {
+            return rewrite(g.bin_op(DIV, g.constant(1), lhs));
+        }
+
+        return g.bin_op(t.op, lhs, rhs);
+    }
+    else
+    {
+        return g.add(t);
+    }
+}
+
+/**
+ * @brief Simplifies a subexpression of a dag, appending the nodes of the
+ * simplified subexpression to the same dag. Every node is simplified once,
+ * after its arguments, with simplify_node.
+ *
+ * @param g Graph containing subexpression.
+ * @param root Id of root node of subexpression.
+ * @param stats If given, where to write a report of the pass to.
+ * @param fast_math Whether to apply the identities that may change values,
+ * see simplify_node.
+ *
+ * @return Id of root node of simplified subexpression.
+*/
+template<std::floating_point T>
+auto simplify(dag<T>& g, typename dag<T>::node_id root, optimize_stats* stats = nullptr, bool fast_math = false) -> typename dag<T>::node_id
+{
+    optimize_stats report;
+
+    // Nodes reachable from root. Users always come after the nodes they use,
+    // so a single pass backwards from root reaches everything.
+    std::vector<bool> reachable(root + 1, false);
+    reachable[root] = true;
+    for (auto n = root + 1; n-- > 0;)
+    {
+        if (reachable[n] && g[n].lhs != dag<T>::no_node)
+        {
+            reachable[g[n].lhs] = true;
+        }
+        if (reachable[n] && g[n].rhs != dag<T>::no_node)
+        {
+            reachable[g[n].rhs] = true;
+        }
+    }
+
+    // Simplified node of every reachable node
+    std::vector<typename dag<T>::node_id> simplified(root + 1, dag<T>::no_node);
+    for (typename dag<T>::node_id n = 0; n <= root; n++)
+    {
+        if (reachable[n])
+        {
+            auto current = g[n];
+            auto lhs = current.lhs != dag<T>::no_node ? simplified[current.lhs] : dag<T>::no_node;
+            auto rhs = current.rhs != dag<T>::no_node ? simplified[current.rhs] : dag<T>::no_node;
+            simplified[n] = simplify_node(g, current.t, lhs, rhs, report, fast_math);
+        }
+    }
+
+    if (stats)
+    {
+        report.tokens_before = g.expanded_size(root);
+        report.tokens_after = g.expanded_size(simplified[root]);
+        *stats = report;
+    }
+
+    return simplified[root];
+}
+
+/**
+ * @brief Optimizes given expression by folding constant subexpressions and
+ * applying algebraic identities. See simplify_node for the rules applied.
+ * Run automatically, without fast_math, when compiling an expression.
+ *
+ * @param e Expression to optimize. Converted to postfix first if it is in
+ * infix.
+ * @param stats If given, where to write a report of the pass to.
+ * @param fast_math Whether to apply the identities that may change values,
+ * see simplify_node.
+ * @tparam T floating point type used by expression.
+ *
+ * @return Optimized postfix expression.
+*/
+template<std::floating_point T, template<typename...> class container>
+auto optimize(const expr<T, container>& e, optimize_stats* stats = nullptr, bool fast_math = false) -> expr<T, container>
+{
+    dag<T> g;
+    auto root = simplify(g, g.push(e.postfix()), stats, fast_math);
+    return g.template to_expr<container>(root);
+}
+
+};
@@ -0,0 +1,188 @@
+/**
+ * @file parallel.h
+ * @brief Contains functions to evaluate compiled expressions over grids of
+ * points using many threads at once.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <complex>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "compiled.h"
+#include "thread_pool.h"
+
+namespace parser
+{
+
+/**
+ * @brief Rectangular region of the complex plane.
+ *
+ * @tparam T The floating point type (float, double or long double) of the
+ * corners. Defaults to double.
+*/
+template<std::floating_point T = double>
+struct region
+{
+    std::complex<T> min; // Corner with smallest real and imaginary parts
+    std::complex<T> max; // Corner with largest real and imaginary parts
+};
+
+// Size of the tiles a grid is split into. A tile of complex<double> values
+// is 64 KB, so its input and output fit in the L2 cache of one core.
+inline constexpr size_t tile_width = 256;
+inline constexpr size_t tile_height = 16;
+
+/**
+ * @brief Runs a function on every tile (tx, ty) of a tiles_x × tiles_y grid
+ * of tiles on the workers of a thread pool. Returns once every tile is done,
+ * helping with the tiles meanwhile.
+ *
+ * @param tiles_x Number of tiles along the first axis.
+ * @param tiles_y Number of tiles along the second axis.
+ * @param pool Thread pool to run on.
+ * @param f Function called with the indices tx and ty of every tile. May be
+ * called from many threads at once.
+ * @throw Rethrows the first exception thrown by f, once every tile is done.
+*/
+template<typename function>
+void run_tiles(size_t tiles_x, size_t tiles_y, thread_pool& pool, const function& f)
+{
+    std::atomic<size_t> remaining = tiles_x * tiles_y;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    for (size_t ty = 0; ty < tiles_y; ty++)
+    {
+        for (size_t tx = 0; tx < tiles_x; tx++)
+        {
+            pool.submit([&, tx, ty]
+            {
+                try
+                {
+                    f(tx, ty);
+                }
+                catch (...)
+                {
+                    std::lock_guard lock(error_mutex);
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                }
+
+                remaining--;
+            });
+        }
+    }
+
+    // Help with the tiles instead of blocking, until all are done
+    while (remaining > 0)
+    {
+        if (!pool.run_pending_task())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * @brief Splits a grid of width × height points covering a region of the
+ * complex plane into tiles, and runs a function on every row of every tile
+ * on the workers of a thread pool. Returns once every tile is done, helping
+ * with the tiles meanwhile.
+ *
+ * The point of pixel (x, y) is at the centre of the pixel, i.e.,
+ * r.min + (x + 0.5) dx + i (r.max - (y + 0.5) dy), where dx and dy are the
+ * width and height of a pixel. So row 0 is the top of the region, as in an
+ * image.
+ *
+ * @param r Region of the complex plane to split.
+ * @param width Number of points along the real axis.
+ * @param height Number of points along the imaginary axis.
+ * @param pool Thread pool to run on.
+ * @param f Function called with a span of the points of a row of a tile and
+ * the index y * width + x of its first pixel (x, y). May be called from many
+ * threads at once.
+ * @throw Rethrows the first exception thrown by f, once every tile is done.
+*/
+template<std::floating_point T, typename function>
+void for_each_tile(region<T> r, size_t width, size_t height, thread_pool& pool, const function& f)
+{
+    T dx = (r.max.real() - r.min.real()) / width;
+    T dy = (r.max.imag() - r.min.imag()) / height;
+
+    auto tiles_x = (width + tile_width - 1) / tile_width;
+    auto tiles_y = (height + tile_height - 1) / tile_height;
+
+    run_tiles(tiles_x, tiles_y, pool, [&](size_t tx, size_t ty)
+    {
+        // Points are kept per tile, not per thread, as f may help with other
+        // tiles on this thread, e.g., by calling for_each_tile itself
+        std::vector<std::complex<T>> points(tile_width);
+
+        auto x_begin = tx * tile_width;
+        auto x_end = std::min(x_begin + tile_width, width);
+        auto y_end = std::min((ty + 1) * tile_height, height);
+
+        for (auto y = ty * tile_height; y < y_end; y++)
+        {
+            T im = r.max.imag() - (y + (T) 0.5) * dy;
+            for (auto x = x_begin; x < x_end; x++)
+            {
+                points[x - x_begin] = {r.min.real() + (x + (T) 0.5) * dx, im};
+            }
+
+            f(std::span<const std::complex<T>>(points.data(), x_end - x_begin), y * width + x_begin);
+        }
+    });
+}
+
+/**
+ * @brief Evaluates a compiled expression over a grid of width × height
+ * points covering a region of the complex plane. The region is split into
+ * tiles that are evaluated by the workers of a thread pool, with the points
+ * placed as in for_each_tile.
+ *
+ * @param e Compiled expression to evaluate.
+ * @param r Region of the complex plane to evaluate over.
+ * @param width Number of points along the real axis.
+ * @param height Number of points along the imaginary axis.
+ * @param out Where the value at pixel (x, y) is written to
+ * out[y * width + x]. Must have width * height values.
+ * @param pool Thread pool to evaluate on. Defaults to thread_pool::global().
+ * @throw invalid_argument if out has the wrong size.
+*/
+template<std::floating_point T>
+void parallel_evaluate(const compiled_expr<T>& e, region<T> r, size_t width, size_t height, std::span<std::complex<T>> out, thread_pool& pool = thread_pool::global())
+{
+    if (out.size() != width * height)
+    {
+        throw std::invalid_argument("Output of grid evaluation has the wrong size.");
+    }
+
+    for_each_tile(r, width, height, pool, [&](std::span<const std::complex<T>> points, size_t offset)
+    {
+        // Scratch is kept per thread, as the points are
+        static thread_local std::vector<T> scratch;
+        scratch.resize(std::max(scratch.size(), e.scratch_size()));
+
+        e.evaluate(points, out.subspan(offset, points.size()), scratch);
+    });
+}
+
+};
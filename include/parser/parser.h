@@ -7,5 +7,8 @@
 
 #pragma once
 
+#include "parser/compact.h"
 #include "parser/expression.h"
-#include "parser/token.h"
\ No newline at end of file
+#include "parser/parse.h"
+#include "parser/token.h"
+#include "parser/tokenizer.h"
\ No newline at end of file
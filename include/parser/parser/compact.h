@@ -0,0 +1,354 @@
+/**
+ * @file compact.h
+ * @brief Contains a compact encoding of postfix expressions, for storing
+ * many expressions, or large ones, in little memory.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <span>
+#include <stack>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "expression.h"
+#include "parse.h"
+#include "token.h"
+
+namespace parser
+{
+
+// Codes of VAR and CONST tokens in a compact_expr. Every other token is coded
+// by its operation, which is below NO_OP.
+inline constexpr std::uint8_t compact_var = 0xFE;
+inline constexpr std::uint8_t compact_const = 0xFF;
+
+/**
+ * @brief Postfix expression in which every token is a single byte: the
+ * operation of a FUNC or BIN_OP token, or compact_var or compact_const. The
+ * values of the CONST tokens are kept in order in a constant pool, and the
+ * slots of the VAR tokens in an array of their own, so the k-th CONST token
+ * has the k-th value of the pool.
+ *
+ * A token<T> is 32 bytes for T = double and 64 for long double, as every
+ * token has room for a value, while here a token takes 1 byte plus the size
+ * of its value if it is a constant, or 4 bytes if it is a variable: about 5
+ * to 7 bytes per token in typical expressions. The tokens are decoded while
+ * iterating, so a compact_expr is used in place wherever a range of tokens
+ * is, e.g., by dag::push or the iterator constructor of expr.
+ *
+ * @tparam T The floating point type (float, double or long double) of the
+ * constants. Defaults to double.
+*/
+template<std::floating_point T = double>
+class compact_expr
+{
+    std::vector<std::uint8_t> m_codes;
+    std::vector<std::complex<T>> m_consts;
+    std::vector<std::uint32_t> m_slots;
+
+    /**
+     * @brief Appends a token of a postfix expression.
+    */
+    void push_back(const token<T>& t)
+    {
+        if (t.type == VAR)
+        {
+            m_codes.push_back(compact_var);
+            m_slots.push_back(t.slot);
+        }
+        else if (t.type == CONST)
+        {
+            m_codes.push_back(compact_const);
+            m_consts.push_back(t.val);
+        }
+        else
+        {
+            m_codes.push_back((std::uint8_t) t.op);
+        }
+    }
+
+public:
+    /**
+     * @brief Input iterator decoding the tokens of a compact_expr in order.
+    */
+    class const_iterator
+    {
+        const compact_expr* m_expr = nullptr;
+        size_t m_code = 0, m_const = 0, m_var = 0;
+
+        // Points at a decoded token, for it->type
+        struct arrow
+        {
+            token<T> t;
+
+            auto operator->() const -> const token<T>*
+            {
+                return &t;
+            }
+        };
+
+    public:
+        using value_type = token<T>;
+        using reference = token<T>;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::input_iterator_tag;
+
+        const_iterator() {};
+
+        const_iterator(const compact_expr* e, size_t code, size_t consts, size_t vars) :
+            m_expr(e),
+            m_code(code),
+            m_const(consts),
+            m_var(vars)
+        {
+        }
+
+        auto operator*() const -> token<T>
+        {
+            auto code = m_expr->m_codes[m_code];
+            if (code == compact_var)
+            {
+                return {VAR, NO_OP, 0, m_expr->m_slots[m_var]};
+            }
+            else if (code == compact_const)
+            {
+                return {CONST, NO_OP, m_expr->m_consts[m_const]};
+            }
+
+            return {operation_type((operation) code), (operation) code};
+        }
+
+        auto operator->() const -> arrow
+        {
+            return {**this};
+        }
+
+        auto operator++() -> const_iterator&
+        {
+            auto code = m_expr->m_codes[m_code++];
+            m_var += code == compact_var;
+            m_const += code == compact_const;
+            return *this;
+        }
+
+        auto operator++(int) -> const_iterator
+        {
+            auto old = *this;
+            ++*this;
+            return old;
+        }
+
+        auto operator==(const const_iterator& other) const -> bool
+        {
+            return m_code == other.m_code;
+        }
+    };
+
+    /**
+     * @brief Default constructor, with no tokens.
+    */
+    compact_expr() {};
+
+    /**
+     * @brief Encodes a math expression.
+     *
+     * @param e Expression to encode. Converted to postfix first if it is in
+     * infix.
+     *
+     * @return compact_expr instance holding the postfix expression.
+     * @throw invalid_argument if the infix expression is not well-formed.
+    */
+    template<template<typename...> class container>
+    explicit compact_expr(const expr<T, container>& e)
+    {
+        auto encode = [&](const auto& postfix)
+        {
+            m_codes.reserve((size_t) std::distance(postfix.cbegin(), postfix.cend()));
+            for (auto it = postfix.cbegin(); it != postfix.cend(); it++)
+            {
+                push_back(*it);
+            }
+        };
+
+        if (e.is_postfix())
+        {
+            encode(e);
+        }
+        else
+        {
+            encode(e.postfix());
+        }
+    }
+
+    /**
+     * @brief Parses a string representing an infix expression straight into
+     * a compact postfix expression, without a token<T> for any of its
+     * tokens. See parse for what the string may contain.
+     *
+     * @param infix String representing an infix math expression.
+     * @param variables Names of the variables of the expression, in order of
+     * their slots. Defaults to the single variable z.
+     *
+     * @return compact_expr instance holding the postfix expression.
+     * @throw parse_error if the string is not a well-formed expression.
+    */
+    static auto parse(std::string_view infix, std::span<const std::string_view> variables = default_variables) -> compact_expr
+    {
+        compact_expr e;
+        parser::parse<T>(infix, [&](const token<T>& t) { e.push_back(t); }, variables);
+        return e;
+    }
+
+    /**
+     * @brief Decodes the expression into an expr.
+     *
+     * @tparam container Container of the tokens of the expression. Defaults
+     * to std::list.
+     * @return Equivalent postfix expression.
+    */
+    template<template<typename...> class container = std::list>
+    auto expand() const -> expr<T, container>
+    {
+        return expr<T, container>(begin(), end());
+    }
+
+    /**
+     * @brief Evaluates the expression of the single variable z, as
+     * expr::evaluate.
+     *
+     * @param z Value to evaluate expression at.
+     * @throw invalid_argument if the expression has more than one variable.
+    */
+    auto evaluate(std::complex<T> z) const -> std::complex<T>
+    {
+        return evaluate(std::span<const std::complex<T>>(&z, 1));
+    }
+
+    /**
+     * @brief Evaluates the expression, as expr::evaluate.
+     *
+     * @param slots Values of the variables, indexed by their slots.
+     * @throw invalid_argument if a variable has no value in slots, or the
+     * expression is not a legal postfix expression.
+    */
+    auto evaluate(std::span<const std::complex<T>> slots) const -> std::complex<T>
+    {
+        std::stack<std::complex<T>, std::vector<std::complex<T>>> eval_stack;
+        size_t k = 0, v = 0;
+
+        for (auto code: m_codes)
+        {
+            if (code == compact_const)
+            {
+                eval_stack.push(m_consts[k++]);
+            }
+            else if (code == compact_var)
+            {
+                auto slot = m_slots[v++];
+                if (slot >= slots.size())
+                {
+                    throw std::invalid_argument("Value of variable not given.");
+                }
+
+                eval_stack.push(slots[slot]);
+            }
+            else if (operation_type((operation) code) == FUNC && eval_stack.size() >= 1)
+            {
+                auto z = eval_stack.top();
+                eval_stack.pop();
+                eval_stack.push(get_func<T>((operation) code)(z));
+            }
+            else if (operation_type((operation) code) == BIN_OP && eval_stack.size() >= 2)
+            {
+                auto rhs = eval_stack.top();
+                eval_stack.pop();
+                auto lhs = eval_stack.top();
+                eval_stack.pop();
+                eval_stack.push(get_bin_op<T>((operation) code)(lhs, rhs));
+            }
+            else
+            {
+                throw std::invalid_argument("Expression is not a legal postfix expression.");
+            }
+        }
+
+        if (eval_stack.size() != 1)
+        {
+            throw std::invalid_argument("Expression is not a legal postfix expression.");
+        }
+
+        return eval_stack.top();
+    }
+
+    auto begin() const -> const_iterator
+    {
+        return const_iterator(this, 0, 0, 0);
+    }
+
+    auto end() const -> const_iterator
+    {
+        return const_iterator(this, m_codes.size(), m_consts.size(), m_slots.size());
+    }
+
+    auto cbegin() const -> const_iterator
+    {
+        return begin();
+    }
+
+    auto cend() const -> const_iterator
+    {
+        return end();
+    }
+
+    /**
+     * @brief One code per token, in order.
+    */
+    auto codes() const noexcept -> std::span<const std::uint8_t>
+    {
+        return m_codes;
+    }
+
+    /**
+     * @brief Values of the CONST tokens, in order.
+    */
+    auto constants() const noexcept -> std::span<const std::complex<T>>
+    {
+        return m_consts;
+    }
+
+    /**
+     * @brief Slots of the VAR tokens, in order.
+    */
+    auto slots() const noexcept -> std::span<const std::uint32_t>
+    {
+        return m_slots;
+    }
+
+    /**
+     * @brief Number of tokens.
+    */
+    auto size() const noexcept -> size_t
+    {
+        return m_codes.size();
+    }
+
+    /**
+     * @brief Number of bytes taken by the tokens, not counting the unused
+     * capacity of the arrays.
+    */
+    auto bytes() const noexcept -> size_t
+    {
+        return m_codes.size() + m_consts.size() * sizeof(std::complex<T>) + m_slots.size() * sizeof(std::uint32_t);
+    }
+};
+
+};
@@ -7,62 +7,56 @@
 
 #pragma once
 
+#include <algorithm>
 #include <concepts>
 #include <iterator>
 #include <list>
+#include <memory_resource>
+#include <span>
 #include <stack>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+#include "parse.h"
 #include "token.h"
+#include "tokenizer.h"
 
 namespace parser
 {
 
 /**
- * @brief Wrapper around std::list<token> that represents a math expression as 
- * a sequence of parser::token, each which represent a value or an operation.
+ * @brief Wrapper around a sequence container of tokens that represents a math
+ * expression as a sequence of parser::token, each which represent a value or
+ * an operation.
  * 
  * @tparam T The floating point type (float, double or long double) to use in 
  * the storing and parsing of values in the expression. Defaults to double.
+ * @tparam container The sequence container to store the tokens in. Defaults to
+ * std::list. See the aliases vector_expr and arena_expr below.
 */
-template<std::floating_point T = double>
+template<std::floating_point T = double, template<typename...> class container = std::list>
 class expr
 {
+public:
+    using storage_type = container<token<T>>;
+
 private:
     /**
-     * Use a list instead of a vector to represent the expression since random
-     * access into an expression is not important, the expressions would be
-     * parsed by traversing the tokens one by one. But, expressions will be
-     * modified repeatedly with insertions and deletions anywhere in the
-     * expression, where lists outperform vectors.
+     * The tokens of the expression. With std::list, tokens can be inserted and
+     * deleted anywhere in the expression in constant time, but every token is
+     * its own heap node. Parsing, postfix() and differentiate only ever append
+     * tokens, so std::vector (or std::pmr::vector, to allocate from an arena)
+     * is usually the better choice: it makes far fewer allocations and is
+     * traversed contiguously in evaluate.
     */
-    std::list<token<T>> m_expr;
+    storage_type m_expr;
     
     // True if expression in postfix, False if expression in infix
     bool m_postfix;
 
-    /**
-     * @brief Helper function in interpreting input string. Finds end of 
-     * function name escaped using a \. 
-     * 
-     * @param input Input string to find end of function name in.
-     * @param n Index of where function name starts.
-     * @return Index of where function name ends.
-     * @throw If end index not found.
-    */
-    auto get_op_end_index(const std::string& input, size_t n) -> size_t
-    {
-        for (size_t i = n + 1; i < input.size(); i++)
-        {
-            if (input[i] == '\\' || input[i] == '-' || input[i] == '+' || input[i] == '*' || input[i] == '/' || input[i] == '^' || input[i] == '{' || input[i] == '(' || input[i] == '[') 
-            {
-                return i - 1;
-            }
-        }
-        
-        throw std::invalid_argument("Operation end index not found.");
-    }
-
 public:
     /**
      * @brief Default constructor.
@@ -71,133 +65,40 @@ public:
 
     /**
      * @brief Initialize infix list of tokens from a string representing an 
-     *        infix expression.
+     *        infix expression. See tokenize for what the string may contain.
      * 
      * @param infix String representing an infix math expression. Note that any
      *        spaces in the string are ignored.
+     * @param variables Names of the variables of the expression, in order of
+     *        their slots. Defaults to the single variable z.
      * 
      * @return expr instance representing infix math expression.
+     * @throw invalid_argument if the string contains anything not recognized.
     */
-    expr(const std::string& infix)
+    expr(std::string_view infix, std::span<const std::string_view> variables = default_variables):
+        m_postfix(false)
     {
-        // Input with spaces removed
-        auto cleaned = infix;
-        std::string::iterator end_pos = std::remove(cleaned.begin(), cleaned.end(), ' ');
-        cleaned.erase(end_pos, cleaned.end());
-
-        for (size_t i = 0; i < cleaned.size(); i++)
-        {
-            // pre-defined operation escaped by \ found, so the token for the operation is made
-            if (cleaned[i] == '\\')
-            {
-                auto j = get_op_end_index(cleaned, i);
-                auto op_str = cleaned.substr(i + 1, j - i);
-                auto op = get_operation(op_str);
-                auto type = get_token_type(op);
-                m_expr.push_back({type, op});
-                i = j;
-            }
-            // negative sign found at start of expression, so NEG token pushed instead of SUB
-            else if (i == 0 && cleaned[i] == '-')
-            {
-                m_expr.push_back({FUNC, NEG});
-            }
-            // negative sign found immediately after bracket, so NEG token pushed instead of SUB
-            else if (i > 0 && cleaned[i] == '-' && (cleaned[i - 1] == '{' || cleaned[i - 1] == '('))
-            {
-                m_expr.push_back({FUNC, NEG});
-            }
-            // a number is found, so we look for the end of the number (i.e., the first non 0-9/. character)
-            else if (std::isdigit(cleaned[i]) || cleaned[i] == '.') {
-                bool period_found = false;
-                auto j = i;
-
-                while (j < cleaned.size() && (std::isdigit(cleaned[j]) || cleaned[j] == '.'))
-                {
-                    if (cleaned[j] == '.')
-                    {
-                        if (period_found)
-                        {
-                            throw std::invalid_argument("Invalid number formatting detected.");
-                        }
-                        else
-                        {
-                            period_found = true;
-                        }
-                    }
-                    j++;
-                }
-
-                auto num = std::stod(cleaned.substr(i, j - i));
-
-                if (j < cleaned.size() && cleaned[j] == 'i')
-                {
-                    m_expr.push_back({CONST, NO_OP, std::complex<T>(0, num)});
-                    j++;
-                }
-                else
-                {
-                    m_expr.push_back({CONST, NO_OP, num});
-                }
-
-                i = j - 1;
-            }
-            // a complex number [a,b] is found
-            else if (cleaned[i] == '[')
-            {
-                auto j = i + 1;
-
-                while (j < cleaned.size() && cleaned[j] != ',')
-                {
-                    j++;
-                }
-
-                auto re = std::stod(cleaned.substr(i + 1, j - i - 1));
-                auto k = j + 1;
-                
-                while (k < cleaned.size() && cleaned[k] != ']')
-                {
-                    k++;
-                }
-
-                auto im = std::stod(cleaned.substr(j + 1, k - j - 1));
-
-                m_expr.push_back({CONST, NO_OP, std::complex<T>(re, im)});
+        tokenize<T>(infix, [&](const token<T>& t) { m_expr.push_back(t); }, variables);
+    }
 
-                i = k;
-            }
-            // imaginary constant i found
-            else if (cleaned[i] == 'i')
-            {
-                m_expr.push_back({CONST, NO_OP, std::complex<T>(0, 1)});
-            }
-            // Euler's number i found
-            else if (cleaned[i] == 'e')
-            {
-                m_expr.push_back({CONST, NO_OP, std::complex<T>(2.71828182845904523536, 0)});
-            }
-            // pi found
-            else if (cleaned.substr(i, 2) == "pi")
-            {
-                m_expr.push_back({CONST, NO_OP, std::complex<T>(3.14159265358979323846, 0)});
-                i++;
-            }
-            // z found
-            else if (cleaned[i] == 'z')
-            {
-                m_expr.push_back({VAR, NO_OP, 0});
-            }
-            // +, -, *, /, (, ), {, } found
-            else 
-            {
-                auto op_str = cleaned.substr(i, 1);
-                auto op = get_operation(op_str);
-                auto type = get_token_type(op);
-                m_expr.push_back({type, op});
-            }
-        }
-    
-        m_postfix = false;
+    /**
+     * @brief Parses a string representing an infix expression straight into
+     * a postfix expression, without building the infix expression first. See
+     * parse for what the string may contain.
+     * 
+     * @param infix String representing an infix math expression.
+     * @param variables Names of the variables of the expression, in order of
+     *        their slots. Defaults to the single variable z.
+     * 
+     * @return expr instance in postfix, the same as expr(infix).postfix().
+     * @throw parse_error if the string is not a well-formed expression, with
+     * the offset of the first character that shows it.
+    */
+    static auto parse(std::string_view infix, std::span<const std::string_view> variables = default_variables) -> expr
+    {
+        storage_type postfix;
+        parser::parse<T>(infix, [&](const token<T>& t) { postfix.push_back(t); }, variables);
+        return expr(std::move(postfix), true);
     }
 
     /**
@@ -209,7 +110,7 @@ public:
      * 
      * @return expr instance representing math expression.
     */
-    expr(const std::list<token<T>>& other, bool postfix = true):
+    expr(const storage_type& other, bool postfix = true):
         m_expr(other),
         m_postfix(postfix)
     {}
@@ -223,8 +124,8 @@ public:
      * 
      * @return expr instance representing math expression.
     */
-    expr(std::list<token<T>>&& other, bool postfix = true):
-        m_expr(other),
+    expr(storage_type&& other, bool postfix = true):
+        m_expr(std::move(other)),
         m_postfix(postfix)
     {}
 
@@ -320,14 +221,26 @@ public:
     ~expr() = default;
 
     /**
-     * @brief Evaluates a postfix expression.
+     * @brief Evaluates a postfix expression of the single variable z.
      * 
-     * @param postfix Vector of tokens representing a postfix math expression.
      * @param z Value to evaluate expression at.
+     * @throw invalid_argument if the expression has more than one variable.
+    */
+    auto evaluate(std::complex<T> z) const -> std::complex<T>
+    {
+        return evaluate(std::span<const std::complex<T>>(&z, 1));
+    }
+
+    /**
+     * @brief Evaluates a postfix expression.
+     * 
+     * @param slots Values of the variables, indexed by the slots of their
+     * tokens, i.e., in the order their names were given in when parsing.
+     * @throw invalid_argument if a variable has no value in slots.
     */
-    auto evaluate(std::complex<T> z) -> std::complex<T>
+    auto evaluate(std::span<const std::complex<T>> slots) const -> std::complex<T>
     {
-        std::stack<std::complex<T>> eval_stack;
+        std::stack<std::complex<T>, std::vector<std::complex<T>>> eval_stack;
         std::complex<T> temp1, temp2;
 
         for (auto it = m_expr.begin(); it != m_expr.end(); it++)
@@ -338,13 +251,18 @@ public:
             }
             else if (it->type == VAR)
             {
-                eval_stack.push(z);
+                if (it->slot >= slots.size())
+                {
+                    throw std::invalid_argument("Value of variable not given.");
+                }
+
+                eval_stack.push(slots[it->slot]);
             }
             else if (it->type == FUNC)
             {
                 temp1 = eval_stack.top();
                 eval_stack.pop();
-                eval_stack.push(get_func(it->op)(temp1));
+                eval_stack.push(get_func<T>(it->op)(temp1));
             }
             else if (it->type == BIN_OP)
             {
@@ -352,7 +270,7 @@ public:
                 eval_stack.pop();
                 temp2 = eval_stack.top();
                 eval_stack.pop();
-                eval_stack.push(get_bin_op(it->op)(temp2, temp1));
+                eval_stack.push(get_bin_op<T>(it->op)(temp2, temp1));
             }
         }
 
@@ -361,10 +279,21 @@ public:
         return temp1;
     }
 
+    /**
+     * @brief Whether the expression is in postfix, e.g., as returned by
+     * postfix() or parse, rather than in infix.
+    */
+    auto is_postfix() const noexcept -> bool
+    {
+        return m_postfix;
+    }
+
     /**
      * @brief Returns an equivalent postfix expression.
      * 
      * @return expr equivalent in postfix.
+     * @throw parse_error if the infix expression is not well-formed, with the
+     * index of the first token that shows it as its offset.
     */
     auto postfix() const -> expr
     {
@@ -374,69 +303,23 @@ public:
             return *this;
         }
         
-        // Convert infix to postfix
-        std::list<token<T>> postfix;
-        std::stack<token<T>> stack;
-
-        for (auto& t: m_expr)
+        // Convert infix to postfix, with the index of every token as its
+        // offset
+        storage_type postfix;
+        if constexpr (requires { postfix.reserve(m_expr.size()); })
         {
-            if (t.type == VAR || t.type == CONST)
-            {
-                postfix.push_back(t);
-            }
-            else if (t.type == FUNC)
-            {
-                stack.push(t);
-            }
-            else if (t.type == BIN_OP)
-            {
-                auto t_precedence = get_precedence(t.op);
-
-                while (!stack.empty() && stack.top().op != L_BRACKET && get_precedence(stack.top().op) >= t_precedence)
-                {
-                    postfix.push_back(stack.top());
-                    stack.pop();
-                }
-
-                stack.push(t);
-            }
-            else if (t.op == L_BRACKET)
-            {
-                stack.push(t);
-            }
-            else if (t.op == R_BRACKET)
-            {
-                while (stack.top().op != L_BRACKET)
-                {
-                    if (stack.empty())
-                    {
-                        throw std::invalid_argument("Mismatched brackets in infix expression.");
-                    }
-
-                    postfix.push_back(stack.top());
-                    stack.pop();
-                }
-
-                stack.pop();
-
-                if (stack.top().type == FUNC)
-                {
-                    postfix.push_back(stack.top());
-                    stack.pop();
-                }
-            }
+            postfix.reserve(m_expr.size());
         }
 
-        while (!stack.empty())
-        {
-            if (stack.top().op == L_BRACKET)
-            {
-                throw std::invalid_argument("Mismatched brackets in infix expression.");
-            }
+        auto emit = [&](const token<T>& t) { postfix.push_back(t); };
+        postfix_parser<T, decltype(emit)> parser(emit);
 
-            postfix.push_back(stack.top());
-            stack.pop();
+        size_t offset = 0;
+        for (auto& t: m_expr)
+        {
+            parser.push(t, offset++);
         }
+        parser.finish(offset);
 
         return postfix;
     }
@@ -500,6 +383,78 @@ public:
         return start;
     }
 
+    /**
+     * @brief Computes the subexpression extent table of a postfix expression.
+     * 
+     * Entry i of the table is the index of the first token of the smallest
+     * legal subexpression (see subexpr_begin above) that ends at token i. The
+     * table is built in a single forward pass, after which the start of any
+     * subexpression is found in constant time instead of with a backward walk.
+     * 
+     * @return Subexpression extent table, with one entry per token.
+     * @throw invalid_argument if the expression is not a legal postfix 
+     * expression.
+    */
+    auto extents() const -> std::vector<size_t>
+    {
+        std::vector<size_t> table;
+        table.reserve(m_expr.size());
+
+        // Indices of the last tokens of the subexpressions evaluated so far;
+        // the stack of an evaluation, with indices in place of values.
+        std::vector<size_t> stack;
+
+        for (auto& t: m_expr)
+        {
+            auto i = table.size();
+
+            if (t.type == VAR || t.type == CONST)
+            {
+                table.push_back(i);
+                stack.push_back(i);
+            }
+            else if (t.type == FUNC && stack.size() >= 1)
+            {
+                // [[g] f] starts where [g] starts
+                table.push_back(table[stack.back()]);
+                stack.back() = i;
+            }
+            else if (t.type == BIN_OP && stack.size() >= 2)
+            {
+                // [[f] [g] ·] starts where [f] starts
+                stack.pop_back();
+                table.push_back(table[stack.back()]);
+                stack.back() = i;
+            }
+            else
+            {
+                throw std::invalid_argument("Expression is not a legal postfix expression.");
+            }
+        }
+
+        return table;
+    }
+
+    /**
+     * @brief Constant time version of subexpr_begin, using the subexpression
+     * extent table of the expression.
+     * 
+     * @tparam iter Random access iterator.
+     * 
+     * @param first Iterator to the first token of the expression.
+     * @param end Iterator to one after the last token of subexpression.
+     * @param table Subexpression extent table of the expression, from 
+     * extents().
+     * 
+     * @return Random access iterator pointing to first token of smallest legal
+     * subexpression that ends at @p end.
+    */
+    template<std::random_access_iterator iter>
+    static auto subexpr_begin(iter first, iter end, const std::vector<size_t>& table)
+    {
+        return first + table[end - first - 1];
+    }
+
     // The following are simply wrapper functions around the contained list. See
     // https://en.cppreference.com/w/cpp/container/list for documentaion of the 
     // underlying functions.
@@ -659,4 +614,19 @@ public:
     }
 };
 
+/**
+ * @brief Expression stored contiguously in a std::vector.
+*/
+template<std::floating_point T = double>
+using vector_expr = expr<T, std::vector>;
+
+/**
+ * @brief Expression stored contiguously in a std::pmr::vector, which 
+ * allocates from std::pmr::get_default_resource(). Set that to, e.g., a
+ * std::pmr::monotonic_buffer_resource to parse and differentiate from an 
+ * arena.
+*/
+template<std::floating_point T = double>
+using arena_expr = expr<T, std::pmr::vector>;
+
 };
\ No newline at end of file
@@ -0,0 +1,193 @@
+/**
+ * @file parse.h
+ * @brief Contains a parser that converts a string representing an infix math
+ * expression straight into postfix tokens, in the same pass as tokenizing it,
+ * with an operator-precedence parser on an explicit stack, as in the
+ * shunting-yard algorithm, and rejects malformed expressions at the first
+ * token that can not follow the ones before it.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "token.h"
+#include "tokenizer.h"
+
+namespace parser
+{
+
+/**
+ * @brief Converts the tokens of an infix expression, given one at a time,
+ * into postfix tokens with an explicit stack of waiting operations, as in the
+ * shunting-yard algorithm.
+ *
+ * Binary operations bind by get_precedence, with + - below * / below ^, and
+ * are left associative, so 2^3^2 is (2^3)^2. A function binds tighter than
+ * any of them, to the value right after it, so \\sin z^2 is (\\sin z)^2, and
+ * to the whole of a bracket right after it. Negation binds as * and /, so
+ * -z^2 is -(z^2) and -z * 2 is (-z) * 2, but, as a function, -(z)^2 is
+ * (-z)^2.
+ *
+ * Operations whose right operand is still being read wait on a stack, rather
+ * than in the frames of recursive calls, so brackets may be nested as deep
+ * as memory allows. The parser alternates between expecting a value (a
+ * variable, a constant, a function or an opening bracket) and expecting what
+ * may follow one (a binary operation, a closing bracket or the end), so
+ * every malformed expression is rejected at the first token that is out of
+ * place, and every expression accepted becomes a legal postfix expression.
+ * Can be used in constant expressions.
+ *
+ * @tparam T Floating point type used by expression.
+ * @tparam F Type of the function called with every postfix token, in order.
+*/
+template<std::floating_point T, typename F>
+class postfix_parser
+{
+    // Operation waiting for its operands, and where it was found
+    struct pending
+    {
+        operation op;
+        size_t offset;
+    };
+
+    F m_emit;
+    std::vector<pending> m_stack;
+
+    // True if a value is expected next, false if a value was just completed
+    bool m_value = true;
+
+    /**
+     * @brief Emits the waiting operations that bind at least as tight as
+     * precedence, up to the innermost open bracket. The value just completed
+     * is their last operand.
+    */
+    constexpr void reduce(size_t precedence)
+    {
+        while (!m_stack.empty() && m_stack.back().op != L_BRACKET && get_precedence(m_stack.back().op) >= precedence)
+        {
+            auto op = m_stack.back().op;
+            m_stack.pop_back();
+            m_emit(token<T>{operation_type(op), op});
+        }
+    }
+
+public:
+    /**
+     * @brief Constructs a parser that has read no tokens.
+     *
+     * @param emit Function called with every postfix token, in order.
+     *
+     * @return postfix_parser instance.
+    */
+    constexpr explicit postfix_parser(F emit) :
+        m_emit(emit)
+    {
+    }
+
+    /**
+     * @brief Reads the next token of the infix expression.
+     *
+     * @param t Token.
+     * @param offset Offset of the token in the expression, reported by the
+     * parse_error if it is out of place.
+     * @throw parse_error if the token can not follow the tokens before it.
+    */
+    constexpr void push(const token<T>& t, size_t offset)
+    {
+        if (m_value)
+        {
+            if (t.type == VAR || t.type == CONST)
+            {
+                m_emit(t);
+                m_value = false;
+            }
+            else if (t.type == FUNC || t.op == L_BRACKET)
+            {
+                m_stack.push_back({t.op, offset});
+            }
+            else
+            {
+                throw parse_error(t.op == R_BRACKET ? "Missing value before closing bracket" : "Missing value before operation", offset);
+            }
+        }
+        else if (t.type == BIN_OP)
+        {
+            reduce(get_precedence(t.op));
+            m_stack.push_back({t.op, offset});
+            m_value = true;
+        }
+        else if (t.op == R_BRACKET)
+        {
+            reduce(0);
+            if (m_stack.empty())
+            {
+                throw parse_error("Closing bracket without an opening bracket", offset);
+            }
+
+            m_stack.pop_back();
+
+            // A function right before the bracket applies to all of it
+            if (!m_stack.empty() && operation_type(m_stack.back().op) == FUNC)
+            {
+                auto op = m_stack.back().op;
+                m_stack.pop_back();
+                m_emit(token<T>{FUNC, op});
+            }
+        }
+        else
+        {
+            throw parse_error("Missing operation before value", offset);
+        }
+    }
+
+    /**
+     * @brief Ends the infix expression, emitting the operations still
+     * waiting.
+     *
+     * @param offset Offset of the end of the expression, i.e., its length.
+     * @throw parse_error if the expression is empty, ends in an operation or
+     * function, or has a bracket that is not closed.
+    */
+    constexpr void finish(size_t offset)
+    {
+        if (m_value)
+        {
+            throw parse_error("Missing value at end of expression", offset);
+        }
+
+        reduce(0);
+        if (!m_stack.empty())
+        {
+            throw parse_error("Opening bracket without a closing bracket", m_stack.back().offset);
+        }
+    }
+};
+
+/**
+ * @brief Parses a string representing an infix math expression into postfix
+ * tokens, in a single pass over the string, without an infix expression in
+ * between, by the shunting-yard style operator-precedence parser of
+ * postfix_parser. See tokenize for what the string may contain and
+ * postfix_parser for how it is read. Can be used in constant expressions.
+ *
+ * @param infix String representing an infix math expression.
+ * @param emit Function called with every postfix token, in order.
+ * @param variables Names of the variables, in order of their slots. Defaults
+ * to default_variables, i.e., the single variable z.
+ * @throw parse_error if the string is not a well-formed expression, with the
+ * offset of the first character that shows it.
+*/
+template<std::floating_point T, typename F>
+constexpr void parse(std::string_view infix, F&& emit, std::span<const std::string_view> variables = default_variables)
+{
+    postfix_parser<T, F&> parser(emit);
+    tokenize<T>(infix, [&](const token<T>& t, size_t offset) { parser.push(t, offset); }, variables);
+    parser.finish(infix.size());
+}
+
+};
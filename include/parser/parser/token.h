@@ -10,6 +10,9 @@
 #pragma once
 
 #include <complex>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
 #include <unordered_map>
 
 namespace parser
@@ -33,9 +36,11 @@ enum operation { L_BRACKET, R_BRACKET, ADD, SUB, NEG, MUL, DIV, POW, RE, IM, ABS
 template<std::floating_point T = double>
 struct token 
 {
-    token_type type;     // Must always be set
-    operation op;        // NO_OP if token_type = VAR, CONST
-    std::complex<T> val; // Set only if token_type = VAR, CONST
+    token_type type;        // Must always be set
+    operation op = NO_OP;   // NO_OP if token_type = VAR, CONST
+    std::complex<T> val{};  // Set only if token_type = CONST
+    std::uint32_t slot = 0; // Set only if token_type = VAR, index of the
+                            // variable in the variables it was parsed with
 };
 
 /**
@@ -93,9 +98,9 @@ auto (*get_func(operation op))(std::complex<T> z) -> std::complex<T>
         {operation::COS,   [](std::complex<T> z) { return std::cos(z); }},
         {operation::SIN,   [](std::complex<T> z) { return std::sin(z); }},
         {operation::TAN,   [](std::complex<T> z) { return std::tan(z); }},
-        {operation::SEC,   [](std::complex<T> z) { return 1.0 / std::cos(z); }},
-        {operation::CSC,   [](std::complex<T> z) { return 1.0 / std::sin(z); }},
-        {operation::COT,   [](std::complex<T> z) { return 1.0 / std::tan(z); }},
+        {operation::SEC,   [](std::complex<T> z) { return (T) 1.0 / std::cos(z); }},
+        {operation::CSC,   [](std::complex<T> z) { return (T) 1.0 / std::sin(z); }},
+        {operation::COT,   [](std::complex<T> z) { return (T) 1.0 / std::tan(z); }},
         {operation::ACOS,  [](std::complex<T> z) { return std::acos(z); }},
         {operation::ASIN,  [](std::complex<T> z) { return std::asin(z); }},
         {operation::ATAN,  [](std::complex<T> z) { return std::atan(z); }},
@@ -119,6 +124,72 @@ auto (*get_func(operation op))(std::complex<T> z) -> std::complex<T>
     }
 }
 
+/**
+ * @brief Map string name of operation to the enum for the operation, without
+ * throwing. Names are matched with a switch on their first character and then
+ * their length, so at most a couple of comparisons are made, no memory is
+ * allocated, and it can be used in constant expressions.
+ * 
+ * @param op String (in all lower case) representing an operation
+ * @return Enum for the corresponding operation, or NO_OP if string does not
+ * correspond to any defined operation.
+*/
+constexpr auto find_operation(std::string_view op) -> operation
+{
+    if (op.empty())
+    {
+        return NO_OP;
+    }
+
+    switch (op[0])
+    {
+        case '{': return op.size() == 1 ? L_BRACKET : NO_OP;
+        case '}': return op.size() == 1 ? R_BRACKET : NO_OP;
+        case '(': return op.size() == 1 ? L_BRACKET : NO_OP;
+        case ')': return op.size() == 1 ? R_BRACKET : NO_OP;
+        case '+': return op.size() == 1 ? ADD : NO_OP;
+        case '-': return op.size() == 1 ? SUB : NO_OP;
+        case '*': return op.size() == 1 ? MUL : NO_OP;
+        case '/': return op.size() == 1 ? DIV : NO_OP;
+        case '^': return op.size() == 1 ? POW : NO_OP;
+        case 'a':
+            switch (op.size())
+            {
+                case 3:  return op == "abs" ? ABS : op == "arg" ? ARG : NO_OP;
+                case 4:  return op == "acos" ? ACOS : op == "asin" ? ASIN : op == "atan" ? ATAN : NO_OP;
+                case 5:  return op == "acosh" ? ACOSH : op == "asinh" ? ASINH : op == "atanh" ? ATANH : NO_OP;
+                default: return NO_OP;
+            }
+        case 'c':
+            switch (op.size())
+            {
+                case 3:  return op == "cos" ? COS : op == "csc" ? CSC : op == "cot" ? COT : NO_OP;
+                case 4:  return op == "conj" ? CONJ : op == "cosh" ? COSH : NO_OP;
+                default: return NO_OP;
+            }
+        case 'd': return op == "deriv" ? DERIV : NO_OP;
+        case 'e': return op == "exp" ? EXP : NO_OP;
+        case 'i': return op == "im" ? IM : NO_OP;
+        case 'l': return op == "log" ? LOG : NO_OP;
+        case 'r': return op == "re" ? RE : NO_OP;
+        case 's':
+            switch (op.size())
+            {
+                case 3:  return op == "sin" ? SIN : op == "sec" ? SEC : NO_OP;
+                case 4:  return op == "sinh" ? SINH : NO_OP;
+                default: return NO_OP;
+            }
+        case 't':
+            switch (op.size())
+            {
+                case 3:  return op == "tan" ? TAN : NO_OP;
+                case 4:  return op == "tanh" ? TANH : NO_OP;
+                default: return NO_OP;
+            }
+        default:  return NO_OP;
+    }
+}
+
 /**
  * @brief Map string name of operation to the enum for the operation
  * 
@@ -127,47 +198,12 @@ auto (*get_func(operation op))(std::complex<T> z) -> std::complex<T>
  * @throw invalid_argument if string does not correspond to any defined 
  * operation.
 */
-auto get_operation(const std::string& op) -> operation
+constexpr auto get_operation(std::string_view op) -> operation
 {
-    static std::unordered_map<std::string, operation> const table = {
-        {"{",     operation::L_BRACKET},
-        {"}",     operation::R_BRACKET},
-        {"(",     operation::L_BRACKET},
-        {")",     operation::R_BRACKET},
-        {"+",     operation::ADD},
-        {"-",     operation::SUB},
-        {"*",     operation::MUL},
-        {"/",     operation::DIV},
-        {"^",     operation::POW},
-        {"re",    operation::RE},
-        {"im",    operation::IM},
-        {"abs",   operation::ABS},
-        {"arg",   operation::ARG},
-        {"conj",  operation::CONJ},
-        {"exp",   operation::EXP},
-        {"log",   operation::LOG},
-        {"cos",   operation::COS},
-        {"sin",   operation::SIN},
-        {"tan",   operation::TAN},
-        {"sec",   operation::TAN},
-        {"csc",   operation::TAN},
-        {"cot",   operation::TAN},
-        {"acos",  operation::TAN},
-        {"asin",  operation::TAN},
-        {"atan",  operation::TAN},
-        {"cosh",  operation::TAN},
-        {"sinh",  operation::TAN},
-        {"tanh",  operation::TAN},
-        {"acosh", operation::TAN},
-        {"asinh", operation::TAN},
-        {"atanh", operation::TAN},
-        {"deriv", operation::DERIV}
-    };
-
-    auto it = table.find(op);
-    if (it != table.end())
+    auto result = find_operation(op);
+    if (result != NO_OP)
     {
-        return it->second;
+        return result;
     }
     else
     {
@@ -182,50 +218,43 @@ auto get_operation(const std::string& op) -> operation
  * @return Non-negative integer representing precendence level of operation. 
  * @throw invalid_argument for invalid operation enum.
 */
-auto get_precedence(operation op) -> size_t
+constexpr auto get_precedence(operation op) -> size_t
 {
-    static std::unordered_map<operation, size_t> const table = {
-        {operation::L_BRACKET, 4},
-        {operation::R_BRACKET, 4},
-        {operation::ADD, 0},
-        {operation::SUB, 0},
-        {operation::NEG, 1},
-        {operation::MUL, 1},
-        {operation::DIV, 1},
-        {operation::POW, 2},
-        {operation::RE, 3},
-        {operation::IM, 3},
-        {operation::ABS, 3},
-        {operation::ARG, 3},
-        {operation::CONJ, 3},
-        {operation::EXP, 3},
-        {operation::LOG, 3},
-        {operation::COS, 3},
-        {operation::SIN, 3},
-        {operation::TAN, 3},
-        {operation::SEC, 3},
-        {operation::CSC, 3},
-        {operation::COT, 3},
-        {operation::ACOS, 3},
-        {operation::ASIN, 3},
-        {operation::ATAN, 3},
-        {operation::COSH, 3},
-        {operation::SINH, 3},
-        {operation::TANH, 3},
-        {operation::ACOSH, 3},
-        {operation::ASINH, 3},
-        {operation::ATANH, 3},
-        {operation::DERIV, 3}
-    };
-
-    auto it = table.find(op);
-    if (it != table.end())
+    switch (op)
     {
-        return it->second;
+        case L_BRACKET:
+        case R_BRACKET: return 4;
+        case ADD:
+        case SUB:       return 0;
+        case NEG:
+        case MUL:
+        case DIV:       return 1;
+        case POW:       return 2;
+        case NO_OP:     throw std::invalid_argument("Type not found.");
+        default:        return 3;
     }
-    else
+}
+
+/**
+ * @brief Maps operator to its token type, as get_token_type, without a table
+ * lookup. Usable in constant expressions.
+ * 
+ * @param op Enum specifying operation.
+ * @return Enum specifying token type.
+*/
+constexpr auto operation_type(operation op) -> token_type
+{
+    switch (op)
     {
-        throw std::invalid_argument("Type not found.");
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+        case POW:       return BIN_OP;
+        case L_BRACKET:
+        case R_BRACKET:
+        case NO_OP:     return OTHER_TYPE;
+        default:        return FUNC;
     }
 }
 
@@ -236,7 +265,7 @@ auto get_precedence(operation op) -> size_t
  * @return Enum specifying token type.
  * @throw invalid_argument for invalid operation enum.
 */
-auto get_token_type(operation op) -> token_type
+inline auto get_token_type(operation op) -> token_type
 {
     static std::unordered_map<operation, token_type> const table = {
         {operation::L_BRACKET, token_type::OTHER_TYPE},
@@ -0,0 +1,365 @@
+/**
+ * @file tokenizer.h
+ * @brief Contains a tokenizer that splits a string representing an infix math
+ * expression into tokens in a single pass, without copying the string.
+ * 
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <span>
+#include <concepts>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+#include "token.h"
+
+namespace parser
+{
+
+/**
+ * @brief Error in the syntax of an infix expression, found at a known place
+ * in it. Thrown by tokenize and parse, and caught as any other
+ * invalid_argument.
+*/
+class parse_error : public std::invalid_argument
+{
+    size_t m_offset;
+
+public:
+    /**
+     * @brief Constructs an error.
+     *
+     * @param message What is wrong, without a full stop.
+     * @param offset Offset of the error in the expression.
+     *
+     * @return parse_error instance, whose what() is the message followed by
+     * the offset.
+    */
+    parse_error(const std::string& message, size_t offset) :
+        std::invalid_argument(message + " at offset " + std::to_string(offset) + "."),
+        m_offset(offset)
+    {
+    }
+
+    /**
+     * @brief Offset of the error: the index of the character it was found at
+     * for a string, or of the token for a sequence of tokens. The length of
+     * the expression if it ended too early.
+    */
+    auto offset() const noexcept -> size_t
+    {
+        return m_offset;
+    }
+};
+
+/**
+ * @brief Parses a real number written in decimal, optionally with a sign and
+ * an exponent. At runtime this is std::from_chars, which rounds correctly.
+ * In constant expressions, where std::from_chars can not be used, the digits
+ * are accumulated in long double instead, which is within an ulp of the
+ * correctly rounded value for T = float or double.
+ * 
+ * @param str String of the number, with nothing before or after it.
+ * @return Value of the number.
+ * @throw invalid_argument if str is not a number.
+*/
+template<std::floating_point T>
+constexpr auto parse_number(std::string_view str) -> T
+{
+    // std::from_chars does not accept a leading +
+    if (!str.empty() && str[0] == '+')
+    {
+        str.remove_prefix(1);
+    }
+
+    if (!std::is_constant_evaluated())
+    {
+        T val = 0;
+        auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), val);
+        if (error != std::errc() || end != str.data() + str.size())
+        {
+            throw std::invalid_argument("Invalid number formatting detected.");
+        }
+
+        return val;
+    }
+
+    size_t i = 0;
+    bool negative = i < str.size() && str[i] == '-';
+    i += negative;
+
+    long double mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+
+    for (; i < str.size() && str[i] >= '0' && str[i] <= '9'; i++, digits = true)
+    {
+        mantissa = 10 * mantissa + (str[i] - '0');
+    }
+    if (i < str.size() && str[i] == '.')
+    {
+        for (i++; i < str.size() && str[i] >= '0' && str[i] <= '9'; i++, digits = true)
+        {
+            mantissa = 10 * mantissa + (str[i] - '0');
+            exponent--;
+        }
+    }
+    if (digits && i < str.size() && (str[i] == 'e' || str[i] == 'E'))
+    {
+        i++;
+        bool negative_exponent = i < str.size() && str[i] == '-';
+        i += i < str.size() && (str[i] == '-' || str[i] == '+');
+
+        int e = 0;
+        for (digits = false; i < str.size() && str[i] >= '0' && str[i] <= '9'; i++, digits = true)
+        {
+            e = 10 * e + (str[i] - '0');
+        }
+        exponent += negative_exponent ? - e : e;
+    }
+
+    if (!digits || i != str.size())
+    {
+        throw std::invalid_argument("Invalid number formatting detected.");
+    }
+
+    for (; exponent > 0; exponent--)
+    {
+        mantissa *= 10;
+    }
+    for (; exponent < 0; exponent++)
+    {
+        mantissa /= 10;
+    }
+
+    return (T) (negative ? - mantissa : mantissa);
+}
+
+// Variables of expressions parsed without naming their variables
+inline constexpr std::string_view default_variables[] = {"z"};
+
+/**
+ * @brief Splits a string representing an infix math expression into tokens,
+ * in a single pass over the string. Spaces are skipped as they are found, and
+ * names and numbers are read in place, so no part of the string is copied.
+ * Can be used in constant expressions.
+ * 
+ * Recognized are the variables, the constants i, e and pi, real numbers such
+ * as 1.5 and imaginary numbers such as 1.5i, complex numbers [a,b], the
+ * symbols + - * / ^ ( ) { }, and the functions escaped with a \\ (see
+ * find_operation). A - at the start of the expression or right after an
+ * opening bracket is a negation (NEG) rather than a subtraction. The name of
+ * a function ends at a space or at the first of \\ - + * / ^ { ( [.
+ * 
+ * Names of variables and constants are letters, digits and underscores
+ * starting with a letter or underscore. A variable is resolved here, once, to
+ * the index of its name in variables, which is stored as the slot of its
+ * token, so evaluating the expression never looks up a name. Variables hide
+ * the constants of the same name.
+ * 
+ * @param infix String representing an infix math expression.
+ * @param emit Function called with every token, in order, and with the
+ * offset of its first character if it takes a second argument.
+ * @param variables Names of the variables, in order of their slots. Defaults
+ * to default_variables, i.e., the single variable z.
+ * @throw parse_error if the string contains anything not recognized.
+*/
+template<std::floating_point T, typename F>
+constexpr void tokenize(std::string_view infix, F&& emit, std::span<const std::string_view> variables = default_variables)
+{
+    // Last character that is not a space, to tell a negation from a
+    // subtraction
+    char previous = '\0';
+
+    auto ends_name = [](char c)
+    {
+        return c == ' ' || c == '\\' || c == '-' || c == '+' || c == '*' || c == '/' || c == '^' || c == '{' || c == '(' || c == '[';
+    };
+    auto is_digit = [](char c)
+    {
+        return c >= '0' && c <= '9';
+    };
+    auto is_letter = [](char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    };
+    auto number = [](std::string_view str, size_t offset)
+    {
+        try
+        {
+            return parse_number<T>(str);
+        }
+        catch (const std::invalid_argument&)
+        {
+            throw parse_error("Invalid number formatting", offset);
+        }
+    };
+    auto trim = [](std::string_view str)
+    {
+        while (!str.empty() && str.front() == ' ')
+        {
+            str.remove_prefix(1);
+        }
+        while (!str.empty() && str.back() == ' ')
+        {
+            str.remove_suffix(1);
+        }
+        return str;
+    };
+
+    // Start of the token being read
+    size_t i = 0;
+    auto out = [&](const token<T>& t)
+    {
+        if constexpr (std::invocable<F&, const token<T>&, size_t>)
+        {
+            emit(t, i);
+        }
+        else
+        {
+            emit(t);
+        }
+    };
+
+    for (; i < infix.size(); i++)
+    {
+        auto c = infix[i];
+
+        if (c == ' ')
+        {
+            continue;
+        }
+        // pre-defined operation escaped by \ found, so the token for the operation is made
+        else if (c == '\\')
+        {
+            auto j = i + 1;
+            while (j < infix.size() && !ends_name(infix[j]))
+            {
+                j++;
+            }
+
+            if (j == infix.size())
+            {
+                throw parse_error("Function without an argument", i);
+            }
+
+            auto op = find_operation(infix.substr(i + 1, j - i - 1));
+            if (op == NO_OP || operation_type(op) != FUNC)
+            {
+                throw parse_error("Unknown function", i);
+            }
+
+            out(token<T>{FUNC, op});
+            i = j - 1;
+        }
+        // negative sign found at start of expression or immediately after bracket, so NEG token pushed instead of SUB
+        else if (c == '-' && (previous == '\0' || previous == '{' || previous == '('))
+        {
+            out(token<T>{FUNC, NEG});
+        }
+        // a number is found, so we look for the end of the number (i.e., the first non 0-9/. character)
+        else if (is_digit(c) || c == '.')
+        {
+            bool period_found = false;
+            auto j = i;
+
+            for (; j < infix.size() && (is_digit(infix[j]) || infix[j] == '.'); j++)
+            {
+                if (infix[j] == '.' && period_found)
+                {
+                    throw parse_error("Invalid number formatting", j);
+                }
+                period_found |= infix[j] == '.';
+            }
+
+            auto num = number(infix.substr(i, j - i), i);
+
+            if (j < infix.size() && infix[j] == 'i')
+            {
+                out(token<T>{CONST, NO_OP, std::complex<T>(0, num)});
+                j++;
+            }
+            else
+            {
+                out(token<T>{CONST, NO_OP, num});
+            }
+
+            i = j - 1;
+        }
+        // a complex number [a,b] is found
+        else if (c == '[')
+        {
+            auto j = infix.find(',', i);
+            auto k = infix.find(']', i);
+
+            if (j == std::string_view::npos || k == std::string_view::npos || k < j)
+            {
+                throw parse_error("Invalid complex number formatting", i);
+            }
+
+            auto re = number(trim(infix.substr(i + 1, j - i - 1)), i + 1);
+            auto im = number(trim(infix.substr(j + 1, k - j - 1)), j + 1);
+            out(token<T>{CONST, NO_OP, std::complex<T>(re, im)});
+
+            i = k;
+        }
+        // a name is found, which is a variable or one of the constants i, e and pi
+        else if (is_letter(c))
+        {
+            auto j = i + 1;
+            while (j < infix.size() && (is_letter(infix[j]) || is_digit(infix[j])))
+            {
+                j++;
+            }
+
+            auto name = infix.substr(i, j - i);
+            auto slot = std::find(variables.begin(), variables.end(), name);
+
+            if (slot != variables.end())
+            {
+                out(token<T>{VAR, NO_OP, 0, (std::uint32_t) (slot - variables.begin())});
+            }
+            else if (name == "i")
+            {
+                out(token<T>{CONST, NO_OP, std::complex<T>(0, 1)});
+            }
+            else if (name == "e")
+            {
+                out(token<T>{CONST, NO_OP, std::complex<T>(2.71828182845904523536, 0)});
+            }
+            else if (name == "pi")
+            {
+                out(token<T>{CONST, NO_OP, std::complex<T>(3.14159265358979323846, 0)});
+            }
+            else
+            {
+                throw parse_error("Unknown variable name", i);
+            }
+
+            i = j - 1;
+        }
+        // +, -, *, /, ^, (, ), {, } found
+        else
+        {
+            auto op = find_operation(infix.substr(i, 1));
+            if (op == NO_OP)
+            {
+                throw parse_error("Unknown character", i);
+            }
+
+            out(token<T>{operation_type(op), op});
+        }
+
+        previous = infix[i];
+    }
+}
+
+};
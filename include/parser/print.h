@@ -8,6 +8,8 @@
 #pragma once
 
 #include <iostream>
+#include <span>
+#include <string_view>
 
 #include "parser/expression.h"
 #include "parser/token.h"
@@ -16,13 +18,15 @@ namespace parser
 {
 
 /**
- * @brief Prints token.
+ * @brief Prints token, with variables printed by name.
  * 
  * @param os Output stream to print to.
  * @param t Token to print.
+ * @param variables Names of the variables, in order of their slots. A
+ * variable whose slot has no name is printed as v followed by its slot.
 */
 template<std::floating_point T>
-auto operator<<(std::ostream& os, const token<T>& t) -> std::ostream&
+auto print(std::ostream& os, const token<T>& t, std::span<const std::string_view> variables) -> std::ostream&
 {
     static std::unordered_map<operation, std::string> const table = {
         {L_BRACKET, "("},
@@ -67,33 +71,62 @@ auto operator<<(std::ostream& os, const token<T>& t) -> std::ostream&
     {
         os << t.val;
     }
+    else if (t.slot < variables.size())
+    {
+        os << variables[t.slot];
+    }
     else
     {
-        os << "z";
+        os << 'v' << t.slot;
     }
 
     return os;
 }
 
 /**
- * @brief Prints vector of tokens.
+ * @brief Prints expression, with variables printed by name.
  * 
  * @param os Output stream to print to.
- * @param ts Vector of tokens to print.
+ * @param e Expression to print.
+ * @param variables Names of the variables, in order of their slots.
 */
-template<std::floating_point T>
-auto operator<<(std::ostream& os, const expr<T>& e) -> std::ostream&
+template<std::floating_point T, template<typename...> class container>
+auto print(std::ostream& os, const expr<T, container>& e, std::span<const std::string_view> variables) -> std::ostream&
 {
     os << "[";
 
     for (auto it = e.cbegin(); it != std::prev(e.cend()); it++)
     {
-        os << *it << ' ';
+        print(os, *it, variables) << ' ';
     }
 
-    os << e.back() << "]";
+    print(os, e.back(), variables) << "]";
 
     return os;
 }
 
+/**
+ * @brief Prints token.
+ * 
+ * @param os Output stream to print to.
+ * @param t Token to print.
+*/
+template<std::floating_point T>
+auto operator<<(std::ostream& os, const token<T>& t) -> std::ostream&
+{
+    return print(os, t, default_variables);
+}
+
+/**
+ * @brief Prints vector of tokens.
+ * 
+ * @param os Output stream to print to.
+ * @param ts Vector of tokens to print.
+*/
+template<std::floating_point T, template<typename...> class container>
+auto operator<<(std::ostream& os, const expr<T, container>& e) -> std::ostream&
+{
+    return print(os, e, default_variables);
+}
+
 };
\ No newline at end of file
@@ -0,0 +1,507 @@
+/**
+ * @file serialize.h
+ * @brief Contains a compact, versioned binary format for math expressions,
+ * holding the postfix expression and optionally its compiled program and its
+ * dag, so that an expression parsed and compiled once can be shipped to other
+ * processes and used there without parsing or compiling it again.
+ *
+ * A serialized expression is a header followed by sections, each starting at
+ * an offset that is a multiple of serial_alignment:
+ *
+ * 1. One byte per token of the postfix expression: the operation of a FUNC
+ *    or BIN_OP token, or serial_var or serial_const.
+ * 2. The values of the CONST tokens, in order, as std::complex<T>, followed
+ *    by the slots of the VAR tokens as std::uint32_t.
+ * 3. The instructions of the compiled program, laid out as in memory.
+ * 4. The constant pool of the compiled program, as std::complex<T>.
+ * 5. One byte per node of the dag, with the same codes as the tokens,
+ *    followed by the ids of the left and the right arguments of every node as
+ *    std::uint32_t, the values of the CONST nodes as std::complex<T>, and the
+ *    slots of the VAR nodes as std::uint32_t.
+ *
+ * Sections 3 and 4 are only there if the program was serialized, and
+ * section 5 if the dag was. Values are in the byte order of the machine that
+ * wrote them, which the header records, so they are only read on machines
+ * with the same byte order and the same floating point type. The program is
+ * used in place, e.g., straight out of a memory mapped file, so loading it
+ * costs one pass over its instructions to check them.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "compiled.h"
+#include "dag.h"
+#include "parser/compact.h"
+#include "parser/expression.h"
+#include "stream.h"
+
+namespace parser
+{
+
+// Version of the format written by serialize. Bumped whenever the layout
+// changes; files of other versions are rejected.
+inline constexpr std::uint16_t serial_version = 2;
+
+// Alignment of the start of every section, and of the serialized expression
+// itself, which is enough for std::complex<long double>.
+inline constexpr size_t serial_alignment = 16;
+
+// Codes of VAR and CONST tokens. Every other token is coded by its operation,
+// as in compact_expr, whose arrays are sections 1 and 2.
+inline constexpr std::uint8_t serial_var = compact_var;
+inline constexpr std::uint8_t serial_const = compact_const;
+
+/**
+ * @brief Header of a serialized expression.
+*/
+struct serial_header
+{
+    char magic[4];                 // Always "MPEX"
+    std::uint16_t version;         // serial_version of the writer
+    std::uint8_t float_size;       // sizeof(T) of the writer
+    std::uint8_t flags;            // serial_program, serial_graph
+    std::uint32_t byte_order;      // 0x01020304, as written by the writer
+    std::uint32_t tokens;          // Number of tokens of the postfix expression
+    std::uint32_t token_consts;    // Number of CONST tokens
+    std::uint32_t code;            // Number of instructions of the program
+    std::uint32_t program_consts;  // Size of the constant pool of the program
+    std::uint32_t temps;           // Number of temporaries of the program
+    std::uint32_t outputs;         // Number of outputs of the program
+    std::uint32_t nodes;           // Number of nodes of the dag
+    std::uint32_t node_consts;     // Number of CONST nodes of the dag
+    std::uint32_t token_vars;      // Number of VAR tokens
+    std::uint32_t node_vars;       // Number of VAR nodes of the dag
+    std::uint32_t reserved[3];     // Always 0
+};
+
+static_assert(sizeof(serial_header) % serial_alignment == 0);
+static_assert(sizeof(instruction) == 8 && offsetof(instruction, op) == 0 && offsetof(instruction, arg) == 4, "Serialized programs assume the layout of instruction.");
+
+// Flags of serial_header
+inline constexpr std::uint8_t serial_program = 1;
+inline constexpr std::uint8_t serial_graph = 2;
+
+/**
+ * @brief What to serialize along with the postfix expression.
+*/
+struct serialize_options
+{
+    bool program = true;  // Compiled program, to evaluate without compiling
+    bool graph = false;   // Dag, to differentiate or simplify without parsing
+    bool optimize = true; // Whether to simplify the program, see compiled_expr
+};
+
+/**
+ * @brief Byte offsets of the sections of a serialized expression.
+*/
+struct serial_layout
+{
+    size_t tokens, token_consts, token_slots, code, program_consts, nodes, lhs, rhs, node_consts, node_slots, size;
+
+    /**
+     * @brief Lays out the sections described by a header.
+    */
+    template<std::floating_point T>
+    static auto of(const serial_header& h) -> serial_layout
+    {
+        auto align = [](size_t offset) { return (offset + serial_alignment - 1) / serial_alignment * serial_alignment; };
+
+        serial_layout l;
+        l.tokens = sizeof(serial_header);
+        l.token_consts = align(l.tokens + h.tokens);
+        l.token_slots = align(l.token_consts + h.token_consts * sizeof(std::complex<T>));
+        l.code = align(l.token_slots + h.token_vars * sizeof(std::uint32_t));
+        l.program_consts = align(l.code + h.code * sizeof(instruction));
+        l.nodes = align(l.program_consts + h.program_consts * sizeof(std::complex<T>));
+        l.lhs = align(l.nodes + h.nodes);
+        l.rhs = align(l.lhs + h.nodes * sizeof(std::uint32_t));
+        l.node_consts = align(l.rhs + h.nodes * sizeof(std::uint32_t));
+        l.node_slots = align(l.node_consts + h.node_consts * sizeof(std::complex<T>));
+        l.size = align(l.node_slots + h.node_vars * sizeof(std::uint32_t));
+        return l;
+    }
+};
+
+/**
+ * @brief Code of a token in a serialized expression.
+*/
+template<std::floating_point T>
+auto serial_code(const token<T>& t) -> std::uint8_t
+{
+    return t.type == VAR ? serial_var : t.type == CONST ? serial_const : (std::uint8_t) t.op;
+}
+
+/**
+ * @brief Serializes a math expression.
+ *
+ * @param e Expression to serialize. Converted to postfix first if it is in
+ * infix.
+ * @param options What to serialize along with the postfix expression.
+ *
+ * @return Serialized expression.
+ * @throw invalid_argument if the expression is not a well-formed expression.
+*/
+template<std::floating_point T, template<typename...> class container>
+auto serialize(const expr<T, container>& e, const serialize_options& options = {}) -> std::vector<std::byte>
+{
+    auto postfix = e.postfix();
+
+    serial_header h{};
+    std::memcpy(h.magic, "MPEX", 4);
+    h.version = serial_version;
+    h.float_size = sizeof(T);
+    h.byte_order = 0x01020304;
+
+    compact_expr<T> compact(postfix);
+    auto codes = compact.codes();
+    auto consts = compact.constants();
+    auto slots = compact.slots();
+    h.tokens = (std::uint32_t) codes.size();
+    h.token_consts = (std::uint32_t) consts.size();
+    h.token_vars = (std::uint32_t) slots.size();
+
+    compiled_expr<T> program;
+    if (options.program)
+    {
+        program = compiled_expr<T>(postfix, options.optimize);
+        h.flags |= serial_program;
+        h.code = (std::uint32_t) program.size();
+        h.program_consts = (std::uint32_t) program.constants().size();
+        h.temps = (std::uint32_t) program.temporaries();
+        h.outputs = (std::uint32_t) program.outputs();
+    }
+
+    dag<T> g;
+    if (options.graph)
+    {
+        g.push(postfix);
+        h.flags |= serial_graph;
+        h.nodes = (std::uint32_t) g.size();
+        for (size_t i = 0; i < g.size(); i++)
+        {
+            h.node_consts += g[i].t.type == CONST;
+            h.node_vars += g[i].t.type == VAR;
+        }
+    }
+
+    // Padding is zeroed, so the same expression always gives the same bytes
+    auto l = serial_layout::of<T>(h);
+    std::vector<std::byte> bytes(l.size);
+    auto at = [&](size_t offset) { return bytes.data() + offset; };
+
+    std::memcpy(at(0), &h, sizeof(h));
+    std::memcpy(at(l.tokens), codes.data(), codes.size());
+    std::memcpy(at(l.token_consts), consts.data(), consts.size() * sizeof(std::complex<T>));
+    std::memcpy(at(l.token_slots), slots.data(), slots.size() * sizeof(std::uint32_t));
+
+    if (options.program)
+    {
+        for (size_t i = 0; i < program.size(); i++)
+        {
+            auto& ins = program.code()[i];
+            std::memcpy(at(l.code + i * sizeof(instruction) + offsetof(instruction, op)), &ins.op, sizeof(ins.op));
+            std::memcpy(at(l.code + i * sizeof(instruction) + offsetof(instruction, arg)), &ins.arg, sizeof(ins.arg));
+        }
+        std::memcpy(at(l.program_consts), program.constants().data(), program.constants().size_bytes());
+    }
+
+    if (options.graph)
+    {
+        size_t k = 0, v = 0;
+        for (size_t i = 0; i < g.size(); i++)
+        {
+            auto code = serial_code(g[i].t);
+            std::memcpy(at(l.nodes + i), &code, 1);
+            std::memcpy(at(l.lhs + i * sizeof(std::uint32_t)), &g[i].lhs, sizeof(std::uint32_t));
+            std::memcpy(at(l.rhs + i * sizeof(std::uint32_t)), &g[i].rhs, sizeof(std::uint32_t));
+            if (g[i].t.type == CONST)
+            {
+                std::memcpy(at(l.node_consts + k++ * sizeof(std::complex<T>)), &g[i].t.val, sizeof(std::complex<T>));
+            }
+            else if (g[i].t.type == VAR)
+            {
+                std::memcpy(at(l.node_slots + v++ * sizeof(std::uint32_t)), &g[i].t.slot, sizeof(std::uint32_t));
+            }
+        }
+    }
+
+    return bytes;
+}
+
+/**
+ * @brief Math expression read from its serialized form, without copying it.
+ * The bytes must stay alive and unchanged for as long as the
+ * serialized_expr, or the compiled_expr returned by program, is used, which
+ * the owner passed on construction can ensure.
+ *
+ * @tparam T The floating point type (float, double or long double) of the
+ * expression. Must be the same as the one it was serialized with. Defaults to
+ * double.
+*/
+template<std::floating_point T = double>
+class serialized_expr
+{
+private:
+    std::shared_ptr<const void> m_owner;
+    std::span<const std::byte> m_bytes;
+    serial_header m_header;
+    serial_layout m_layout;
+    compiled_expr<T> m_program;
+
+    template<typename U>
+    auto section(size_t offset, size_t count) const -> std::span<const U>
+    {
+        return {reinterpret_cast<const U*>(m_bytes.data() + offset), count};
+    }
+
+    /**
+     * @brief Token of a code, with a value if it is a CONST and a slot if it
+     * is a VAR.
+     *
+     * @throw invalid_argument if the code is not the code of a token.
+    */
+    static auto decode(std::uint8_t code, std::complex<T> val = 0, std::uint32_t slot = 0) -> token<T>
+    {
+        if (code == serial_var)
+        {
+            return {VAR, NO_OP, 0, slot};
+        }
+        else if (code == serial_const)
+        {
+            return {CONST, NO_OP, val};
+        }
+        else if (code < NO_OP && (operation_type((operation) code) == FUNC || operation_type((operation) code) == BIN_OP))
+        {
+            return {operation_type((operation) code), (operation) code, 0};
+        }
+
+        throw std::invalid_argument("Serialized expression has an unknown token.");
+    }
+
+    /**
+     * @brief Checks that a section of codes only has codes of tokens, and has
+     * the given numbers of CONST and VAR codes.
+    */
+    static void check_codes(std::span<const std::uint8_t> codes, size_t consts, size_t vars)
+    {
+        size_t n = 0, m = 0;
+        for (auto code: codes)
+        {
+            auto type = decode(code).type;
+            n += type == CONST;
+            m += type == VAR;
+        }
+
+        if (n != consts || m != vars)
+        {
+            throw std::invalid_argument("Serialized expression has the wrong number of constants or variables.");
+        }
+    }
+
+public:
+    /**
+     * @brief Reads a serialized expression. The header and the codes are
+     * checked, and so is the program, which is then used in place.
+     *
+     * @param bytes Serialized expression, starting at an address that is a
+     * multiple of serial_alignment, as returned by serialize or read from a
+     * file.
+     * @param owner Keeps the memory of bytes alive. May be null if the memory
+     * outlives the serialized_expr and every program taken from it anyway.
+     *
+     * @return serialized_expr instance.
+     * @throw invalid_argument if the bytes are not a serialized expression of
+     * this version, floating point type and byte order, or are corrupt.
+    */
+    explicit serialized_expr(std::span<const std::byte> bytes, std::shared_ptr<const void> owner = nullptr) :
+        m_owner(std::move(owner)),
+        m_bytes(bytes)
+    {
+        if (bytes.size() < sizeof(serial_header) || std::memcmp(bytes.data(), "MPEX", 4) != 0)
+        {
+            throw std::invalid_argument("Bytes are not a serialized expression.");
+        }
+
+        // The byte order is checked first, as every other field of the header
+        // is read in the wrong order if it differs
+        std::memcpy(&m_header, bytes.data(), sizeof(serial_header));
+        if (m_header.byte_order != 0x01020304)
+        {
+            throw std::invalid_argument("Serialized expression was written with another byte order.");
+        }
+
+        if (m_header.version != serial_version)
+        {
+            throw std::invalid_argument("Serialized expression has an unsupported version.");
+        }
+
+        if (m_header.float_size != sizeof(T))
+        {
+            throw std::invalid_argument("Serialized expression was written with another floating point type.");
+        }
+
+        if ((std::uintptr_t) bytes.data() % serial_alignment != 0)
+        {
+            throw std::invalid_argument("Serialized expression is not aligned.");
+        }
+
+        m_layout = serial_layout::of<T>(m_header);
+        if (bytes.size() < m_layout.size)
+        {
+            throw std::invalid_argument("Serialized expression is truncated.");
+        }
+
+        check_codes(section<std::uint8_t>(m_layout.tokens, m_header.tokens), m_header.token_consts, m_header.token_vars);
+        check_codes(section<std::uint8_t>(m_layout.nodes, m_header.nodes), m_header.node_consts, m_header.node_vars);
+
+        if (has_program())
+        {
+            m_program = compiled_expr<T>(section<instruction>(m_layout.code, m_header.code), section<std::complex<T>>(m_layout.program_consts, m_header.program_consts), m_header.temps, m_header.outputs, m_owner);
+        }
+    }
+
+    /**
+     * @brief Whether the compiled program was serialized.
+    */
+    auto has_program() const noexcept -> bool
+    {
+        return m_header.flags & serial_program;
+    }
+
+    /**
+     * @brief Whether the dag was serialized.
+    */
+    auto has_graph() const noexcept -> bool
+    {
+        return m_header.flags & serial_graph;
+    }
+
+    /**
+     * @brief Number of bytes of the serialized expression.
+    */
+    auto size() const noexcept -> size_t
+    {
+        return m_layout.size;
+    }
+
+    /**
+     * @brief Postfix expression, decoded into a new expr.
+     *
+     * @tparam container Container of the tokens of the expression. Defaults
+     * to std::list.
+     * @throw invalid_argument if the expression is not well-formed.
+    */
+    template<template<typename...> class container = std::list>
+    auto postfix() const -> expr<T, container>
+    {
+        auto codes = section<std::uint8_t>(m_layout.tokens, m_header.tokens);
+        auto consts = section<std::complex<T>>(m_layout.token_consts, m_header.token_consts);
+        auto slots = section<std::uint32_t>(m_layout.token_slots, m_header.token_vars);
+
+        std::vector<token<T>> tokens;
+        tokens.reserve(codes.size());
+
+        size_t k = 0, v = 0;
+        for (auto code: codes)
+        {
+            tokens.push_back(decode(code, code == serial_const ? consts[k++] : 0, code == serial_var ? slots[v++] : 0));
+        }
+
+        return expr<T, container>(tokens.begin(), tokens.end());
+    }
+
+    /**
+     * @brief Compiled program, used in place. Copies of it keep the owner
+     * alive.
+     *
+     * @throw invalid_argument if the program was not serialized.
+    */
+    auto program() const -> const compiled_expr<T>&
+    {
+        if (!has_program())
+        {
+            throw std::invalid_argument("Serialized expression has no compiled program.");
+        }
+
+        return m_program;
+    }
+
+    /**
+     * @brief Dag, rebuilt into a new dag<T> node by node, which is linear in
+     * the number of nodes and needs no parsing. Node ids are the same as in
+     * the serialized dag.
+     *
+     * @return Dag and id of root node of the expression.
+     * @throw invalid_argument if the dag was not serialized or is corrupt.
+    */
+    auto graph() const -> std::pair<dag<T>, typename dag<T>::node_id>
+    {
+        if (!has_graph() || m_header.nodes == 0)
+        {
+            throw std::invalid_argument("Serialized expression has no dag.");
+        }
+
+        auto codes = section<std::uint8_t>(m_layout.nodes, m_header.nodes);
+        auto lhs = section<std::uint32_t>(m_layout.lhs, m_header.nodes);
+        auto rhs = section<std::uint32_t>(m_layout.rhs, m_header.nodes);
+        auto consts = section<std::complex<T>>(m_layout.node_consts, m_header.node_consts);
+        auto slots = section<std::uint32_t>(m_layout.node_slots, m_header.node_vars);
+
+        dag<T> g;
+        size_t k = 0, v = 0;
+        for (size_t i = 0; i < codes.size(); i++)
+        {
+            auto t = decode(codes[i], codes[i] == serial_const ? consts[k++] : 0, codes[i] == serial_var ? slots[v++] : 0);
+
+            // Arguments come before the nodes using them, and only functions
+            // and binary operations have them
+            auto arity = t.type == BIN_OP ? 2 : t.type == FUNC ? 1 : 0;
+            auto valid = [&](std::uint32_t arg, bool used) { return used ? arg < i : arg == dag<T>::no_node; };
+            if (!valid(lhs[i], arity >= 1) || !valid(rhs[i], arity == 2))
+            {
+                throw std::invalid_argument("Serialized dag is corrupt.");
+            }
+
+            if (g.add(t, lhs[i], rhs[i]) != i)
+            {
+                throw std::invalid_argument("Serialized dag has duplicate nodes.");
+            }
+        }
+
+        auto root = (typename dag<T>::node_id) (g.size() - 1);
+        return {std::move(g), root};
+    }
+};
+
+/**
+ * @brief Reads a serialized expression from a file, which is memory mapped
+ * and used in place, so that only the pages that are used are ever read.
+ *
+ * @param path Path of file, as written from the bytes returned by serialize.
+ *
+ * @return Serialized expression, which keeps the file mapped.
+ * @throw runtime_error if the file can not be mapped.
+ * @throw invalid_argument if the file is not a serialized expression.
+*/
+template<std::floating_point T = double>
+auto load_serialized(const std::filesystem::path& path) -> serialized_expr<T>
+{
+    auto file = std::make_shared<mapped_file>(path);
+    auto bytes = file->bytes();
+    return serialized_expr<T>(bytes, std::move(file));
+}
+
+};
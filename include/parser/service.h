@@ -0,0 +1,372 @@
+/**
+ * @file service.h
+ * @brief Contains an asynchronous front end for evaluating compiled
+ * expressions, for services where many small requests for the same
+ * expression arrive concurrently. Requests are coalesced into batches that
+ * run on a thread pool.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <chrono>
+#include <complex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "compiled.h"
+#include "thread_pool.h"
+
+namespace parser
+{
+
+/**
+ * @brief Options of an eval_service.
+ *
+ * @tparam T The floating point type (float, double or long double) the
+ * service evaluates in. Defaults to double.
+*/
+template<std::floating_point T = double>
+struct service_options
+{
+    // Longest a request waits for others to join its batch. A batch is run
+    // this long after its first request arrived at the latest.
+    std::chrono::microseconds max_latency{200};
+
+    // A batch is run as soon as it has this many points, without waiting
+    // for max_latency
+    size_t max_batch = 64 * compiled_expr<T>::block_size;
+};
+
+/**
+ * @brief Counters of an eval_service.
+*/
+struct service_stats
+{
+    size_t requests = 0; // Requests submitted
+    size_t batches = 0;  // Batches run, each with one or more requests
+    size_t points = 0;   // Points evaluated
+};
+
+/**
+ * @brief Evaluates compiled expressions asynchronously, coalescing the
+ * requests for the same expression that arrive within a short time of each
+ * other into one batch, which is evaluated by one call to the batch
+ * evaluator on a thread pool.
+ *
+ * Expressions are added once and referred to by id afterwards. Every call to
+ * evaluate queues its points behind those of the other pending requests for
+ * the same expression and returns a future for their values. The queue of an
+ * expression is run as one task on the pool once it holds
+ * options.max_batch points, or options.max_latency after its first request,
+ * whichever comes first, so a request waits at most max_latency for others
+ * before it is evaluated, and many small requests cost as much as one large
+ * one rather than one task and one batch each.
+ *
+ * Every member function is thread safe. Batches own their points and a copy
+ * of their expression, so they may complete after the service is destroyed,
+ * as long as the pool outlives them.
+ *
+ * @tparam T The floating point type (float, double or long double) to
+ * evaluate in. Defaults to double.
+*/
+template<std::floating_point T = double>
+class eval_service
+{
+public:
+    using expr_id = size_t;
+    using values = std::vector<std::complex<T>>;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct request
+    {
+        values points;
+        std::promise<values> result;
+    };
+
+    // Requests waiting for an expression, and when they are run at the
+    // latest. deadline is only meaningful if pending is not empty.
+    struct queue
+    {
+        compiled_expr<T> expression;
+        std::vector<request> pending;
+        size_t points = 0;
+        clock::time_point deadline;
+    };
+
+    thread_pool& m_pool;
+    service_options<T> m_options;
+
+    // Guards everything below
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<queue>> m_queues;
+    service_stats m_stats;
+
+    // Deadlines of the queues, earliest first. An entry is stale once its
+    // queue was run for reaching max_batch, and is then skipped.
+    using due = std::pair<clock::time_point, expr_id>;
+    std::priority_queue<due, std::vector<due>, std::greater<due>> m_deadlines;
+
+    // Runs the queues whose deadline has passed, sleeping on m_wake until
+    // the earliest deadline
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    std::thread m_timer;
+
+    /**
+     * @brief Evaluates the points of a batch of requests in one call to the
+     * batch evaluator, and fulfils every request with its values. If that
+     * throws, the requests not fulfilled yet get the exception.
+     *
+     * @param e Compiled expression to evaluate.
+     * @param batch Requests to evaluate.
+    */
+    static void run_batch(const compiled_expr<T>& e, std::vector<request>& batch)
+    {
+        // Requests before this one have their results
+        size_t done = 0;
+
+        try
+        {
+            values points;
+            for (const auto& r: batch)
+            {
+                points.insert(points.end(), r.points.begin(), r.points.end());
+            }
+
+            values out(points.size());
+            e.evaluate(std::span<const std::complex<T>>(points), std::span<std::complex<T>>(out));
+
+            size_t offset = 0;
+            for (auto& r: batch)
+            {
+                auto n = r.points.size();
+                r.result.set_value(values(out.begin() + offset, out.begin() + offset + n));
+                offset += n;
+                done++;
+            }
+        }
+        catch (...)
+        {
+            for (auto i = done; i < batch.size(); i++)
+            {
+                batch[i].result.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    /**
+     * @brief Takes the pending requests of a queue and submits them to the
+     * pool as one batch. Must be called with m_mutex held.
+     *
+     * @param q Queue to run.
+    */
+    void flush(queue& q)
+    {
+        if (q.pending.empty())
+        {
+            return;
+        }
+
+        m_stats.batches++;
+        m_stats.points += q.points;
+        q.points = 0;
+
+        auto batch = std::make_shared<std::vector<request>>(std::move(q.pending));
+        q.pending.clear();
+
+        m_pool.submit([e = q.expression, batch]
+        {
+            run_batch(e, *batch);
+        });
+    }
+
+    /**
+     * @brief Main loop of the timer thread.
+    */
+    void time()
+    {
+        std::unique_lock lock(m_mutex);
+        while (!m_stop)
+        {
+            if (m_deadlines.empty())
+            {
+                m_wake.wait(lock);
+                continue;
+            }
+
+            auto [deadline, id] = m_deadlines.top();
+            if (clock::now() < deadline)
+            {
+                m_wake.wait_until(lock, deadline);
+                continue;
+            }
+
+            m_deadlines.pop();
+            auto& q = *m_queues[id];
+            if (!q.pending.empty() && q.deadline == deadline)
+            {
+                flush(q);
+            }
+        }
+    }
+
+public:
+    /**
+     * @brief Starts a service with no expressions.
+     *
+     * @param pool Pool to run batches on. Must outlive the service and every
+     * batch it runs. Defaults to the global pool.
+     * @param options Latency and batch size of the service.
+     *
+     * @return eval_service instance.
+    */
+    explicit eval_service(thread_pool& pool = thread_pool::global(), service_options<T> options = {}) :
+        m_pool(pool),
+        m_options(options)
+    {
+        m_timer = std::thread([this] { time(); });
+    }
+
+    eval_service(const eval_service&) = delete;
+    auto operator=(const eval_service&) -> eval_service& = delete;
+
+    /**
+     * @brief Runs every pending request without waiting for its deadline,
+     * then stops the service.
+    */
+    ~eval_service()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+            for (auto& q: m_queues)
+            {
+                flush(*q);
+            }
+        }
+        m_wake.notify_all();
+        m_timer.join();
+    }
+
+    /**
+     * @brief Adds an expression to be evaluated by the service.
+     *
+     * @param e Compiled expression of one variable.
+     * @return Id to evaluate the expression with.
+     * @throw invalid_argument if the expression has more than one variable.
+    */
+    auto add(compiled_expr<T> e) -> expr_id
+    {
+        if (e.variables() > 1)
+        {
+            throw std::invalid_argument("Only expressions of one variable can be evaluated by a service.");
+        }
+
+        auto q = std::make_unique<queue>();
+        q->expression = std::move(e);
+
+        std::lock_guard lock(m_mutex);
+        m_queues.push_back(std::move(q));
+        return m_queues.size() - 1;
+    }
+
+    /**
+     * @brief Queues points to be evaluated with the batch of other requests
+     * for the same expression.
+     *
+     * @param id Id of the expression, returned by add.
+     * @param points Points to evaluate the expression at.
+     *
+     * @return Future for the values of the expression at the points, in the
+     * same order. Holds the exception thrown by the evaluation, if any.
+     * @throw invalid_argument if there is no expression with the id.
+    */
+    auto evaluate(expr_id id, values points) -> std::future<values>
+    {
+        request r{std::move(points), {}};
+        auto result = r.result.get_future();
+        auto n = r.points.size();
+
+        bool first;
+        {
+            std::lock_guard lock(m_mutex);
+            if (id >= m_queues.size())
+            {
+                throw std::invalid_argument("Service has no expression with this id.");
+            }
+
+            auto& q = *m_queues[id];
+            first = q.pending.empty();
+            q.pending.push_back(std::move(r));
+            q.points += n;
+            m_stats.requests++;
+
+            if (q.points >= m_options.max_batch)
+            {
+                flush(q);
+                return result;
+            }
+
+            if (first)
+            {
+                q.deadline = clock::now() + m_options.max_latency;
+                m_deadlines.push({q.deadline, id});
+            }
+        }
+
+        // Only a new deadline can be earlier than the one the timer sleeps
+        // until
+        if (first)
+        {
+            m_wake.notify_one();
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Runs the pending requests of every expression now, without
+     * waiting for their deadlines, e.g., before a pause in the requests.
+    */
+    void flush()
+    {
+        std::lock_guard lock(m_mutex);
+        for (auto& q: m_queues)
+        {
+            flush(*q);
+        }
+    }
+
+    /**
+     * @brief Counters of the requests and batches so far.
+    */
+    auto stats() -> service_stats
+    {
+        std::lock_guard lock(m_mutex);
+        return m_stats;
+    }
+
+    /**
+     * @brief Options of the service.
+    */
+    auto options() const noexcept -> const service_options<T>&
+    {
+        return m_options;
+    }
+};
+
+};
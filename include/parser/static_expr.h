@@ -0,0 +1,287 @@
+/**
+ * @file static_expr.h
+ * @brief Contains math expressions that are parsed at compile time, from a
+ * string given as a template argument, into a type that evaluates the
+ * expression with straight-line code.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "dual.h"
+#include "parser/expression.h"
+#include "parser/parse.h"
+
+namespace parser
+{
+
+/**
+ * @brief String literal usable as a template argument.
+ *
+ * @tparam N Size of the string literal, including the terminating null.
+*/
+template<size_t N>
+struct fixed_string
+{
+    char data[N] = {};
+
+    constexpr fixed_string(const char (&str)[N])
+    {
+        std::copy_n(str, N, data);
+    }
+
+    constexpr auto view() const -> std::string_view
+    {
+        return {data, N - 1};
+    }
+};
+
+/**
+ * @brief Postfix expression with a fixed maximum number of tokens, together
+ * with the index of the first token of the subexpression ending at every
+ * token. Built in constant expressions by make_static_program.
+ *
+ * @tparam T Floating point type used by expression.
+ * @tparam N Maximum number of tokens.
+*/
+template<std::floating_point T, size_t N>
+struct static_program
+{
+    std::array<token<T>, N> tokens{};
+    std::array<size_t, N> begin{};
+    size_t size = 0;
+};
+
+/**
+ * @brief Parses an infix expression into a postfix static_program. Runs the
+ * same parser as expr::parse, so that both give the same postfix expression.
+ *
+ * @tparam T Floating point type used by expression.
+ * @tparam N Maximum number of tokens. Every token takes at least one
+ * character, so the length of the string is always enough.
+ *
+ * @param infix String representing an infix math expression.
+ * @return Postfix expression.
+ * @throw invalid_argument if the expression is not well-formed. In a constant
+ * expression, this is a compile error.
+*/
+template<std::floating_point T, size_t N>
+constexpr auto make_static_program(std::string_view infix) -> static_program<T, N>
+{
+    static_program<T, N> program;
+    auto& postfix = program.tokens;
+    auto& n = program.size;
+
+    parse<T>(infix, [&](const token<T>& t) { postfix[n++] = t; });
+
+    // Start of the subexpression ending at every token, found with a stack
+    // of the starts of the subexpressions evaluated so far
+    std::array<size_t, N> starts{};
+    size_t top = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        auto& t = postfix[i];
+        auto arity = t.type == BIN_OP ? 2 : t.type == FUNC ? 1 : 0;
+
+        if (top < (size_t) arity)
+        {
+            throw std::invalid_argument("Expression is not a legal postfix expression.");
+        }
+
+        top -= arity;
+        program.begin[i] = arity == 0 ? i : starts[top];
+        starts[top++] = program.begin[i];
+    }
+
+    if (top != 1)
+    {
+        throw std::invalid_argument("Expression is not a legal postfix expression.");
+    }
+
+    return program;
+}
+
+/**
+ * @brief Math expression parsed at compile time.
+ *
+ * Every token of the postfix expression is a separate instantiation of a
+ * function template, in which the operation is known at compile time, so a
+ * call compiles into straight-line code, with no evaluation stack and no
+ * dispatch on the operations. Integer powers with a constant exponent are
+ * unrolled into multiplications.
+ *
+ * Derivatives are found in forward mode: the expression is evaluated on
+ * (nested) dual numbers, so the derivative is computed alongside the value
+ * without ever building the expression of the derivative. See dual.h for how
+ * non-holomorphic functions are differentiated.
+ *
+ * @tparam S String representing an infix math expression.
+ * @tparam T The floating point type (float, double or long double) to use in
+ * the evaluation of the expression. Defaults to double.
+ * @tparam order Order of the derivative of the expression that is evaluated.
+ * Defaults to 0, i.e., the expression itself.
+*/
+template<fixed_string S, std::floating_point T = double, size_t order = 0>
+class static_expr
+{
+private:
+    static constexpr auto program = make_static_program<T, sizeof(S.data)>(S.view());
+
+    /**
+     * @brief Computes z^p for a constant integer p by exponentiation by
+     * squaring, unrolled at compile time.
+    */
+    template<int p, typename V>
+    static auto powi(const V& z) -> V
+    {
+        if constexpr (p < 0)
+        {
+            return V(1) / powi<- p>(z);
+        }
+        else if constexpr (p == 0)
+        {
+            return V(1);
+        }
+        else if constexpr (p == 1)
+        {
+            return z;
+        }
+        else if constexpr (p % 2 == 0)
+        {
+            auto h = powi<p / 2>(z);
+            return h * h;
+        }
+        else
+        {
+            return powi<p - 1>(z) * z;
+        }
+    }
+
+    /**
+     * @brief Evaluates the subexpression ending at token k.
+     *
+     * @tparam k Index of last token of subexpression.
+     * @tparam V std::complex<T> to evaluate the expression, or nested dual
+     * numbers to evaluate its derivatives.
+    */
+    template<size_t k, typename V>
+    static auto eval(const V& z) -> V
+    {
+        constexpr auto t = program.tokens[k];
+
+        if constexpr (t.type == VAR)
+        {
+            return z;
+        }
+        else if constexpr (t.type == CONST)
+        {
+            return V(t.val);
+        }
+        else if constexpr (t.type == FUNC)
+        {
+            return apply_func<t.op>(eval<k - 1>(z));
+        }
+        else
+        {
+            constexpr auto rhs = k - 1;
+            constexpr auto lhs = program.begin[rhs] - 1;
+            constexpr auto p = program.tokens[rhs].val;
+
+            if constexpr (t.op == POW && program.tokens[rhs].type == CONST && p.imag() == 0 && (p.real() < 0 ? - p.real() : p.real()) <= 64 && p.real() == (int) p.real())
+            {
+                return powi<(int) p.real()>(eval<lhs>(z));
+            }
+            else
+            {
+                return apply_bin_op<t.op>(eval<lhs>(z), eval<rhs>(z));
+            }
+        }
+    }
+
+    /**
+     * @brief Variable z + ε_1 + ... + ε_n as n nested dual numbers, whose
+     * innermost derivative part is the n-th derivative of the expression.
+    */
+    template<size_t n>
+    static auto seed(std::complex<T> z)
+    {
+        if constexpr (n == 0)
+        {
+            return z;
+        }
+        else
+        {
+            using V = decltype(seed<n - 1>(z));
+            return dual<V>(seed<n - 1>(z), V(1));
+        }
+    }
+
+    /**
+     * @brief Innermost derivative part of n nested dual numbers.
+    */
+    template<size_t n, typename V>
+    static auto innermost(const V& x) -> std::complex<T>
+    {
+        if constexpr (n == 0)
+        {
+            return x;
+        }
+        else
+        {
+            return innermost<n - 1>(x.der);
+        }
+    }
+
+public:
+    /**
+     * @brief Evaluates the expression, or its derivative of the given order.
+     *
+     * @param z Value to evaluate at.
+     * @return Value of the expression (or its derivative) at z.
+    */
+    auto operator()(std::complex<T> z) const -> std::complex<T>
+    {
+        return innermost<order>(eval<program.size - 1>(seed<order>(z)));
+    }
+
+    /**
+     * @brief Number of tokens in the postfix expression.
+    */
+    static constexpr auto size() noexcept -> size_t
+    {
+        return program.size;
+    }
+
+    /**
+     * @brief Postfix expression, as a runtime expression.
+    */
+    static auto postfix() -> expr<T, std::vector>
+    {
+        return expr<T, std::vector>(program.tokens.begin(), program.tokens.begin() + program.size);
+    }
+};
+
+/**
+ * @brief Differentiates an expression parsed at compile time. Nothing is
+ * computed, the result is just the type evaluating one more derivative.
+ *
+ * @param e Expression to differentiate.
+ * @return Derivative of expression.
+*/
+template<fixed_string S, std::floating_point T, size_t order>
+constexpr auto differentiate(const static_expr<S, T, order>&) -> static_expr<S, T, order + 1>
+{
+    return {};
+}
+
+};
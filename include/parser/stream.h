@@ -0,0 +1,338 @@
+/**
+ * @file stream.h
+ * @brief Contains functions to evaluate compiled expressions over sets of
+ * points that are too large to hold in memory, read from memory mapped files
+ * or streams one chunk at a time.
+ *
+ * Points and values are stored as raw arrays of std::complex<T>, i.e., the
+ * real and imaginary part of every point one after the other, in the byte
+ * order of the machine.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <complex>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "compiled.h"
+
+namespace parser
+{
+
+// Number of points evaluated at a time by default. A chunk of
+// complex<double> values is 1 MB, large enough for reads to be efficient,
+// and small enough for the input and output of a chunk to stay in cache.
+inline constexpr size_t stream_chunk_size = 1 << 16;
+
+/**
+ * @brief File mapped into memory read only, unmapped on destruction. Pages
+ * are read from disk as they are first touched, so mapping a file larger
+ * than memory is fine as long as it is read in order.
+*/
+class mapped_file
+{
+private:
+    const std::byte* m_data = nullptr;
+    size_t m_size = 0;
+
+public:
+    /**
+     * @brief Maps a file into memory.
+     *
+     * @param path Path of file.
+     * @throw runtime_error if the file can not be opened or mapped.
+    */
+    explicit mapped_file(const std::filesystem::path& path)
+    {
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open " + path.string() + ": " + std::strerror(errno));
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0)
+        {
+            auto error = errno;
+            ::close(fd);
+            throw std::runtime_error("Could not read size of " + path.string() + ": " + std::strerror(error));
+        }
+
+        m_size = (size_t) info.st_size;
+        if (m_size > 0)
+        {
+            auto data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                auto error = errno;
+                ::close(fd);
+                throw std::runtime_error("Could not map " + path.string() + ": " + std::strerror(error));
+            }
+
+            // The file is expected to be read front to back
+            ::madvise(data, m_size, MADV_SEQUENTIAL);
+            m_data = static_cast<const std::byte*>(data);
+        }
+
+        // The mapping stays valid after the file is closed
+        ::close(fd);
+    }
+
+    mapped_file(mapped_file&& other) noexcept :
+        m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0))
+    {
+    }
+
+    auto operator=(mapped_file&& other) noexcept -> mapped_file&
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        return *this;
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    auto operator=(const mapped_file&) -> mapped_file& = delete;
+
+    ~mapped_file()
+    {
+        if (m_data)
+        {
+            ::munmap(const_cast<std::byte*>(m_data), m_size);
+        }
+    }
+
+    /**
+     * @brief Contents of the file.
+    */
+    auto bytes() const noexcept -> std::span<const std::byte>
+    {
+        return {m_data, m_size};
+    }
+
+    /**
+     * @brief Size of the file in bytes.
+    */
+    auto size() const noexcept -> size_t
+    {
+        return m_size;
+    }
+
+    /**
+     * @brief Contents of the file as an array of values, without copying.
+     *
+     * @tparam U Type of the values, e.g., std::complex<double>.
+     * @throw invalid_argument if the size of the file is not a multiple of
+     * the size of U.
+    */
+    template<typename U>
+    auto view() const -> std::span<const U>
+    {
+        if (m_size % sizeof(U) != 0)
+        {
+            throw std::invalid_argument("Size of mapped file is not a multiple of the size of its values.");
+        }
+
+        return {reinterpret_cast<const U*>(m_data), m_size / sizeof(U)};
+    }
+
+    /**
+     * @brief Asks the kernel to start reading a range of the file in the
+     * background, so that it is in memory by the time it is touched. Ranges
+     * partly past the end of the file are cut short.
+     *
+     * @param offset Offset of first byte of range.
+     * @param length Number of bytes in range.
+    */
+    void prefetch(size_t offset, size_t length) const noexcept
+    {
+        if (offset >= m_size)
+        {
+            return;
+        }
+
+        // madvise needs the start of a page
+        auto page = (size_t) ::sysconf(_SC_PAGESIZE);
+        auto begin = offset / page * page;
+        auto end = std::min(offset + length, m_size);
+        ::madvise(const_cast<std::byte*>(m_data) + begin, end - begin, MADV_WILLNEED);
+    }
+};
+
+/**
+ * @brief Evaluates a compiled expression over points read one chunk at a
+ * time, writing the values one chunk at a time, so that only two chunks of
+ * points and one of values are ever in memory. The next chunk is read on
+ * another thread while the current one is evaluated, so reading and
+ * evaluating overlap.
+ *
+ * @param e Compiled expression to evaluate.
+ * @param read Called with a span to fill with the next points. Returns the
+ * number of points written to the span, which is only less than its size at
+ * the end of the points. Called on another thread, but never twice at once.
+ * @param write Called with the values of every chunk, in order.
+ * @param chunk Number of points evaluated at a time. Defaults to
+ * stream_chunk_size.
+ *
+ * @return Number of points evaluated.
+ * @throw Rethrows any exception thrown by read or write.
+*/
+template<std::floating_point T, typename source, typename sink>
+requires std::invocable<source&, std::span<std::complex<T>>> && std::invocable<sink&, std::span<const std::complex<T>>>
+auto stream_evaluate(const compiled_expr<T>& e, source&& read, sink&& write, size_t chunk = stream_chunk_size) -> size_t
+{
+    chunk = std::max<size_t>(chunk, 1);
+
+    std::vector<std::complex<T>> in[2] = {std::vector<std::complex<T>>(chunk), std::vector<std::complex<T>>(chunk)};
+    std::vector<std::complex<T>> out(chunk);
+    std::vector<T> scratch(e.scratch_size());
+
+    size_t total = 0;
+    size_t current = 0;
+    size_t n = read(std::span(in[current]));
+
+    while (n > 0)
+    {
+        // A short read means there are no points left
+        std::future<size_t> next;
+        if (n == chunk)
+        {
+            next = std::async(std::launch::async, [&, k = current ^ 1] { return (size_t) read(std::span(in[k])); });
+        }
+
+        e.evaluate(std::span<const std::complex<T>>(in[current].data(), n), std::span(out.data(), n), scratch);
+        write(std::span<const std::complex<T>>(out.data(), n));
+        total += n;
+
+        n = next.valid() ? next.get() : 0;
+        current ^= 1;
+    }
+
+    return total;
+}
+
+/**
+ * @brief Evaluates a compiled expression over the points of a stream,
+ * writing the values to another stream in the same layout. See the overload
+ * taking a source and a sink.
+ *
+ * @param e Compiled expression to evaluate.
+ * @param in Stream of points, e.g., a std::ifstream opened in binary mode.
+ * @param out Stream to write the values to.
+ * @param chunk Number of points evaluated at a time. Defaults to
+ * stream_chunk_size.
+ *
+ * @return Number of points evaluated.
+ * @throw invalid_argument if the stream ends in the middle of a point.
+ * @throw runtime_error if writing to out fails.
+*/
+template<std::floating_point T>
+auto stream_evaluate(const compiled_expr<T>& e, std::istream& in, std::ostream& out, size_t chunk = stream_chunk_size) -> size_t
+{
+    auto read = [&](std::span<std::complex<T>> points) -> size_t
+    {
+        in.read(reinterpret_cast<char*>(points.data()), (std::streamsize) points.size_bytes());
+        auto bytes = (size_t) in.gcount();
+
+        if (bytes % sizeof(std::complex<T>) != 0)
+        {
+            throw std::invalid_argument("Input stream ends in the middle of a point.");
+        }
+
+        return bytes / sizeof(std::complex<T>);
+    };
+
+    auto write = [&](std::span<const std::complex<T>> values)
+    {
+        if (!out.write(reinterpret_cast<const char*>(values.data()), (std::streamsize) values.size_bytes()))
+        {
+            throw std::runtime_error("Could not write to output stream.");
+        }
+    };
+
+    return stream_evaluate(e, read, write, chunk);
+}
+
+/**
+ * @brief Evaluates a compiled expression over the points of a memory mapped
+ * file, one chunk at a time. The points are evaluated where they are mapped,
+ * without copying them, and the kernel is asked to read the next chunk from
+ * disk while the current one is evaluated.
+ *
+ * @param e Compiled expression to evaluate.
+ * @param in Mapped file of points.
+ * @param write Called with the values of every chunk, in order.
+ * @param chunk Number of points evaluated at a time. Defaults to
+ * stream_chunk_size.
+ *
+ * @return Number of points evaluated.
+ * @throw invalid_argument if the size of the file is not a whole number of
+ * points.
+ * @throw Rethrows any exception thrown by write.
+*/
+template<std::floating_point T, typename sink>
+requires std::invocable<sink&, std::span<const std::complex<T>>>
+auto stream_evaluate(const compiled_expr<T>& e, const mapped_file& in, sink&& write, size_t chunk = stream_chunk_size) -> size_t
+{
+    chunk = std::max<size_t>(chunk, 1);
+
+    auto points = in.template view<std::complex<T>>();
+    std::vector<std::complex<T>> out(std::min(chunk, points.size()));
+    std::vector<T> scratch(e.scratch_size());
+
+    in.prefetch(0, chunk * sizeof(std::complex<T>));
+
+    for (size_t i = 0; i < points.size(); i += chunk)
+    {
+        auto n = std::min(chunk, points.size() - i);
+        in.prefetch((i + chunk) * sizeof(std::complex<T>), chunk * sizeof(std::complex<T>));
+
+        e.evaluate(points.subspan(i, n), std::span(out.data(), n), scratch);
+        write(std::span<const std::complex<T>>(out.data(), n));
+    }
+
+    return points.size();
+}
+
+/**
+ * @brief Evaluates a compiled expression over the points of a memory mapped
+ * file, writing the values to a stream in the same layout. See the overload
+ * taking a sink.
+ *
+ * @throw invalid_argument if the size of the file is not a whole number of
+ * points.
+ * @throw runtime_error if writing to out fails.
+*/
+template<std::floating_point T>
+auto stream_evaluate(const compiled_expr<T>& e, const mapped_file& in, std::ostream& out, size_t chunk = stream_chunk_size) -> size_t
+{
+    return stream_evaluate(e, in, [&](std::span<const std::complex<T>> values)
+    {
+        if (!out.write(reinterpret_cast<const char*>(values.data()), (std::streamsize) values.size_bytes()))
+        {
+            throw std::runtime_error("Could not write to output stream.");
+        }
+    }, chunk);
+}
+
+};
@@ -0,0 +1,399 @@
+/**
+ * @file taylor.h
+ * @brief Contains arithmetic on truncated Taylor series, for evaluating the
+ * derivatives of a math expression up to any order in a single pass.
+ *
+ * A series is an array of n coefficients a_0, ..., a_{n-1} of
+ * a(t) = a_0 + a_1 t + ... + a_{n-1} t^{n-1}, where a_k = a^(k)(0) / k!.
+ * Evaluating an expression on the series z + t gives the series of the
+ * expression around z. Every function takes O(n^2) operations, using the
+ * usual recurrences of automatic differentiation (Griewank & Walther,
+ * Evaluating Derivatives, chapter 13). Outputs must not overlap inputs.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <concepts>
+#include <stdexcept>
+#include <vector>
+
+#include "parser/token.h"
+
+namespace parser
+{
+
+/**
+ * @brief c = a b.
+*/
+template<std::floating_point T>
+inline void taylor_mul(const std::complex<T>* a, const std::complex<T>* b, std::complex<T>* c, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        std::complex<T> sum = 0;
+        for (size_t j = 0; j <= k; j++)
+        {
+            sum += a[j] * b[k - j];
+        }
+        c[k] = sum;
+    }
+}
+
+/**
+ * @brief c = a / b.
+*/
+template<std::floating_point T>
+inline void taylor_div(const std::complex<T>* a, const std::complex<T>* b, std::complex<T>* c, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        auto sum = a[k];
+        for (size_t j = 0; j < k; j++)
+        {
+            sum -= c[j] * b[k - j];
+        }
+        c[k] = sum / b[0];
+    }
+}
+
+/**
+ * @brief c = exp(a).
+*/
+template<std::floating_point T>
+inline void taylor_exp(const std::complex<T>* a, std::complex<T>* c, size_t n)
+{
+    c[0] = std::exp(a[0]);
+    for (size_t k = 1; k < n; k++)
+    {
+        std::complex<T> sum = 0;
+        for (size_t j = 1; j <= k; j++)
+        {
+            sum += (T) j * a[j] * c[k - j];
+        }
+        c[k] = sum / (T) k;
+    }
+}
+
+/**
+ * @brief c = log(a).
+*/
+template<std::floating_point T>
+inline void taylor_log(const std::complex<T>* a, std::complex<T>* c, size_t n)
+{
+    c[0] = std::log(a[0]);
+    for (size_t k = 1; k < n; k++)
+    {
+        std::complex<T> sum = 0;
+        for (size_t j = 1; j < k; j++)
+        {
+            sum += (T) j * c[j] * a[k - j];
+        }
+        c[k] = (a[k] - sum / (T) k) / a[0];
+    }
+}
+
+/**
+ * @brief c = sqrt(a).
+*/
+template<std::floating_point T>
+inline void taylor_sqrt(const std::complex<T>* a, std::complex<T>* c, size_t n)
+{
+    c[0] = std::sqrt(a[0]);
+    for (size_t k = 1; k < n; k++)
+    {
+        auto sum = a[k];
+        for (size_t j = 1; j < k; j++)
+        {
+            sum -= c[j] * c[k - j];
+        }
+        c[k] = sum / ((T) 2 * c[0]);
+    }
+}
+
+/**
+ * @brief s = sin(a) and c = cos(a), or s = sinh(a) and c = cosh(a), which
+ * are found together.
+ *
+ * @param hyperbolic Whether to find sinh and cosh instead of sin and cos.
+*/
+template<std::floating_point T>
+inline void taylor_sin_cos(const std::complex<T>* a, std::complex<T>* s, std::complex<T>* c, size_t n, bool hyperbolic = false)
+{
+    s[0] = hyperbolic ? std::sinh(a[0]) : std::sin(a[0]);
+    c[0] = hyperbolic ? std::cosh(a[0]) : std::cos(a[0]);
+    for (size_t k = 1; k < n; k++)
+    {
+        std::complex<T> sum_s = 0, sum_c = 0;
+        for (size_t j = 1; j <= k; j++)
+        {
+            sum_s += (T) j * a[j] * c[k - j];
+            sum_c += (T) j * a[j] * s[k - j];
+        }
+        s[k] = sum_s / (T) k;
+        c[k] = (hyperbolic ? sum_c : - sum_c) / (T) k;
+    }
+}
+
+/**
+ * @brief c = a^p for an integer p, by exponentiation by squaring, which unlike
+ * exp(p log(a)) also works where a_0 = 0.
+*/
+template<std::floating_point T>
+inline void taylor_powi(const std::complex<T>* a, int p, std::complex<T>* c, size_t n)
+{
+    std::vector<std::complex<T>> base(a, a + n), square(n), result(n), product(n);
+    result[0] = 1;
+
+    for (unsigned e = p < 0 ? - (unsigned) p : (unsigned) p; e != 0; e >>= 1)
+    {
+        if (e & 1)
+        {
+            taylor_mul(result.data(), base.data(), product.data(), n);
+            std::swap(result, product);
+        }
+        if (e > 1)
+        {
+            taylor_mul(base.data(), base.data(), square.data(), n);
+            std::swap(base, square);
+        }
+    }
+
+    if (p < 0)
+    {
+        std::vector<std::complex<T>> one(n);
+        one[0] = 1;
+        taylor_div(one.data(), result.data(), c, n);
+    }
+    else
+    {
+        std::copy(result.begin(), result.end(), c);
+    }
+}
+
+/**
+ * @brief c = f(a) for an inverse function f with f'(x) = sign / g(x), where
+ * g(x) = sqrt((1 - x)(1 + x)) for ACOS and ASIN, 1 + x^2 for ATAN,
+ * sqrt(x - 1) sqrt(x + 1) for ACOSH, sqrt(x^2 + 1) for ASINH and
+ * (1 - x)(1 + x) for ATANH, the same branches as in dual.h. Found by
+ * integrating the series of f(a)' = sign a' / g(a).
+*/
+template<std::floating_point T>
+inline void taylor_inverse(operation op, const std::complex<T>* a, std::complex<T>* c, size_t n, std::complex<T> value, T sign)
+{
+    c[0] = value;
+    if (n == 1)
+    {
+        return;
+    }
+
+    // Series of a' and of g(a), with one coefficient less
+    auto m = n - 1;
+    std::vector<std::complex<T>> da(m), g(m), s(m), t(m), u(m);
+    for (size_t k = 0; k < m; k++)
+    {
+        da[k] = (T) (k + 1) * a[k + 1];
+    }
+
+    if (op == ACOSH)
+    {
+        std::copy(a, a + m, s.begin());
+        s[0] -= 1;
+        taylor_sqrt(s.data(), t.data(), m);
+        s[0] += 2;
+        taylor_sqrt(s.data(), u.data(), m);
+        taylor_mul(t.data(), u.data(), g.data(), m);
+    }
+    else if (op == ACOS || op == ASIN || op == ATANH)
+    {
+        // (1 - x)(1 + x), as in dual.h, rather than 1 - x^2 found by negating
+        // x^2, which gives a zero imaginary part the other sign at real
+        // x > 1, and with it the other branch of the square root
+        for (size_t k = 0; k < m; k++)
+        {
+            t[k] = - a[k];
+            u[k] = a[k];
+        }
+        t[0] += 1;
+        u[0] += 1;
+        taylor_mul(t.data(), u.data(), s.data(), m);
+
+        if (op == ATANH)
+        {
+            std::swap(g, s);
+        }
+        else
+        {
+            taylor_sqrt(s.data(), g.data(), m);
+        }
+    }
+    else
+    {
+        // x^2 + 1
+        taylor_mul(a, a, s.data(), m);
+        s[0] += 1;
+
+        if (op == ATAN)
+        {
+            std::swap(g, s);
+        }
+        else
+        {
+            taylor_sqrt(s.data(), g.data(), m);
+        }
+    }
+
+    taylor_div(da.data(), g.data(), u.data(), m);
+    for (size_t k = 1; k < n; k++)
+    {
+        c[k] = sign * u[k - 1] / (T) k;
+    }
+}
+
+/**
+ * @brief c = f(a) for a function of one variable f. RE, IM, ABS, ARG and CONJ
+ * are taken along the real axis, as in dual.h.
+ *
+ * @param op Operation with type FUNC.
+ * @throw invalid_argument if op is not a function.
+*/
+template<std::floating_point T>
+inline void taylor_func(operation op, const std::complex<T>* a, std::complex<T>* c, size_t n)
+{
+    std::vector<std::complex<T>> s, t;
+    auto scratch = [&] { s.resize(n); t.resize(n); };
+
+    switch (op)
+    {
+        case NEG:
+            for (size_t k = 0; k < n; k++) c[k] = - a[k];
+            break;
+        case RE:
+            for (size_t k = 0; k < n; k++) c[k] = a[k].real();
+            break;
+        case IM:
+            for (size_t k = 0; k < n; k++) c[k] = a[k].imag();
+            break;
+        case CONJ:
+            for (size_t k = 0; k < n; k++) c[k] = std::conj(a[k]);
+            break;
+        case ABS:
+        {
+            // |a| = r sqrt(b conj(b)) for b = a / r, a real series, with r = |a0|
+            // so that the square does not overflow or underflow
+            scratch();
+            T r = std::abs(a[0]);
+            if (!(r > 0) || !std::isfinite(r)) r = 1;
+            for (size_t k = 0; k < n; k++)
+            {
+                t[k] = a[k] / r;
+                s[k] = std::conj(t[k]);
+            }
+            taylor_mul(t.data(), s.data(), c, n);
+            for (size_t k = 0; k < n; k++) c[k] = c[k].real();
+            taylor_sqrt(c, s.data(), n);
+            for (size_t k = 0; k < n; k++) c[k] = r * s[k];
+            break;
+        }
+        case ARG:
+            // arg(a) = im(log(a))
+            taylor_log(a, c, n);
+            for (size_t k = 0; k < n; k++) c[k] = c[k].imag();
+            break;
+        case EXP:
+            taylor_exp(a, c, n);
+            break;
+        case LOG:
+            taylor_log(a, c, n);
+            break;
+        case SIN:
+            scratch();
+            taylor_sin_cos(a, c, s.data(), n);
+            break;
+        case COS:
+            scratch();
+            taylor_sin_cos(a, s.data(), c, n);
+            break;
+        case SINH:
+            scratch();
+            taylor_sin_cos(a, c, s.data(), n, true);
+            break;
+        case COSH:
+            scratch();
+            taylor_sin_cos(a, s.data(), c, n, true);
+            break;
+        case TAN:
+        case COT:
+        case TANH:
+            scratch();
+            taylor_sin_cos(a, s.data(), t.data(), n, op == TANH);
+            op == COT ? taylor_div(t.data(), s.data(), c, n) : taylor_div(s.data(), t.data(), c, n);
+            break;
+        case SEC:
+        case CSC:
+            scratch();
+            taylor_sin_cos(a, s.data(), t.data(), n);
+            // 1 / cos(a) or 1 / sin(a), with the numerator 1 reusing the other
+            {
+                auto& denom = op == SEC ? t : s;
+                auto& one = op == SEC ? s : t;
+                std::fill(one.begin(), one.end(), 0);
+                one[0] = 1;
+                taylor_div(one.data(), denom.data(), c, n);
+            }
+            break;
+        case ACOS:  taylor_inverse(op, a, c, n, std::acos(a[0]), (T) -1); break;
+        case ASIN:  taylor_inverse(op, a, c, n, std::asin(a[0]), (T) 1); break;
+        case ATAN:  taylor_inverse(op, a, c, n, std::atan(a[0]), (T) 1); break;
+        case ACOSH: taylor_inverse(op, a, c, n, std::acosh(a[0]), (T) 1); break;
+        case ASINH: taylor_inverse(op, a, c, n, std::asinh(a[0]), (T) 1); break;
+        case ATANH: taylor_inverse(op, a, c, n, std::atanh(a[0]), (T) 1); break;
+        case DERIV:
+            for (size_t k = 0; k < n; k++) c[k] = 0;
+            break;
+        default:
+            throw std::invalid_argument("Function not found.");
+    }
+}
+
+/**
+ * @brief c = a · b for a binary operation ·. Powers are taken as
+ * exp(b log(a)), as std::pow does.
+ *
+ * @param op Operation with type BIN_OP.
+ * @throw invalid_argument if op is not a binary operation.
+*/
+template<std::floating_point T>
+inline void taylor_bin_op(operation op, const std::complex<T>* a, const std::complex<T>* b, std::complex<T>* c, size_t n)
+{
+    switch (op)
+    {
+        case ADD:
+            for (size_t k = 0; k < n; k++) c[k] = a[k] + b[k];
+            break;
+        case SUB:
+            for (size_t k = 0; k < n; k++) c[k] = a[k] - b[k];
+            break;
+        case MUL:
+            taylor_mul(a, b, c, n);
+            break;
+        case DIV:
+            taylor_div(a, b, c, n);
+            break;
+        case POW:
+        {
+            std::vector<std::complex<T>> s(n), t(n);
+            taylor_log(a, s.data(), n);
+            taylor_mul(b, s.data(), t.data(), n);
+            taylor_exp(t.data(), c, n);
+            break;
+        }
+        default:
+            throw std::invalid_argument("Binary operation not found.");
+    }
+}
+
+};
@@ -0,0 +1,233 @@
+/**
+ * @file thread_pool.h
+ * @brief Contains a work-stealing thread pool used to run evaluations across
+ * many cores.
+ *
+ * @author Dhairya Patel
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parser
+{
+
+/**
+ * @brief Pool of worker threads, each with its own queue of tasks.
+ *
+ * A worker takes tasks from the back of its own queue and, once that is
+ * empty, steals tasks from the front of the queues of other workers, so that
+ * work submitted unevenly is still spread across all the workers. Tasks
+ * submitted from a worker go to its own queue, and tasks submitted from any
+ * other thread are spread round robin over the queues.
+*/
+class thread_pool
+{
+private:
+    using task = std::function<void()>;
+
+    struct task_queue
+    {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    std::vector<std::unique_ptr<task_queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    // Workers sleep on m_wake while there are no queued tasks
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<size_t> m_queued = 0;
+    bool m_stop = false;
+
+    // Queue that the next task submitted from outside the pool goes to
+    std::atomic<size_t> m_next = 0;
+
+    // Pool and queue index of the worker running on the current thread, if any
+    static inline thread_local thread_pool* t_pool = nullptr;
+    static inline thread_local size_t t_index = 0;
+
+    /**
+     * @brief Takes a task to run, first from the back of queue i and then
+     * from the front of every other queue.
+     *
+     * @param i Index of the queue to look at first.
+     * @param t Task to move the taken task to.
+     * @return True if a task was taken, false if all queues are empty.
+    */
+    auto take(size_t i, task& t) -> bool
+    {
+        {
+            std::lock_guard lock(m_queues[i]->mutex);
+            if (!m_queues[i]->tasks.empty())
+            {
+                t = std::move(m_queues[i]->tasks.back());
+                m_queues[i]->tasks.pop_back();
+                m_queued--;
+                return true;
+            }
+        }
+
+        for (size_t j = 1; j < m_queues.size(); j++)
+        {
+            auto& queue = *m_queues[(i + j) % m_queues.size()];
+            std::lock_guard lock(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                t = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                m_queued--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Main loop of the worker with queue i.
+     *
+     * @param i Index of the queue of the worker.
+    */
+    void work(size_t i)
+    {
+        t_pool = this;
+        t_index = i;
+
+        task t;
+        while (true)
+        {
+            if (take(i, t))
+            {
+                t();
+                t = nullptr;
+                continue;
+            }
+
+            std::unique_lock lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_queued > 0; });
+
+            if (m_stop && m_queued == 0)
+            {
+                return;
+            }
+        }
+    }
+
+public:
+    /**
+     * @brief Starts the worker threads.
+     *
+     * @param n Number of worker threads. Defaults to the number of hardware
+     * threads.
+     *
+     * @return thread_pool instance with n workers.
+    */
+    explicit thread_pool(size_t n = std::thread::hardware_concurrency())
+    {
+        n = std::max<size_t>(n, 1);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            m_queues.push_back(std::make_unique<task_queue>());
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            m_threads.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    auto operator=(const thread_pool&) -> thread_pool& = delete;
+
+    /**
+     * @brief Runs all tasks that are still queued, then stops the worker
+     * threads.
+    */
+    ~thread_pool()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+
+        for (auto& thread: m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief Queues a task to be run by one of the workers.
+     *
+     * @param t Task to run.
+    */
+    void submit(task t)
+    {
+        auto i = t_pool == this ? t_index : m_next++ % m_queues.size();
+
+        // Counted before the task is published, so a worker taking it at
+        // once never takes the count below zero
+        {
+            std::lock_guard lock(m_mutex);
+            m_queued++;
+        }
+
+        {
+            std::lock_guard lock(m_queues[i]->mutex);
+            m_queues[i]->tasks.push_back(std::move(t));
+        }
+        m_wake.notify_one();
+    }
+
+    /**
+     * @brief Runs a single queued task on the calling thread, if there is
+     * one. Lets a thread waiting on tasks help with them instead of blocking,
+     * which also keeps workers waiting on other tasks from deadlocking.
+     *
+     * @return True if a task was run, false if there were no queued tasks.
+    */
+    auto run_pending_task() -> bool
+    {
+        task t;
+        if (take(t_pool == this ? t_index : 0, t))
+        {
+            t();
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Number of worker threads.
+    */
+    auto size() const noexcept -> size_t
+    {
+        return m_threads.size();
+    }
+
+    /**
+     * @brief Pool shared by the whole process, with one worker per hardware
+     * thread. Started on first use.
+    */
+    static auto global() -> thread_pool&
+    {
+        static thread_pool pool;
+        return pool;
+    }
+};
+
+};
@@ -0,0 +1,192 @@
+/**
+ * @file count_allocations.cpp
+ * @brief Replaces the global operator new and operator delete with ones that
+ * count the allocations of each thread in parser::thread_allocations (see
+ * instrument.h). Linked only into the binaries that profile allocations, as
+ * the replacement may only be made once in a program.
+ *
+ * @author Dhairya Patel
+*/
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "parser/instrument.h"
+
+namespace
+{
+
+/**
+ * @brief Allocates and counts size bytes aligned to alignment.
+ *
+ * @return Allocated memory, or nullptr if there is not enough memory.
+*/
+auto allocate(std::size_t size, std::size_t alignment) noexcept -> void*
+{
+    auto bytes = size > 0 ? size : 1;
+    void* p;
+    if (alignment <= alignof(std::max_align_t))
+    {
+        p = std::malloc(bytes);
+    }
+    else
+    {
+        // aligned_alloc needs a size that is a multiple of the alignment
+        p = std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+    }
+
+    if (p)
+    {
+        parser::thread_allocations.count++;
+        parser::thread_allocations.bytes += size;
+    }
+    return p;
+}
+
+/**
+ * @brief Allocates as operator new does, calling the new handler until there
+ * is enough memory.
+ *
+ * @throw bad_alloc if there is not enough memory and no new handler.
+*/
+auto allocate_or_throw(std::size_t size, std::size_t alignment) -> void*
+{
+    while (true)
+    {
+        if (auto p = allocate(size, alignment))
+        {
+            return p;
+        }
+
+        if (auto handler = std::get_new_handler())
+        {
+            handler();
+        }
+        else
+        {
+            throw std::bad_alloc();
+        }
+    }
+}
+
+/**
+ * @brief Calls f, returning nullptr instead of throwing bad_alloc.
+*/
+template<typename function>
+auto nothrow(function&& f) noexcept -> void*
+{
+    try
+    {
+        return f();
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+};
+
+auto operator new(std::size_t size) -> void*
+{
+    return allocate_or_throw(size, 0);
+}
+
+auto operator new[](std::size_t size) -> void*
+{
+    return allocate_or_throw(size, 0);
+}
+
+auto operator new(std::size_t size, std::align_val_t alignment) -> void*
+{
+    return allocate_or_throw(size, (std::size_t) alignment);
+}
+
+auto operator new[](std::size_t size, std::align_val_t alignment) -> void*
+{
+    return allocate_or_throw(size, (std::size_t) alignment);
+}
+
+auto operator new(std::size_t size, const std::nothrow_t&) noexcept -> void*
+{
+    return nothrow([&] { return allocate_or_throw(size, 0); });
+}
+
+auto operator new[](std::size_t size, const std::nothrow_t&) noexcept -> void*
+{
+    return nothrow([&] { return allocate_or_throw(size, 0); });
+}
+
+auto operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept -> void*
+{
+    return nothrow([&] { return allocate_or_throw(size, (std::size_t) alignment); });
+}
+
+auto operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept -> void*
+{
+    return nothrow([&] { return allocate_or_throw(size, (std::size_t) alignment); });
+}
+
+// Memory from malloc and aligned_alloc alike is released by free, so every
+// operator delete is the same
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
@@ -1,9 +1,36 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "parser/adaptive.h"
+#include "parser/cache.h"
+#include "parser/compiled.h"
 #include "parser/derivative.h"
+#include "parser/gpu.h"
+#include "parser/interval.h"
+#ifdef PARSER_JIT
+#include "parser/jit.h"
+#endif
+#include "parser/instrument.h"
+#include "parser/multi.h"
+#include "parser/newton.h"
+#include "parser/optimize.h"
+#include "parser/parallel.h"
 #include "parser/parser.h"
 #include "parser/print.h"
+#include "parser/serialize.h"
+#include "parser/service.h"
+#include "parser/static_expr.h"
+#include "parser/stream.h"
 
 TEST(test, test)
 {
@@ -15,4 +42,1426 @@ TEST(test, test)
 
     auto deriv = parser::differentiate(postfix);
     std::cout << deriv << std::endl;
-}
\ No newline at end of file
+}
+
+TEST(compiled, matches_evaluate)
+{
+    for (auto infix: {"4.5^z", "z^2 + 3*z - [1,2]", "\\sin(z)/\\exp(-z) - \\log{z + 2i}", "\\abs(\\conj(z)) * \\re(z) - \\im(z)"})
+    {
+        auto postfix = parser::expr<double>(infix).postfix();
+        auto compiled = parser::compile(postfix);
+
+        for (auto z: {std::complex<double>(0.5, -1.5), std::complex<double>(2.0, 0.25)})
+        {
+            auto expected = postfix.evaluate(z);
+            EXPECT_NEAR(std::abs(compiled.evaluate(z) - expected), 0.0, 1e-12 * std::abs(expected)) << infix;
+        }
+    }
+}
+
+TEST(compiled, batch_matches_scalar)
+{
+    for (auto infix: {"z^2 + 3*z - [1,2]", "\\sin(z)/\\exp(-z) - \\log{z + 2i}", "\\abs(\\conj(z)) * \\re(z) / \\im(z)"})
+    {
+        auto compiled = parser::compile(parser::expr<double>(infix));
+
+        std::vector<std::complex<double>> in, out(300);
+        for (size_t i = 0; i < out.size(); i++)
+        {
+            in.emplace_back(0.01 * i - 1.0, 0.5 - 0.003 * i);
+        }
+        compiled.evaluate(in, out);
+
+        for (size_t i = 0; i < in.size(); i++)
+        {
+            auto expected = compiled.evaluate(in[i]);
+            EXPECT_NEAR(std::abs(out[i] - expected), 0.0, 1e-12 * std::abs(expected)) << infix;
+        }
+    }
+}
+
+TEST(parallel, matches_scalar)
+{
+    auto compiled = parser::compile(parser::expr<double>("\\sin(z) * z^2 - 1"));
+    parser::region<double> r{{-2.0, -1.0}, {2.0, 1.0}};
+    size_t width = 300, height = 40;
+
+    parser::thread_pool pool(4);
+    std::vector<std::complex<double>> out(width * height);
+    parser::parallel_evaluate(compiled, r, width, height, std::span(out), pool);
+
+    for (size_t y = 0; y < height; y++)
+    {
+        for (size_t x = 0; x < width; x++)
+        {
+            std::complex<double> z(-2.0 + (x + 0.5) * 4.0 / width, 1.0 - (y + 0.5) * 2.0 / height);
+            auto expected = compiled.evaluate(z);
+            EXPECT_NEAR(std::abs(out[y * width + x] - expected), 0.0, 1e-12 * std::abs(expected));
+        }
+    }
+
+    // A row may run tiles of another grid on its thread while it waits, here
+    // with the same function, which must leave its own points alone
+    parser::region<double> inner{{10.0, 10.0}, {11.0, 11.0}};
+    std::atomic<size_t> rows = 0, changed = 0;
+    std::function<void(std::span<const std::complex<double>>, size_t)> row = [&](auto points, size_t)
+    {
+        if (points[0].real() >= inner.min.real())
+        {
+            return;
+        }
+
+        std::vector<std::complex<double>> before(points.begin(), points.end());
+        parser::for_each_tile(inner, width, 2, pool, row);
+        changed += !std::equal(points.begin(), points.end(), before.begin());
+        rows++;
+    };
+    parser::for_each_tile(r, width, height, pool, row);
+    EXPECT_EQ(rows, height * ((width + parser::tile_width - 1) / parser::tile_width));
+    EXPECT_EQ(changed, 0);
+}
+
+TEST(expr, storage_modes)
+{
+    auto infix = "\\sin(z) * z^2 - \\cos(2*z) / (z + 1)";
+    auto list = parser::differentiate(parser::expr<double>(infix).postfix());
+    auto vector = parser::differentiate(parser::vector_expr<double>(infix).postfix());
+
+    std::pmr::monotonic_buffer_resource arena;
+    auto previous = std::pmr::set_default_resource(&arena);
+    auto pmr = parser::differentiate(parser::arena_expr<double>(infix).postfix());
+    std::pmr::set_default_resource(previous);
+
+    ASSERT_EQ(list.size(), vector.size());
+    ASSERT_EQ(list.size(), pmr.size());
+    EXPECT_TRUE(std::equal(list.cbegin(), list.cend(), vector.cbegin(), [](auto& a, auto& b) { return a.type == b.type && a.op == b.op && a.val == b.val; }));
+
+    auto z = std::complex<double>(0.3, 0.7);
+    EXPECT_EQ(list.evaluate(z), vector.evaluate(z));
+    EXPECT_EQ(list.evaluate(z), pmr.evaluate(z));
+}
+
+TEST(expr, extents)
+{
+    // [5 3 4 \sin * -] is 5 - (3 * \sin(4))
+    auto postfix = parser::vector_expr<double>("5 - 3 * \\sin(4)").postfix();
+    auto table = postfix.extents();
+
+    ASSERT_EQ(table.size(), postfix.size());
+    for (auto it = postfix.begin(); it != postfix.end(); it++)
+    {
+        auto end = std::next(it);
+        EXPECT_EQ(parser::vector_expr<double>::subexpr_begin(postfix.begin(), end, table), parser::vector_expr<double>::subexpr_begin(end));
+    }
+}
+
+TEST(derivative, matches_finite_difference)
+{
+    for (auto infix: {"4.5^z", "z^3 - 2*z", "\\sin(z) * \\cos(z^2)", "(z + 1)/(z^2 - [0,1])", "z^z", "\\sin(\\cos(z)) / 3"})
+    {
+        auto postfix = parser::expr<double>(infix).postfix();
+        auto deriv = parser::differentiate(postfix);
+
+        auto z = std::complex<double>(0.7, 0.4);
+        auto h = 1e-6;
+        auto expected = (postfix.evaluate(z + h) - postfix.evaluate(z - h)) / (2 * h);
+        EXPECT_NEAR(std::abs(deriv.evaluate(z) - expected), 0.0, 1e-6 * std::abs(expected)) << infix;
+    }
+}
+
+TEST(derivative, linear_in_dag)
+{
+    // A product of n factors has a derivative with n^2 tokens when expanded,
+    // but the nodes added to the dag grow linearly.
+    std::string infix = "\\sin(z)";
+    for (int i = 0; i < 200; i++)
+    {
+        infix += " * \\sin(z + " + std::to_string(i) + ")";
+    }
+
+    parser::dag<double> g;
+    std::vector<parser::dag<double>::node_id> derivs;
+    auto root = g.push(parser::expr<double>(infix).postfix());
+    auto before = g.size();
+    auto deriv = parser::differentiate(g, root, derivs);
+
+    EXPECT_LT(g.size() - before, 10 * before);
+    EXPECT_GT(g.expanded_size(deriv), 10 * before);
+}
+
+TEST(compiled, common_subexpressions)
+{
+    // \sin(z + 1) appears three times but is evaluated once
+    auto postfix = parser::expr<double>("\\sin(z + 1) * \\sin(z + 1) - \\sin(z + 1) / 2").postfix();
+    auto compiled = parser::compile(postfix);
+
+    auto sines = std::count_if(compiled.code().begin(), compiled.code().end(), [](auto& ins) { return ins.op == parser::opcode::SIN; });
+    EXPECT_EQ(sines, 1);
+    EXPECT_EQ(compiled.temporaries(), 1);
+
+    // Higher derivatives grow with the distinct subterms, not the tree size
+    parser::dag<double> g;
+    std::vector<parser::dag<double>::node_id> derivs;
+    auto root = g.push(parser::expr<double>("\\sin(z^3) / (z + 2)").postfix());
+    for (int i = 0; i < 4; i++)
+    {
+        root = parser::differentiate(g, root, derivs);
+    }
+    auto fourth = parser::compiled_expr<double>(g, root);
+    EXPECT_LT(10 * fourth.size(), g.expanded_size(root));
+
+    auto z = std::complex<double>(0.6, -0.2);
+    auto expected = g.to_expr(root).evaluate(z);
+    EXPECT_NEAR(std::abs(fourth.evaluate(z) - expected), 0.0, 1e-12 * std::abs(expected));
+
+    std::vector<std::complex<double>> in(5, z), out(5);
+    fourth.evaluate(in, out);
+    EXPECT_NEAR(std::abs(out[4] - expected), 0.0, 1e-12 * std::abs(expected));
+}
+
+TEST(optimize, folds_and_rewrites)
+{
+    parser::optimize_stats stats;
+    auto postfix = parser::expr<double>("(\\exp(2) - 0) * z^1 + 0 * 1").postfix();
+    auto optimized = parser::optimize(postfix, &stats, true);
+
+    // Only \exp(2) * z is left, with \exp(2) folded into one constant and
+    // + 0 * 1 removed
+    auto size = [](auto& e) { return (size_t) std::distance(e.cbegin(), e.cend()); };
+    EXPECT_EQ(stats.tokens_after, size(optimized));
+    EXPECT_EQ(stats.tokens_removed(), (std::ptrdiff_t) size(postfix) - 3);
+    EXPECT_GT(stats.folded, 0);
+    EXPECT_GT(stats.rewritten, 0);
+    ASSERT_EQ(size(optimized), 3);
+    auto it = optimized.cbegin();
+    EXPECT_EQ(it->type, parser::CONST);
+    EXPECT_EQ(it->val, std::exp(std::complex<double>(2)));
+    EXPECT_EQ((++it)->type, parser::VAR);
+    EXPECT_EQ((++it)->op, parser::MUL);
+
+    // x^2 = x * x writes out x twice, so the expression grows
+    parser::optimize_stats grown;
+    parser::optimize(parser::expr<double>("(\\sin(z) + 1)^2").postfix(), &grown, true);
+    EXPECT_GT(grown.tokens_after, grown.tokens_before);
+    EXPECT_EQ(grown.tokens_removed(), (std::ptrdiff_t) grown.tokens_before - (std::ptrdiff_t) grown.tokens_after);
+
+    for (auto infix: {"(z^2 - 0) * 1 + \\sin(pi) * z", "0 - (-(-z))^2 + z^(-1)", "z^3 / 1 + (2 + 3)^0"})
+    {
+        auto original = parser::expr<double>(infix).postfix();
+        auto simplified = parser::optimize(original, nullptr, true);
+        EXPECT_LT(size(simplified), size(original)) << infix;
+
+        auto z = std::complex<double>(0.7, 1.3);
+        auto expected = original.evaluate(z);
+        EXPECT_NEAR(std::abs(simplified.evaluate(z) - expected), 0.0, 1e-12 * std::abs(expected)) << infix;
+    }
+}
+
+TEST(optimize, exact_by_default)
+{
+    // Without fast_math, only the identities that hold for every complex
+    // value are applied, so optimized and unoptimized programs agree bit for
+    // bit, up to the payload of a NaN, at signed zeros, infinities and NaNs
+    auto nan = std::numeric_limits<double>::quiet_NaN();
+    auto inf = std::numeric_limits<double>::infinity();
+    std::vector<std::complex<double>> in = {{0, 0}, {-0.0, 0}, {0, -0.0}, {-0.0, -0.0}, {inf, 0}, {-inf, 0}, {0, inf}, {0, -inf}, {inf, -inf}, {nan, 0}, {0, nan}, {nan, nan}, {1, -0.0}, {-1, -0.0}, {-1, 0}};
+    auto same = [](double a, double b) { return (std::isnan(a) && std::isnan(b)) || (a == b && std::signbit(a) == std::signbit(b)); };
+
+    for (auto infix: {"z + 0", "0 + z", "z - 0", "0 - z", "z * 1", "1 * z", "z / 1", "z^1", "z^0", "z^2", "-(-z)", "z + (-0)", "(-0) + z", "-0 - z", "-0 - (-z)", "\\log(0 - z) + \\log(z * 1)", "\\arg(z + 0) * (z - 0)^0.5"})
+    {
+        auto postfix = parser::expr<double>(infix).postfix();
+        auto optimized = parser::compiled_expr<double>(postfix, true);
+        auto unoptimized = parser::compiled_expr<double>(postfix, false);
+        std::vector<std::complex<double>> out(in.size()), expected(in.size());
+        optimized.evaluate(in, out);
+        unoptimized.evaluate(in, expected);
+
+        for (size_t i = 0; i < in.size(); i++)
+        {
+            auto a = optimized.evaluate(in[i]);
+            auto b = unoptimized.evaluate(in[i]);
+            EXPECT_TRUE(same(a.real(), b.real()) && same(a.imag(), b.imag())) << infix << " at " << in[i] << ": " << a << " != " << b;
+            EXPECT_TRUE(same(out[i].real(), expected[i].real()) && same(out[i].imag(), expected[i].imag())) << infix << " at " << in[i] << ": " << out[i] << " != " << expected[i];
+        }
+    }
+
+    // The exact identities are still applied
+    auto size = [](const auto& e) { return (size_t) std::distance(e.cbegin(), e.cend()); };
+    EXPECT_EQ(size(parser::optimize(parser::expr<double>("-(-z) - 0").postfix())), 1);
+    EXPECT_EQ(size(parser::optimize(parser::expr<double>("-0 - z").postfix())), 2);
+    EXPECT_EQ(size(parser::optimize(parser::expr<double>("z + 0").postfix())), 3);
+}
+
+TEST(compiled, fast_powers)
+{
+    auto postfix = parser::expr<double>("z^5 - 2 * z^(-3) + z^0.5 * z^64 - z^2.5").postfix();
+    auto compiled = parser::compile(postfix);
+
+    auto count = [&](parser::opcode op) { return std::count_if(compiled.code().begin(), compiled.code().end(), [&](auto& ins) { return ins.op == op; }); };
+    EXPECT_EQ(count(parser::opcode::POWI), 3);
+    EXPECT_EQ(count(parser::opcode::SQRT), 1);
+    EXPECT_EQ(count(parser::opcode::POW), 1);
+
+    std::vector<std::complex<double>> in, out(200);
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        // Crosses the branch cut of the square root along the negative real axis
+        in.emplace_back(0.01 * i - 1.2, 0.3 - 0.003 * i);
+    }
+    compiled.evaluate(in, out);
+
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        auto expected = postfix.evaluate(in[i]);
+        EXPECT_NEAR(std::abs(compiled.evaluate(in[i]) - expected), 0.0, 1e-12 * std::abs(expected));
+        EXPECT_NEAR(std::abs(out[i] - expected), 0.0, 1e-12 * std::abs(expected));
+    }
+}
+
+TEST(expr, tokenizer)
+{
+    constexpr auto count = []
+    {
+        size_t n = 0;
+        parser::tokenize<double>("\\sin(z) + 2.5i * [1, -0.5]", [&](auto) { n++; });
+        return n;
+    }();
+    static_assert(count == 8);
+
+    constexpr auto value = []
+    {
+        std::complex<double> val;
+        parser::tokenize<double>(" [1.25e2, -0.5] ", [&](auto t) { val = t.val; });
+        return val;
+    }();
+    static_assert(value == std::complex<double>(125, -0.5));
+
+    std::vector<parser::token<double>> tokens;
+    parser::tokenize<double>("-\\sec { z } - pi*3.5i", [&](auto t) { tokens.push_back(t); });
+
+    std::vector<std::pair<parser::token_type, parser::operation>> expected = {
+        {parser::FUNC, parser::NEG}, {parser::FUNC, parser::SEC}, {parser::OTHER_TYPE, parser::L_BRACKET}, {parser::VAR, parser::NO_OP},
+        {parser::OTHER_TYPE, parser::R_BRACKET}, {parser::BIN_OP, parser::SUB}, {parser::CONST, parser::NO_OP}, {parser::BIN_OP, parser::MUL},
+        {parser::CONST, parser::NO_OP}
+    };
+    ASSERT_EQ(tokens.size(), expected.size());
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        EXPECT_EQ(tokens[i].type, expected[i].first) << i;
+        EXPECT_EQ(tokens[i].op, expected[i].second) << i;
+    }
+    EXPECT_EQ(tokens[8].val, std::complex<double>(0, 3.5));
+
+    for (auto infix: {"1.2.3", "z + \\foo(z)", "z + \\sin", "[1 2]", "z # 2"})
+    {
+        EXPECT_THROW(parser::expr<double>{infix}, std::invalid_argument) << infix;
+    }
+}
+
+TEST(static_expr, matches_expr)
+{
+    constexpr parser::static_expr<"z^2 + \\sin(z) / (3 - z)^(-3)"> f;
+    static_assert(f.size() == 13);
+
+    auto postfix = parser::expr<double>("z^2 + \\sin(z) / (3 - z)^(-3)").postfix();
+    EXPECT_TRUE(std::ranges::equal(f.postfix(), postfix, [](auto& a, auto& b) { return a.type == b.type && a.op == b.op && a.val == b.val; }));
+
+    auto df = parser::differentiate(f);
+    auto d2f = parser::differentiate(df);
+    auto deriv = parser::differentiate(postfix);
+
+    for (auto z: {std::complex<double>(0.5, -1.5), std::complex<double>(2.0, 0.25)})
+    {
+        auto expected = postfix.evaluate(z);
+        EXPECT_NEAR(std::abs(f(z) - expected), 0.0, 1e-12 * std::abs(expected));
+
+        expected = deriv.evaluate(z);
+        EXPECT_NEAR(std::abs(df(z) - expected), 0.0, 1e-12 * std::abs(expected));
+
+        // Second derivative against a central difference of the first
+        auto h = 1e-5;
+        expected = (df(z + h) - df(z - h)) / (2 * h);
+        EXPECT_NEAR(std::abs(d2f(z) - expected), 0.0, 1e-6 * std::abs(expected));
+    }
+
+    // Non-holomorphic functions are differentiated along the real axis
+    constexpr parser::static_expr<"\\abs(z) * \\re(z)", double, 1> g;
+    EXPECT_NEAR(std::abs(g(std::complex<double>(3, 4)) - 3.0 * 3.0 / 5.0 - 5.0), 0.0, 1e-12);
+}
+
+TEST(cache, hits_misses_evictions)
+{
+    parser::expr_cache<double> cache(1 << 20, 2, 4);
+
+    auto first = cache.get("\\sin(z) * z");
+    auto second = cache.get(" \\sin( z )*z ");
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(first->derivatives.size(), 2);
+
+    auto z = std::complex<double>(0.3, -0.7);
+    auto expected = std::cos(z) * z + std::sin(z);
+    EXPECT_NEAR(std::abs(first->compiled_derivatives[0].evaluate(z) - expected), 0.0, 1e-12);
+    EXPECT_NEAR(std::abs(first->derivatives[0].evaluate(z) - expected), 0.0, 1e-12);
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.entries, 1);
+    EXPECT_THROW(cache.get("z + \\foo(z)"), std::invalid_argument);
+
+    // Many threads looking up the same few sources
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&]
+        {
+            for (int i = 0; i < 200; i++)
+            {
+                auto e = cache.get("z^" + std::to_string(i % 10) + " + 1");
+                EXPECT_EQ(e->source, "z^" + std::to_string(i % 10) + " + 1");
+            }
+        });
+    }
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+    stats = cache.stats();
+    EXPECT_EQ(stats.entries, 11);
+    EXPECT_EQ(stats.hits + stats.misses, 2 + 800 + 1);
+
+    // A small cap keeps only the most recently used entries
+    parser::expr_cache<float> small(8 * 1024, 1, 1);
+    for (int i = 0; i < 100; i++)
+    {
+        small.get("z * " + std::to_string(i));
+    }
+    stats = small.stats();
+    EXPECT_GT(stats.evictions, 0);
+    EXPECT_EQ(stats.evictions + stats.entries, 100);
+    EXPECT_LE(stats.bytes, 8 * 1024);
+    EXPECT_EQ(small.get("z*99"), small.get("z * 99"));
+}
+
+TEST(cache, matches_parse)
+{
+    // Spaces that separate tokens are kept apart from those that do not, so a
+    // lookup parses or fails exactly as the source does
+    parser::expr_cache<double> cache;
+    for (auto infix: {"\\sin z", "\\sin z + 1", "\\sin  z+1", "1 2", "12", "z  *  2", "\\exp z^2", "\\si n(z)", " z "})
+    {
+        std::optional<parser::vector_expr<double>> direct;
+        try
+        {
+            direct = parser::vector_expr<double>::parse(infix);
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+
+        if (!direct)
+        {
+            EXPECT_THROW(cache.get(infix), std::invalid_argument) << infix;
+            continue;
+        }
+
+        auto e = cache.get(infix);
+        auto z = std::complex<double>(0.3, -0.7);
+        EXPECT_EQ(e->postfix.size(), direct->size()) << infix;
+        EXPECT_EQ(e->postfix.evaluate(z), direct->evaluate(z)) << infix;
+    }
+
+    EXPECT_THROW(cache.get("1 2"), std::invalid_argument);
+    EXPECT_EQ(cache.get("12")->postfix.evaluate(0), 12.0);
+    EXPECT_EQ(cache.get("\\sin z + 1"), cache.get("\\sin z+1"));
+    EXPECT_NE(cache.get("\\sin z + 1"), cache.get("\\sin(z + 1)"));
+}
+
+#ifdef PARSER_JIT
+TEST(jit, matches_compiled)
+{
+    for (auto infix: {"z^2 + 3*z - [1,2]", "\\sin(z)/\\exp(-z) - \\log{z + 2i}", "\\abs(\\conj(z)) * \\re(z) / \\im(z) + z^0.5 * z^(-7)"})
+    {
+        auto compiled = parser::compile(parser::expr<double>(infix));
+        auto jit = parser::jit_expr<double>(compiled);
+
+        std::vector<std::complex<double>> in, out(300);
+        for (size_t i = 0; i < out.size(); i++)
+        {
+            in.emplace_back(0.01 * i - 1.0, 0.5 - 0.003 * i);
+        }
+        jit.evaluate(in, out);
+
+        for (size_t i = 0; i < in.size(); i++)
+        {
+            auto expected = compiled.evaluate(in[i]);
+            EXPECT_NEAR(std::abs(out[i] - expected), 0.0, 1e-12 * std::abs(expected)) << infix;
+            EXPECT_NEAR(std::abs(jit.evaluate(in[i]) - expected), 0.0, 1e-12 * std::abs(expected)) << infix;
+        }
+    }
+
+    // Compiling the same expression again reuses the loaded library
+    auto first = parser::jit_compile(parser::expr<float>("z * \\cos(z)"));
+    auto loaded = parser::jit_cache::global().size();
+    auto second = parser::jit_compile(parser::expr<float>("z * \\cos(z)"));
+    EXPECT_EQ(parser::jit_cache::global().size(), loaded);
+    EXPECT_EQ(first.evaluate({1.0f, 2.0f}), second.evaluate({1.0f, 2.0f}));
+
+    // Threads compiling the same expression at once share one library
+    parser::jit_cache cache;
+    auto compiled = parser::compile(parser::expr<double>("z^3 * \\cos(z) - 5"));
+    std::vector<parser::jit_expr<double>> jits(4);
+    std::vector<std::thread> threads;
+    for (auto& jit: jits)
+    {
+        threads.emplace_back([&] { jit = parser::jit_expr<double>(compiled, {}, cache); });
+    }
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(cache.size(), 1);
+    for (auto& jit: jits)
+    {
+        EXPECT_EQ(jit.evaluate({0.5, 0.5}), jits[0].evaluate({0.5, 0.5}));
+    }
+
+    // The cache directory is made private, no shell sees its path, and one
+    // others can write to is refused
+    parser::jit_options options;
+    options.cache_dir = std::filesystem::temp_directory_path() / ("math-parser-jit test $(" + std::to_string(getpid()) + ")");
+    std::filesystem::remove_all(options.cache_dir);
+    parser::jit_cache private_cache;
+    EXPECT_EQ(parser::jit_expr<double>(compiled, options, private_cache).evaluate({0.5, 0.5}), jits[0].evaluate({0.5, 0.5}));
+    auto perms = std::filesystem::status(options.cache_dir).permissions();
+    EXPECT_EQ(perms & std::filesystem::perms::all, std::filesystem::perms::owner_all);
+
+    std::filesystem::permissions(options.cache_dir, std::filesystem::perms::all);
+    parser::jit_cache shared_cache;
+    EXPECT_THROW(parser::jit_expr<double>(compiled, options, shared_cache), std::runtime_error);
+    std::filesystem::remove_all(options.cache_dir);
+}
+#endif
+
+TEST(compiled, forward_derivatives)
+{
+    // Derivatives of the compiled program against those of static_expr,
+    // which come from nested dual numbers over the unrolled expression
+    auto check = [](auto f)
+    {
+        auto df = parser::differentiate(f);
+        auto d2f = parser::differentiate(df);
+        auto d3f = parser::differentiate(d2f);
+        auto c = parser::compiled_expr<double>(f.postfix(), false);
+
+        for (auto z: {std::complex<double>(0.3, -0.4), std::complex<double>(0.6, 0.2)})
+        {
+            auto [value, derivative] = c.evaluate_with_derivative(z);
+            EXPECT_NEAR(std::abs(value - f(z)), 0.0, 1e-12 * std::abs(f(z)));
+            EXPECT_NEAR(std::abs(derivative - df(z)), 0.0, 1e-12 * std::abs(df(z)));
+
+            auto all = c.evaluate_derivatives(z, 3);
+            ASSERT_EQ(all.size(), 4);
+            std::complex<double> expected[] = {f(z), df(z), d2f(z), d3f(z)};
+            for (size_t k = 0; k < 4; k++)
+            {
+                EXPECT_NEAR(std::abs(all[k] - expected[k]), 0.0, 1e-10 * std::abs(expected[k])) << k;
+            }
+        }
+    };
+
+    check(parser::static_expr<"\\exp(\\sin(z)) * \\log(z + 3) / \\cosh(z) + \\atan(z)^3 - (z + 2)^0.5">());
+    check(parser::static_expr<"\\tan(z) + \\sec(z) - \\csc(z) * \\cot(z) + \\tanh(z)^(-2)">());
+    check(parser::static_expr<"\\acos(z) * \\asin(z) + \\acosh(z + 2) - \\asinh(z) / \\atanh(z) + z^z">());
+    check(parser::static_expr<"\\abs(z) * \\re(z)^2 - \\im(z) + \\arg(z + 1) * \\conj(z) + \\sinh(z)">());
+}
+
+TEST(compiled, derivative_paths_agree)
+{
+    // The dual and Taylor paths take the same branch past the ends of the cuts
+    // of the inverse functions, where 1 - z^2 has a zero imaginary part
+    for (auto source: {"\\acos(z)", "\\asin(z)", "\\atanh(z)"})
+    {
+        auto c = parser::compiled_expr<double>(parser::expr<double>(source).postfix(), false);
+        for (double x: {2.0, -2.0, 0.5})
+        {
+            auto dual = c.evaluate_with_derivative(x).second;
+            auto taylor = c.evaluate_derivatives(x, 1)[1];
+            EXPECT_NEAR(std::abs(dual - taylor), 0.0, 1e-12) << source << " at " << x;
+        }
+    }
+
+    // |z| is scaled by |z0| before squaring, so neither path overflows
+    auto abs = parser::compiled_expr<double>(parser::expr<double>("\\abs(z)").postfix(), false);
+    for (double x: {1e300, -1e300, 1e-300})
+    {
+        auto all = abs.evaluate_derivatives(x, 1);
+        EXPECT_NEAR(std::abs(all[0] / std::abs(x) - 1.0), 0.0, 1e-15) << x;
+        EXPECT_NEAR(std::abs(all[1] - (x > 0 ? 1.0 : -1.0)), 0.0, 1e-15) << x;
+        EXPECT_NEAR(std::abs(abs.evaluate_with_derivative(x).second - all[1]), 0.0, 1e-15) << x;
+    }
+
+    // A constant exponent is differentiated without log(z), so the derivative
+    // at 0 is the one differentiate gives
+    for (auto source: {"z^2.5", "z^2", "(z + 1)^3", "3*z^1.5"})
+    {
+        auto postfix = parser::expr<double>(source).postfix();
+        auto c = parser::compiled_expr<double>(postfix, false);
+        auto expected = parser::differentiate(postfix).evaluate(0.0);
+        EXPECT_NEAR(std::abs(c.evaluate_with_derivative(0.0).second - expected), 0.0, 1e-12) << source;
+    }
+}
+
+TEST(newton, converges_to_roots)
+{
+    auto f = parser::expr<double>("z^3 - 1");
+    parser::root_finder<double> newton(f);
+    parser::root_finder<double> halley(f, parser::root_method::HALLEY);
+    EXPECT_EQ(newton.program().outputs(), 2);
+    EXPECT_EQ(halley.program().outputs(), 3);
+
+    // Every point of the grid that converges ends at a cube root of unity,
+    // and Halley's method gets there in fewer iterations
+    parser::region<double> r{{-2.0, -1.5}, {2.0, 1.5}};
+    size_t width = 200, height = 150;
+    std::vector<parser::root_result<double>> newton_out(width * height), halley_out(width * height);
+
+    parser::thread_pool pool(4);
+    newton.solve(r, width, height, std::span(newton_out), {}, pool);
+    halley.solve(r, width, height, std::span(halley_out), {}, pool);
+
+    size_t newton_iterations = 0, halley_iterations = 0;
+    for (size_t i = 0; i < width * height; i++)
+    {
+        for (auto& result: {newton_out[i], halley_out[i]})
+        {
+            ASSERT_TRUE(result.converged) << i;
+            EXPECT_NEAR(std::abs(result.root * result.root * result.root - 1.0), 0.0, 1e-12) << i;
+        }
+
+        newton_iterations += newton_out[i].iterations;
+        halley_iterations += halley_out[i].iterations;
+
+        // Lanes are refilled as points leave them, without changing results
+        auto single = newton.solve(std::complex<double>(-2.0 + (i % width + 0.5) * (4.0 / width), 1.5 - (i / width + 0.5) * (3.0 / height)));
+        EXPECT_EQ(single.root, newton_out[i].root);
+        EXPECT_EQ(single.iterations, newton_out[i].iterations);
+    }
+    EXPECT_LT(halley_iterations, newton_iterations);
+
+    // f and f' share sin(z), which is evaluated once
+    parser::root_finder<double> shared(parser::expr<double>("\\sin(z) * z - 1"));
+    EXPECT_GT(shared.program().temporaries(), 0);
+    auto result = shared.solve({1.0, 0.0});
+    EXPECT_TRUE(result.converged);
+    EXPECT_NEAR(std::abs(std::sin(result.root) * result.root - 1.0), 0.0, 1e-12);
+
+    // A point where f' = 0 stops without converging
+    result = newton.solve(0.0);
+    EXPECT_FALSE(result.converged);
+    EXPECT_EQ(result.iterations, 1);
+}
+
+TEST(stream, matches_batch)
+{
+    auto compiled = parser::compile(parser::expr<double>("\\exp(z) / (z^2 + 1)"));
+
+    std::vector<std::complex<double>> points, expected(1000);
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        points.emplace_back(0.01 * i - 5.0, 0.003 * i - 1.0);
+    }
+    compiled.evaluate(points, expected);
+
+    auto bytes = [](const std::vector<std::complex<double>>& v) { return std::string(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(v[0])); };
+    auto path = std::filesystem::temp_directory_path() / "parser_stream_test.bin";
+    std::ofstream(path, std::ios::binary) << bytes(points);
+
+    // Chunks that do not divide the number of points nor the block size
+    for (size_t chunk: {1000, 300, 7})
+    {
+        std::istringstream in(bytes(points));
+        std::ostringstream out;
+        EXPECT_EQ(parser::stream_evaluate(compiled, in, out, chunk), points.size());
+        EXPECT_EQ(out.str(), bytes(expected));
+
+        parser::mapped_file file(path);
+        std::ostringstream mapped;
+        EXPECT_EQ(parser::stream_evaluate(compiled, file, mapped, chunk), points.size());
+        EXPECT_EQ(mapped.str(), bytes(expected));
+    }
+
+    std::istringstream partial(bytes(points).substr(0, 20));
+    std::ostringstream out;
+    EXPECT_THROW(parser::stream_evaluate(compiled, partial, out), std::invalid_argument);
+    EXPECT_THROW(parser::mapped_file("/nonexistent/points.bin"), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
+
+TEST(serialize, round_trip)
+{
+    auto e = parser::expr<double>("\\sin(z)^2 + \\sin(z) * [1.5,-2] - z / 3");
+    auto postfix = e.postfix();
+    auto compiled = parser::compile(e);
+
+    auto bytes = parser::serialize(e, {.program = true, .graph = true});
+    EXPECT_EQ(bytes, parser::serialize(e, {.program = true, .graph = true}));
+
+    parser::serialized_expr<double> loaded(bytes);
+    EXPECT_TRUE(loaded.has_program());
+    EXPECT_TRUE(loaded.has_graph());
+    EXPECT_EQ(loaded.size(), bytes.size());
+
+    auto same = [](auto& a, auto& b) { return a.type == b.type && a.op == b.op && (a.type != parser::CONST || a.val == b.val); };
+    EXPECT_TRUE(std::ranges::equal(loaded.postfix(), postfix, same));
+
+    // The program runs in place, out of the serialized bytes
+    auto& program = loaded.program();
+    EXPECT_EQ((const void*) program.code().data(), (const void*) (bytes.data() + parser::serial_layout::of<double>(*reinterpret_cast<const parser::serial_header*>(bytes.data())).code));
+    for (auto z: {std::complex<double>(0.5, -1.5), std::complex<double>(2.0, 0.25)})
+    {
+        EXPECT_EQ(program.evaluate(z), compiled.evaluate(z));
+    }
+
+    auto [g, root] = loaded.graph();
+    EXPECT_TRUE(std::ranges::equal(g.to_expr(root), postfix, same));
+
+    // Loading from a mapped file keeps the file mapped for the program
+    auto path = std::filesystem::temp_directory_path() / "parser_serialize_test.bin";
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    auto file_program = parser::load_serialized<double>(path).program();
+    EXPECT_EQ(file_program.evaluate(1.0), compiled.evaluate(1.0));
+    std::filesystem::remove(path);
+
+    // Without a program or dag, and with corrupt or mismatched bytes
+    auto small = parser::serialize(e, {.program = false});
+    EXPECT_LT(small.size(), bytes.size());
+    EXPECT_THROW(parser::serialized_expr<double>(small).program(), std::invalid_argument);
+    EXPECT_THROW(parser::serialized_expr<float>{bytes}, std::invalid_argument);
+    EXPECT_THROW(parser::serialized_expr<double>(std::span(bytes).first(bytes.size() - 16)), std::invalid_argument);
+
+    auto corrupt = bytes;
+    corrupt[parser::serial_layout::of<double>(*reinterpret_cast<const parser::serial_header*>(bytes.data())).code] = std::byte{0xEE};
+    EXPECT_THROW(parser::serialized_expr<double>{corrupt}, std::invalid_argument);
+
+    // Bytes written with the other byte order are reported as such, not as an
+    // unknown version
+    auto swapped = bytes;
+    std::reverse(swapped.begin() + offsetof(parser::serial_header, version), swapped.begin() + offsetof(parser::serial_header, version) + 2);
+    std::reverse(swapped.begin() + offsetof(parser::serial_header, byte_order), swapped.begin() + offsetof(parser::serial_header, byte_order) + 4);
+    try
+    {
+        parser::serialized_expr<double>{swapped};
+        ADD_FAILURE();
+    }
+    catch (const std::invalid_argument& error)
+    {
+        EXPECT_NE(std::string_view(error.what()).find("byte order"), std::string_view::npos) << error.what();
+    }
+}
+
+TEST(instrument, profiles)
+{
+    auto compiled = parser::compile(parser::expr<double>("\\sin(z) * z^2 + \\acosh(z) / z"));
+
+    parser::eval_profile scalar;
+    for (auto z: {std::complex<double>(0.5, -1.5), std::complex<double>(2.0, 0.25)})
+    {
+        EXPECT_EQ(compiled.evaluate(z, scalar), compiled.evaluate(z));
+    }
+    EXPECT_EQ(scalar.evaluations, 2);
+    EXPECT_EQ(scalar.stack_high_water, compiled.stack_depth());
+    EXPECT_EQ(scalar.counts[(size_t) parser::opcode::ACOSH], 2);
+    EXPECT_EQ(scalar.counts[(size_t) parser::opcode::SIN], 2);
+    EXPECT_EQ(scalar.counts[(size_t) parser::opcode::POW], 0);
+    EXPECT_EQ(parser::get_opcode_name(parser::opcode::ACOSH), "ACOSH");
+
+    // The batch evaluator counts every instruction once per point
+    std::vector<std::complex<double>> in(300, 1.5), out(300);
+    parser::eval_profile batch;
+    compiled.evaluate(in, out, batch);
+    EXPECT_EQ(out[299], compiled.evaluate(1.5));
+    EXPECT_EQ(batch.evaluations, 300);
+    EXPECT_EQ(batch.counts[(size_t) parser::opcode::SIN], 300);
+
+    batch += scalar;
+    EXPECT_EQ(batch.counts[(size_t) parser::opcode::ACOSH], 302);
+
+    auto profile = parser::profile_pipeline<double>("\\sin(z) * \\cos(z + 1) - z^3");
+    EXPECT_GT(profile.parse.allocations.count, 0);
+    EXPECT_GT(profile.postfix.allocations.count, 0);
+    EXPECT_GT(profile.differentiate.allocations.bytes, 0);
+    EXPECT_GT(profile.compile.cycles, 0);
+    EXPECT_EQ(profile.tokens, 15);
+    EXPECT_GT(profile.derivative_tokens, profile.tokens);
+
+    auto allocations = parser::count_allocations([] { std::vector<int> v(10); });
+    EXPECT_EQ(allocations.count, 1);
+    EXPECT_EQ(allocations.bytes, 10 * sizeof(int));
+}
+
+TEST(expr, variables)
+{
+    constexpr std::string_view names[] = {"z", "c", "t_0"};
+    auto e = parser::expr<double>("z^2 + c * \\sin(t_0) - c", names);
+    auto postfix = e.postfix();
+
+    // Variables are resolved to slots once, when parsing
+    std::complex<double> slots[] = {{0.5, -1.0}, {2.0, 0.25}, {1.5, 0.0}};
+    auto expected = slots[0] * slots[0] + slots[1] * std::sin(slots[2]) - slots[1];
+    EXPECT_NEAR(std::abs(postfix.evaluate(slots) - expected), 0, 1e-12);
+    EXPECT_THROW(postfix.evaluate(slots[0]), std::invalid_argument);
+    EXPECT_THROW(parser::expr<double>("z + w", names), std::invalid_argument);
+
+    std::ostringstream os;
+    parser::print(os, postfix, names);
+    EXPECT_EQ(os.str(), "[z (2,0) ^ c t_0 sin * + c -]");
+
+    auto compiled = parser::compile(postfix);
+    EXPECT_EQ(compiled.variables(), 3);
+    EXPECT_NEAR(std::abs(compiled.evaluate(slots) - expected), 0, 1e-12);
+    EXPECT_THROW(compiled.evaluate(slots[0]), std::invalid_argument);
+
+    // A sweep over z and t with c held fixed, as columns of the batch
+    // evaluator
+    std::vector<std::complex<double>> z(300), t(300), out(300);
+    for (size_t i = 0; i < z.size(); i++)
+    {
+        z[i] = {0.01 * i, -0.5};
+        t[i] = {0.5, 0.02 * i};
+    }
+    std::span<const std::complex<double>> columns[] = {z, std::span(&slots[1], 1), t};
+    compiled.evaluate(columns, out);
+    for (size_t i = 0; i < z.size(); i++)
+    {
+        std::complex<double> set[] = {z[i], slots[1], t[i]};
+        EXPECT_NEAR(std::abs(out[i] - compiled.evaluate(set)), 0, 1e-12);
+    }
+    EXPECT_THROW(compiled.evaluate(std::span(columns).first(2), out), std::invalid_argument);
+
+    // Derivatives are taken with respect to slot 0, the others held constant
+    auto derivative = parser::compile(parser::differentiate(postfix));
+    EXPECT_NEAR(std::abs(derivative.evaluate(slots) - 2.0 * slots[0]), 0, 1e-12);
+}
+
+TEST(compiled, parameters)
+{
+    constexpr std::string_view names[] = {"z", "c", "k"};
+    auto e = parser::expr<double>("z^2 + c * \\sin(c) + k * z", names);
+    std::complex<double> parameters[] = {{0.3, 0.5}, 2.0};
+    parser::compiled_expr<double> compiled(e, 1, parameters);
+
+    // c sin(c) and k are folded into the constant pool, so only z is read
+    EXPECT_EQ(compiled.parameters(), 2);
+    EXPECT_EQ(compiled.variables(), 1);
+    EXPECT_EQ(std::ranges::count(compiled.code(), parser::opcode::SIN, &parser::instruction::op), 0);
+
+    auto expected = [&](std::complex<double> z, std::complex<double> c, std::complex<double> k)
+    {
+        std::complex<double> slots[] = {z, c, k};
+        return parser::compile(e.postfix()).evaluate(slots);
+    };
+    std::complex<double> z(1.5, -0.5);
+    EXPECT_NEAR(std::abs(compiled.evaluate(z) - expected(z, parameters[0], parameters[1])), 0, 1e-12);
+
+    // Binding patches the pool; copies keep their own values
+    auto copy = compiled;
+    compiled.bind(0, {-0.7, 0.1});
+    EXPECT_EQ(compiled.parameter(0), std::complex<double>(-0.7, 0.1));
+    EXPECT_NEAR(std::abs(compiled.evaluate(z) - expected(z, {-0.7, 0.1}, parameters[1])), 0, 1e-12);
+    EXPECT_NEAR(std::abs(copy.evaluate(z) - expected(z, parameters[0], parameters[1])), 0, 1e-12);
+
+    std::vector<std::complex<double>> in(200, z), out(200);
+    compiled.bind(1, 3.0);
+    compiled.evaluate(in, out);
+    EXPECT_NEAR(std::abs(out[199] - expected(z, {-0.7, 0.1}, 3.0)), 0, 1e-12);
+
+    EXPECT_THROW(compiled.bind(2, 1.0), std::invalid_argument);
+    EXPECT_THROW(parser::compiled_expr<double>(e, 1, std::span(parameters, 1)), std::invalid_argument);
+}
+
+TEST(derivative, every_function)
+{
+    // Symbolic derivatives agree with the forward mode derivatives of
+    // dual.h, at a point away from every branch cut
+    for (auto name: {"exp", "log", "sin", "cos", "tan", "sec", "csc", "cot", "acos", "asin", "atan", "cosh", "sinh", "tanh", "acosh", "asinh", "atanh", "re", "im", "abs", "arg", "conj"})
+    {
+        auto e = parser::expr<double>(std::string("\\") + name + "(z^2 + 0.5 * z)").postfix();
+        auto derivative = parser::compile(parser::differentiate(e)).evaluate({0.3, 0.2});
+        auto expected = parser::compile(e).evaluate_with_derivative({0.3, 0.2}).second;
+        EXPECT_NEAR(std::abs(derivative - expected), 0, 1e-12 * std::max(1.0, std::abs(expected))) << name;
+    }
+
+    EXPECT_EQ(parser::compile(parser::differentiate(parser::expr<double>("\\deriv(z)").postfix())).evaluate(1.0), 0.0);
+}
+
+TEST(derivative, deep_expressions)
+{
+    // Far deeper than a recursive differentiator could go on a native stack
+    constexpr size_t depth = 200000;
+    std::string infix;
+    for (size_t i = 0; i < depth; i++)
+    {
+        infix += "\\sin(";
+    }
+    infix += "z" + std::string(depth, ')');
+
+    parser::dag<double> g;
+    std::vector<parser::dag<double>::node_id> derivs;
+    auto root = g.push(parser::vector_expr<double>(infix).postfix());
+    auto derivative = parser::differentiate(g, root, derivs);
+
+    std::complex<double> z(0.5, 0.1);
+    auto expected = parser::compiled_expr<double>(g, root).evaluate_with_derivative(z).second;
+    EXPECT_NEAR(std::abs(parser::compiled_expr<double>(g, derivative).evaluate(z) - expected), 0, 1e-12);
+}
+
+TEST(compiled, real_arithmetic)
+{
+    // i * i folds to the real constant -1, so the program is real
+    auto compiled = parser::compile(parser::expr<double>("z^0.5 * \\log(z) + z^3 * (i * i) - \\exp(z) / (z + 2)").postfix());
+    auto complex = parser::compile(parser::expr<double>("z^0.5 * \\log(z) + z^3 * i - \\exp(z) / (z + 2)").postfix());
+    EXPECT_TRUE(compiled.is_real());
+    EXPECT_FALSE(complex.is_real());
+
+    // Negative points leave the real line in the square root and log, and fall back to
+    // complex arithmetic
+    std::vector<std::complex<double>> in, out(300);
+    std::vector<double> real_in, real_out(300);
+    for (size_t i = 0; i < 300; i++)
+    {
+        in.push_back(0.02 * i - 1.49);
+        real_in.push_back(in.back().real());
+    }
+    compiled.evaluate(in, out);
+    compiled.evaluate(real_in, real_out);
+
+    auto reference = parser::expr<double>("z^0.5 * \\log(z) + z^3 * (i * i) - \\exp(z) / (z + 2)").postfix();
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        auto expected = reference.evaluate(in[i]);
+        EXPECT_NEAR(std::abs(out[i] - expected), 0, 1e-12 * std::max(1.0, std::abs(expected)));
+        EXPECT_NEAR(std::abs(compiled.evaluate(in[i]) - expected), 0, 1e-12 * std::max(1.0, std::abs(expected)));
+        if (in[i].real() < 0)
+        {
+            EXPECT_TRUE(std::isnan(real_out[i]));
+            EXPECT_NE(out[i].imag(), 0);
+        }
+        else
+        {
+            EXPECT_NEAR(real_out[i], expected.real(), 1e-12 * std::max(1.0, std::abs(expected)));
+        }
+    }
+
+    EXPECT_THROW(complex.evaluate(real_in, real_out), std::invalid_argument);
+
+    // At integer z, (-2)^z is real, but complex arithmetic leaves a rounding error in
+    // the imaginary part that the real path does not, so the values agree to within
+    // rounding only
+    auto power = parser::compile(parser::expr<double>("(-2)^z").postfix());
+    auto power_reference = parser::expr<double>("(-2)^z").postfix();
+    std::vector<std::complex<double>> integers, powers(21);
+    for (int k = -10; k <= 10; k++)
+    {
+        integers.emplace_back(k);
+    }
+    power.evaluate(integers, powers);
+    for (size_t i = 0; i < integers.size(); i++)
+    {
+        auto expected = power_reference.evaluate(integers[i]);
+        EXPECT_EQ(powers[i], std::pow(-2.0, integers[i].real()));
+        EXPECT_NEAR(std::abs(powers[i] - expected), 0, 1e-14 * std::abs(expected));
+    }
+
+    // On a branch cut the sign of a zero imaginary part picks the branch, so these
+    // points are not left to real arithmetic or the batch kernels: 1.5 / z is
+    // -2.86 - 0i, of argument -pi, and ^ of the second expression has a negative
+    // base with a zero imaginary part
+    std::vector<std::pair<std::string, double>> cuts = {
+        {"\\arg(1.5/z)", -0.5239},
+        {"((\\sec((z)^0))^3)^((\\csc(z))^((z)*(3.5))+\\asin(\\sec(4.5)))", -1.66929},
+        {"\\log(1/z)", -2.0},
+        {"\\log(\\csc(z)) + [0,1]", -1.66929},
+    };
+    for (const auto& [infix, x]: cuts)
+    {
+        auto cut_reference = parser::expr<double>(infix).postfix();
+        auto expected = cut_reference.evaluate(x);
+        for (bool optimize: {false, true})
+        {
+            parser::compiled_expr<double> cut(cut_reference, optimize);
+            std::vector<std::complex<double>> cut_in(3, x), cut_out(3);
+            cut.evaluate(cut_in, cut_out);
+            EXPECT_NEAR(std::abs(cut.evaluate(x) - expected), 0, 1e-12 * std::abs(expected)) << infix;
+            EXPECT_NEAR(std::abs(cut_out[0] - expected), 0, 1e-12 * std::abs(expected)) << infix;
+        }
+    }
+}
+
+TEST(interval, encloses_values)
+{
+    std::vector<std::string> functions = {"abs", "arg", "re", "im", "conj", "exp", "log", "sin", "cos", "tan", "sec", "csc", "cot", "asin", "acos", "atan", "sinh", "cosh", "tanh", "asinh", "acosh", "atanh"};
+    std::vector<std::string> infixes = {"z^3 - 2 * z + 1", "(z + 1) / (z - 2)", "z^0.5", "z^(-2)", "2^z", "z^(1 + i)"};
+    for (const auto& f: functions)
+    {
+        infixes.push_back("\\" + f + "(z)");
+        infixes.push_back("\\" + f + "(z * z + i) * z");
+    }
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> corner(-3, 3), size(0, 0.5), t(0, 1);
+
+    for (const auto& infix: infixes)
+    {
+        auto compiled = parser::compile(parser::expr<double>(infix).postfix());
+        for (int k = 0; k < 50; k++)
+        {
+            std::complex<double> min = {corner(rng), corner(rng)};
+            std::complex<double> max = min + std::complex<double>(size(rng), size(rng));
+            auto bound = compiled.evaluate_interval(parser::complex_interval<double>(min, max));
+
+            for (int j = 0; j < 20; j++)
+            {
+                std::complex<double> z = {min.real() + t(rng) * (max.real() - min.real()), min.imag() + t(rng) * (max.imag() - min.imag())};
+                auto value = compiled.evaluate(z);
+                if (std::isfinite(value.real()) && std::isfinite(value.imag()))
+                {
+                    EXPECT_TRUE(bound.contains(value)) << infix << " at " << z;
+                }
+            }
+        }
+    }
+
+    // Bounds shrink with the rectangle
+    auto compiled = parser::compile(parser::expr<double>("\\sin(z) * \\exp(z)").postfix());
+    auto bound = compiled.evaluate_interval(parser::complex_interval<double>(std::complex<double>(1, 1), std::complex<double>(1.001, 1.001)));
+    EXPECT_LT(bound.re.width(), 0.05);
+    EXPECT_LT(bound.im.width(), 0.05);
+
+    // Far from 0 the peaks found with the rounded pi may be missed, so the whole
+    // range is given instead, however narrow the interval
+    auto far = parser::sin(parser::interval<double>(1e12, std::nextafter(1e12, 2e12)));
+    EXPECT_EQ(far.lo, -1);
+    EXPECT_EQ(far.hi, 1);
+    auto near = parser::cos(parser::interval<double>(1e3, 1e3 + 1e-3));
+    EXPECT_LT(near.width(), 1e-3);
+    EXPECT_TRUE(near.contains(std::cos(1e3 + 5e-4)));
+}
+
+TEST(adaptive, level_sets)
+{
+    auto compiled = parser::compile(parser::expr<double>("\\sin(z) * z - 0.5").postfix());
+    parser::region<double> r = {{-3, -2}, {3, 2}};
+    size_t width = 512, height = 512;
+
+    std::vector<std::complex<double>> dense(width * height), adaptive(width * height);
+    parser::parallel_evaluate(compiled, r, width, height, std::span(dense));
+
+    // Every pixel is on the right side of the level, for far fewer evaluations
+    auto stats = parser::adaptive_evaluate(compiled, r, width, height, std::span(adaptive));
+    for (size_t i = 0; i < dense.size(); i++)
+    {
+        EXPECT_EQ(dense[i].real() > 0, adaptive[i].real() > 0) << i;
+    }
+    EXPECT_LT(10 * (stats.points + stats.bounds), width * height);
+
+    // Zeros are only refined where both parts may vanish. The zero i of
+    // z^2 + 1 is at the corner of pixels 255 and 256 across, 127 and 128 down.
+    auto quadratic = parser::compile(parser::expr<double>("z^2 + 1").postfix());
+    parser::parallel_evaluate(quadratic, r, width, height, std::span(dense));
+
+    parser::sample_options<double> options;
+    options.target = parser::sample_target::ZERO;
+    auto zeros = parser::adaptive_evaluate(quadratic, r, width, height, std::span(adaptive), options);
+    EXPECT_LT(20 * zeros.points, width * height);
+    for (size_t y: {127, 128})
+    {
+        for (size_t x: {255, 256})
+        {
+            EXPECT_EQ(adaptive[y * width + x], dense[y * width + x]);
+        }
+    }
+
+    EXPECT_THROW(parser::adaptive_evaluate(compiled, r, width, height, std::span(adaptive).subspan(1)), std::invalid_argument);
+}
+
+TEST(gpu, backend_selection)
+{
+    auto compiled = parser::compile(parser::expr<double>("\\sin(z) * \\exp(z / 3) + 1 / (z^2 + 2)").postfix());
+    parser::region<double> r = {{-2, -1}, {2, 1}};
+    size_t width = 300, height = 200;
+
+    std::vector<std::complex<double>> cpu(width * height), grid(width * height);
+    parser::parallel_evaluate(compiled, r, width, height, std::span(cpu));
+    EXPECT_EQ(parser::evaluate_grid(compiled, r, width, height, std::span(grid), parser::backend::CPU), parser::backend::CPU);
+    EXPECT_EQ(grid, cpu);
+
+    auto where = parser::evaluate_grid(compiled, r, width, height, std::span(grid));
+    EXPECT_EQ(where, parser::gpu_available() ? parser::backend::GPU : parser::backend::CPU);
+    for (size_t i = 0; i < cpu.size(); i++)
+    {
+        EXPECT_NEAR(std::abs(grid[i] - cpu[i]), 0, 1e-12 * std::max(1.0, std::abs(cpu[i])));
+    }
+
+    if (!parser::gpu_available())
+    {
+        EXPECT_THROW(parser::evaluate_grid(compiled, r, width, height, std::span(grid), parser::backend::GPU), std::runtime_error);
+    }
+#ifdef PARSER_CUDA
+    else
+    {
+        parser::gpu_expr<double> gpu(compiled);
+        std::vector<std::complex<double>> in = {{0.5, 0.25}, {-1, 2}, {3, 0}}, out(3);
+        gpu.evaluate(in, out);
+        for (size_t i = 0; i < in.size(); i++)
+        {
+            EXPECT_NEAR(std::abs(out[i] - compiled.evaluate(in[i])), 0, 1e-12);
+        }
+    }
+#endif
+}
+
+TEST(kernels, fast_functions)
+{
+    // Random points, points with parts past the range of the polynomials, and special values
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    std::mt19937 rng(25);
+    std::uniform_real_distribution<double> part(-20, 20);
+    std::vector<std::complex<double>> points;
+    for (size_t i = 0; i < 1000; i++)
+    {
+        points.emplace_back(part(rng), part(rng));
+    }
+    points.insert(points.end(), {{0, 0}, {-2, 0}, {-0.0, -0.0}, {1e7, 0.5}, {0.5, -1e7}, {800, 1}, {1, 800}, {inf, 0}, {-inf, 1}, {NAN, 1}});
+
+    const char* functions[] = {"exp", "log", "sin", "cos", "tan", "sec", "csc", "cot", "sinh", "cosh", "tanh"};
+    std::vector<std::complex<double>> out(points.size());
+    for (auto f : functions)
+    {
+        auto source = std::string("\\") + f + "(z)";
+        auto compiled = parser::compile(parser::expr<double>(source).postfix());
+        compiled.evaluate(points, out);
+
+        // Within a few ulp of std:: relative to the modulus, and not finite wherever std:: is not
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            auto expected = compiled.evaluate(points[i]);
+            if (std::isfinite(expected.real()) && std::isfinite(expected.imag()))
+            {
+                EXPECT_LE(std::abs(out[i] - expected), 8 * std::numeric_limits<double>::epsilon() * std::abs(expected)) << f << points[i];
+            }
+            else
+            {
+                EXPECT_FALSE(std::isfinite(out[i].real()) && std::isfinite(out[i].imag())) << f << points[i];
+            }
+        }
+    }
+
+    // The real kernels agree with std:: too, and give NaN off the domain of log
+    std::vector<double> real_points = {-3, -0.5, 0, 1e-310, 0.5, 2, 30, 700, 1e7};
+    std::vector<double> real_out(real_points.size());
+    auto compiled = parser::compile(parser::expr<double>("\\log(z) + \\sin(z) * \\tanh(z)").postfix());
+    compiled.evaluate(real_points, real_out);
+    for (size_t i = 0; i < real_points.size(); i++)
+    {
+        auto x = real_points[i];
+        auto expected = std::log(x) + std::sin(x) * std::tanh(x);
+        if (std::isfinite(expected))
+        {
+            EXPECT_NEAR(real_out[i], expected, 16 * std::numeric_limits<double>::epsilon() * std::max(1.0, std::abs(expected)));
+        }
+        else
+        {
+            EXPECT_EQ(std::isnan(real_out[i]), std::isnan(expected)) << x;
+            EXPECT_EQ(std::isinf(real_out[i]), std::isinf(expected)) << x;
+        }
+    }
+}
+
+TEST(compiled, fused_functions)
+{
+    // The derivatives of sin(f), sinh(f) and f^g use cos(f), cosh(f) and log(f)
+    auto derivative = parser::differentiate(parser::expr<double>("\\sin(z^3 + z) * \\sinh(z) + z^(z + 1)").postfix());
+    auto compiled = parser::compile(derivative);
+
+    std::array<size_t, parser::opcode_count> counts{};
+    for (const auto& ins: compiled.code())
+    {
+        counts[(size_t) ins.op]++;
+    }
+    EXPECT_EQ(counts[(size_t) parser::opcode::SINCOS], 1);
+    EXPECT_EQ(counts[(size_t) parser::opcode::SINHCOSH], 1);
+    EXPECT_EQ(counts[(size_t) parser::opcode::POWLOG], 1);
+    EXPECT_EQ(counts[(size_t) parser::opcode::SIN] + counts[(size_t) parser::opcode::COS] + counts[(size_t) parser::opcode::SINH] + counts[(size_t) parser::opcode::COSH], 0);
+    EXPECT_EQ(counts[(size_t) parser::opcode::LOG], 0);
+
+    // Every evaluator agrees with the expression, also for a program loaded from its instructions
+    parser::compiled_expr<double> loaded(compiled.code(), compiled.constants(), compiled.temporaries(), compiled.outputs());
+    std::vector<std::complex<double>> in, out(300), loaded_out(300);
+    for (size_t i = 0; i < 300; i++)
+    {
+        in.emplace_back(0.01 * i - 1.49, 0.5 - 0.003 * i);
+    }
+    compiled.evaluate(in, out);
+    loaded.evaluate(in, loaded_out);
+
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        auto expected = derivative.evaluate(in[i]);
+        auto tolerance = 1e-12 * std::max(1.0, std::abs(expected));
+        EXPECT_NEAR(std::abs(out[i] - expected), 0, tolerance);
+        EXPECT_NEAR(std::abs(compiled.evaluate(in[i]) - expected), 0, tolerance);
+        EXPECT_NEAR(std::abs(compiled.evaluate_with_derivative(in[i]).first - expected), 0, tolerance);
+        EXPECT_NEAR(std::abs(compiled.evaluate_derivatives(in[i], 2)[0] - expected), 0, tolerance);
+        EXPECT_EQ(loaded_out[i], out[i]);
+    }
+
+    // A log in the exponent of its own power can not be evaluated with it
+    auto nested = parser::compile(parser::expr<double>("z^\\log(z)").postfix());
+    EXPECT_TRUE(std::none_of(nested.code().begin(), nested.code().end(), [](const parser::instruction& ins) { return ins.op == parser::opcode::POWLOG; }));
+    EXPECT_NEAR(std::abs(nested.evaluate(std::complex<double>(2, 1)) - std::pow(std::complex<double>(2, 1), std::log(std::complex<double>(2, 1)))), 0, 1e-14);
+
+    // A fused opcode storing past the last temporary is rejected
+    std::vector<parser::instruction> code = {{parser::opcode::VAR, 0}, {parser::opcode::SINCOS, 0}, {parser::opcode::LOAD, 1}};
+    EXPECT_THROW(parser::compiled_expr<double>(code, {}, 1, 1), std::invalid_argument);
+    EXPECT_NO_THROW(parser::compiled_expr<double>(code, {}, 2, 1));
+}
+
+TEST(service, coalesces_requests)
+{
+    parser::thread_pool pool(4);
+    // The latency is far longer than the test, so only max_batch and flush
+    // run batches, and the batch count does not depend on timing
+    parser::service_options<double> options;
+    options.max_latency = std::chrono::hours(1);
+    options.max_batch = 1000;
+
+    auto compiled = parser::compile(parser::expr<double>("z^3 - \\sin(z) / (z + 2)").postfix());
+    std::vector<std::future<std::vector<std::complex<double>>>> results;
+    std::vector<std::vector<std::complex<double>>> requests;
+    {
+        parser::eval_service<double> service(pool, options);
+        auto id = service.add(compiled);
+
+        // Evaluated in two full batches of 1000 points, and a partial batch of
+        // 560 points run by flush
+        for (size_t i = 0; i < 64; i++)
+        {
+            std::vector<std::complex<double>> points;
+            for (size_t j = 0; j < 40; j++)
+            {
+                points.emplace_back(0.01 * j - 0.2, 0.03 * i);
+            }
+            requests.push_back(points);
+            results.push_back(service.evaluate(id, std::move(points)));
+        }
+        service.flush();
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            auto values = results[i].get();
+            ASSERT_EQ(values.size(), requests[i].size());
+            for (size_t j = 0; j < values.size(); j++)
+            {
+                auto expected = compiled.evaluate(requests[i][j]);
+                EXPECT_NEAR(std::abs(values[j] - expected), 0, 1e-14 * std::max(1.0, std::abs(expected)));
+            }
+        }
+
+        auto stats = service.stats();
+        EXPECT_EQ(stats.requests, 64);
+        EXPECT_EQ(stats.points, 64 * 40);
+        EXPECT_EQ(stats.batches, 3);
+
+        EXPECT_THROW(service.evaluate(id + 1, {}), std::invalid_argument);
+        constexpr std::string_view names[] = {"z", "c"};
+        EXPECT_THROW(service.add(parser::compile(parser::expr<double>("z + c", names).postfix())), std::invalid_argument);
+
+        // Pending requests are still evaluated when the service is destroyed
+        results.clear();
+        results.push_back(service.evaluate(id, {1.0}));
+    }
+    EXPECT_NEAR(std::abs(results[0].get()[0] - compiled.evaluate(1.0)), 0, 1e-14);
+}
+
+TEST(parse, matches_postfix)
+{
+    auto same = [](const auto& a, const auto& b)
+    {
+        return std::equal(a.cbegin(), a.cend(), b.cbegin(), b.cend(), [](const auto& x, const auto& y)
+        {
+            return x.type == y.type && x.op == y.op && x.val == y.val && x.slot == y.slot;
+        });
+    };
+
+    // Binary operations are left associative, functions bind tighter than ^
+    // and negation as tightly as *, but a function applies to all of a
+    // bracket right after it
+    std::vector<std::pair<const char*, std::vector<parser::token<double>>>> cases = {
+        {"2^3^2", {{parser::CONST, parser::NO_OP, 2}, {parser::CONST, parser::NO_OP, 3}, {parser::BIN_OP, parser::POW}, {parser::CONST, parser::NO_OP, 2}, {parser::BIN_OP, parser::POW}}},
+        {"\\sin z^2", {{parser::VAR, parser::NO_OP}, {parser::FUNC, parser::SIN}, {parser::CONST, parser::NO_OP, 2}, {parser::BIN_OP, parser::POW}}},
+        {"-z^2", {{parser::VAR, parser::NO_OP}, {parser::CONST, parser::NO_OP, 2}, {parser::BIN_OP, parser::POW}, {parser::FUNC, parser::NEG}}},
+        {"-(z)^2", {{parser::VAR, parser::NO_OP}, {parser::FUNC, parser::NEG}, {parser::CONST, parser::NO_OP, 2}, {parser::BIN_OP, parser::POW}}},
+    };
+    for (auto& [infix, expected]: cases)
+    {
+        EXPECT_TRUE(same(parser::vector_expr<double>::parse(infix), expected)) << infix;
+    }
+
+    for (auto infix: {"z^2 + 3*z - [1,2]", "\\sin(z)/\\exp(-z) - \\log{z + 2i}", "\\sin \\cos z * 2 - 1 / z^z", "(z + 1) * (z - 1) / ((z))"})
+    {
+        EXPECT_TRUE(same(parser::vector_expr<double>::parse(infix), parser::vector_expr<double>(infix).postfix())) << infix;
+        EXPECT_EQ(parser::compiled_expr<double>(infix).evaluate(0.5), parser::compile(parser::expr<double>(infix).postfix()).evaluate(0.5)) << infix;
+    }
+
+    constexpr std::string_view names[] = {"z", "c"};
+    EXPECT_EQ(parser::compiled_expr<double>("z * c", names).variables(), 2);
+
+    // Nested far deeper than a recursive parser could go
+    constexpr size_t depth = 200000;
+    auto nested = std::string(depth, '(') + "z" + std::string(depth, ')');
+    EXPECT_EQ(parser::vector_expr<double>::parse(nested).size(), 1);
+}
+
+TEST(parse, error_offsets)
+{
+    std::vector<std::pair<const char*, size_t>> cases = {
+        {"", 0},
+        {"z +", 3},
+        {"z + * 2", 4},
+        {"2 z", 2},
+        {"\\sin(z) (z)", 8},
+        {"(z + 1", 0},
+        {"z + 1)", 5},
+        {"z * ()", 5},
+        {"z + \\foo(z)", 4},
+        {"z + 1.2.3", 7},
+        {"z # 2", 2},
+    };
+    for (auto& [infix, offset]: cases)
+    {
+        try
+        {
+            parser::vector_expr<double>::parse(infix);
+            ADD_FAILURE() << infix;
+        }
+        catch (const parser::parse_error& error)
+        {
+            EXPECT_EQ(error.offset(), offset) << infix << ": " << error.what();
+        }
+    }
+
+    // An infix expression reports the index of the token
+    try
+    {
+        parser::expr<double>("z + (2 * )").postfix();
+        ADD_FAILURE();
+    }
+    catch (const parser::parse_error& error)
+    {
+        EXPECT_EQ(error.offset(), 5);
+    }
+}
+
+TEST(multi, matches_each_expression)
+{
+    // A population of small distinct expressions, more than one tile of each
+    std::vector<parser::vector_expr<double>> population;
+    for (int k = 0; k < 100; k++)
+    {
+        auto c = std::to_string(k % 7 + 1);
+        switch (k % 4)
+        {
+            case 0:  population.push_back(parser::vector_expr<double>::parse("z^2 * " + c + " - \\sin(z)")); break;
+            case 1:  population.push_back(parser::vector_expr<double>::parse("\\exp(-z / " + c + ") + [0," + c + "]")); break;
+            case 2:  population.push_back(parser::vector_expr<double>::parse("(z + " + c + ") / (z - 0.5)")); break;
+            default: population.push_back(parser::vector_expr<double>::parse("\\log(z * z + " + c + ")^" + c)); break;
+        }
+    }
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> dist(-2, 2);
+    std::vector<std::complex<double>> in(parser::multi_expr<double>::multi_points + 300);
+    for (auto& z: in)
+    {
+        z = {dist(rng), dist(rng)};
+    }
+
+    parser::thread_pool pool(4);
+    parser::multi_expr<double> multi(population);
+    ASSERT_EQ(multi.size(), population.size());
+
+    std::vector<std::complex<double>> out(multi.size() * in.size()), expected(in.size());
+    multi.evaluate(in, out, pool);
+
+    for (size_t k = 0; k < population.size(); k++)
+    {
+        parser::compile(population[k]).evaluate(std::span<const std::complex<double>>(in), std::span(expected));
+        for (size_t i = 0; i < in.size(); i++)
+        {
+            ASSERT_EQ(out[k * in.size() + i], expected[i]) << k << " " << i;
+        }
+    }
+
+    // Strings are parsed straight into the table
+    constexpr std::string_view infix[] = {"z + 1", "\\cos(z)"};
+    parser::multi_expr<double> strings(infix);
+    EXPECT_EQ(strings[1].evaluate(0.0), 1.0);
+
+    constexpr std::string_view names[] = {"z", "c"};
+    EXPECT_THROW(parser::multi_expr<double>(std::vector{parser::expr<double>("z + c", names)}), std::invalid_argument);
+    EXPECT_THROW(multi.evaluate(in, std::span(out).subspan(1), pool), std::invalid_argument);
+}
+
+TEST(compact, matches_postfix)
+{
+    constexpr std::string_view names[] = {"z", "c"};
+    auto infix = "z^2 * c - \\sin(z) / [1,2] + 3.5i";
+    auto postfix = parser::vector_expr<double>(infix, names).postfix();
+    auto compact = parser::compact_expr<double>::parse(infix, names);
+
+    ASSERT_EQ(compact.size(), postfix.size());
+    auto it = postfix.begin();
+    for (auto t: compact)
+    {
+        EXPECT_EQ(t.type, it->type);
+        EXPECT_EQ(t.op, it->op);
+        EXPECT_EQ(t.val, it->val);
+        EXPECT_EQ(t.slot, it->slot);
+        it++;
+    }
+
+    // One byte per token, the values of 3 constants and the slots of 3
+    // variables, instead of a whole token each
+    EXPECT_EQ(compact.bytes(), compact.size() + 3 * sizeof(std::complex<double>) + 3 * sizeof(std::uint32_t));
+    EXPECT_LT(compact.bytes(), postfix.size() * sizeof(parser::token<double>) / 3);
+
+    std::complex<double> slots[] = {{0.5, 0.25}, {-1, 2}};
+    EXPECT_EQ(compact.evaluate(slots), postfix.evaluate(slots));
+    EXPECT_EQ(parser::compact_expr<double>(parser::expr<double>(infix, names)).expand().evaluate(slots), postfix.evaluate(slots));
+
+    parser::dag<double> g;
+    auto root = g.push(compact.begin(), compact.end());
+    EXPECT_EQ(parser::compiled_expr<double>(g, root).evaluate(std::span<const std::complex<double>>(slots)), parser::compiled_expr<double>(postfix, false).evaluate(std::span<const std::complex<double>>(slots)));
+}
+
+TEST(instrument, counting_resource)
+{
+    parser::counting_resource counter;
+    auto previous = std::pmr::set_default_resource(&counter);
+    {
+        auto postfix = parser::arena_expr<double>("\\sin(z) * z^2 - \\cos(2*z) / (z + 1)").postfix();
+        auto derivative = parser::differentiate(postfix);
+        EXPECT_GT(counter.stats().count, 0);
+        EXPECT_GE(counter.stats().bytes, (postfix.size() + derivative.size()) * sizeof(parser::token<double>));
+        EXPECT_GT(counter.live_bytes(), 0);
+    }
+    std::pmr::set_default_resource(previous);
+
+    EXPECT_EQ(counter.live_bytes(), 0);
+    EXPECT_GE(counter.peak_bytes(), sizeof(parser::token<double>));
+
+    auto profile = parser::profile_pipeline<double>("\\sin(z) * z^2 - \\cos(2*z) / (z + 1)");
+    EXPECT_LT(profile.compact_bytes, profile.postfix_bytes);
+}